@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "DCXTransferSessionProtocol.h"
+
+/**
+ * \brief An in-process DCXTransferSessionProtocol implementation that stores composites in a local
+ * directory instead of on a server.
+ *
+ * Composites get stored at their href relative to the root directory of the session. Every upload
+ * assigns a new etag to the uploaded file. Manifest uploads fail with DCXErrorConflictingChanges if
+ * the etag of the manifest doesn't match the etag of the stored manifest, manifest downloads return
+ * nil if the etag of the local manifest matches and component downloads fail with a 404 if the
+ * requested etag is not the current one. Chunked uploads (see chunkedUploadThreshold) collect their
+ * chunks in a hidden directory under the root directory until they get committed.
+ *
+ * A cancelled component download keeps the bytes that it has received so far and fails with an
+ * error that carries resume data (see DCXErrorUtils ResumeDataOfError:). Passing that data to
+ * the resumable variant of downloadComponent: only transfers the remaining bytes, like a 206
+ * response would, and gets reported as a request of kind @"resumeDownloadComponent".
+ *
+ * Requests complete asynchronously after a delay determined by latency and bandwidth so that the
+ * concurrency of the transfer code gets exercised without blocking any threads. Cancelled requests
+ * complete right away.
+ */
+@interface DCXLocalTransferSession : NSObject <DCXTransferSessionProtocol>
+
+/** The directory the session stores composites in. */
+@property (readonly) NSString *rootPath;
+
+/** The delay in seconds added to every request. Defaults to 0. */
+@property NSTimeInterval latency;
+
+/** The simulated bandwidth in bytes per second for the bodies of requests and responses. 0 means
+ * unlimited, which is the default. */
+@property double bandwidth;
+
+/** The fraction of requests (0 to 1) that fail with an HTTP status of 500. Defaults to 0. */
+@property double failureRate;
+
+/** Optional block that gets called for every request with a name for the kind of request (e.g.
+ * @"uploadComponent") and the href of the affected resource. Returning an error fails the request
+ * with that error. */
+@property (copy) NSError *(^errorInjector)(NSString *requestKind, NSString *href);
+
+/** Files of at least this many bytes get uploaded in chunks when the transfer code uses the
+ * resumable variant of uploadComponent:. 0, the default, disables chunked uploads. */
+@property unsigned long long chunkedUploadThreshold;
+
+/** The size in bytes of the chunks of chunked uploads. Defaults to 64 KB. */
+@property NSUInteger chunkSize;
+
+/** The number of requests that have completed so far. */
+@property (readonly) NSUInteger requestCount;
+
+/** The number of body bytes that have been transferred so far. */
+@property (readonly) int64_t transferredBytes;
+
+/** The largest number of requests that have been in flight at the same time. */
+@property (readonly) NSUInteger peakConcurrentRequests;
+
+/** The largest number of component uploads (including the chunk and commit requests of chunked
+ * uploads) that have been in flight at the same time. */
+@property (readonly) NSUInteger peakConcurrentUploads;
+
+/**
+ * \brief Initializes a session that stores composites in the given directory.
+ *
+ * \param rootPath The directory to store composites in. Gets created if necessary.
+ */
+- (instancetype)initWithRootPath:(NSString *)rootPath;
+
+@end
@@ -0,0 +1,637 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#import "DCXLocalTransferSession.h"
+
+#import "DCXComposite.h"
+#import "DCXComponent.h"
+#import "DCXMutableComponent.h"
+#import "DCXManifest.h"
+#import "DCXResourceItem.h"
+#import "DCXConstants_Internal.h"
+#import "DCXError.h"
+#import "DCXHTTPRequest_Internal.h"
+#import "DCXErrorUtils.h"
+#import "DCXFileUtils.h"
+#import "DCXChunkedUpload.h"
+
+// Signature of the blocks that execute a request on the "server". error is non-nil if the request
+// has been failed by error injection or cancellation.
+typedef void (^DCXLocalRequestBlock)(NSError *error);
+
+// Like DCXLocalRequestBlock but also gets the number of body bytes that have been transferred
+// before the request got cancelled.
+typedef void (^DCXLocalPartialRequestBlock)(NSError *error, int64_t transferredLength);
+
+// Keys of the resume data of downloads
+static NSString *const DCXLocalResumeHrefKey = @"href";
+static NSString *const DCXLocalResumeEtagKey = @"etag";
+static NSString *const DCXLocalResumeFileKey = @"file";
+
+@implementation DCXLocalTransferSession
+{
+    // Current etag (NSString) by href of every stored file.
+    NSMutableDictionary *_etags;
+    NSUInteger _nextEtag;
+    NSUInteger _requestCount;
+    int64_t _transferredBytes;
+    NSUInteger _concurrentRequests;
+    NSUInteger _peakConcurrentRequests;
+    NSUInteger _concurrentUploads;
+    NSUInteger _peakConcurrentUploads;
+    dispatch_queue_t _requestQueue;
+}
+
+-(instancetype) initWithRootPath:(NSString *)rootPath
+{
+    self = [super init];
+    if (self != nil) {
+        _rootPath = rootPath;
+        _etags = [NSMutableDictionary dictionary];
+        _nextEtag = 1;
+        _chunkSize = 64 * 1024;
+        _requestQueue = dispatch_queue_create("com.adobe.dcx.localtransfersession", DISPATCH_QUEUE_CONCURRENT);
+        [[NSFileManager defaultManager] createDirectoryAtPath:rootPath withIntermediateDirectories:YES
+                                                   attributes:nil error:nil];
+    }
+    return self;
+}
+
+-(NSUInteger) requestCount
+{
+    @synchronized(_etags) {
+        return _requestCount;
+    }
+}
+
+-(int64_t) transferredBytes
+{
+    @synchronized(_etags) {
+        return _transferredBytes;
+    }
+}
+
+-(NSUInteger) peakConcurrentRequests
+{
+    @synchronized(_etags) {
+        return _peakConcurrentRequests;
+    }
+}
+
+-(NSUInteger) peakConcurrentUploads
+{
+    @synchronized(_etags) {
+        return _peakConcurrentUploads;
+    }
+}
+
+#pragma mark - Internal
+
+-(NSString*) pathForHref:(NSString*)href
+{
+    return [self.rootPath stringByAppendingPathComponent:href];
+}
+
+-(NSString*) pathForUploadId:(NSString*)uploadId
+{
+    return [[self.rootPath stringByAppendingPathComponent:@".uploads"] stringByAppendingPathComponent:uploadId];
+}
+
+-(NSString*) pathForPartialDownloadWithId:(NSString*)downloadId
+{
+    return [[self.rootPath stringByAppendingPathComponent:@".downloads"] stringByAppendingPathComponent:downloadId];
+}
+
+-(NSString*) hrefForManifestOfComposite:(DCXComposite*)composite
+{
+    return [composite.href stringByAppendingPathComponent:@"manifest"];
+}
+
+-(NSString*) hrefForComponent:(DCXComponent*)component ofComposite:(DCXComposite*)composite
+{
+    return [composite.href stringByAppendingPathComponent:component.componentId];
+}
+
+-(NSString*) etagForHref:(NSString*)href
+{
+    @synchronized(_etags) {
+        return _etags[href];
+    }
+}
+
+-(NSString*) assignNewEtagToHref:(NSString*)href
+{
+    @synchronized(_etags) {
+        NSString *etag = [NSString stringWithFormat:@"%lu", (unsigned long)_nextEtag++];
+        _etags[href] = etag;
+        return etag;
+    }
+}
+
+-(void) removeEtagsWithPrefix:(NSString*)prefix
+{
+    @synchronized(_etags) {
+        for (NSString *href in _etags.allKeys) {
+            if ([href isEqualToString:prefix] || [href hasPrefix:[prefix stringByAppendingString:@"/"]]) {
+                [_etags removeObjectForKey:href];
+            }
+        }
+    }
+}
+
+-(NSError*) errorWithStatusCode:(NSInteger)statusCode forHref:(NSString*)href
+{
+    NSInteger code = (statusCode == 412 ? DCXErrorConflictingChanges : DCXErrorUnexpectedResponse);
+    return [DCXErrorUtils ErrorWithCode:code domain:DCXErrorDomain
+                                    URL:[NSURL fileURLWithPath:[self pathForHref:href]]
+                           responseData:nil httpStatusCode:statusCode headers:nil
+                        underlyingError:nil details:nil];
+}
+
+-(BOOL) isUploadRequestKind:(NSString*)kind
+{
+    return [kind isEqualToString:@"uploadComponent"] || [kind isEqualToString:@"uploadChunk"]
+        || [kind isEqualToString:@"commitChunkedUpload"];
+}
+
+-(int64_t) lengthOfFile:(NSString*)path
+{
+    return [[[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil] fileSize];
+}
+
+-(void) callBlock:(void(^)(void))block onQueue:(NSOperationQueue*)queue
+{
+    if (queue != nil) {
+        [queue addOperationWithBlock:block];
+    } else {
+        block();
+    }
+}
+
+/**
+Runs block asynchronously after the latency of the session plus the time it takes to transfer
+length bytes. The returned request tracks the progress of the transfer and can be used to cancel it.
+*/
+-(DCXHTTPRequest*) scheduleRequestOfKind:(NSString*)kind forHref:(NSString*)href
+                              withLength:(int64_t)length block:(DCXLocalRequestBlock)block
+{
+    return [self scheduleRequestOfKind:kind forHref:href withLength:length partialBlock:^(NSError *error, int64_t transferredLength) {
+        block(error);
+    }];
+}
+
+/**
+Like scheduleRequestOfKind:forHref:withLength:block: but a cancelled request completes right away and
+block gets the number of bytes that would have been transferred by the time of the cancellation.
+*/
+-(DCXHTTPRequest*) scheduleRequestOfKind:(NSString*)kind forHref:(NSString*)href
+                              withLength:(int64_t)length partialBlock:(DCXLocalPartialRequestBlock)block
+{
+    // Created while the caller's progress is current so that it becomes a child of that progress
+    NSProgress *progress = [NSProgress progressWithTotalUnitCount:length];
+    DCXHTTPRequest *request = [[DCXHTTPRequest alloc] initWithProgress:progress andOperation:nil];
+
+    NSTimeInterval latency = self.latency;
+    double bandwidth = self.bandwidth;
+    NSTimeInterval delay = latency;
+    if (bandwidth > 0) {
+        delay += length / bandwidth;
+    }
+
+    NSError *error = nil;
+    NSError *(^errorInjector)(NSString*, NSString*) = self.errorInjector;
+    if (errorInjector != nil) {
+        error = errorInjector(kind, href);
+    }
+    if (error == nil && self.failureRate > 0 && arc4random_uniform(10000) < self.failureRate * 10000) {
+        error = [self errorWithStatusCode:500 forHref:href];
+    }
+
+    BOOL isUpload = [self isUploadRequestKind:kind];
+    @synchronized(_etags) {
+        _peakConcurrentRequests = MAX(_peakConcurrentRequests, ++_concurrentRequests);
+        if (isUpload) {
+            _peakConcurrentUploads = MAX(_peakConcurrentUploads, ++_concurrentUploads);
+        }
+    }
+
+    NSDate *startDate = [NSDate date];
+    __block BOOL finished = NO;
+    void (^finish)(void) = ^{
+        @synchronized(progress) {
+            if (finished) {
+                return;
+            }
+            finished = YES;
+        }
+        progress.cancellationHandler = nil;
+
+        NSError *requestError = error;
+        int64_t transferredLength = length;
+        if (requestError == nil && progress.isCancelled) {
+            requestError = [DCXErrorUtils ErrorWithCode:DCXErrorCancelled domain:DCXErrorDomain details:nil];
+            // Bytes only start flowing after the latency has passed
+            NSTimeInterval transferTime = [[NSDate date] timeIntervalSinceDate:startDate] - latency;
+            transferredLength = (bandwidth > 0 && transferTime > 0) ? MIN(length, (int64_t)(transferTime * bandwidth)) : 0;
+        } else if (requestError != nil) {
+            transferredLength = 0;
+        }
+        @synchronized(_etags) {
+            _concurrentRequests--;
+            if (isUpload) {
+                _concurrentUploads--;
+            }
+            _requestCount++;
+            _transferredBytes += transferredLength;
+        }
+        block(requestError, transferredLength);
+        progress.completedUnitCount = length;
+    };
+    progress.cancellationHandler = ^{
+        dispatch_async(_requestQueue, finish);
+    };
+    if (progress.isCancelled) {
+        // The progress of the caller has been cancelled before the request got created
+        dispatch_async(_requestQueue, finish);
+    }
+
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), _requestQueue, finish);
+
+    return request;
+}
+
+#pragma mark - Composite Methods
+
+-(DCXHTTPRequest*) createComposite:(DCXComposite *)composite
+                   requestPriority:(NSOperationQueuePriority)priority
+                      handlerQueue:(NSOperationQueue *)queue
+                 completionHandler:(DCXCompositeRequestCompletionHandler)handler
+{
+    NSString *href = composite.href;
+    return [self scheduleRequestOfKind:@"createComposite" forHref:href withLength:0 block:^(NSError *error) {
+        NSString *path = [self pathForHref:href];
+        NSFileManager *fm = [NSFileManager defaultManager];
+        if (error == nil) {
+            if ([fm fileExistsAtPath:path]) {
+                error = [DCXErrorUtils ErrorWithCode:DCXErrorCompositeAlreadyExists domain:DCXErrorDomain details:nil];
+            } else {
+                [fm createDirectoryAtPath:path withIntermediateDirectories:YES attributes:nil error:&error];
+            }
+        }
+        [self callBlock:^{
+            handler(error == nil ? composite : nil, error);
+        } onQueue:queue];
+    }];
+}
+
+-(DCXHTTPRequest*) deleteComposite:(DCXComposite *)composite
+                   requestPriority:(NSOperationQueuePriority)priority
+                      handlerQueue:(NSOperationQueue *)queue
+                 completionHandler:(DCXCompositeRequestCompletionHandler)handler
+{
+    NSString *href = composite.href;
+    return [self scheduleRequestOfKind:@"deleteComposite" forHref:href withLength:0 block:^(NSError *error) {
+        if (error == nil) {
+            // Deleting a missing composite succeeds just like a 404 does for a real service
+            [[NSFileManager defaultManager] removeItemAtPath:[self pathForHref:href] error:nil];
+            [self removeEtagsWithPrefix:href];
+        }
+        [self callBlock:^{
+            handler(composite, error);
+        } onQueue:queue];
+    }];
+}
+
+#pragma mark - Manifest Methods
+
+-(DCXResourceItem*) resourceForManifest:(DCXManifest *)manifest ofComposite:(DCXComposite *)composite
+{
+    DCXResourceItem *resource = [[DCXResourceItem alloc] init];
+    resource.type = DCXManifestType;
+    resource.href = [self hrefForManifestOfComposite:composite];
+    resource.etag = manifest.etag;
+    return resource;
+}
+
+-(DCXHTTPRequest*) updateManifest:(DCXManifest *)manifest ofComposite:(DCXComposite *)composite
+                  requestPriority:(NSOperationQueuePriority)priority
+                     handlerQueue:(NSOperationQueue *)queue
+                completionHandler:(DCXManifestRequestCompletionHandler)handler
+{
+    NSString *href = [self hrefForManifestOfComposite:composite];
+    NSData *data = manifest.remoteData;
+    return [self scheduleRequestOfKind:@"updateManifest" forHref:href withLength:data.length block:^(NSError *error) {
+        DCXManifest *updatedManifest = nil;
+        if (error == nil) {
+            @synchronized(_etags) {
+                NSString *currentEtag = _etags[href];
+                if (currentEtag != nil && ![currentEtag isEqualToString:manifest.etag]) {
+                    // Somebody else has pushed in the meantime
+                    error = [self errorWithStatusCode:412 forHref:href];
+                } else if ([data writeToFile:[self pathForHref:href] options:NSDataWritingAtomic error:&error]) {
+                    updatedManifest = [manifest copy];
+                    updatedManifest.etag = [self assignNewEtagToHref:href];
+                }
+            }
+        }
+        [self callBlock:^{
+            handler(updatedManifest, error);
+        } onQueue:queue];
+    }];
+}
+
+-(DCXHTTPRequest*) getHeaderInfoForManifestOfComposite:(DCXComposite *)composite
+                                       requestPriority:(NSOperationQueuePriority)priority
+                                          handlerQueue:(NSOperationQueue *)queue
+                                     completionHandler:(DCXResourceRequestCompletionHandler)handler
+{
+    DCXResourceItem *resource = [self resourceForManifest:composite.manifest ofComposite:composite];
+    NSString *href = resource.href;
+    return [self scheduleRequestOfKind:@"getHeaderInfoForManifest" forHref:href withLength:0 block:^(NSError *error) {
+        if (error == nil) {
+            resource.etag = [self etagForHref:href];
+            if (resource.etag == nil) {
+                error = [self errorWithStatusCode:404 forHref:href];
+            }
+        }
+        [self callBlock:^{
+            handler(error == nil ? resource : nil, error);
+        } onQueue:queue];
+    }];
+}
+
+-(DCXHTTPRequest*) getManifest:(DCXManifest *)manifest ofComposite:(DCXComposite *)composite
+               requestPriority:(NSOperationQueuePriority)priority
+                  handlerQueue:(NSOperationQueue *)queue
+             completionHandler:(DCXManifestRequestCompletionHandler)handler
+{
+    NSString *href = [self hrefForManifestOfComposite:composite];
+    NSString *path = [self pathForHref:href];
+    return [self scheduleRequestOfKind:@"getManifest" forHref:href withLength:[self lengthOfFile:path] block:^(NSError *error) {
+        DCXManifest *downloadedManifest = nil;
+        if (error == nil) {
+            NSString *etag = [self etagForHref:href];
+            if (etag == nil) {
+                error = [self errorWithStatusCode:404 forHref:href];
+            } else if (![etag isEqualToString:manifest.etag]) {
+                downloadedManifest = [[DCXManifest alloc] initWithContentsOfFile:path withError:&error];
+                downloadedManifest.etag = etag;
+                downloadedManifest.compositeHref = composite.href;
+            }
+            // else: the manifest hasn't changed, which is reported as a nil manifest without an error
+        }
+        [self callBlock:^{
+            handler(error == nil ? downloadedManifest : nil, error);
+        } onQueue:queue];
+    }];
+}
+
+#pragma mark - Component Methods
+
+-(DCXHTTPRequest*) uploadComponent:(DCXComponent *)component
+                       ofComposite:(DCXComposite *)composite
+                          fromPath:(NSString *)path
+                    componentIsNew:(BOOL)isNew
+                   requestPriority:(NSOperationQueuePriority)priority
+                      handlerQueue:(NSOperationQueue *)queue
+                 completionHandler:(DCXComponentRequestCompletionHandler)handler
+{
+    NSString *href = [self hrefForComponent:component ofComposite:composite];
+    int64_t length = [self lengthOfFile:path];
+    return [self scheduleRequestOfKind:@"uploadComponent" forHref:href withLength:length block:^(NSError *error) {
+        DCXMutableComponent *updatedComponent = nil;
+        if (error == nil) {
+            BOOL exists = [self etagForHref:href] != nil;
+            if (isNew && exists) {
+                error = [self errorWithStatusCode:412 forHref:href];
+            } else if (!isNew && !exists) {
+                error = [self errorWithStatusCode:404 forHref:href];
+            } else {
+                NSString *tempPath = [[self pathForHref:href] stringByAppendingString:@".upload"];
+                NSFileManager *fm = [NSFileManager defaultManager];
+                [fm removeItemAtPath:tempPath error:nil];
+                if ([fm copyItemAtPath:path toPath:tempPath error:&error]
+                    && [DCXFileUtils moveFileAtomicallyFrom:tempPath to:[self pathForHref:href] withError:&error]) {
+                    updatedComponent = [component mutableCopy];
+                    updatedComponent.etag = [self assignNewEtagToHref:href];
+                    updatedComponent.version = updatedComponent.etag;
+                    updatedComponent.length = @(length);
+                } else {
+                    error = [DCXErrorUtils ErrorWithCode:DCXErrorComponentReadFailure domain:DCXErrorDomain
+                                         underlyingError:error path:path details:nil];
+                }
+            }
+        }
+        [self callBlock:^{
+            handler(updatedComponent, error);
+        } onQueue:queue];
+    }];
+}
+
+-(DCXHTTPRequest*) uploadComponent:(DCXComponent *)component
+                       ofComposite:(DCXComposite *)composite
+                          fromPath:(NSString *)path
+                    componentIsNew:(BOOL)isNew
+                     uploadSession:(NSDictionary *)uploadSession
+                    sessionHandler:(DCXUploadSessionHandler)sessionHandler
+                   requestPriority:(NSOperationQueuePriority)priority
+                      handlerQueue:(NSOperationQueue *)queue
+                 completionHandler:(DCXComponentRequestCompletionHandler)handler
+{
+    unsigned long long threshold = self.chunkedUploadThreshold;
+    if (threshold == 0 || (unsigned long long)[self lengthOfFile:path] < threshold) {
+        return [self uploadComponent:component ofComposite:composite fromPath:path componentIsNew:isNew
+                     requestPriority:priority handlerQueue:queue completionHandler:handler];
+    }
+
+    NSString *href = [self hrefForComponent:component ofComposite:composite];
+
+    DCXChunkUploadBlock chunkBlock = ^DCXHTTPRequest*(NSData *chunk, NSString *uploadId, unsigned long long offset,
+                                                      DCXChunkCompletionHandler chunkHandler) {
+        return [self scheduleRequestOfKind:@"uploadChunk" forHref:href withLength:chunk.length block:^(NSError *error) {
+            NSString *newUploadId = uploadId;
+            unsigned long long newOffset = 0;
+            if (error == nil) {
+                NSFileManager *fm = [NSFileManager defaultManager];
+                if (newUploadId == nil) {
+                    newUploadId = [[NSUUID UUID] UUIDString];
+                    [fm createDirectoryAtPath:[[self pathForUploadId:newUploadId] stringByDeletingLastPathComponent]
+                  withIntermediateDirectories:YES attributes:nil error:nil];
+                    [fm createFileAtPath:[self pathForUploadId:newUploadId] contents:nil attributes:nil];
+                }
+                NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingAtPath:[self pathForUploadId:newUploadId]];
+                if (fileHandle == nil) {
+                    error = [self errorWithStatusCode:404 forHref:href];
+                } else {
+                    newOffset = [fileHandle seekToEndOfFile];
+                    // Like a real service we report the offset we expect if it doesn't match
+                    if (newOffset == offset) {
+                        [fileHandle writeData:chunk];
+                        newOffset += chunk.length;
+                    }
+                    [fileHandle closeFile];
+                }
+            }
+            chunkHandler(newUploadId, newOffset, error);
+        }];
+    };
+
+    DCXChunkCommitBlock commitBlock = ^DCXHTTPRequest*(NSString *uploadId, DCXComponentRequestCompletionHandler commitHandler) {
+        return [self scheduleRequestOfKind:@"commitChunkedUpload" forHref:href withLength:0 block:^(NSError *error) {
+            DCXMutableComponent *updatedComponent = nil;
+            NSString *uploadPath = [self pathForUploadId:uploadId];
+            if (error == nil) {
+                BOOL exists = [self etagForHref:href] != nil;
+                if (![[NSFileManager defaultManager] fileExistsAtPath:uploadPath]) {
+                    error = [self errorWithStatusCode:404 forHref:href];
+                } else if (isNew && exists) {
+                    error = [self errorWithStatusCode:412 forHref:href];
+                } else if (!isNew && !exists) {
+                    error = [self errorWithStatusCode:404 forHref:href];
+                } else {
+                    int64_t length = [self lengthOfFile:uploadPath];
+                    if ([DCXFileUtils moveFileAtomicallyFrom:uploadPath to:[self pathForHref:href] withError:&error]) {
+                        updatedComponent = [component mutableCopy];
+                        updatedComponent.etag = [self assignNewEtagToHref:href];
+                        updatedComponent.version = updatedComponent.etag;
+                        updatedComponent.length = @(length);
+                    }
+                }
+            }
+            commitHandler(updatedComponent, error);
+        }];
+    };
+
+    DCXChunkedUpload *upload = [[DCXChunkedUpload alloc] initWithPath:path uploadSession:uploadSession
+                                                           chunkBlock:chunkBlock commitBlock:commitBlock];
+    // Fixed chunks keep the number of requests predictable
+    upload.chunkSize = upload.minChunkSize = upload.maxChunkSize = self.chunkSize;
+    return [upload startWithPriority:priority sessionHandler:sessionHandler handlerQueue:queue completionHandler:handler];
+}
+
+-(DCXHTTPRequest*) downloadComponent:(DCXComponent *)component
+                         ofComposite:(DCXComposite *)composite
+                              toPath:(NSString *)path
+                     requestPriority:(NSOperationQueuePriority)priority
+                        handlerQueue:(NSOperationQueue *)queue
+                   completionHandler:(DCXComponentRequestCompletionHandler)handler
+{
+    return [self downloadComponent:component ofComposite:composite toPath:path resumeData:nil
+                   requestPriority:priority handlerQueue:queue completionHandler:handler];
+}
+
+-(DCXHTTPRequest*) downloadComponent:(DCXComponent *)component
+                         ofComposite:(DCXComposite *)composite
+                              toPath:(NSString *)path
+                          resumeData:(NSData *)resumeData
+                     requestPriority:(NSOperationQueuePriority)priority
+                        handlerQueue:(NSOperationQueue *)queue
+                   completionHandler:(DCXComponentRequestCompletionHandler)handler
+{
+    NSString *href = [self hrefForComponent:component ofComposite:composite];
+    NSString *sourcePath = [self pathForHref:href];
+    NSFileManager *fm = [NSFileManager defaultManager];
+
+    // Like an If-Range request the download only gets resumed if the component hasn't changed since
+    NSDictionary *resume = resumeData == nil ? nil : [NSJSONSerialization JSONObjectWithData:resumeData options:0 error:nil];
+    NSString *partialPath = nil;
+    int64_t offset = 0;
+    if ([resume isKindOfClass:[NSDictionary class]] && [resume[DCXLocalResumeHrefKey] isEqual:href]
+        && [resume[DCXLocalResumeEtagKey] isEqual:[self etagForHref:href]]) {
+        partialPath = [self pathForPartialDownloadWithId:[resume[DCXLocalResumeFileKey] lastPathComponent]];
+        if ([fm fileExistsAtPath:partialPath]) {
+            offset = [self lengthOfFile:partialPath];
+        } else {
+            partialPath = nil;
+        }
+    }
+
+    NSString *kind = partialPath == nil ? @"downloadComponent" : @"resumeDownloadComponent";
+    int64_t length = [self lengthOfFile:sourcePath];
+    return [self scheduleRequestOfKind:kind forHref:href withLength:length - offset
+                          partialBlock:^(NSError *error, int64_t transferredLength) {
+        NSError *handlerError = error;
+        NSString *tempPath = [path stringByAppendingString:@".download"];
+        [fm removeItemAtPath:tempPath error:nil];
+        if (error == nil && ![[self etagForHref:href] isEqualToString:component.etag]) {
+            handlerError = [self errorWithStatusCode:404 forHref:href];
+        } else if (error == nil || transferredLength > 0 || partialPath != nil) {
+            // Assemble the bytes received so far: the partial file of the resumed download followed
+            // by the part of the file that has been transferred by this request
+            BOOL success = partialPath == nil ? [fm createFileAtPath:tempPath contents:nil attributes:nil]
+                                              : [fm moveItemAtPath:partialPath toPath:tempPath error:nil];
+            NSFileHandle *source = [NSFileHandle fileHandleForReadingAtPath:sourcePath];
+            NSFileHandle *target = [NSFileHandle fileHandleForWritingAtPath:tempPath];
+            if (success && source != nil && target != nil) {
+                [source seekToFileOffset:(unsigned long long)offset];
+                [target seekToEndOfFile];
+                [target writeData:[source readDataOfLength:(NSUInteger)transferredLength]];
+            } else {
+                success = NO;
+            }
+            [source closeFile];
+            [target closeFile];
+
+            if (error != nil) {
+                // Keep what we have got so far for a later resumed download
+                NSString *downloadId = [[NSUUID UUID] UUIDString];
+                NSString *newPartialPath = [self pathForPartialDownloadWithId:downloadId];
+                [fm createDirectoryAtPath:[newPartialPath stringByDeletingLastPathComponent]
+              withIntermediateDirectories:YES attributes:nil error:nil];
+                if (success && [fm moveItemAtPath:tempPath toPath:newPartialPath error:nil]) {
+                    NSDictionary *newResume = @{ DCXLocalResumeHrefKey: href,
+                                                 DCXLocalResumeEtagKey: component.etag,
+                                                 DCXLocalResumeFileKey: downloadId };
+                    handlerError = [DCXErrorUtils ErrorWithCode:error.code domain:error.domain
+                                                       userInfo:@{ NSURLSessionDownloadTaskResumeData:
+                                                                       [NSJSONSerialization dataWithJSONObject:newResume options:0 error:nil] }];
+                }
+            } else if (!success || ![DCXFileUtils moveFileAtomicallyFrom:tempPath to:path withError:&handlerError]) {
+                handlerError = [DCXErrorUtils ErrorWithCode:DCXErrorComponentWriteFailure domain:DCXErrorDomain
+                                            underlyingError:handlerError path:path details:nil];
+            }
+        }
+        [self callBlock:^{
+            handler(handlerError == nil ? component : nil, handlerError);
+        } onQueue:queue];
+    }];
+}
+
+-(DCXHTTPRequest*) deleteComponent:(DCXComponent *)component
+                       ofComposite:(DCXComposite *)composite
+                   requestPriority:(NSOperationQueuePriority)priority
+                      handlerQueue:(NSOperationQueue *)queue
+                 completionHandler:(DCXComponentRequestCompletionHandler)handler
+{
+    NSString *href = [self hrefForComponent:component ofComposite:composite];
+    return [self scheduleRequestOfKind:@"deleteComponent" forHref:href withLength:0 block:^(NSError *error) {
+        if (error == nil) {
+            [[NSFileManager defaultManager] removeItemAtPath:[self pathForHref:href] error:nil];
+            [self removeEtagsWithPrefix:href];
+        }
+        [self callBlock:^{
+            handler(error == nil ? component : nil, error);
+        } onQueue:queue];
+    }];
+}
+
+@end
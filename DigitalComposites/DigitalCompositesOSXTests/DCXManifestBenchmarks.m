@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Cocoa/Cocoa.h>
+#import <XCTest/XCTest.h>
+#import <malloc/malloc.h>
+#import <sys/resource.h>
+#import "DCX.h"
+#import "DCXManifest.h"
+
+/*
+ * Microbenchmarks for DCXManifest. Manifests get generated deterministically in two shapes: a wide
+ * one where all child nodes hang off the root and a deep one where the child nodes form a binary
+ * tree. Their sizes and the amount of work per benchmark can be configured through these
+ * environment variables:
+ *
+ * DCX_BENCHMARK_MANIFEST_SIZES  Comma-separated list of component counts (default 1000,10000,100000)
+ * DCX_BENCHMARK_ITERATIONS      Number of measured iterations of whole-manifest operations (default 5)
+ * DCX_BENCHMARK_OPERATIONS      Number of measured edits per edit operation (default 1000)
+ *
+ * For every operation the benchmarks log ops/sec, latency percentiles, the net number of blocks
+ * and bytes that were left allocated on the default malloc zone and the peak resident size of the
+ * process.
+ */
+
+@interface DCXManifest (Benchmarks)
+- (void) buildHashes;
+@end
+
+typedef NS_ENUM(NSInteger, DCXBenchmarkTreeShape) {
+    DCXBenchmarkTreeShapeWide,
+    DCXBenchmarkTreeShapeDeep,
+};
+
+@interface DCXManifestBenchmarks : XCTestCase
+
+@end
+
+@implementation DCXManifestBenchmarks
+{
+    uint64_t _seed;
+}
+
+#pragma mark - Helpers
+
+static NSUInteger benchmarkParameter(NSString *name, NSUInteger defaultValue)
+{
+    NSString *value = [[NSProcessInfo processInfo] environment][name];
+    return value != nil ? (NSUInteger)[value integerValue] : defaultValue;
+}
+
+static NSArray* benchmarkManifestSizes()
+{
+    NSString *value = [[NSProcessInfo processInfo] environment][@"DCX_BENCHMARK_MANIFEST_SIZES"];
+    NSMutableArray *sizes = [NSMutableArray array];
+    for (NSString *size in [(value ?: @"1000,10000,100000") componentsSeparatedByString:@","]) {
+        if (size.integerValue > 0) {
+            [sizes addObject:@(size.integerValue)];
+        }
+    }
+    return sizes;
+}
+
+static NSString* shapeName(DCXBenchmarkTreeShape shape)
+{
+    return shape == DCXBenchmarkTreeShapeWide ? @"wide" : @"deep";
+}
+
+// A linear congruential generator so that runs are reproducible across machines.
+-(NSUInteger) nextRandom:(NSUInteger)bound
+{
+    _seed = _seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (NSUInteger)((_seed >> 33) % bound);
+}
+
+-(id) pickFrom:(NSArray*)array
+{
+    return array[[self nextRandom:array.count]];
+}
+
+// Returns the values of the dictionary sorted by key so that picks don't depend on hash order.
+static NSArray* sortedValues(NSDictionary *dict)
+{
+    NSArray *keys = [dict.allKeys sortedArrayUsingSelector:@selector(compare:)];
+    return [dict objectsForKeys:keys notFoundMarker:[NSNull null]];
+}
+
+-(DCXMutableComponent*) newComponentWithIndex:(NSUInteger)index
+{
+    NSString *componentId = [NSString stringWithFormat:@"c%08lu", (unsigned long)index];
+    DCXMutableComponent *component = [DCXMutableComponent componentWithId:componentId
+                                                                     path:[componentId stringByAppendingPathExtension:@"bin"]
+                                                                     name:@"component" type:@"application/octet-stream"
+                                                             relationship:@"primary"];
+    component.etag = [NSString stringWithFormat:@"\"%lx\"", (unsigned long)[self nextRandom:NSUIntegerMax]];
+    component.version = [NSString stringWithFormat:@"%lu", (unsigned long)[self nextRandom:100]];
+    component.length = @([self nextRandom:1 << 24]);
+    component.state = DCXAssetStateUnmodified;
+    return component;
+}
+
+-(DCXMutableNode*) newNodeWithIndex:(NSUInteger)index
+{
+    NSString *nodeId = [NSString stringWithFormat:@"n%08lu", (unsigned long)index];
+    DCXMutableNode *node = [DCXMutableNode nodeWithId:nodeId];
+    node.type = @"page";
+    node.path = nodeId;
+    node.name = @"node";
+    return node;
+}
+
+// Generates a manifest with componentCount components spread across componentCount / 10 child nodes.
+-(DCXManifest*) manifestWithComponentCount:(NSUInteger)componentCount shape:(DCXBenchmarkTreeShape)shape
+{
+    NSError *error = nil;
+    _seed = componentCount * 2 + shape;
+
+    DCXManifest *manifest = [DCXManifest manifestWithName:@"benchmark" andType:@"t"];
+    manifest.compositeId = @"benchmark";
+
+    NSUInteger nodeCount = MAX(1, componentCount / 10);
+    NSMutableArray *nodes = [NSMutableArray arrayWithCapacity:nodeCount];
+    for (NSUInteger i = 0; i < nodeCount; i++) {
+        // The deep shape is a binary heap layout: the parent of node i is node (i - 1) / 2
+        DCXNode *parent = (shape == DCXBenchmarkTreeShapeWide || i == 0 ? manifest.rootNode : nodes[(i - 1) / 2]);
+        DCXNode *node = [manifest addChild:[self newNodeWithIndex:i] toParent:parent withError:&error];
+        XCTAssertNotNil(node, @"%@", error);
+        [nodes addObject:node];
+    }
+    for (NSUInteger i = 0; i < componentCount; i++) {
+        DCXComponent *component = [manifest addComponent:[self newComponentWithIndex:i] fromManifest:nil
+                                                 toChild:nodes[i % nodeCount] newPath:nil withError:&error];
+        XCTAssertNotNil(component, @"%@", error);
+    }
+
+    return manifest;
+}
+
+// Measures count runs of block and logs throughput, latency percentiles and memory usage.
+-(void) measure:(NSString*)operation ofManifest:(NSString*)label count:(NSUInteger)count
+          block:(void(^)(NSUInteger index))block
+{
+    DCXMetricsHistogram *histogram = [[DCXMetricsHistogram alloc] init];
+    malloc_statistics_t before, after;
+    malloc_zone_statistics(NULL, &before);
+
+    NSDate *start = [NSDate date];
+    for (NSUInteger i = 0; i < count; i++) {
+        @autoreleasepool {
+            NSDate *opStart = [NSDate date];
+            block(i);
+            [histogram recordValue:-[opStart timeIntervalSinceNow]];
+        }
+    }
+    NSTimeInterval total = -[start timeIntervalSinceNow];
+
+    malloc_zone_statistics(NULL, &after);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    NSLog(@"manifest.%@ [%@]: %.1f ops/s, p50 %.6fs, p95 %.6fs, p99 %.6fs, net %ld blocks / %ld bytes, peak rss %ld KB",
+          operation, label, total > 0 ? count / total : 0,
+          [histogram valueAtPercentile:0.5], [histogram valueAtPercentile:0.95], [histogram valueAtPercentile:0.99],
+          (long)after.blocks_in_use - (long)before.blocks_in_use, (long)after.size_in_use - (long)before.size_in_use,
+          // ru_maxrss is in bytes on OS X
+          (long)(usage.ru_maxrss / 1024));
+}
+
+// Runs block for every configured manifest size and shape.
+-(void) forEachManifest:(void(^)(DCXManifest *manifest, NSString *label))block
+{
+    for (NSNumber *size in benchmarkManifestSizes()) {
+        for (DCXBenchmarkTreeShape shape = DCXBenchmarkTreeShapeWide; shape <= DCXBenchmarkTreeShapeDeep; shape++) {
+            @autoreleasepool {
+                DCXManifest *manifest = [self manifestWithComponentCount:size.unsignedIntegerValue shape:shape];
+                block(manifest, [NSString stringWithFormat:@"%@ %@", shapeName(shape), size]);
+            }
+        }
+    }
+}
+
+#pragma mark - Whole manifest operations
+
+- (void)testBenchmarkParse {
+    NSUInteger iterations = benchmarkParameter(@"DCX_BENCHMARK_ITERATIONS", 5);
+    [self forEachManifest:^(DCXManifest *manifest, NSString *label) {
+        NSData *data = [manifest localData];
+        [self measure:@"initWithData" ofManifest:label count:iterations block:^(NSUInteger index) {
+            NSError *error = nil;
+            XCTAssertNotNil([[DCXManifest alloc] initWithData:data withError:&error], @"%@", error);
+        }];
+    }];
+}
+
+- (void)testBenchmarkBuildHashes {
+    NSUInteger iterations = benchmarkParameter(@"DCX_BENCHMARK_ITERATIONS", 5);
+    [self forEachManifest:^(DCXManifest *manifest, NSString *label) {
+        [self measure:@"buildHashes" ofManifest:label count:iterations block:^(NSUInteger index) {
+            [manifest buildHashes];
+        }];
+    }];
+}
+
+- (void)testBenchmarkEncode {
+    NSUInteger iterations = benchmarkParameter(@"DCX_BENCHMARK_ITERATIONS", 5);
+    [self forEachManifest:^(DCXManifest *manifest, NSString *label) {
+        [self measure:@"localData" ofManifest:label count:iterations block:^(NSUInteger index) {
+            XCTAssertNotNil([manifest localData]);
+        }];
+        [self measure:@"remoteData" ofManifest:label count:iterations block:^(NSUInteger index) {
+            XCTAssertNotNil([manifest remoteData]);
+        }];
+        // Re-encode after a single edit so that any caching of unchanged parts shows up. Sort the
+        // components up front so that the sort doesn't count towards the measurement.
+        NSArray *components = sortedValues(manifest.allComponents);
+        [self measure:@"localData.afterEdit" ofManifest:label count:iterations block:^(NSUInteger index) {
+            DCXMutableComponent *component = [[self pickFrom:components] mutableCopy];
+            component.etag = [NSString stringWithFormat:@"\"edit%lu\"", (unsigned long)index];
+            [manifest updateComponent:component withError:nil];
+            XCTAssertNotNil([manifest localData]);
+        }];
+    }];
+}
+
+- (void)testBenchmarkCopy {
+    NSUInteger iterations = benchmarkParameter(@"DCX_BENCHMARK_ITERATIONS", 5);
+    [self forEachManifest:^(DCXManifest *manifest, NSString *label) {
+        [self measure:@"copy" ofManifest:label count:iterations block:^(NSUInteger index) {
+            XCTAssertNotNil([manifest copy]);
+        }];
+    }];
+}
+
+- (void)testBenchmarkVerifyIntegrity {
+    NSUInteger iterations = benchmarkParameter(@"DCX_BENCHMARK_ITERATIONS", 5);
+    [self forEachManifest:^(DCXManifest *manifest, NSString *label) {
+        [self measure:@"verifyIntegrity" ofManifest:label count:iterations block:^(NSUInteger index) {
+            XCTAssertEqual([manifest verifyIntegrityWithLogging:NO withBranchName:@"benchmark"].count, 0);
+        }];
+    }];
+}
+
+#pragma mark - Component edits
+
+- (void)testBenchmarkComponentEdits {
+    NSUInteger operations = benchmarkParameter(@"DCX_BENCHMARK_OPERATIONS", 1000);
+    [self forEachManifest:^(DCXManifest *original, NSString *label) {
+        NSArray *nodes = sortedValues(original.allChildren);
+        NSUInteger componentCount = original.allComponents.count;
+
+        DCXManifest *manifest = [original copy];
+        [self measure:@"addComponent" ofManifest:label count:operations block:^(NSUInteger index) {
+            NSError *error = nil;
+            XCTAssertNotNil([manifest addComponent:[self newComponentWithIndex:componentCount + index] fromManifest:nil
+                                           toChild:[self pickFrom:nodes] newPath:nil withError:&error], @"%@", error);
+        }];
+
+        manifest = [original copy];
+        NSArray *components = sortedValues(manifest.allComponents);
+        [self measure:@"updateComponent" ofManifest:label count:operations block:^(NSUInteger index) {
+            NSError *error = nil;
+            DCXMutableComponent *component = [[self pickFrom:components] mutableCopy];
+            component.state = DCXAssetStateModified;
+            XCTAssertNotNil([manifest updateComponent:component withError:&error], @"%@", error);
+        }];
+
+        manifest = [original copy];
+        components = sortedValues(manifest.allComponents);
+        [self measure:@"moveComponent" ofManifest:label count:operations block:^(NSUInteger index) {
+            NSError *error = nil;
+            XCTAssertNotNil([manifest moveComponent:[self pickFrom:components] toChild:[self pickFrom:nodes]
+                                          withError:&error], @"%@", error);
+        }];
+
+        manifest = [original copy];
+        components = sortedValues(manifest.allComponents);
+        NSUInteger removals = MIN(operations, components.count);
+        [self measure:@"removeComponent" ofManifest:label count:removals block:^(NSUInteger index) {
+            // Stride through the sorted list so that removals hit all parts of the tree
+            DCXComponent *component = components[(index * 7919) % components.count];
+            if (manifest.allComponents[component.componentId] != nil) {
+                [manifest removeComponent:component];
+            }
+        }];
+    }];
+}
+
+#pragma mark - Child edits
+
+- (void)testBenchmarkChildEdits {
+    NSUInteger operations = benchmarkParameter(@"DCX_BENCHMARK_OPERATIONS", 1000);
+    [self forEachManifest:^(DCXManifest *original, NSString *label) {
+        NSUInteger nodeCount = original.allChildren.count;
+
+        DCXManifest *manifest = [original copy];
+        NSArray *nodes = sortedValues(manifest.allChildren);
+        [self measure:@"insertChild" ofManifest:label count:operations block:^(NSUInteger index) {
+            NSError *error = nil;
+            XCTAssertNotNil([manifest insertChild:[self newNodeWithIndex:nodeCount + index] parent:[self pickFrom:nodes]
+                                          atIndex:0 withError:&error], @"%@", error);
+        }];
+
+        manifest = [original copy];
+        NSMutableArray *movableNodes = [sortedValues(manifest.allChildren) mutableCopy];
+        [movableNodes removeObject:manifest.rootNode];
+        [self measure:@"moveChild" ofManifest:label count:operations block:^(NSUInteger index) {
+            NSError *error = nil;
+            // Moving to the root can never create a cycle
+            XCTAssertNotNil([manifest moveChild:[self pickFrom:movableNodes] toParent:manifest.rootNode
+                                        toIndex:0 withError:&error], @"%@", error);
+        }];
+
+        manifest = [original copy];
+        movableNodes = [sortedValues(manifest.allChildren) mutableCopy];
+        [movableNodes removeObject:manifest.rootNode];
+        NSUInteger removals = MIN(operations, movableNodes.count);
+        [self measure:@"removeChild" ofManifest:label count:removals block:^(NSUInteger index) {
+            // Walk from the end so that the deep shape mostly removes leaves
+            DCXNode *node = movableNodes[movableNodes.count - 1 - index];
+            if (manifest.allChildren[node.nodeId] != nil) {
+                [manifest removeChild:node removedComponents:nil];
+            }
+        }];
+    }];
+}
+
+@end
@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Cocoa/Cocoa.h>
+#import <XCTest/XCTest.h>
+#import "DCX.h"
+#import "DCXLocalTransferSession.h"
+
+/*
+ * End-to-end push and pull benchmarks against a DCXLocalTransferSession. The size of the synthetic
+ * composites and the simulated network can be configured through these environment variables:
+ *
+ * DCX_BENCHMARK_COMPONENTS     Number of components per composite (default 200)
+ * DCX_BENCHMARK_CHILDREN       Number of child nodes the components are spread across (default 20)
+ * DCX_BENCHMARK_COMPONENT_SIZE Size of each component in bytes (default 4096)
+ * DCX_BENCHMARK_ITERATIONS     Number of measured iterations per benchmark (default 5)
+ * DCX_BENCHMARK_LATENCY_MS     Simulated latency per request in milliseconds (default 0)
+ * DCX_BENCHMARK_BANDWIDTH      Simulated bandwidth in bytes per second, 0 for unlimited (default 0)
+ *
+ * Each benchmark logs p50/p95/p99 of its measurements and of the push/pull phases at the end.
+ */
+@interface DigitalCompositesOSXBenchmarks : XCTestCase
+
+@end
+
+@implementation DigitalCompositesOSXBenchmarks
+{
+    NSFileManager                   *_fm;
+    NSString                        *_tempPath;
+    DCXLocalTransferSession         *_session;
+    DCXTransferMetricsAggregator    *_metrics;
+}
+
+#pragma mark - Helpers
+
+static NSUInteger benchmarkParameter(NSString *name, NSUInteger defaultValue)
+{
+    NSString *value = [[NSProcessInfo processInfo] environment][name];
+    return value != nil ? (NSUInteger)[value integerValue] : defaultValue;
+}
+
+// Records the duration of block under the given name.
+-(void) measure:(NSString*)name block:(void(^)(void))block
+{
+    NSDate *start = [NSDate date];
+    block();
+    [_metrics didFinishPhase:[@"benchmark." stringByAppendingString:name] ofComposite:nil
+                withDuration:-[start timeIntervalSinceNow]];
+}
+
+// Writes a file with random content of the configured size.
+-(NSString*) writeRandomFileNamed:(NSString*)name
+{
+    NSUInteger size = benchmarkParameter(@"DCX_BENCHMARK_COMPONENT_SIZE", 4096);
+    NSMutableData *data = [NSMutableData dataWithLength:size];
+    arc4random_buf(data.mutableBytes, size);
+    NSString *path = [[_tempPath stringByAppendingPathComponent:@"source"] stringByAppendingPathComponent:name];
+    [_fm createDirectoryAtPath:[path stringByDeletingLastPathComponent] withIntermediateDirectories:YES
+                    attributes:nil error:nil];
+    XCTAssertTrue([data writeToFile:path atomically:YES]);
+    return path;
+}
+
+// Creates and commits a new composite with the configured number of children and components.
+-(DCXComposite*) createSyntheticComposite
+{
+    NSError *error = nil;
+    NSUInteger componentCount = benchmarkParameter(@"DCX_BENCHMARK_COMPONENTS", 200);
+    NSUInteger childCount = MAX(1, benchmarkParameter(@"DCX_BENCHMARK_CHILDREN", 20));
+
+    NSString *compositeId = [[NSUUID UUID] UUIDString];
+    DCXComposite *composite = [DCXComposite compositeWithName:@"benchmark" andType:@"t"
+                                                      andPath:[_tempPath stringByAppendingPathComponent:compositeId]
+                                                        andId:compositeId
+                                                      andHref:[@"/benchmark" stringByAppendingPathComponent:compositeId]];
+    composite.metricsSink = _metrics;
+    DCXMutableBranch *current = composite.current;
+
+    NSMutableArray *children = [NSMutableArray arrayWithCapacity:childCount];
+    for (NSUInteger i = 0; i < childCount; i++) {
+        DCXNode *child = [current addChild:[DCXMutableNode nodeWithType:@"page" path:[NSString stringWithFormat:@"page%lu", (unsigned long)i] name:@"page"]
+                                  toParent:current.rootNode withError:&error];
+        XCTAssertNotNil(child, @"%@", error);
+        [children addObject:child];
+    }
+    for (NSUInteger i = 0; i < componentCount; i++) {
+        NSString *name = [NSString stringWithFormat:@"component%lu", (unsigned long)i];
+        DCXComponent *component = [current addComponent:name withId:nil withType:@"application/octet-stream"
+                                       withRelationship:@"primary" withPath:[name stringByAppendingPathExtension:@"bin"]
+                                                toChild:children[i % childCount]
+                                               fromFile:[self writeRandomFileNamed:name] copy:YES
+                                              withError:&error];
+        XCTAssertNotNil(component, @"%@", error);
+    }
+    XCTAssertTrue([composite commitChangesWithError:&error], @"%@", error);
+
+    return composite;
+}
+
+-(void) pushComposite:(DCXComposite*)composite
+{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"push"];
+    [DCXCompositeXfer pushComposite:composite usingSession:_session requestPriority:NSOperationQueuePriorityNormal
+                       handlerQueue:nil completionHandler:^(BOOL success, NSError *error) {
+                           XCTAssertTrue(success, @"%@", error);
+                           [expectation fulfill];
+                       }];
+    [self waitForExpectationsWithTimeout:600 handler:nil];
+}
+
+-(void) pushAndAcceptComposite:(DCXComposite*)composite
+{
+    NSError *error = nil;
+    [self pushComposite:composite];
+    XCTAssertTrue([composite acceptPushWithError:&error], @"%@", error);
+}
+
+-(DCXComposite*) pullCompositeFromHref:(NSString*)href minimal:(BOOL)minimal
+{
+    NSString *compositeId = [[NSUUID UUID] UUIDString];
+    DCXComposite *composite = [DCXComposite compositeFromHref:href andId:compositeId
+                                                      andPath:[_tempPath stringByAppendingPathComponent:compositeId]];
+    composite.metricsSink = _metrics;
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"pull"];
+    void (^handler)(DCXBranch*, NSError*) = ^(DCXBranch *branch, NSError *error) {
+        XCTAssertNotNil(branch, @"%@", error);
+        [expectation fulfill];
+    };
+    if (minimal) {
+        [DCXCompositeXfer pullMinimalComposite:composite usingSession:_session requestPriority:NSOperationQueuePriorityNormal
+                                  handlerQueue:nil completionHandler:handler];
+    } else {
+        [DCXCompositeXfer pullComposite:composite usingSession:_session requestPriority:NSOperationQueuePriorityNormal
+                           handlerQueue:nil completionHandler:handler];
+    }
+    [self waitForExpectationsWithTimeout:600 handler:nil];
+
+    return composite;
+}
+
+#pragma mark - Setup Teardown
+
+- (void)setUp {
+    [super setUp];
+
+    _fm = [NSFileManager defaultManager];
+    _tempPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"benchmark%f", [[NSDate date] timeIntervalSince1970]]];
+    [_fm createDirectoryAtPath:_tempPath withIntermediateDirectories:YES attributes:nil error:nil];
+
+    _session = [[DCXLocalTransferSession alloc] initWithRootPath:[_tempPath stringByAppendingPathComponent:@"server"]];
+    _session.latency = benchmarkParameter(@"DCX_BENCHMARK_LATENCY_MS", 0) / 1000.0;
+    _session.bandwidth = benchmarkParameter(@"DCX_BENCHMARK_BANDWIDTH", 0);
+    _metrics = [[DCXTransferMetricsAggregator alloc] init];
+}
+
+- (void)tearDown {
+    NSLog(@"%@ (%lu requests, %lld bytes):\n%@", self.name, (unsigned long)_session.requestCount,
+          _session.transferredBytes, [_metrics summary]);
+    [_fm removeItemAtPath:_tempPath error:nil];
+    [super tearDown];
+}
+
+#pragma mark - Benchmarks
+
+/*
+ * Pushes newly created composites.
+ */
+- (void)testBenchmarkPushNewComposite {
+    NSUInteger iterations = benchmarkParameter(@"DCX_BENCHMARK_ITERATIONS", 5);
+    for (NSUInteger i = 0; i < iterations; i++) {
+        DCXComposite *composite = [self createSyntheticComposite];
+        [self measure:@"push" block:^{
+            [self pushComposite:composite];
+        }];
+        [self measure:@"acceptPush" block:^{
+            NSError *error = nil;
+            XCTAssertTrue([composite acceptPushWithError:&error], @"%@", error);
+        }];
+        XCTAssertEqual([composite verifyIntegrityWithLogging:YES shouldBeComplete:YES].count, 0);
+    }
+}
+
+/*
+ * Modifies a tenth of the components of a pushed composite and pushes it again.
+ */
+- (void)testBenchmarkPushModifiedComponents {
+    NSUInteger iterations = benchmarkParameter(@"DCX_BENCHMARK_ITERATIONS", 5);
+    DCXComposite *composite = [self createSyntheticComposite];
+    [self pushAndAcceptComposite:composite];
+
+    for (NSUInteger i = 0; i < iterations; i++) {
+        NSError *error = nil;
+        DCXMutableBranch *current = composite.current;
+        NSArray *components = [current getAllComponents];
+        for (NSUInteger j = i % 10; j < components.count; j += 10) {
+            DCXComponent *component = components[j];
+            NSString *path = [self writeRandomFileNamed:[NSString stringWithFormat:@"modified%lu-%lu", (unsigned long)i, (unsigned long)j]];
+            XCTAssertNotNil([current updateComponent:component fromFile:path copy:YES withError:&error], @"%@", error);
+        }
+        XCTAssertTrue([composite commitChangesWithError:&error], @"%@", error);
+
+        [self measure:@"push" block:^{
+            [self pushComposite:composite];
+        }];
+        [self measure:@"acceptPush" block:^{
+            NSError *error = nil;
+            XCTAssertTrue([composite acceptPushWithError:&error], @"%@", error);
+        }];
+    }
+}
+
+/*
+ * Pulls a pushed composite into new local composites and resolves the pulls.
+ */
+- (void)testBenchmarkPull {
+    NSUInteger iterations = benchmarkParameter(@"DCX_BENCHMARK_ITERATIONS", 5);
+    DCXComposite *pushedComposite = [self createSyntheticComposite];
+    [self pushAndAcceptComposite:pushedComposite];
+
+    for (NSUInteger i = 0; i < iterations; i++) {
+        __block DCXComposite *composite = nil;
+        [self measure:@"pull" block:^{
+            composite = [self pullCompositeFromHref:pushedComposite.href minimal:NO];
+        }];
+        [self measure:@"resolvePull" block:^{
+            NSError *error = nil;
+            XCTAssertTrue([composite resolvePullWithBranch:nil withError:&error], @"%@", error);
+        }];
+        XCTAssertEqual([composite.current getAllComponents].count, [pushedComposite.current getAllComponents].count);
+        XCTAssertEqual([composite verifyIntegrityWithLogging:YES shouldBeComplete:YES].count, 0);
+    }
+}
+
+/*
+ * Pulls just the manifest of a pushed composite into new local composites.
+ */
+- (void)testBenchmarkPullMinimalComposite {
+    NSUInteger iterations = benchmarkParameter(@"DCX_BENCHMARK_ITERATIONS", 5);
+    DCXComposite *pushedComposite = [self createSyntheticComposite];
+    [self pushAndAcceptComposite:pushedComposite];
+
+    for (NSUInteger i = 0; i < iterations; i++) {
+        [self measure:@"pullMinimal" block:^{
+            [self pullCompositeFromHref:pushedComposite.href minimal:YES];
+        }];
+    }
+}
+
+/*
+ * Verifies that a push that fails because of server errors can be completed by pushing again.
+ */
+- (void)testPushAfterInjectedErrors {
+    DCXComposite *composite = [self createSyntheticComposite];
+    __block NSUInteger uploadCount = 0;
+    _session.errorInjector = ^NSError *(NSString *requestKind, NSString *href) {
+        if ([requestKind isEqualToString:@"uploadComponent"] && ++uploadCount % 5 == 0) {
+            return [NSError errorWithDomain:DCXErrorDomain code:DCXErrorUnexpectedResponse
+                                   userInfo:@{ DCXHTTPStatusKey: @500 }];
+        }
+        return nil;
+    };
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"push"];
+    [DCXCompositeXfer pushComposite:composite usingSession:_session requestPriority:NSOperationQueuePriorityNormal
+                       handlerQueue:nil completionHandler:^(BOOL success, NSError *error) {
+                           XCTAssertFalse(success);
+                           [expectation fulfill];
+                       }];
+    [self waitForExpectationsWithTimeout:600 handler:nil];
+
+    _session.errorInjector = nil;
+    [self pushAndAcceptComposite:composite];
+
+    DCXComposite *pulledComposite = [self pullCompositeFromHref:composite.href minimal:NO];
+    NSError *error = nil;
+    XCTAssertTrue([pulledComposite resolvePullWithBranch:nil withError:&error], @"%@", error);
+    XCTAssertEqual([pulledComposite.current getAllComponents].count, [composite.current getAllComponents].count);
+}
+
+@end
@@ -23,6 +23,86 @@
 #import <Cocoa/Cocoa.h>
 #import <XCTest/XCTest.h>
 #import "DCX.h"
+#import "DCXManifest.h"
+#import "DCXConstants_Internal.h"
+#import "DCXComposite_Internal.h"
+#import "DCXManifestReader.h"
+#import "DCXManifestDiff.h"
+#import "DCXManifestMerger.h"
+#import "DCXPushJournal.h"
+#import "DCXPullJournal.h"
+#import "DCXLocalStorage.h"
+#import "DCXFileUtils.h"
+#import "DCXConcurrencyController.h"
+#import "DCXChunkedUpload.h"
+#import "DCXRequestOperation.h"
+
+extern const NSTimeInterval DCXHTTPServiceMaxRetryAfterDelay;
+
+// The retry policy of DCXHTTPService
+@interface DCXHTTPService (RetryTesting)
+
+- (NSTimeInterval)retryAfterDelayOfResponse:(DCXHTTPResponse *)response;
+
+- (BOOL)shouldRetryOperation:(DCXRequestOperation *)requestOperation
+               afterResponse:(DCXHTTPResponse *)response
+                     forHost:(NSString *)host
+                   withDelay:(NSTimeInterval *)delayPtr;
+
+- (void)replenishRetryBudgetForHost:(NSString *)host;
+
+@end
+
+static NSString *const DCXRetryTestHost = @"retry.test";
+
+// The paths of the requests to DCXRetryTestHost in the order they have arrived. Guarded by itself.
+static NSMutableArray *DCXRetryTestRequestPaths;
+
+// Returns the response to a request to DCXRetryTestHost given the number of earlier requests to its path.
+static NSHTTPURLResponse *(^DCXRetryTestResponder)(NSURL *URL, NSUInteger attempt);
+
+static NSHTTPURLResponse *DCXRetryTestResponse(NSURL *URL, NSInteger statusCode, NSDictionary *headers)
+{
+    return [[NSHTTPURLResponse alloc] initWithURL:URL statusCode:statusCode HTTPVersion:@"HTTP/1.1" headerFields:headers];
+}
+
+// Answers requests to DCXRetryTestHost without going to the network.
+@interface DCXRetryTestURLProtocol : NSURLProtocol
+@end
+
+@implementation DCXRetryTestURLProtocol
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request
+{
+    return [request.URL.host isEqualToString:DCXRetryTestHost];
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request
+{
+    return request;
+}
+
+- (void)startLoading
+{
+    NSString *path = self.request.URL.path;
+    NSUInteger attempt;
+    @synchronized(DCXRetryTestRequestPaths) {
+        attempt = [DCXRetryTestRequestPaths indexesOfObjectsPassingTest:^BOOL(NSString *p, NSUInteger idx, BOOL *stop) {
+            return [p isEqualToString:path];
+        }].count;
+        [DCXRetryTestRequestPaths addObject:path];
+    }
+    NSHTTPURLResponse *response = DCXRetryTestResponder(self.request.URL, attempt);
+    [self.client URLProtocol:self didReceiveResponse:response cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+    [self.client URLProtocol:self didLoadData:[NSData data]];
+    [self.client URLProtocolDidFinishLoading:self];
+}
+
+- (void)stopLoading
+{
+}
+
+@end
 
 @interface DigitalCompositesOSXTests : XCTestCase
 
@@ -68,6 +148,28 @@
     return nil;
 }
 
+// Creates a service whose requests to DCXRetryTestHost get answered by DCXRetryTestResponder.
+-(DCXHTTPService*) createRetryTestService
+{
+    DCXRetryTestRequestPaths = [NSMutableArray array];
+    [NSURLProtocol registerClass:[DCXRetryTestURLProtocol class]];
+    DCXHTTPService *service = [[DCXHTTPService alloc] initWithUrl:[NSURL URLWithString:[NSString stringWithFormat:@"https://%@/", DCXRetryTestHost]]
+                                            additionalHTTPHeaders:nil];
+    service.authToken = @"token";
+    // Failures of the retried requests must not disconnect the service
+    service.recentErrorThresholdToDisconnect = 1000;
+    return service;
+}
+
+// Issues a GET request for the path to a service created with createRetryTestService.
+-(void) getPath:(NSString*)path fromRetryTestService:(DCXHTTPService*)service
+  completionHandler:(void (^)(DCXHTTPResponse *))handler
+{
+    NSURL *URL = [NSURL URLWithString:path relativeToURL:service.baseURL];
+    [service getResponseForDataRequest:[NSURLRequest requestWithURL:URL] requestPriority:NSOperationQueuePriorityNormal
+                     completionHandler:handler];
+}
+
 -(NSString*) pathForTestAsset:(NSString*)nameOfTestAsset
 {
     NSString* xcTestBundlePath = nil;
@@ -89,6 +191,8 @@
 }
 
 - (void)tearDown {
+    [NSURLProtocol unregisterClass:[DCXRetryTestURLProtocol class]];
+    DCXRetryTestResponder = nil;
     if (_tempPath != nil) {
         // delete the temp directory
         [_fm removeItemAtPath:_tempPath error:nil];
@@ -225,6 +329,1470 @@
     XCTAssertEqual(problems.count, 0);
 }
 
+/*
+ * Moves and removes nodes and components and verifies that lookups of parents still work.
+ */
+- (void)testFindParentsAfterEditing {
+    NSError *error = nil;
+    DCXComposite *composite = [DCXComposite compositeWithName:@"n" andType:@"t" andPath:nil andId:nil andHref:nil];
+    composite.path = [[self createTemporaryDirectoryWithError:&error] stringByAppendingPathComponent:composite.compositeId];
+    DCXMutableBranch *current = composite.current;
+    NSString *testAssetPath = [self pathForTestAsset:@"Component.png"];
+    
+    DCXNode *pagesNode = [current addChild:[DCXMutableNode nodeWithType:@"nt1" path:@"pages" name:@"nn1"]
+                                  toParent:current.rootNode withError:&error];
+    XCTAssertNil(error);
+    NSMutableArray *pages = [NSMutableArray array];
+    NSMutableArray *renditions = [NSMutableArray array];
+    for (int i = 0; i < 5; i++) {
+        DCXNode *page = [current addChild:[DCXMutableNode nodeWithType:@"nt2" path:[NSString stringWithFormat:@"page %d", i] name:@"nn2"]
+                                 toParent:pagesNode withError:&error];
+        XCTAssertNil(error);
+        [pages addObject:page];
+        DCXComponent *rendition = [current addComponent:@"cn" withId:nil withType:@"image/png"
+                                       withRelationship:@"rendition" withPath:@"rendition.png"
+                                                toChild:page fromFile:testAssetPath copy:YES
+                                              withError:&error];
+        XCTAssertNil(error);
+        [renditions addObject:rendition];
+    }
+    
+    // Remove a page in the middle so that the indexes of its siblings change
+    [current removeChild:pages[1]];
+    XCTAssertNil([current getChildWithId:[pages[1] nodeId]]);
+    XCTAssertNil([current findParentOfComponent:renditions[1]]);
+    NSUInteger index = NSNotFound;
+    XCTAssertEqualObjects([current findParentOfChild:pages[3] foundIndex:&index].nodeId, pagesNode.nodeId);
+    XCTAssertEqual(index, 2);
+    
+    // Move a page to the root and a component to a different page
+    DCXNode *movedPage = [current moveChild:pages[4] toParent:current.rootNode toIndex:0 withError:&error];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects([current findParentOfChild:movedPage foundIndex:&index].nodeId, current.rootNode.nodeId);
+    XCTAssertEqual(index, 0);
+    DCXComponent *movedComponent = [current moveComponent:renditions[2] toChild:pages[0] withError:&error];
+    XCTAssertNil(error);
+    XCTAssertNil(movedComponent); // page 0 already has a rendition.png
+    XCTAssertNotNil(error);
+    error = nil;
+    movedComponent = [current moveComponent:renditions[2] toChild:pagesNode withError:&error];
+    XCTAssertNotNil(movedComponent);
+    XCTAssertEqualObjects([current findParentOfComponent:movedComponent].nodeId, pagesNode.nodeId);
+    XCTAssertEqualObjects([current findParentOfComponent:renditions[4]].nodeId, movedPage.nodeId);
+    
+    // Update a component and a node and make sure that they can still be found
+    DCXComponent *updatedComponent = [current updateComponent:renditions[3] fromFile:testAssetPath copy:YES withError:&error];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects([current findParentOfComponent:updatedComponent].nodeId, [pages[3] nodeId]);
+    DCXMutableNode *updatedPage = [pages[3] mutableCopy];
+    updatedPage.path = @"renamed";
+    XCTAssertNotNil([current updateChild:updatedPage withError:&error]);
+    XCTAssertNil(error);
+    XCTAssertEqual([current getComponentsOf:updatedPage].count, 1);
+    XCTAssertNotNil([current getComponentWithAbsolutePath:@"/pages/renamed/rendition.png"]);
+    
+    [composite commitChangesWithError:&error];
+    XCTAssertNil(error);
+    
+    NSArray *problems = [composite verifyIntegrityWithLogging:YES shouldBeComplete:YES];
+    XCTAssertEqual(problems.count, 0);
+}
+
+/*
+ * Commits changes incrementally and verifies that reloading the composite replays the commit log.
+ */
+- (void)testCommitIncrementally {
+    NSError *error = nil;
+    NSString *compositePath = [self createTemporaryDirectoryWithContents:[self pathForTestAsset:@"unbound/"] withError:&error];
+    XCTAssertNil(error);
+    DCXComposite *composite = [DCXComposite compositeFromPath:compositePath withError:&error];
+    XCTAssertNil(error);
+    composite.commitsIncrementally = YES;
+    DCXMutableBranch *current = composite.current;
+    NSString *manifestPath = [compositePath stringByAppendingPathComponent:@"manifest"];
+    NSData *manifestData = [NSData dataWithContentsOfFile:manifestPath];
+    
+    // Edit a node, add a node and move a component
+    DCXMutableNode *pageNode = [[current getChildWithAbsolutePath:@"/pages/page 1"] mutableCopy];
+    [pageNode setValue:@"v" forKey:@"custom#key"];
+    XCTAssertNotNil([current updateChild:pageNode withError:&error]);
+    XCTAssertNil(error);
+    [composite commitChangesWithError:&error];
+    XCTAssertNil(error);
+    DCXNode *newNode = [current addChild:[DCXMutableNode nodeWithType:@"nt" path:@"new" name:@"nn"]
+                                toParent:[current getChildWithAbsolutePath:@"/pages"] withError:&error];
+    XCTAssertNil(error);
+    DCXComponent *pageComponent = [current getComponentWithAbsolutePath:@"/pages/page 1/rendition.png"];
+    XCTAssertNotNil([current moveComponent:pageComponent toChild:newNode withError:&error]);
+    XCTAssertNil(error);
+    [composite commitChangesWithError:&error];
+    XCTAssertNil(error);
+    
+    // Add a component to the root and then only edit a child node again
+    DCXComponent *rootComponent = [current addComponent:@"root" withId:nil withType:@"image/png"
+                                       withRelationship:@"rendition" withPath:@"root.png" toChild:current.rootNode
+                                               fromFile:[self pathForTestAsset:@"Component.png"] copy:YES withError:&error];
+    XCTAssertNotNil(rootComponent, @"%@", error);
+    [composite commitChangesWithError:&error];
+    XCTAssertNil(error);
+    NSString *logPath = [manifestPath stringByAppendingPathExtension:@"log"];
+    NSString *lastRecord = [[NSString stringWithContentsOfFile:logPath encoding:NSUTF8StringEncoding error:nil]
+                            componentsSeparatedByString:@"\n"].lastObject;
+    NSDictionary *record = [NSJSONSerialization JSONObjectWithData:[lastRecord dataUsingEncoding:NSUTF8StringEncoding]
+                                                           options:0 error:&error];
+    XCTAssertNotNil(record, @"%@", error);
+    // Only the local data of the new component gets logged, not the whole lookup table
+    XCTAssertEqual([record[@"local-changes"][DCXLocalStorageAssetIdMapManifestKey] count], 1);
+    XCTAssertNil(record[@"nodes"][0][DCXLocalDataManifestKey][DCXLocalStorageAssetIdMapManifestKey]);
+    [pageNode setValue:@"w" forKey:@"custom#key"];
+    XCTAssertNotNil([current updateChild:pageNode withError:&error]);
+    [composite commitChangesWithError:&error];
+    XCTAssertNil(error);
+    
+    // The manifest file must not have been rewritten
+    XCTAssertEqualObjects([NSData dataWithContentsOfFile:manifestPath], manifestData);
+    XCTAssertTrue([_fm fileExistsAtPath:logPath]);
+    
+    DCXComposite *reloaded = [DCXComposite compositeFromPath:compositePath withError:&error];
+    XCTAssertNil(error);
+    XCTAssertNotNil([reloaded.current pathForComponent:[reloaded.current getComponentWithId:rootComponent.componentId]
+                                             withError:&error], @"%@", error);
+    XCTAssertEqualObjects([[reloaded.current getChildWithAbsolutePath:@"/pages/page 1"] valueForKey:@"custom#key"], @"w");
+    XCTAssertNotNil([reloaded.current getComponentWithAbsolutePath:@"/pages/new/rendition.png"]);
+    XCTAssertNil([reloaded.current getComponentWithAbsolutePath:@"/pages/page 1/rendition.png"]);
+    
+    NSArray *problems = [reloaded verifyIntegrityWithLogging:YES shouldBeComplete:YES];
+    XCTAssertEqual(problems.count, 0);
+}
+
+/*
+ * Adds the same file twice to a composite that stores its components by content and verifies that
+ * both components share one local file which survives the eviction of either component.
+ */
+- (void)testStoreComponentsByContent {
+    NSError *error = nil;
+    DCXComposite *composite = [DCXComposite compositeWithName:@"n" andType:@"t" andPath:nil andId:nil andHref:nil];
+    composite.path = [[self createTemporaryDirectoryWithError:&error] stringByAppendingPathComponent:composite.compositeId];
+    XCTAssertNil(error);
+    composite.storesComponentsByContent = YES;
+    DCXMutableBranch *current = composite.current;
+    
+    NSString *testAssetPath = [self pathForTestAsset:@"Component.png"];
+    DCXComponent *first = [current addComponent:@"cn1" withId:nil withType:@"image/png"
+                               withRelationship:@"rendition" withPath:@"first.png"
+                                        toChild:current.rootNode fromFile:testAssetPath copy:YES
+                                      withError:&error];
+    XCTAssertNil(error);
+    DCXComponent *second = [current addComponent:@"cn2" withId:nil withType:@"image/png"
+                                withRelationship:@"rendition" withPath:@"second.png"
+                                         toChild:current.rootNode fromFile:testAssetPath copy:YES
+                                       withError:&error];
+    XCTAssertNil(error);
+    [composite commitChangesWithError:&error];
+    XCTAssertNil(error);
+    
+    NSString *firstPath = [current pathForComponent:first withError:&error];
+    NSString *secondPath = [current pathForComponent:second withError:&error];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects(firstPath, secondPath);
+    XCTAssertTrue([_fm contentsEqualAtPath:firstPath andPath:testAssetPath]);
+    // Writing to the shared file in place would change both components
+    XCTAssertEqual([[_fm attributesOfItemAtPath:firstPath error:nil] filePosixPermissions] & 0222, 0);
+    
+    // Evicting one of the components must not remove the file of the other one. Components with
+    // local changes cannot be evicted so we pretend that both have been pushed.
+    for (DCXComponent *component in @[first, second]) {
+        DCXMutableComponent *pushedComponent = [component mutableCopy];
+        pushedComponent.state = DCXAssetStateUnmodified;
+        XCTAssertNotNil([current updateComponent:pushedComponent fromFile:nil copy:NO withError:&error]);
+        XCTAssertNil(error);
+    }
+    [composite commitChangesWithError:&error];
+    XCTAssertNil(error);
+    NSArray *errors = nil;
+    [composite removeLocalFilesForComponentsWithIDs:@[first.componentId] errorList:&errors];
+    XCTAssertNil(errors);
+    XCTAssertTrue([_fm fileExistsAtPath:secondPath]);
+    XCTAssertEqualObjects([current pathForComponent:second withError:&error], secondPath);
+    
+    // The file goes away together with its last reference
+    [composite removeLocalFilesForComponentsWithIDs:@[second.componentId] errorList:&errors];
+    XCTAssertNil(errors);
+    XCTAssertFalse([_fm fileExistsAtPath:secondPath]);
+}
+
+/*
+ * Removes unused local files based on the index and verifies that a full scan catches the files that the
+ * index doesn't know about.
+ */
+- (void)testRemoveUnusedLocalFilesIncrementally {
+    NSError *error = nil;
+    DCXComposite *composite = [DCXComposite compositeWithName:@"n" andType:@"t" andPath:nil andId:nil andHref:nil];
+    composite.path = [[self createTemporaryDirectoryWithError:&error] stringByAppendingPathComponent:composite.compositeId];
+    composite.autoRemoveUnusedLocalFiles = NO;
+    composite.unusedLocalFilesScanInterval = 0;
+    DCXMutableBranch *current = composite.current;
+
+    NSString *testAssetPath = [self pathForTestAsset:@"Component.png"];
+    NSMutableArray *components = [NSMutableArray array];
+    for (int i = 0; i < 2; i++) {
+        DCXComponent *component = [current addComponent:@"cn" withId:nil withType:@"image/png"
+                                       withRelationship:@"rendition" withPath:[NSString stringWithFormat:@"c%d.png", i]
+                                                toChild:current.rootNode fromFile:testAssetPath copy:YES
+                                              withError:&error];
+        XCTAssertNil(error);
+        [components addObject:component];
+    }
+    [composite commitChangesWithError:&error];
+    XCTAssertNil(error);
+    XCTAssertNotNil([composite removeUnusedLocalFilesWithError:&error]);
+    XCTAssertNil(error);
+    XCTAssertTrue([_fm fileExistsAtPath:[composite.path stringByAppendingPathComponent:@"components.index"]]);
+
+    // Files only get removed if they are older than the manifests
+    NSString *removedPath = [current pathForComponent:components[0] withError:&error];
+    NSString *keptPath = [current pathForComponent:components[1] withError:&error];
+    NSString *strayPath = [[removedPath stringByDeletingLastPathComponent] stringByAppendingPathComponent:@"stray.png"];
+    XCTAssertTrue([_fm copyItemAtPath:testAssetPath toPath:strayPath error:&error]);
+    NSDictionary *oldDate = @{NSFileModificationDate: [NSDate dateWithTimeIntervalSinceNow:-3600]};
+    for (NSString *path in @[removedPath, keptPath, strayPath]) {
+        XCTAssertTrue([_fm setAttributes:oldDate ofItemAtPath:path error:&error]);
+    }
+
+    // The incremental pass only looks at the file that has lost its reference
+    [current removeComponent:components[0]];
+    [composite commitChangesWithError:&error];
+    XCTAssertNil(error);
+    XCTAssertNotNil([composite removeUnusedLocalFilesWithError:&error]);
+    XCTAssertNil(error);
+    XCTAssertFalse([_fm fileExistsAtPath:removedPath]);
+    XCTAssertTrue([_fm fileExistsAtPath:keptPath]);
+    XCTAssertTrue([_fm fileExistsAtPath:strayPath]);
+
+    // The full scan removes the file that has never been referenced
+    XCTAssertNotNil([DCXLocalStorage removeAllUnusedLocalFilesOfComposite:composite withError:&error]);
+    XCTAssertNil(error);
+    XCTAssertFalse([_fm fileExistsAtPath:strayPath]);
+    XCTAssertTrue([_fm fileExistsAtPath:keptPath]);
+}
+
+/*
+ * Puts a composite over its storage quota and verifies that the file of the least recently used
+ * component gets evicted.
+ */
+- (void)testEvictLeastRecentlyUsedComponents {
+    NSError *error = nil;
+    NSString *rootPath = [self createTemporaryDirectoryWithError:&error];
+    DCXComposite *composite = [DCXComposite compositeWithName:@"n" andType:@"t" andPath:nil andId:nil andHref:nil];
+    composite.path = [rootPath stringByAppendingPathComponent:composite.compositeId];
+    composite.autoRemoveUnusedLocalFiles = NO;
+    DCXMutableBranch *current = composite.current;
+
+    // Only components that have been pushed can be evicted so we pretend that they have been
+    NSString *testAssetPath = [self pathForTestAsset:@"Component.png"];
+    NSMutableArray *components = [NSMutableArray array];
+    for (int i = 0; i < 3; i++) {
+        DCXComponent *component = [current addComponent:@"cn" withId:nil withType:@"image/png"
+                                       withRelationship:@"rendition" withPath:[NSString stringWithFormat:@"c%d.png", i]
+                                                toChild:current.rootNode fromFile:testAssetPath copy:YES
+                                              withError:&error];
+        XCTAssertNil(error);
+        DCXMutableComponent *pushedComponent = [component mutableCopy];
+        pushedComponent.state = DCXAssetStateUnmodified;
+        pushedComponent.etag = @"etag";
+        XCTAssertNotNil([current updateComponent:pushedComponent fromFile:nil copy:NO withError:&error]);
+        [components addObject:component];
+    }
+    current.etag = @"etag";
+    [composite commitChangesWithError:&error];
+    XCTAssertNil(error);
+
+    DCXStorageQuotaManager *quotaManager = [[DCXStorageQuotaManager alloc] initWithRootPath:rootPath byteBudget:ULLONG_MAX];
+    [quotaManager addComposite:composite];
+    XCTAssertEqual(composite.storageQuotaManager, quotaManager);
+    unsigned long long consumed = quotaManager.bytesConsumed;
+    XCTAssertEqual([[quotaManager enforceBudgetWithError:&error] unsignedLongLongValue], 0);
+
+    // Components that haven't been used count as used when their file was written
+    XCTAssertNotNil([current pathForComponent:components[0] withError:&error]);
+    XCTAssertNotNil([current pathForComponent:components[2] withError:&error]);
+    quotaManager.byteBudget = consumed - 1;
+
+    // Composites with an active push or pull are left alone
+    [composite pullDidStart];
+    XCTAssertEqual([[quotaManager enforceBudgetWithError:&error] unsignedLongLongValue], 0);
+    [composite pullDidFinish];
+    composite.activePushManifest = current.manifest;
+    XCTAssertEqual([[quotaManager enforceBudgetWithError:&error] unsignedLongLongValue], 0);
+    composite.activePushManifest = nil;
+
+    NSNumber *bytesFreed = [quotaManager enforceBudgetWithError:&error];
+    XCTAssertNil(error);
+    XCTAssertEqual(bytesFreed.unsignedLongLongValue, [_fm attributesOfItemAtPath:testAssetPath error:nil].fileSize);
+    XCTAssertNil([current pathForComponent:components[1] withError:&error]);
+    XCTAssertNotNil([current pathForComponent:components[0] withError:&error]);
+    XCTAssertNotNil([current pathForComponent:components[2] withError:&error]);
+    XCTAssertLessThanOrEqual(quotaManager.bytesConsumed, quotaManager.byteBudget);
+
+    // The count kept up to date by the eviction matches a fresh measurement
+    XCTAssertEqual(quotaManager.bytesConsumed, consumed - bytesFreed.unsignedLongLongValue);
+    XCTAssertEqual(quotaManager.bytesConsumed, composite.localStorageBytesConsumed.unsignedLongLongValue);
+
+    [quotaManager writeAccessTimes];
+    XCTAssertTrue([_fm fileExistsAtPath:[rootPath stringByAppendingPathComponent:@"component-access-times.json"]]);
+}
+
+/*
+ * Fetches the path of a component whose file is available locally, which must not require a download.
+ */
+- (void)testFetchPathOfLocalComponent {
+    NSError *error = nil;
+    DCXComposite *composite = [DCXComposite compositeWithName:@"n" andType:@"t" andPath:nil andId:nil andHref:nil];
+    composite.path = [self createTemporaryDirectoryWithError:&error];
+    composite.autoRemoveUnusedLocalFiles = NO;
+    DCXMutableBranch *current = composite.current;
+    DCXComponent *component = [current addComponent:@"cn" withId:nil withType:@"image/png"
+                                   withRelationship:@"rendition" withPath:@"c.png"
+                                            toChild:current.rootNode fromFile:[self pathForTestAsset:@"Component.png"]
+                                               copy:YES withError:&error];
+    XCTAssertNil(error);
+
+    __block NSString *fetchedPath = nil;
+    __block BOOL handlerCalled = NO;
+    DCXHTTPRequest *request = [current fetchPathForComponent:component usingSession:nil
+                                             requestPriority:NSOperationQueuePriorityHigh handlerQueue:nil
+                                           completionHandler:^(NSString *path, NSError *fetchError) {
+                                               XCTAssertNil(fetchError);
+                                               fetchedPath = path;
+                                               handlerCalled = YES;
+                                           }];
+    XCTAssertNil(request);
+    XCTAssertTrue(handlerCalled);
+    XCTAssertEqualObjects(fetchedPath, [current pathForComponent:component withError:&error]);
+}
+
+/*
+ * Evaluates the criteria and ranking of a DCXComponentPrefetchPolicy.
+ */
+- (void)testComponentPrefetchPolicy {
+    NSError *error = nil;
+    DCXComposite *composite = [DCXComposite compositeWithName:@"n" andType:@"t" andPath:nil andId:nil andHref:nil];
+    composite.path = [[self createTemporaryDirectoryWithError:&error] stringByAppendingPathComponent:composite.compositeId];
+    DCXMutableBranch *current = composite.current;
+    NSString *testAssetPath = [self pathForTestAsset:@"Component.png"];
+
+    DCXNode *pagesNode = [current addChild:[DCXMutableNode nodeWithType:@"nt1" path:@"pages" name:@"nn1"]
+                                  toParent:current.rootNode withError:&error];
+    DCXNode *pageNode = [current addChild:[DCXMutableNode nodeWithType:@"nt2" path:@"page 1" name:@"nn2"]
+                                 toParent:pagesNode withError:&error];
+    XCTAssertNil(error);
+    DCXComponent *thumbnail = [current addComponent:@"cn" withId:nil withType:@"image/png"
+                                   withRelationship:@"thumbnail" withPath:@"thumbnail.png"
+                                            toChild:current.rootNode fromFile:testAssetPath copy:YES
+                                          withError:&error];
+    DCXComponent *rendition = [current addComponent:@"cn" withId:nil withType:@"image/png"
+                                   withRelationship:@"rendition" withPath:@"rendition.png"
+                                            toChild:pageNode fromFile:testAssetPath copy:YES
+                                          withError:&error];
+    DCXComponent *primary = [current addComponent:@"cn" withId:nil withType:@"application/pdf"
+                                 withRelationship:@"primary" withPath:@"page.pdf"
+                                          toChild:pageNode fromFile:testAssetPath copy:YES
+                                        withError:&error];
+    XCTAssertNil(error);
+
+    DCXComponentPrefetchPolicy *policy = [[DCXComponentPrefetchPolicy alloc] init];
+    XCTAssertTrue([policy shouldPrefetchComponent:primary ofBranch:current]);
+
+    policy.nodeIds = [NSSet setWithObject:pagesNode.nodeId];
+    XCTAssertFalse([policy shouldPrefetchComponent:thumbnail ofBranch:current]);
+    XCTAssertTrue([policy shouldPrefetchComponent:rendition ofBranch:current]);
+    XCTAssertTrue([policy shouldPrefetchComponent:primary ofBranch:current]);
+
+    policy.types = [NSSet setWithObject:@"image/*"];
+    XCTAssertTrue([policy shouldPrefetchComponent:rendition ofBranch:current]);
+    XCTAssertFalse([policy shouldPrefetchComponent:primary ofBranch:current]);
+
+    policy.nodeIds = nil;
+    policy.relationships = [NSSet setWithObject:@"thumbnail"];
+    XCTAssertTrue([policy shouldPrefetchComponent:thumbnail ofBranch:current]);
+    XCTAssertFalse([policy shouldPrefetchComponent:rendition ofBranch:current]);
+
+    policy.relationships = nil;
+    XCTAssertNotNil(thumbnail.length);
+    policy.maxLength = @(thumbnail.length.unsignedLongLongValue - 1);
+    XCTAssertFalse([policy shouldPrefetchComponent:thumbnail ofBranch:current]);
+
+    policy.rankedRelationships = @[ @"thumbnail", @"rendition" ];
+    XCTAssertEqual([policy prefetchRankOfComponent:thumbnail ofBranch:current], 0);
+    XCTAssertEqual([policy prefetchRankOfComponent:rendition ofBranch:current], 1);
+    XCTAssertEqual([policy prefetchRankOfComponent:primary ofBranch:current], 2);
+}
+
+/*
+ * Adds and updates a component and verifies that the digest of its local file gets tracked.
+ */
+- (void)testRecordComponentDigests {
+    NSError *error = nil;
+    DCXComposite *composite = [DCXComposite compositeWithName:@"n" andType:@"t" andPath:nil andId:nil andHref:nil];
+    NSString *tempPath = [self createTemporaryDirectoryWithError:&error];
+    composite.path = [tempPath stringByAppendingPathComponent:composite.compositeId];
+    XCTAssertNil(error);
+    DCXMutableBranch *current = composite.current;
+    
+    NSString *testAssetPath = [self pathForTestAsset:@"Component.png"];
+    DCXComponent *component = [current addComponent:@"cn" withId:nil withType:@"image/png"
+                                   withRelationship:@"rendition" withPath:@"rendition.png"
+                                            toChild:current.rootNode fromFile:testAssetPath copy:YES
+                                          withError:&error];
+    XCTAssertNil(error);
+    NSString *digest = [DCXLocalStorage digestOfComponent:component inManifest:current.manifest ofComposite:composite];
+    XCTAssertEqual(digest.length, 64);
+    XCTAssertEqualObjects(digest, [DCXFileUtils sha256DigestOfFile:testAssetPath withError:nil]);
+    
+    NSString *otherFilePath = [tempPath stringByAppendingPathComponent:@"other.png"];
+    XCTAssertTrue([[@"other" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:otherFilePath atomically:YES]);
+    component = [current updateComponent:component fromFile:otherFilePath copy:YES withError:&error];
+    XCTAssertNil(error);
+    NSString *otherDigest = [DCXLocalStorage digestOfComponent:component inManifest:current.manifest ofComposite:composite];
+    XCTAssertNotEqualObjects(otherDigest, digest);
+    XCTAssertEqualObjects(otherDigest, [DCXFileUtils sha256DigestOfFile:otherFilePath withError:nil]);
+}
+
+/*
+ * Feeds request and phase metrics into an aggregator and verifies the percentiles it computes.
+ */
+- (void)testTransferMetricsAggregator {
+    DCXTransferMetricsAggregator *aggregator = [[DCXTransferMetricsAggregator alloc] init];
+    for (int i = 1; i <= 100; i++) {
+        DCXRequestMetrics *metrics = [[DCXRequestMetrics alloc] init];
+        metrics.kind = DCXRequestMetricsKindUpload;
+        metrics.requestDuration = i / 100.0;
+        metrics.bytesSent = 1000 * i;
+        metrics.retryCount = (i % 10 == 0 ? 1 : 0);
+        [aggregator didFinishRequestWithMetrics:metrics];
+    }
+    [aggregator didFinishPhase:DCXTransferPhasePush ofComposite:@"id" withDuration:2];
+
+    XCTAssertEqual(aggregator.requestCount, 100);
+    XCTAssertEqual(aggregator.retriedRequestCount, 10);
+    XCTAssertEqual(aggregator.failedRequestCount, 0);
+
+    // A request that fails with a server error and gets retried twice counts as one retried request
+    for (NSUInteger retryCount = 0; retryCount < 3; retryCount++) {
+        DCXRequestMetrics *metrics = [[DCXRequestMetrics alloc] init];
+        metrics.kind = DCXRequestMetricsKindData;
+        metrics.statusCode = retryCount < 2 ? 503 : 200;
+        metrics.retryCount = retryCount;
+        metrics.willRetry = retryCount < 2;
+        [aggregator didFinishRequestWithMetrics:metrics];
+    }
+    XCTAssertEqual(aggregator.requestCount, 103);
+    XCTAssertEqual(aggregator.retriedRequestCount, 11);
+    XCTAssertEqual(aggregator.failedRequestCount, 2);
+
+    DCXMetricsHistogram *durations = [aggregator histogramForKey:@"upload.duration"];
+    XCTAssertEqual(durations.count, 100);
+    XCTAssertEqualWithAccuracy([durations valueAtPercentile:0.5], 0.5, 0.5 * 0.03);
+    XCTAssertEqualWithAccuracy([durations valueAtPercentile:0.95], 0.95, 0.95 * 0.03);
+    XCTAssertEqualWithAccuracy([durations valueAtPercentile:0.99], 0.99, 0.99 * 0.03);
+    XCTAssertEqualWithAccuracy([durations valueAtPercentile:1], 1, 0.03);
+    XCTAssertEqualWithAccuracy([[aggregator histogramForKey:@"upload.bytes"] valueAtPercentile:0.5], 50000, 50000 * 0.03);
+    XCTAssertEqualWithAccuracy([[aggregator histogramForKey:DCXTransferPhasePush] valueAtPercentile:0.5], 2, 2 * 0.03);
+    XCTAssertNil([aggregator histogramForKey:@"download.duration"]);
+    XCTAssertTrue([aggregator.summary containsString:@"upload.duration: count 100"]);
+
+    [aggregator reset];
+    XCTAssertEqual(aggregator.requestCount, 0);
+    XCTAssertEqual(aggregator.histogramKeys.count, 0);
+}
+
+/*
+ * Feeds successful requests into a concurrency controller and verifies that its limit grows by
+ * about one per window of requests and stays within its bounds.
+ */
+- (void)testConcurrencyAdditiveIncrease {
+    NSOperationQueue *queue = [[NSOperationQueue alloc] init];
+    queue.maxConcurrentOperationCount = 1;
+    DCXConcurrencyController *controller = [[DCXConcurrencyController alloc] initWithQueue:queue normalizeByBytes:NO];
+    XCTAssertEqual(controller.limit, 1);
+
+    [controller requestDidFinishWithDuration:0.1 transferredBytes:0 statusCode:200 error:nil growthPaused:NO];
+    XCTAssertEqual(controller.limit, 2);
+    [controller requestDidFinishWithDuration:0.1 transferredBytes:0 statusCode:200 error:nil growthPaused:NO];
+    XCTAssertEqual(controller.limit, 2);
+    [controller requestDidFinishWithDuration:0.1 transferredBytes:0 statusCode:200 error:nil growthPaused:NO];
+    XCTAssertEqual(controller.limit, 3);
+    XCTAssertEqual(queue.maxConcurrentOperationCount, 3);
+
+    // Responses that don't indicate congestion count as successes
+    for (int i = 0; i < 4; i++) {
+        [controller requestDidFinishWithDuration:0.1 transferredBytes:0 statusCode:404 error:nil growthPaused:NO];
+    }
+    XCTAssertEqual(controller.limit, 4);
+
+    // No growth while paused
+    for (int i = 0; i < 10; i++) {
+        [controller requestDidFinishWithDuration:0.1 transferredBytes:0 statusCode:200 error:nil growthPaused:YES];
+    }
+    XCTAssertEqual(controller.limit, 4);
+
+    // The limit never exceeds the maximum
+    for (int i = 0; i < 500; i++) {
+        [controller requestDidFinishWithDuration:0.1 transferredBytes:0 statusCode:200 error:nil growthPaused:NO];
+    }
+    XCTAssertEqual(controller.limit, controller.maxLimit);
+    XCTAssertEqual(queue.maxConcurrentOperationCount, controller.maxLimit);
+
+    // Explicitly set limits get clamped
+    controller.limit = 0;
+    XCTAssertEqual(controller.limit, 1);
+    controller.limit = controller.maxLimit + 10;
+    XCTAssertEqual(controller.limit, controller.maxLimit);
+    XCTAssertEqual(queue.maxConcurrentOperationCount, controller.maxLimit);
+}
+
+/*
+ * Feeds failed requests into a concurrency controller and verifies that its limit gets halved at
+ * most once per request latency and never drops below 1.
+ */
+- (void)testConcurrencyMultiplicativeDecreaseOnErrors {
+    NSOperationQueue *queue = [[NSOperationQueue alloc] init];
+    DCXConcurrencyController *controller = [[DCXConcurrencyController alloc] initWithQueue:queue normalizeByBytes:NO];
+    controller.limit = 8;
+
+    [controller requestDidFinishWithDuration:0.001 transferredBytes:0 statusCode:503 error:nil growthPaused:NO];
+    XCTAssertEqual(controller.limit, 4);
+    XCTAssertEqual(queue.maxConcurrentOperationCount, 4);
+
+    // A request that has been in flight together with the first one doesn't halve the limit again
+    [controller requestDidFinishWithDuration:10 transferredBytes:0 statusCode:429 error:nil growthPaused:NO];
+    XCTAssertEqual(controller.limit, 4);
+
+    controller.limit = 4;
+    NSError *networkError = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorTimedOut userInfo:nil];
+    for (NSNumber *expectedLimit in @[@2, @1, @1]) {
+        [NSThread sleepForTimeInterval:0.01];
+        [controller requestDidFinishWithDuration:0.001 transferredBytes:0 statusCode:0 error:networkError growthPaused:NO];
+        XCTAssertEqual(controller.limit, expectedLimit.integerValue);
+    }
+    XCTAssertEqual(queue.maxConcurrentOperationCount, 1);
+}
+
+/*
+ * Feeds requests that slow down into a concurrency controller and verifies that its limit gets
+ * halved once the smoothed cost exceeds congestionFactor times the baseline cost.
+ */
+- (void)testConcurrencyMultiplicativeDecreaseOnSlowness {
+    NSOperationQueue *queue = [[NSOperationQueue alloc] init];
+    DCXConcurrencyController *controller = [[DCXConcurrencyController alloc] initWithQueue:queue normalizeByBytes:NO];
+    XCTAssertEqual(controller.congestionFactor, DCXConcurrencyDefaultCongestionFactor);
+
+    // With a baseline of 0.1s one request of 1s raises the smoothed cost to 0.2125s.
+    controller.limit = 8;
+    controller.congestionFactor = 3;
+    [controller requestDidFinishWithDuration:0.1 transferredBytes:0 statusCode:200 error:nil growthPaused:YES];
+    [controller requestDidFinishWithDuration:1 transferredBytes:0 statusCode:200 error:nil growthPaused:YES];
+    XCTAssertEqual(controller.limit, 8);
+
+    controller.limit = 8;
+    controller.congestionFactor = 2;
+    [controller requestDidFinishWithDuration:0.1 transferredBytes:0 statusCode:200 error:nil growthPaused:YES];
+    [controller requestDidFinishWithDuration:1 transferredBytes:0 statusCode:200 error:nil growthPaused:YES];
+    XCTAssertEqual(controller.limit, 4);
+
+    // Transfers that take longer because they move more bytes aren't slow
+    DCXConcurrencyController *transferController = [[DCXConcurrencyController alloc] initWithQueue:queue normalizeByBytes:YES];
+    transferController.limit = 8;
+    [transferController requestDidFinishWithDuration:0.1 transferredBytes:64 * 1024 statusCode:200 error:nil growthPaused:YES];
+    [transferController requestDidFinishWithDuration:1 transferredBytes:640 * 1024 statusCode:200 error:nil growthPaused:YES];
+    XCTAssertEqual(transferController.limit, 8);
+}
+
+/*
+ * Parses the Retry-After header of responses in seconds and as an HTTP date.
+ */
+- (void)testRetryAfterDelayOfResponse {
+    DCXHTTPService *service = [[DCXHTTPService alloc] initWithUrl:[NSURL URLWithString:@"https://retry.test/"] additionalHTTPHeaders:nil];
+    DCXHTTPResponse *response = [[DCXHTTPResponse alloc] init];
+    XCTAssertEqual([service retryAfterDelayOfResponse:response], -1);
+
+    response.headers = @{@"retry-after": @"7"};
+    XCTAssertEqual([service retryAfterDelayOfResponse:response], 7);
+    response.headers = @{@"retry-after": @"soon"};
+    XCTAssertEqual([service retryAfterDelayOfResponse:response], -1);
+
+    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+    formatter.locale = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
+    formatter.timeZone = [NSTimeZone timeZoneWithAbbreviation:@"GMT"];
+    formatter.dateFormat = @"EEE',' dd MMM yyyy HH':'mm':'ss 'GMT'";
+    response.headers = @{@"retry-after": [formatter stringFromDate:[NSDate dateWithTimeIntervalSinceNow:30]]};
+    NSTimeInterval delay = [service retryAfterDelayOfResponse:response];
+    XCTAssertGreaterThan(delay, 28);
+    XCTAssertLessThanOrEqual(delay, 30);
+
+    // Dates in the past don't delay the retry
+    response.headers = @{@"retry-after": [formatter stringFromDate:[NSDate dateWithTimeIntervalSinceNow:-30]]};
+    XCTAssertEqual([service retryAfterDelayOfResponse:response], 0);
+}
+
+/*
+ * Verifies that retry delays get spread out between 50% and 150% of the configured delay, that a
+ * longer Retry-After wins and that a Retry-After above the maximum fails the request.
+ */
+- (void)testRetryDelay {
+    DCXHTTPService *service = [[DCXHTTPService alloc] initWithUrl:[NSURL URLWithString:@"https://retry.test/"] additionalHTTPHeaders:nil];
+    service.retryOn5xxDelays = @[@2];
+    DCXRequestOperation *operation = [[DCXRequestOperation alloc] init];
+    DCXHTTPResponse *response = [[DCXHTTPResponse alloc] init];
+
+    NSTimeInterval minDelay = DBL_MAX;
+    NSTimeInterval maxDelay = 0;
+    for (int i = 0; i < 200; i++) {
+        NSTimeInterval delay = -1;
+        XCTAssertTrue([service shouldRetryOperation:operation afterResponse:response forHost:nil withDelay:&delay]);
+        XCTAssertGreaterThanOrEqual(delay, 1);
+        XCTAssertLessThanOrEqual(delay, 3);
+        minDelay = MIN(minDelay, delay);
+        maxDelay = MAX(maxDelay, delay);
+    }
+    XCTAssertLessThan(minDelay, maxDelay);
+
+    NSTimeInterval delay = -1;
+    response.headers = @{@"retry-after": @"5"};
+    XCTAssertTrue([service shouldRetryOperation:operation afterResponse:response forHost:nil withDelay:&delay]);
+    XCTAssertEqual(delay, 5);
+
+    response.headers = @{@"retry-after": [NSString stringWithFormat:@"%d", (int)DCXHTTPServiceMaxRetryAfterDelay + 1]};
+    XCTAssertFalse([service shouldRetryOperation:operation afterResponse:response forHost:nil withDelay:&delay]);
+
+    // No more retries once the configured delays have been used up
+    response.headers = nil;
+    operation.retryCount = 1;
+    XCTAssertFalse([service shouldRetryOperation:operation afterResponse:response forHost:nil withDelay:&delay]);
+}
+
+/*
+ * Exhausts the retry budget of a host and replenishes it with successful requests.
+ */
+- (void)testRetryBudgetPerHost {
+    DCXHTTPService *service = [[DCXHTTPService alloc] initWithUrl:[NSURL URLWithString:@"https://retry.test/"] additionalHTTPHeaders:nil];
+    service.retryOn5xxDelays = @[@0];
+    DCXRequestOperation *operation = [[DCXRequestOperation alloc] init];
+    DCXHTTPResponse *response = [[DCXHTTPResponse alloc] init];
+    NSTimeInterval delay;
+
+    for (int i = 0; i < 10; i++) {
+        XCTAssertTrue([service shouldRetryOperation:operation afterResponse:response forHost:@"a" withDelay:&delay]);
+    }
+    XCTAssertFalse([service shouldRetryOperation:operation afterResponse:response forHost:@"a" withDelay:&delay]);
+
+    // Other hosts have budgets of their own
+    XCTAssertTrue([service shouldRetryOperation:operation afterResponse:response forHost:@"b" withDelay:&delay]);
+
+    // Each success refunds a tenth of a retry
+    for (int i = 0; i < 9; i++) {
+        [service replenishRetryBudgetForHost:@"a"];
+    }
+    XCTAssertFalse([service shouldRetryOperation:operation afterResponse:response forHost:@"a" withDelay:&delay]);
+    [service replenishRetryBudgetForHost:@"a"];
+    XCTAssertTrue([service shouldRetryOperation:operation afterResponse:response forHost:@"a" withDelay:&delay]);
+    XCTAssertFalse([service shouldRetryOperation:operation afterResponse:response forHost:@"a" withDelay:&delay]);
+}
+
+/*
+ * Verifies that the copy of an operation that gets scheduled for a retry keeps its resume data and
+ * retry count.
+ */
+- (void)testCopyRequestOperationForRetry {
+    DCXRequestOperation *operation = [[DCXRequestOperation alloc] init];
+    operation.type = DCXDownloadRequestType;
+    operation.path = @"/tmp/download";
+    operation.resumeData = [@"resume" dataUsingEncoding:NSUTF8StringEncoding];
+    operation.retryCount = 2;
+
+    DCXRequestOperation *copy = [operation copy];
+    XCTAssertEqualObjects(copy.resumeData, operation.resumeData);
+    XCTAssertEqual(copy.retryCount, 2);
+    XCTAssertEqualObjects(copy.originalId, operation.originalId);
+    XCTAssertNotEqualObjects(copy.id, operation.id);
+}
+
+/*
+ * Retries a request that failed with a 503 after its Retry-After delay and verifies that another
+ * request gets to use the only slot of the queue in the meantime.
+ */
+- (void)testRetryReleasesQueueSlotWhileWaiting {
+    DCXHTTPService *service = [self createRetryTestService];
+    service.concurrentRequestCount = 1;
+    service.retryOn5xxDelays = @[@0];
+    DCXRetryTestResponder = ^NSHTTPURLResponse *(NSURL *URL, NSUInteger attempt) {
+        if ([URL.path isEqualToString:@"/busy"] && attempt == 0) {
+            return DCXRetryTestResponse(URL, 503, @{@"Retry-After": @"2"});
+        }
+        return DCXRetryTestResponse(URL, 200, nil);
+    };
+
+    NSDate *start = [NSDate date];
+    __block NSTimeInterval busyDuration = 0;
+    __block NSTimeInterval idleDuration = 0;
+    XCTestExpectation *busyExpectation = [self expectationWithDescription:@"busy"];
+    XCTestExpectation *idleExpectation = [self expectationWithDescription:@"idle"];
+    [self getPath:@"/busy" fromRetryTestService:service completionHandler:^(DCXHTTPResponse *response) {
+        XCTAssertEqual(response.statusCode, 200);
+        busyDuration = -[start timeIntervalSinceNow];
+        [busyExpectation fulfill];
+    }];
+    [self getPath:@"/idle" fromRetryTestService:service completionHandler:^(DCXHTTPResponse *response) {
+        XCTAssertEqual(response.statusCode, 200);
+        idleDuration = -[start timeIntervalSinceNow];
+        [idleExpectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+
+    XCTAssertGreaterThanOrEqual(busyDuration, 1.9);
+    XCTAssertLessThan(idleDuration, 1.5);
+    XCTAssertEqualObjects(DCXRetryTestRequestPaths, (@[@"/busy", @"/idle", @"/busy"]));
+}
+
+/*
+ * Fails a request right away whose Retry-After exceeds DCXHTTPServiceMaxRetryAfterDelay.
+ */
+- (void)testRetryAfterAboveMaximumFails {
+    DCXHTTPService *service = [self createRetryTestService];
+    NSString *retryAfter = [NSString stringWithFormat:@"%d", (int)DCXHTTPServiceMaxRetryAfterDelay + 1];
+    DCXRetryTestResponder = ^NSHTTPURLResponse *(NSURL *URL, NSUInteger attempt) {
+        return DCXRetryTestResponse(URL, 429, @{@"Retry-After": retryAfter});
+    };
+
+    NSDate *start = [NSDate date];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"request"];
+    [self getPath:@"/busy" fromRetryTestService:service completionHandler:^(DCXHTTPResponse *response) {
+        XCTAssertEqual(response.statusCode, 429);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+
+    XCTAssertLessThan(-[start timeIntervalSinceNow], 30);
+    XCTAssertEqualObjects(DCXRetryTestRequestPaths, @[@"/busy"]);
+}
+
+/*
+ * Exhausts the retry budget of the host with requests that keep failing and verifies that a
+ * further request fails without a retry until successful requests have replenished the budget.
+ */
+- (void)testRetryBudgetOfFailingHost {
+    DCXHTTPService *service = [self createRetryTestService];
+    service.retryOn5xxDelays = @[@0];
+    DCXRetryTestResponder = ^NSHTTPURLResponse *(NSURL *URL, NSUInteger attempt) {
+        return DCXRetryTestResponse(URL, [URL.path hasPrefix:@"/fail"] ? 503 : 200, nil);
+    };
+
+    // Every failing request uses up one retry until the budget of ten has been spent
+    for (int i = 0; i < 11; i++) {
+        XCTestExpectation *expectation = [self expectationWithDescription:@"fail"];
+        NSString *path = [NSString stringWithFormat:@"/fail%d", i];
+        [self getPath:path fromRetryTestService:service completionHandler:^(DCXHTTPResponse *response) {
+            XCTAssertEqual(response.statusCode, 503);
+            [expectation fulfill];
+        }];
+        [self waitForExpectationsWithTimeout:30 handler:nil];
+    }
+    NSCountedSet *attempts = [[NSCountedSet alloc] initWithArray:DCXRetryTestRequestPaths];
+    XCTAssertEqual([attempts countForObject:@"/fail9"], 2);
+    XCTAssertEqual([attempts countForObject:@"/fail10"], 1);
+
+    // Ten successes buy another retry
+    for (int i = 0; i < 10; i++) {
+        XCTestExpectation *expectation = [self expectationWithDescription:@"ok"];
+        [self getPath:@"/ok" fromRetryTestService:service completionHandler:^(DCXHTTPResponse *response) {
+            XCTAssertEqual(response.statusCode, 200);
+            [expectation fulfill];
+        }];
+        [self waitForExpectationsWithTimeout:30 handler:nil];
+    }
+    XCTestExpectation *expectation = [self expectationWithDescription:@"fail"];
+    [self getPath:@"/fail11" fromRetryTestService:service completionHandler:^(DCXHTTPResponse *response) {
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+    attempts = [[NSCountedSet alloc] initWithArray:DCXRetryTestRequestPaths];
+    XCTAssertEqual([attempts countForObject:@"/fail11"], 2);
+}
+
+/*
+ * Verifies that the size of the next chunk of a chunked upload adapts to the measured throughput,
+ * stays within the size limits and is a multiple of the minimum chunk size.
+ */
+- (void)testNextChunkSizeOfChunkedUpload {
+    DCXChunkedUpload *upload = [[DCXChunkedUpload alloc] initWithPath:@"/nonexistent" uploadSession:nil
+                                                           chunkBlock:^DCXHTTPRequest *(NSData *chunk, NSString *uploadId, unsigned long long offset,
+                                                                                        DCXChunkCompletionHandler handler) {
+                                                               return nil;
+                                                           }
+                                                          commitBlock:^DCXHTTPRequest *(NSString *uploadId, DCXComponentRequestCompletionHandler handler) {
+                                                              return nil;
+                                                          }];
+    upload.minChunkSize = 256 * 1024;
+    upload.maxChunkSize = 32 * 1024 * 1024;
+    upload.targetChunkDuration = 5;
+    NSUInteger size = 4 * 1024 * 1024;
+
+    // Moves half way towards the size that would have taken targetChunkDuration
+    XCTAssertEqual([upload nextChunkSizeAfterChunkOfSize:size tookDuration:5], size);
+    XCTAssertEqual([upload nextChunkSizeAfterChunkOfSize:size tookDuration:2.5], 6 * 1024 * 1024);
+    XCTAssertEqual([upload nextChunkSizeAfterChunkOfSize:size tookDuration:0], size);
+
+    // Rounds down to a multiple of minChunkSize
+    XCTAssertEqual([upload nextChunkSizeAfterChunkOfSize:size tookDuration:1000], 2 * 1024 * 1024);
+
+    // Clamps to the limits
+    XCTAssertEqual([upload nextChunkSizeAfterChunkOfSize:size tookDuration:0.001], upload.maxChunkSize);
+    XCTAssertEqual([upload nextChunkSizeAfterChunkOfSize:upload.minChunkSize tookDuration:1000], upload.minChunkSize);
+    XCTAssertEqual([upload nextChunkSizeAfterChunkOfSize:1 tookDuration:5], upload.minChunkSize);
+
+    // A maximum that isn't a multiple of minChunkSize gets rounded down as well
+    upload.minChunkSize = 100;
+    upload.maxChunkSize = 1050;
+    XCTAssertEqual([upload nextChunkSizeAfterChunkOfSize:1050 tookDuration:5], 1000);
+    XCTAssertEqual([upload nextChunkSizeAfterChunkOfSize:1000 tookDuration:0.001], 1000);
+}
+
+/*
+ * Edits a manifest between serializations and verifies that the compact output always matches
+ * the pretty-printed output.
+ */
+- (void)testSerializeManifestAfterEditing {
+    NSError *error = nil;
+    DCXManifest *manifest = [DCXManifest manifestWithName:@"n" andType:@"t"];
+    
+    DCXNode *pagesNode = [manifest addChild:[DCXMutableNode nodeWithType:@"nt1" path:@"pages" name:@"nn1"] withError:&error];
+    XCTAssertNil(error);
+    NSMutableArray *pages = [NSMutableArray array];
+    for (int i = 0; i < 3; i++) {
+        DCXNode *page = [manifest addChild:[DCXMutableNode nodeWithType:@"nt2" path:[NSString stringWithFormat:@"page %d", i] name:@"nn2"]
+                                  toParent:pagesNode withError:&error];
+        XCTAssertNil(error);
+        [pages addObject:page];
+    }
+    
+    void (^verify)(void) = ^{
+        id compact = [NSJSONSerialization JSONObjectWithData:[manifest localData] options:0 error:nil];
+        [DCXManifest setPrettyPrintsLocalData:YES];
+        id pretty = [NSJSONSerialization JSONObjectWithData:[manifest localData] options:0 error:nil];
+        [DCXManifest setPrettyPrintsLocalData:NO];
+        XCTAssertNotNil(compact);
+        XCTAssertEqualObjects(compact, pretty);
+        id remote = [NSJSONSerialization JSONObjectWithData:[manifest remoteData] options:0 error:nil];
+        XCTAssertNil(remote[@"local"]);
+    };
+    
+    verify();
+    
+    // Change a deeply nested node after its encoding has been cached
+    DCXMutableNode *updatedPage = [pages[1] mutableCopy];
+    updatedPage.name = @"renamed";
+    XCTAssertNotNil([manifest updateChild:updatedPage withError:&error]);
+    XCTAssertNil(error);
+    verify();
+    
+    // Move, remove and reorder children
+    XCTAssertNotNil([manifest moveChild:pages[2] toParent:manifest.rootNode toIndex:0 withError:&error]);
+    XCTAssertNil(error);
+    verify();
+    [manifest removeChild:pages[0] removedComponents:nil];
+    verify();
+    [manifest removeAllChildrenWithRemovedComponents:nil];
+    verify();
+}
+
+/*
+ * Edits a copy of a manifest and verifies that the diff reports each kind of change.
+ */
+- (void)testDiffManifests {
+    NSError *error = nil;
+    DCXManifest *manifest = [DCXManifest manifestWithName:@"n" andType:@"t"];
+    DCXNode *pagesNode = [manifest addChild:[DCXMutableNode nodeWithType:@"nt1" path:@"pages" name:@"nn1"] withError:&error];
+    NSMutableArray *pages = [NSMutableArray array];
+    NSMutableArray *componentIds = [NSMutableArray array];
+    for (int i = 0; i < 4; i++) {
+        DCXNode *page = [manifest addChild:[DCXMutableNode nodeWithType:@"nt2" path:[NSString stringWithFormat:@"page %d", i] name:@"nn2"]
+                                  toParent:pagesNode withError:&error];
+        [pages addObject:page];
+        DCXMutableComponent *component = [DCXMutableComponent componentWithId:[[NSUUID UUID] UUIDString]
+                                                                         path:[NSString stringWithFormat:@"c%d.jpg", i]
+                                                                         name:@"c" type:@"image/jpeg" relationship:@"r"];
+        component.etag = @"etag";
+        component.state = DCXAssetStateUnmodified;
+        [manifest addComponent:component fromManifest:nil toChild:page newPath:nil withError:&error];
+        [componentIds addObject:component.componentId];
+    }
+    XCTAssertNil(error);
+    XCTAssertTrue([manifest diffFromManifest:manifest].isEmpty);
+
+    DCXManifest *copy = [manifest copy];
+    XCTAssertTrue([copy diffFromManifest:manifest].isEmpty);
+
+    DCXMutableComponent *updatedComponent = [copy.allComponents[componentIds[0]] mutableCopy];
+    updatedComponent.etag = @"etag2";
+    updatedComponent.relationship = @"r2";
+    XCTAssertNotNil([copy updateComponent:updatedComponent withError:&error]);
+    updatedComponent = [copy.allComponents[componentIds[1]] mutableCopy];
+    updatedComponent.name = @"updated";
+    XCTAssertNotNil([copy updateComponent:updatedComponent withError:&error]);
+    XCTAssertNotNil([copy moveComponent:copy.allComponents[componentIds[2]] toChild:copy.allChildren[[pages[0] nodeId]]
+                              withError:&error]);
+    DCXNode *addedPage = [copy addChild:[DCXMutableNode nodeWithType:@"nt2" path:@"page 4" name:@"nn2"]
+                               toParent:copy.allChildren[pagesNode.nodeId] withError:&error];
+    XCTAssertNil(error);
+    [copy removeChild:copy.allChildren[[pages[3] nodeId]] removedComponents:nil];
+    copy.name = @"n2";
+
+    DCXManifestDiff *diff = [copy diffFromManifest:manifest];
+    XCTAssertFalse(diff.isEmpty);
+    XCTAssertEqualObjects(diff.addedComponentIds, [NSSet set]);
+    XCTAssertEqualObjects(diff.removedComponentIds, [NSSet setWithObject:componentIds[3]]);
+    XCTAssertEqualObjects(diff.movedComponentIds, [NSSet setWithObject:componentIds[2]]);
+    XCTAssertEqualObjects(diff.renamedComponentIds, [NSSet setWithObject:componentIds[1]]);
+    XCTAssertEqualObjects(diff.contentChangedComponentIds, [NSSet setWithObject:componentIds[0]]);
+    XCTAssertEqualObjects(diff.propertyChangedComponentIds, [NSSet setWithObject:componentIds[0]]);
+    XCTAssertEqualObjects(diff.addedChildIds, [NSSet setWithObject:addedPage.nodeId]);
+    XCTAssertEqualObjects(diff.removedChildIds, [NSSet setWithObject:[pages[3] nodeId]]);
+    XCTAssertEqualObjects(diff.movedChildIds, [NSSet set]);
+    XCTAssertTrue(diff.manifestPropertiesChanged);
+
+    // The reverse diff swaps additions and removals
+    DCXManifestDiff *reverseDiff = [manifest diffFromManifest:copy];
+    XCTAssertEqualObjects(reverseDiff.addedComponentIds, diff.removedComponentIds);
+    XCTAssertEqualObjects(reverseDiff.removedChildIds, diff.addedChildIds);
+    XCTAssertEqualObjects(reverseDiff.changedComponentIds, diff.changedComponentIds);
+}
+
+/*
+ * Makes changes to a local and a server copy of a manifest and verifies the three-way merge of both
+ * with each conflict policy.
+ */
+- (void)testMergeManifests {
+    NSError *error = nil;
+    DCXManifest *base = [DCXManifest manifestWithName:@"n" andType:@"t"];
+    NSMutableArray *pages = [NSMutableArray array];
+    NSMutableArray *componentIds = [NSMutableArray array];
+    for (int i = 0; i < 3; i++) {
+        DCXNode *page = [base addChild:[DCXMutableNode nodeWithType:@"nt" path:[NSString stringWithFormat:@"page %d", i] name:@"nn"]
+                             withError:&error];
+        [pages addObject:page];
+        DCXMutableComponent *component = [DCXMutableComponent componentWithId:[[NSUUID UUID] UUIDString]
+                                                                         path:[NSString stringWithFormat:@"c%d.jpg", i]
+                                                                         name:@"c" type:@"image/jpeg" relationship:@"r"];
+        component.etag = @"etag";
+        component.state = DCXAssetStateUnmodified;
+        [base addComponent:component fromManifest:nil toChild:page newPath:nil withError:&error];
+        [componentIds addObject:component.componentId];
+    }
+    XCTAssertNil(error);
+
+    // Locally: rename component 0, change component 1, add a component to page 2 and remove page 2
+    DCXManifest *local = [base copy];
+    DCXMutableComponent *component = [local.allComponents[componentIds[0]] mutableCopy];
+    component.name = @"local";
+    [local updateComponent:component withError:&error];
+    component = [local.allComponents[componentIds[1]] mutableCopy];
+    component.state = DCXAssetStateModified;
+    component.relationship = @"local";
+    [local updateComponent:component withError:&error];
+    DCXMutableComponent *addedComponent = [DCXMutableComponent componentWithId:[[NSUUID UUID] UUIDString] path:@"added.jpg"
+                                                                          name:@"c" type:@"image/jpeg" relationship:@"r"];
+    [local addComponent:addedComponent fromManifest:nil toChild:local.allChildren[[pages[1] nodeId]] newPath:nil withError:&error];
+    [local removeChild:local.allChildren[[pages[2] nodeId]] removedComponents:nil];
+    XCTAssertNil(error);
+
+    // On the server: change component 1 and component 2, which is on the locally removed page 2
+    DCXManifest *server = [base copy];
+    component = [server.allComponents[componentIds[1]] mutableCopy];
+    component.etag = @"etag2";
+    [server updateComponent:component withError:&error];
+    component = [server.allComponents[componentIds[2]] mutableCopy];
+    component.etag = @"etag2";
+    [server updateComponent:component withError:&error];
+    XCTAssertNil(error);
+
+    DCXManifest *merged = [DCXManifestMerger mergeManifest:local intoManifest:server baseManifest:base
+                                            conflictPolicy:DCXMergeConflictPolicyServerWins withError:&error];
+    XCTAssertNil(error);
+    XCTAssertNotNil(merged);
+    XCTAssertEqualObjects([merged.allComponents[componentIds[0]] name], @"local");
+    XCTAssertEqualObjects([merged.allComponents[componentIds[1]] etag], @"etag2");
+    XCTAssertEqualObjects([merged.allComponents[componentIds[1]] relationship], @"r");
+    XCTAssertNotNil(merged.allComponents[addedComponent.componentId]);
+    XCTAssertEqualObjects([merged findParentOfComponent:merged.allComponents[addedComponent.componentId]].nodeId, [pages[1] nodeId]);
+    // The server has changed a component on page 2 so it doesn't get removed
+    XCTAssertNotNil(merged.allChildren[[pages[2] nodeId]]);
+    XCTAssertEqualObjects([merged.allComponents[componentIds[2]] etag], @"etag2");
+    XCTAssertEqual(merged.allComponents.count, 4);
+    XCTAssertEqualObjects([server.allComponents[componentIds[0]] name], @"c");
+
+    merged = [DCXManifestMerger mergeManifest:local intoManifest:server baseManifest:base
+                               conflictPolicy:DCXMergeConflictPolicyClientWins withError:&error];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects([merged.allComponents[componentIds[1]] relationship], @"local");
+    XCTAssertNil(merged.allChildren[[pages[2] nodeId]]);
+    XCTAssertNil(merged.allComponents[componentIds[2]]);
+    XCTAssertEqual(merged.allComponents.count, 3);
+
+    merged = [DCXManifestMerger mergeManifest:local intoManifest:server baseManifest:base
+                               conflictPolicy:DCXMergeConflictPolicyKeepBoth withError:&error];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects([merged.allComponents[componentIds[1]] relationship], @"r");
+    DCXComponent *localVersion = [merged componentWithAbsolutePath:@"/page 1/c1-local.jpg"];
+    XCTAssertNotNil(localVersion);
+    XCTAssertNotEqualObjects(localVersion.componentId, componentIds[1]);
+    XCTAssertEqualObjects(localVersion.relationship, @"local");
+    XCTAssertEqualObjects(localVersion.state, DCXAssetStateModified);
+    XCTAssertNil(localVersion.etag);
+    XCTAssertEqual(merged.allComponents.count, 5);
+    XCTAssertEqual([merged verifyIntegrityWithLogging:YES withBranchName:@"merged"].count, 0);
+}
+
+/*
+ * Merges a local rename of a node and a component added locally to the same node and verifies that
+ * the server manifest doesn't change.
+ */
+- (void)testMergeLeavesServerManifestUnchanged {
+    NSError *error = nil;
+    DCXManifest *base = [DCXManifest manifestWithName:@"n" andType:@"t"];
+    DCXNode *page = [base addChild:[DCXMutableNode nodeWithType:@"nt" path:@"page" name:@"nn"] withError:&error];
+    DCXMutableComponent *component = [DCXMutableComponent componentWithId:[[NSUUID UUID] UUIDString] path:@"c0.jpg"
+                                                                     name:@"c" type:@"image/jpeg" relationship:@"r"];
+    component.etag = @"etag";
+    component.state = DCXAssetStateUnmodified;
+    [base addComponent:component fromManifest:nil toChild:page newPath:nil withError:&error];
+    XCTAssertNil(error);
+
+    DCXManifest *local = [base copy];
+    DCXMutableNode *renamedPage = [local.allChildren[page.nodeId] mutableCopy];
+    renamedPage.name = @"renamed";
+    [local updateChild:renamedPage withError:&error];
+    DCXMutableComponent *addedComponent = [DCXMutableComponent componentWithId:[[NSUUID UUID] UUIDString] path:@"added.jpg"
+                                                                          name:@"c" type:@"image/jpeg" relationship:@"r"];
+    [local addComponent:addedComponent fromManifest:nil toChild:local.allChildren[page.nodeId] newPath:nil withError:&error];
+    XCTAssertNil(error);
+
+    DCXManifest *server = [base copy];
+    server.etag = @"etag2";
+    NSData *serverData = [server localData];
+
+    DCXManifest *merged = [DCXManifestMerger mergeManifest:local intoManifest:server baseManifest:base
+                                            conflictPolicy:DCXMergeConflictPolicyServerWins withError:&error];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects([merged.allChildren[page.nodeId] name], @"renamed");
+    XCTAssertEqual([merged componentsOfChild:merged.allChildren[page.nodeId]].count, 2);
+
+    XCTAssertEqualObjects([server localData], serverData);
+    XCTAssertEqualObjects([server.allChildren[page.nodeId] name], @"nn");
+    XCTAssertEqual([server componentsOfChild:server.allChildren[page.nodeId]].count, 1);
+    XCTAssertEqual([server verifyIntegrityWithLogging:YES withBranchName:@"server"].count, 0);
+}
+
+/*
+ * Edits a copy of a manifest and verifies that the original doesn't change and that both stay consistent.
+ */
+- (void)testEditCopyOfManifest {
+    NSError *error = nil;
+    DCXManifest *manifest = [DCXManifest manifestWithName:@"n" andType:@"t"];
+    manifest.etag = @"etag";
+
+    DCXNode *pagesNode = [manifest addChild:[DCXMutableNode nodeWithType:@"nt1" path:@"pages" name:@"nn1"] withError:&error];
+    NSMutableArray *pages = [NSMutableArray array];
+    NSMutableArray *components = [NSMutableArray array];
+    for (int i = 0; i < 3; i++) {
+        DCXNode *page = [manifest addChild:[DCXMutableNode nodeWithType:@"nt2" path:[NSString stringWithFormat:@"page %d", i] name:@"nn2"]
+                                  toParent:pagesNode withError:&error];
+        [pages addObject:page];
+        DCXMutableComponent *component = [DCXMutableComponent componentWithId:[[NSUUID UUID] UUIDString]
+                                                                         path:[NSString stringWithFormat:@"c%d.jpg", i]
+                                                                         name:@"c" type:@"image/jpeg" relationship:@"r"];
+        component.etag = @"etag";
+        component.state = DCXAssetStateUnmodified;
+        [components addObject:[manifest addComponent:component fromManifest:nil toChild:page newPath:nil withError:&error]];
+    }
+    XCTAssertNil(error);
+    NSData *originalData = [manifest localData];
+
+    DCXManifest *copy = [manifest copy];
+    XCTAssertEqualObjects([copy localData], originalData);
+    XCTAssertEqual([copy verifyIntegrityWithLogging:YES withBranchName:@"copy"].count, 0);
+
+    // Edit nested items of the copy
+    DCXMutableComponent *updatedComponent = [copy.allComponents[[components[1] componentId]] mutableCopy];
+    updatedComponent.name = @"updated";
+    XCTAssertNotNil([copy updateComponent:updatedComponent withError:&error]);
+    XCTAssertNotNil([copy moveComponent:copy.allComponents[[components[2] componentId]] toChild:copy.allChildren[[pages[0] nodeId]]
+                              withError:&error]);
+    XCTAssertNotNil([copy addChild:[DCXMutableNode nodeWithType:@"nt2" path:@"page 3" name:@"nn2"]
+                          toParent:copy.allChildren[pagesNode.nodeId] withError:&error]);
+    XCTAssertNil(error);
+    [copy removeChild:copy.allChildren[[pages[1] nodeId]] removedComponents:nil];
+    XCTAssertEqual([copy verifyIntegrityWithLogging:YES withBranchName:@"copy"].count, 0);
+    XCTAssertEqualObjects([manifest localData], originalData);
+
+    // Edit the original after the copy has been edited
+    [manifest resetBinding];
+    XCTAssertEqualObjects([copy.allComponents[[components[0] componentId]] etag], @"etag");
+    XCTAssertNil([manifest.allComponents[[components[0] componentId]] etag]);
+    XCTAssertEqual([manifest verifyIntegrityWithLogging:YES withBranchName:@"original"].count, 0);
+
+    // The copy must encode to the same data as a manifest parsed from its data
+    DCXManifest *parsedCopy = [[DCXManifest alloc] initWithData:[copy localData] withError:&error];
+    XCTAssertNotNil(parsedCopy, @"%@", error);
+    XCTAssertEqualObjects([NSJSONSerialization JSONObjectWithData:[copy localData] options:0 error:nil],
+                          [NSJSONSerialization JSONObjectWithData:[parsedCopy localData] options:0 error:nil]);
+    XCTAssertEqualObjects([copy.allComponents[[components[2] componentId]] parentPath], [copy.allChildren[[pages[0] nodeId]] absolutePath]);
+}
+
+/*
+ * Inserts and removes siblings in front of the children of a wide node and verifies that the
+ * children are still found at their new indices.
+ */
+- (void)testFindChildrenAfterShiftingSiblings {
+    NSError *error = nil;
+    DCXManifest *manifest = [DCXManifest manifestWithName:@"n" andType:@"t"];
+    NSMutableArray *pages = [NSMutableArray array];
+    for (int i = 0; i < 20; i++) {
+        [pages addObject:[manifest addChild:[DCXMutableNode nodeWithType:@"nt" path:[NSString stringWithFormat:@"page %d", i] name:@"nn"]
+                                  withError:&error]];
+    }
+    XCTAssertNil(error);
+
+    // Look up every child so that the recorded indices are current, then shift them
+    NSUInteger index;
+    for (DCXNode *page in pages) {
+        XCTAssertNotNil([manifest findParentOfChild:page foundIndex:&index]);
+    }
+    [manifest removeChild:manifest.allChildren[[pages[0] nodeId]] removedComponents:nil];
+    [manifest removeChild:manifest.allChildren[[pages[1] nodeId]] removedComponents:nil];
+    [pages removeObjectsInRange:NSMakeRange(0, 2)];
+    for (int i = 0; i < 3; i++) {
+        DCXNode *page = [manifest insertChild:[DCXMutableNode nodeWithType:@"nt" path:[NSString stringWithFormat:@"new %d", i] name:@"nn"]
+                                      atIndex:0 withError:&error];
+        [pages insertObject:page atIndex:0];
+    }
+    XCTAssertNil(error);
+
+    for (NSUInteger i = 0; i < pages.count; i++) {
+        DCXNode *parent = [manifest findParentOfChild:manifest.allChildren[[pages[i] nodeId]] foundIndex:&index];
+        XCTAssertTrue(parent.isRoot);
+        XCTAssertEqual(index, i);
+    }
+    XCTAssertEqual([manifest verifyIntegrityWithLogging:YES withBranchName:@"manifest"].count, 0);
+}
+
+/*
+ * Renames a child of a manifest that has been copied, adds a component and a child to it and verifies
+ * that the copy is unchanged.
+ */
+- (void)testEditRenamedChildOfCopiedManifest {
+    NSError *error = nil;
+    DCXManifest *manifest = [DCXManifest manifestWithName:@"n" andType:@"t"];
+    DCXNode *pagesNode = [manifest addChild:[DCXMutableNode nodeWithType:@"nt1" path:@"pages" name:@"nn1"] withError:&error];
+    DCXNode *page = [manifest addChild:[DCXMutableNode nodeWithType:@"nt2" path:@"page" name:@"nn2"]
+                              toParent:pagesNode withError:&error];
+    DCXMutableComponent *component = [DCXMutableComponent componentWithId:[[NSUUID UUID] UUIDString] path:@"c0.jpg"
+                                                                     name:@"c" type:@"image/jpeg" relationship:@"r"];
+    XCTAssertNotNil([manifest addComponent:component fromManifest:nil toChild:pagesNode newPath:nil withError:&error]);
+    XCTAssertNil(error);
+
+    DCXManifest *copy = [manifest copy];
+    NSData *copyData = [copy localData];
+
+    DCXMutableNode *renamedNode = [manifest.allChildren[pagesNode.nodeId] mutableCopy];
+    renamedNode.name = @"renamed";
+    XCTAssertNotNil([manifest updateChild:renamedNode withError:&error]);
+    component = [DCXMutableComponent componentWithId:[[NSUUID UUID] UUIDString] path:@"c1.jpg"
+                                                name:@"c" type:@"image/jpeg" relationship:@"r"];
+    XCTAssertNotNil([manifest addComponent:component fromManifest:nil toChild:manifest.allChildren[pagesNode.nodeId]
+                                   newPath:nil withError:&error]);
+    XCTAssertNotNil([manifest addChild:[DCXMutableNode nodeWithType:@"nt2" path:@"page 2" name:@"nn2"]
+                              toParent:manifest.allChildren[pagesNode.nodeId] withError:&error]);
+    XCTAssertNil(error);
+
+    XCTAssertEqualObjects([copy localData], copyData);
+    XCTAssertEqual([copy childrenOf:copy.allChildren[pagesNode.nodeId]].count, 1);
+    XCTAssertEqual([copy componentsOfChild:copy.allChildren[pagesNode.nodeId]].count, 1);
+    XCTAssertEqualObjects([copy.allChildren[pagesNode.nodeId] name], @"nn1");
+    XCTAssertNotNil(copy.allChildren[page.nodeId]);
+    XCTAssertEqual([copy verifyIntegrityWithLogging:YES withBranchName:@"copy"].count, 0);
+    XCTAssertEqual([manifest verifyIntegrityWithLogging:YES withBranchName:@"original"].count, 0);
+}
+
+/*
+ * Reads manifests with DCXManifestReader and verifies the result against NSJSONSerialization and the
+ * lookup tables of DCXManifest.
+ */
+- (void)testReadManifest {
+    NSError *error = nil;
+    NSString *json = @"{ \"id\": \"m\", \"name\": \"n\\u00e4me\", \"type\": \"t\", \"manifest-format-version\": 6, \"links\": [],"
+        " \"local\": { \"k\": [1, -2, 3.5, 1e3, true, false, null, \"\\ud83d\\ude00\", \"a\\\"b\\\\c\\/\\n\"] },"
+        " \"components\": [ { \"id\": \"c0\", \"path\": \"C0.jpg\", \"name\": \"c\", \"type\": \"image/jpeg\", \"rel\": \"r\", \"length\": 42 } ],"
+        " \"children\": [ { \"children\": [ { \"id\": \"n1\", \"path\": \"Page\", \"components\": [ { \"path\": \"c1.jpg\", \"id\": \"c1\" } ] } ],"
+        " \"id\": \"n0\", \"path\": \"pages\", \"components\": [], \"name\": \"\\u0070ages\" },"
+        " { \"id\": \"n2\", \"children\": [], \"components\": [ { \"id\": \"c2\", \"path\": \"c2.jpg\" } ] } ] }\n";
+    // Starts with a byte order mark
+    NSMutableData *data = [NSMutableData dataWithBytes:"\xEF\xBB\xBF" length:3];
+    [data appendData:[json dataUsingEncoding:NSUTF8StringEncoding]];
+    
+    // The reader produces the same values as NSJSONSerialization minus the empty arrays of nodes
+    DCXManifestReader *reader = [[DCXManifestReader alloc] initWithData:data];
+    NSMutableDictionary *dict = [reader readWithError:&error];
+    XCTAssertNotNil(dict, @"%@", error);
+    NSMutableDictionary *expected = [NSJSONSerialization JSONObjectWithData:[data subdataWithRange:NSMakeRange(3, data.length - 3)]
+                                                                   options:NSJSONReadingMutableContainers error:&error];
+    [expected removeObjectForKey:@"links"];
+    [expected[@"children"][0] removeObjectForKey:@"components"];
+    [expected[@"children"][1] removeObjectForKey:@"children"];
+    XCTAssertEqualObjects(dict, expected);
+    XCTAssertEqual(reader.nodeCount, 3);
+    XCTAssertEqual(reader.componentCount, 3);
+    XCTAssertTrue([dict[@"local"][@"k"][2] isKindOfClass:[NSNumber class]]);
+    XCTAssertTrue([dict[@"children"] isKindOfClass:[NSMutableArray class]]);
+    
+    // Parents are reported before their descendants and relative to the path of their parent
+    NSMutableArray *items = [NSMutableArray array];
+    [reader enumerateItemsWithRootId:@"m" usingBlock:^(NSMutableDictionary *itemDict, BOOL isComponent, NSString *itemId,
+                                                       NSString *parentId, NSUInteger index, NSString *parentPath) {
+        [items addObject:[NSString stringWithFormat:@"%@ %@ %lu %@", itemId, parentId, (unsigned long)index, parentPath]];
+    }];
+    NSArray *expectedItems = @[@"c0 m 0 /", @"n0 m 0 /", @"n1 n0 0 /pages", @"c1 n1 0 /pages/Page", @"n2 m 1 /", @"c2 n2 0 /"];
+    XCTAssertEqualObjects(items, expectedItems);
+    
+    // The manifest builds its lookup tables from the reader
+    DCXManifest *manifest = [[DCXManifest alloc] initWithData:data withError:&error];
+    XCTAssertNotNil(manifest, @"%@", error);
+    XCTAssertEqual(manifest.allComponents.count, 3);
+    XCTAssertEqual(manifest.allChildren.count, 4);
+    XCTAssertEqualObjects([manifest componentWithAbsolutePath:@"/pages/page/C1.JPG"].componentId, @"c1");
+    XCTAssertEqualObjects([manifest childWithAbsolutePath:@"/pages/page"].nodeId, @"n1");
+    XCTAssertEqualObjects([manifest findParentOfComponent:manifest.allComponents[@"c2"]].nodeId, @"n2");
+    XCTAssertEqual([manifest verifyIntegrityWithLogging:YES withBranchName:@"read"].count, 0);
+    XCTAssertNil([manifest addChild:[DCXMutableNode nodeWithType:@"nt" path:@"PAGES" name:@"nn"] withError:&error]);
+    XCTAssertEqual(error.code, DCXErrorDuplicatePath);
+    
+    // Manifests read from a file are the same as the ones read from data
+    NSString *path = [[self createTemporaryDirectoryWithError:&error] stringByAppendingPathComponent:@"manifest"];
+    XCTAssertTrue([[manifest localData] writeToFile:path atomically:YES]);
+    DCXManifest *manifestFromFile = [DCXManifest manifestWithContentsOfFile:path withError:&error];
+    XCTAssertNotNil(manifestFromFile, @"%@", error);
+    XCTAssertEqualObjects([manifestFromFile localData], [manifest localData]);
+    DCXManifest *downloadedManifest = [[DCXManifest alloc] initWithContentsOfFile:path withError:&error];
+    XCTAssertNotNil(downloadedManifest, @"%@", error);
+    XCTAssertEqualObjects([downloadedManifest localData], [manifest localData]);
+    
+    // Invalid JSON
+    NSArray *invalidDocuments = @[@"", @"[]", @"{", @"{\"a\": 1,}", @"{\"a\": 01}", @"{\"a\": \"\\ud83d\"}", @"{\"a\": tru}",
+                                  @"{\"children\": [1]}", @"{} {}",
+                                  @"{\"children\": [{\"id\": \"a\"}], \"children\": [{\"id\": \"b\"}]}",
+                                  @"{\"children\": [{\"components\": [], \"components\": [{\"id\": \"c\"}]}]}"];
+    for (NSString *document in invalidDocuments) {
+        error = nil;
+        XCTAssertNil([[DCXManifest alloc] initWithData:[document dataUsingEncoding:NSUTF8StringEncoding] withError:&error], @"%@", document);
+        XCTAssertEqual(error.code, DCXErrorInvalidManifest, @"%@", document);
+    }
+    error = nil;
+    XCTAssertNil([DCXManifest manifestWithContentsOfFile:[path stringByAppendingString:@".missing"] withError:&error]);
+    XCTAssertEqual(error.code, DCXErrorManifestReadFailure);
+    error = nil;
+    XCTAssertNil([[DCXManifest alloc] initWithContentsOfFile:[path stringByAppendingString:@".missing"] withError:&error]);
+    XCTAssertEqual(error.code, DCXErrorManifestReadFailure);
+}
+
+/*
+ * Loads manifests through their binary cache and verifies that stale or damaged cache files get ignored.
+ */
+- (void)testManifestCache {
+    NSError *error = nil;
+    DCXManifest *manifest = [DCXManifest manifestWithName:@"n" andType:@"t"];
+    [manifest addChild:[DCXMutableNode nodeWithType:@"nt" path:@"pages" name:@"p"] withError:&error];
+    [manifest setValue:@[@1, @2.5, @YES, [NSNull null], @"s"] forKey:@"k"];
+    NSString *path = [[self createTemporaryDirectoryWithError:&error] stringByAppendingPathComponent:@"manifest"];
+    NSString *cachePath = [DCXManifest cachePathForManifestPath:path];
+    XCTAssertTrue([manifest writeToFile:path generateNewSaveId:YES withError:&error], @"%@", error);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:cachePath]);
+
+    // The first load creates the cache, the second one reads it
+    DCXManifest *loaded = [DCXManifest manifestWithContentsOfFile:path usingCache:YES withError:&error];
+    XCTAssertNotNil(loaded, @"%@", error);
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:cachePath]);
+    DCXManifest *cached = [DCXManifest manifestWithContentsOfFile:path usingCache:YES withError:&error];
+    XCTAssertNotNil(cached, @"%@", error);
+    XCTAssertEqualObjects([cached localData], [loaded localData]);
+    XCTAssertEqualObjects(cached.saveId, manifest.saveId);
+    XCTAssertEqualObjects([cached childWithAbsolutePath:@"/pages"].name, @"p");
+
+    // The encoding round-trips
+    NSDictionary *dict = [NSJSONSerialization JSONObjectWithData:[manifest localData] options:0 error:&error];
+    NSData *key = [@"key" dataUsingEncoding:NSUTF8StringEncoding];
+    DCXManifestReader *reader = [[DCXManifestReader alloc] initWithBinaryData:[DCXManifestReader binaryDataWithDictionary:dict key:key]];
+    XCTAssertEqualObjects(reader.binaryKey, key);
+    XCTAssertEqualObjects([reader readWithError:&error], dict);
+
+    // A rewritten manifest invalidates the cache
+    manifest.name = @"renamed";
+    XCTAssertTrue([manifest writeToFile:path generateNewSaveId:YES withError:&error], @"%@", error);
+    cached = [DCXManifest manifestWithContentsOfFile:path usingCache:YES withError:&error];
+    XCTAssertEqualObjects(cached.name, @"renamed");
+    XCTAssertEqualObjects(cached.saveId, manifest.saveId);
+
+    // A damaged cache file falls back to the JSON
+    NSMutableData *damaged = [NSMutableData dataWithContentsOfFile:cachePath];
+    ((uint8_t*)damaged.mutableBytes)[damaged.length - 1] ^= 0xFF;
+    XCTAssertTrue([damaged writeToFile:cachePath atomically:NO]);
+    cached = [DCXManifest manifestWithContentsOfFile:path usingCache:YES withError:&error];
+    XCTAssertNotNil(cached, @"%@", error);
+    XCTAssertEqualObjects(cached.name, @"renamed");
+
+    // The cache file moves along with its manifest file and gets removed with it
+    NSString *movedPath = [path stringByAppendingString:@".moved"];
+    XCTAssertTrue([DCXFileUtils moveFileAtomicallyFrom:path to:movedPath withError:&error], @"%@", error);
+    [DCXManifest moveCacheOfManifestPath:path toPath:movedPath];
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:cachePath]);
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[DCXManifest cachePathForManifestPath:movedPath]]);
+    [DCXManifest removeCacheOfManifestPath:movedPath];
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[DCXManifest cachePathForManifestPath:movedPath]]);
+}
+
+/*
+ * Lets separately loaded manifests share their component dictionaries and verifies that editing one of
+ * them doesn't affect the other.
+ */
+- (void)testShareComponentsBetweenManifests {
+    NSError *error = nil;
+    DCXManifest *manifest = [DCXManifest manifestWithName:@"n" andType:@"t"];
+    DCXNode *page = [manifest addChild:[DCXMutableNode nodeWithType:@"nt" path:@"page" name:@"p"] withError:&error];
+    NSMutableArray *componentIds = [NSMutableArray array];
+    for (int i = 0; i < 3; i++) {
+        DCXMutableComponent *component = [DCXMutableComponent componentWithId:[[NSUUID UUID] UUIDString]
+                                                                         path:[NSString stringWithFormat:@"c%d.jpg", i]
+                                                                         name:@"c" type:@"image/jpeg" relationship:@"r"];
+        component.etag = @"etag";
+        component.state = DCXAssetStateUnmodified;
+        [manifest addComponent:component fromManifest:nil toChild:(i == 0 ? manifest.rootNode : page) newPath:nil withError:&error];
+        [componentIds addObject:component.componentId];
+    }
+    XCTAssertNil(error);
+
+    NSMapTable *pool = [NSMapTable strongToWeakObjectsMapTable];
+    DCXManifest *first = [[DCXManifest alloc] initWithData:[manifest localData] withError:&error];
+    DCXManifest *second = [[DCXManifest alloc] initWithData:[manifest localData] withError:&error];
+    XCTAssertEqual([first shareComponentsWithPool:pool], 0);
+    XCTAssertEqual([second shareComponentsWithPool:pool], 3);
+    XCTAssertEqual([first shareComponentsWithPool:pool], 3);
+    XCTAssertEqual([second verifyIntegrityWithLogging:YES withBranchName:@"second"].count, 0);
+    XCTAssertEqualObjects([second componentWithAbsolutePath:@"/page/c1.jpg"].componentId, componentIds[1]);
+    XCTAssertEqualObjects([second localData], [first localData]);
+
+    // Components with a different etag don't get shared
+    DCXMutableComponent *updatedComponent = [second.allComponents[componentIds[1]] mutableCopy];
+    updatedComponent.etag = @"etag2";
+    updatedComponent.name = @"updated";
+    XCTAssertNotNil([second updateComponent:updatedComponent withError:&error]);
+    XCTAssertEqualObjects([first.allComponents[componentIds[1]] name], @"c");
+    DCXManifest *third = [[DCXManifest alloc] initWithData:[second localData] withError:&error];
+    XCTAssertEqual([third shareComponentsWithPool:pool], 2);
+    XCTAssertEqualObjects([third.allComponents[componentIds[1]] name], @"updated");
+}
+
+/*
+ * Records uploaded components in a push journal and verifies that they survive reloading the journal.
+ */
+- (void)testPushJournalLog {
+    NSError *error = nil;
+    DCXComposite *composite = [DCXComposite compositeWithName:@"n" andType:@"t" andPath:nil andId:nil andHref:nil];
+    composite.path = [[self createTemporaryDirectoryWithError:&error] stringByAppendingPathComponent:composite.compositeId];
+    DCXMutableBranch *current = composite.current;
+    NSString *testAssetPath = [self pathForTestAsset:@"Component.png"];
+    NSString *journalPath = [composite.path stringByAppendingPathComponent:@"push.journal"];
+    
+    NSMutableArray *components = [NSMutableArray array];
+    for (int i = 0; i < 5; i++) {
+        DCXComponent *component = [current addComponent:@"cn" withId:nil withType:@"image/png"
+                                       withRelationship:@"rendition" withPath:[NSString stringWithFormat:@"c%d.png", i]
+                                                toChild:current.rootNode fromFile:testAssetPath copy:YES
+                                              withError:&error];
+        XCTAssertNil(error);
+        [components addObject:component];
+    }
+    
+    DCXPushJournal *journal = [DCXPushJournal journalForComposite:composite persistedAt:journalPath error:nil];
+    journal.flushCount = 3;
+    journal.flushInterval = 0;
+    for (DCXComponent *component in components) {
+        [journal recordUploadedComponent:component fromPath:@"file"];
+    }
+    [journal clearComponent:components[0]];
+    XCTAssertTrue([journal flushWithError:&error]);
+    XCTAssertNil(error);
+    
+    DCXPushJournal *reloaded = [DCXPushJournal journalForComposite:composite fromFile:journalPath error:&error];
+    XCTAssertNil(error);
+    XCTAssertNil([reloaded getUploadedComponent:components[0] fromPath:@"file"]);
+    for (NSUInteger i = 1; i < components.count; i++) {
+        XCTAssertNotNil([reloaded getUploadedComponent:components[i] fromPath:@"file"]);
+    }
+    XCTAssertFalse(reloaded.isComplete);
+}
+
+/*
+ * Records downloaded components and resume data in a pull journal and verifies that they survive
+ * reloading the journal and only apply to components with the same etag.
+ */
+- (void)testPullJournal {
+    NSError *error = nil;
+    DCXComposite *composite = [DCXComposite compositeWithName:@"n" andType:@"t" andPath:nil andId:nil andHref:nil];
+    composite.path = [[self createTemporaryDirectoryWithError:&error] stringByAppendingPathComponent:composite.compositeId];
+    [_fm createDirectoryAtPath:composite.path withIntermediateDirectories:YES attributes:nil error:nil];
+    NSString *journalPath = [composite.path stringByAppendingPathComponent:@"pull.journal"];
+    
+    NSMutableArray *components = [NSMutableArray array];
+    for (int i = 0; i < 3; i++) {
+        DCXMutableComponent *component = [DCXMutableComponent componentWithId:[[NSUUID UUID] UUIDString]
+                                                                         path:[NSString stringWithFormat:@"c%d.jpg", i]
+                                                                         name:@"c" type:@"image/jpeg" relationship:@"r"];
+        component.etag = @"etag";
+        component.length = @100;
+        [components addObject:component];
+    }
+    NSData *resumeData = [@"resume" dataUsingEncoding:NSUTF8StringEncoding];
+    
+    DCXPullJournal *journal = [DCXPullJournal journalForComposite:composite persistedAt:journalPath error:nil];
+    XCTAssertTrue(journal.isEmpty);
+    [journal recordResumeData:resumeData forComponent:components[0]];
+    [journal recordDownloadedComponent:components[0] withStorageId:@"s0"];
+    [journal recordDownloadedComponent:components[1] withStorageId:@"s1"];
+    [journal recordResumeData:resumeData forComponent:components[2]];
+    journal = nil;
+    
+    DCXPullJournal *reloaded = [DCXPullJournal journalForComposite:composite persistedAt:journalPath error:&error];
+    XCTAssertNil(error);
+    XCTAssertFalse(reloaded.isEmpty);
+    XCTAssertEqualObjects([reloaded storageIdOfDownloadedComponent:components[0]], @"s0");
+    XCTAssertEqualObjects([reloaded storageIdOfDownloadedComponent:components[1]], @"s1");
+    XCTAssertNil([reloaded storageIdOfDownloadedComponent:components[2]]);
+    XCTAssertNil([reloaded takeResumeDataForComponent:components[0]]);
+    
+    // A different version of a component doesn't match
+    DCXMutableComponent *changed = [components[1] mutableCopy];
+    changed.etag = @"etag2";
+    XCTAssertNil([reloaded storageIdOfDownloadedComponent:changed]);
+    
+    // Resume data can only be used once
+    XCTAssertEqualObjects([reloaded takeResumeDataForComponent:components[2]], resumeData);
+    XCTAssertNil([reloaded takeResumeDataForComponent:components[2]]);
+    reloaded = [DCXPullJournal journalForComposite:composite persistedAt:journalPath error:&error];
+    XCTAssertNil([reloaded takeResumeDataForComponent:components[2]]);
+    
+    XCTAssertTrue([DCXPullJournal removeJournalAtPath:journalPath withError:&error]);
+    XCTAssertFalse([_fm fileExistsAtPath:journalPath]);
+    XCTAssertTrue([DCXPullJournal journalForComposite:composite persistedAt:journalPath error:nil].isEmpty);
+}
+
 #pragma mark - Tests - Branch Management
 
 /*
@@ -0,0 +1,537 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import <Cocoa/Cocoa.h>
+#import <XCTest/XCTest.h>
+#import "DCX.h"
+#import "DCXLocalTransferSession.h"
+
+/*
+ * End-to-end transfer tests that push and pull composites through a DCXLocalTransferSession.
+ */
+@interface DigitalCompositesOSXTransferTests : XCTestCase
+
+@end
+
+@implementation DigitalCompositesOSXTransferTests
+{
+    NSFileManager                   *_fm;
+    NSString                        *_tempPath;
+    DCXLocalTransferSession         *_session;
+}
+
+#pragma mark - Helpers
+
+// Writes a file with the given number of random bytes.
+-(NSString*) writeRandomFileNamed:(NSString*)name length:(NSUInteger)length
+{
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    arc4random_buf(data.mutableBytes, length);
+    NSString *path = [[_tempPath stringByAppendingPathComponent:@"source"] stringByAppendingPathComponent:name];
+    [_fm createDirectoryAtPath:[path stringByDeletingLastPathComponent] withIntermediateDirectories:YES
+                    attributes:nil error:nil];
+    XCTAssertTrue([data writeToFile:path atomically:YES]);
+    return path;
+}
+
+// Creates and commits a new composite with one component of each of the given sizes in its root.
+-(DCXComposite*) createCompositeWithComponentLengths:(NSArray*)lengths
+{
+    NSError *error = nil;
+    NSString *compositeId = [[NSUUID UUID] UUIDString];
+    DCXComposite *composite = [DCXComposite compositeWithName:@"transfer" andType:@"t"
+                                                      andPath:[_tempPath stringByAppendingPathComponent:compositeId]
+                                                        andId:compositeId
+                                                      andHref:[@"/transfer" stringByAppendingPathComponent:compositeId]];
+    DCXMutableBranch *current = composite.current;
+    for (NSUInteger i = 0; i < lengths.count; i++) {
+        NSString *name = [NSString stringWithFormat:@"component%lu", (unsigned long)i];
+        DCXComponent *component = [current addComponent:name withId:nil withType:@"application/octet-stream"
+                                       withRelationship:@"primary" withPath:[name stringByAppendingPathExtension:@"bin"]
+                                                toChild:current.rootNode
+                                               fromFile:[self writeRandomFileNamed:name length:[lengths[i] unsignedIntegerValue]]
+                                                   copy:YES withError:&error];
+        XCTAssertNotNil(component, @"%@", error);
+    }
+    XCTAssertTrue([composite commitChangesWithError:&error], @"%@", error);
+
+    return composite;
+}
+
+-(void) pushAndAcceptComposite:(DCXComposite*)composite
+{
+    NSError *error = nil;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"push"];
+    [DCXCompositeXfer pushComposite:composite usingSession:_session requestPriority:NSOperationQueuePriorityNormal
+                       handlerQueue:nil completionHandler:^(BOOL success, NSError *error) {
+                           XCTAssertTrue(success, @"%@", error);
+                           [expectation fulfill];
+                       }];
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+    XCTAssertTrue([composite acceptPushWithError:&error], @"%@", error);
+}
+
+-(DCXComposite*) pullCompositeFromHref:(NSString*)href minimal:(BOOL)minimal
+{
+    return [self pullCompositeFromHref:href minimal:minimal prefetchPolicy:nil];
+}
+
+-(DCXComposite*) pullCompositeFromHref:(NSString*)href minimal:(BOOL)minimal prefetchPolicy:(id<DCXPrefetchPolicy>)policy
+{
+    NSError *resolveError = nil;
+    NSString *compositeId = [[NSUUID UUID] UUIDString];
+    DCXComposite *composite = [DCXComposite compositeFromHref:href andId:compositeId
+                                                      andPath:[_tempPath stringByAppendingPathComponent:compositeId]];
+    composite.prefetchPolicy = policy;
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"pull"];
+    void (^handler)(DCXBranch*, NSError*) = ^(DCXBranch *branch, NSError *error) {
+        XCTAssertNotNil(branch, @"%@", error);
+        [expectation fulfill];
+    };
+    if (minimal) {
+        [DCXCompositeXfer pullMinimalComposite:composite usingSession:_session requestPriority:NSOperationQueuePriorityNormal
+                                  handlerQueue:nil completionHandler:handler];
+    } else {
+        [DCXCompositeXfer pullComposite:composite usingSession:_session requestPriority:NSOperationQueuePriorityNormal
+                           handlerQueue:nil completionHandler:handler];
+    }
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+    XCTAssertTrue([composite resolvePullWithBranch:nil withError:&resolveError], @"%@", resolveError);
+
+    return composite;
+}
+
+// Returns the contents of the source file that the component with the given name has been created from.
+-(NSData*) sourceDataOfComponentNamed:(NSString*)name
+{
+    return [NSData dataWithContentsOfFile:[[_tempPath stringByAppendingPathComponent:@"source"]
+                                           stringByAppendingPathComponent:name]];
+}
+
+// Returns the component of the current branch of the composite with the given name.
+-(DCXComponent*) componentNamed:(NSString*)name ofComposite:(DCXComposite*)composite
+{
+    for (DCXComponent *component in [composite.current getAllComponents]) {
+        if ([component.name isEqualToString:name]) {
+            return component;
+        }
+    }
+    return nil;
+}
+
+#pragma mark - Setup Teardown
+
+- (void)setUp {
+    [super setUp];
+
+    _fm = [NSFileManager defaultManager];
+    _tempPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"transfer%f", [[NSDate date] timeIntervalSince1970]]];
+    [_fm createDirectoryAtPath:_tempPath withIntermediateDirectories:YES attributes:nil error:nil];
+
+    _session = [[DCXLocalTransferSession alloc] initWithRootPath:[_tempPath stringByAppendingPathComponent:@"server"]];
+}
+
+- (void)tearDown {
+    [_fm removeItemAtPath:_tempPath error:nil];
+    [super tearDown];
+}
+
+#pragma mark - Push
+
+/*
+ * Pushes components through a window of a single upload and verifies that they get uploaded
+ * in the requested order.
+ */
+- (void)testPushUploadOrder {
+    NSArray *lengths = @[@3000, @1000, @5000, @2000, @4000];
+    for (NSNumber *order in @[@(DCXPushUploadOrderLargestFirst), @(DCXPushUploadOrderSmallestFirst)]) {
+        DCXComposite *composite = [self createCompositeWithComponentLengths:lengths];
+        NSMutableArray *uploadedHrefs = [NSMutableArray array];
+        _session.errorInjector = ^NSError *(NSString *requestKind, NSString *href) {
+            if ([requestKind isEqualToString:@"uploadComponent"]) {
+                @synchronized(uploadedHrefs) {
+                    [uploadedHrefs addObject:href];
+                }
+            }
+            return nil;
+        };
+
+        XCTestExpectation *expectation = [self expectationWithDescription:@"push"];
+        [DCXCompositeXfer pushComposite:composite usingSession:_session requestPriority:NSOperationQueuePriorityNormal
+                   maxConcurrentUploads:1 uploadOrder:order.integerValue
+                           handlerQueue:nil completionHandler:^(BOOL success, NSError *error) {
+                               XCTAssertTrue(success, @"%@", error);
+                               [expectation fulfill];
+                           }];
+        [self waitForExpectationsWithTimeout:60 handler:nil];
+
+        NSMutableArray *uploadedLengths = [NSMutableArray array];
+        for (NSString *href in uploadedHrefs) {
+            [uploadedLengths addObject:[composite.current getComponentWithId:href.lastPathComponent].length];
+        }
+        NSArray *expected = [lengths sortedArrayUsingSelector:@selector(compare:)];
+        if (order.integerValue == DCXPushUploadOrderLargestFirst) {
+            expected = expected.reverseObjectEnumerator.allObjects;
+        }
+        XCTAssertEqualObjects(uploadedLengths, expected);
+    }
+}
+
+/*
+ * Rewrites one component with its original bytes and another one with new bytes and verifies that
+ * the next push only uploads the component whose bytes have changed.
+ */
+- (void)testPushSkipsUnchangedComponents {
+    NSError *error = nil;
+    DCXComposite *composite = [self createCompositeWithComponentLengths:@[ @1000, @2000 ]];
+    [self pushAndAcceptComposite:composite];
+
+    DCXMutableBranch *current = composite.current;
+    DCXComponent *unchangedComponent = [self componentNamed:@"component0" ofComposite:composite];
+    XCTAssertNotNil([current updateComponent:unchangedComponent
+                                    fromFile:[[_tempPath stringByAppendingPathComponent:@"source"] stringByAppendingPathComponent:@"component0"]
+                                        copy:YES withError:&error], @"%@", error);
+    DCXComponent *changedComponent = [self componentNamed:@"component1" ofComposite:composite];
+    XCTAssertNotNil([current updateComponent:changedComponent fromFile:[self writeRandomFileNamed:@"component1" length:2000]
+                                        copy:YES withError:&error], @"%@", error);
+    XCTAssertTrue([composite commitChangesWithError:&error], @"%@", error);
+
+    NSMutableArray *uploadedHrefs = [NSMutableArray array];
+    _session.errorInjector = ^NSError *(NSString *requestKind, NSString *href) {
+        if ([requestKind isEqualToString:@"uploadComponent"]) {
+            @synchronized(uploadedHrefs) {
+                [uploadedHrefs addObject:href];
+            }
+        }
+        return nil;
+    };
+    [self pushAndAcceptComposite:composite];
+
+    XCTAssertEqual(uploadedHrefs.count, 1);
+    XCTAssertTrue([uploadedHrefs.firstObject hasSuffix:changedComponent.componentId]);
+    DCXComposite *pulledComposite = [self pullCompositeFromHref:composite.href minimal:NO];
+    for (NSString *name in @[ @"component0", @"component1" ]) {
+        DCXComponent *component = [self componentNamed:name ofComposite:pulledComposite];
+        NSString *path = [pulledComposite.current pathForComponent:component withError:&error];
+        XCTAssertEqualObjects([NSData dataWithContentsOfFile:path], [self sourceDataOfComponentNamed:name]);
+    }
+}
+
+/*
+ * Pushes more components than fit into the upload window and verifies that the number of
+ * concurrent uploads never exceeds the window.
+ */
+- (void)testPushUploadWindow {
+    NSMutableArray *lengths = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 12; i++) {
+        [lengths addObject:@1024];
+    }
+    DCXComposite *composite = [self createCompositeWithComponentLengths:lengths];
+    _session.latency = 0.02;
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"push"];
+    [DCXCompositeXfer pushComposite:composite usingSession:_session requestPriority:NSOperationQueuePriorityNormal
+               maxConcurrentUploads:3 uploadOrder:DCXPushUploadOrderLargestFirst
+                       handlerQueue:nil completionHandler:^(BOOL success, NSError *error) {
+                           XCTAssertTrue(success, @"%@", error);
+                           [expectation fulfill];
+                       }];
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+
+    XCTAssertLessThanOrEqual(_session.peakConcurrentUploads, 3);
+    XCTAssertGreaterThan(_session.peakConcurrentUploads, 1);
+    XCTAssertEqual([composite.pushed getAllComponents].count, lengths.count);
+}
+
+#pragma mark - Chunked uploads
+
+/*
+ * Verifies that a push that fails in the middle of a chunked upload resumes the upload at the last
+ * chunk the server has received.
+ */
+- (void)testResumeChunkedUpload {
+    NSError *error = nil;
+    NSUInteger length = 1024 * 1024;
+    _session.chunkedUploadThreshold = 1;
+    _session.chunkSize = 64 * 1024;
+    DCXComposite *composite = [self createCompositeWithComponentLengths:@[@(length)]];
+
+    // Fail the ninth chunk
+    __block NSUInteger chunkCount = 0;
+    _session.errorInjector = ^NSError *(NSString *requestKind, NSString *href) {
+        if ([requestKind isEqualToString:@"uploadChunk"] && ++chunkCount == 9) {
+            return [NSError errorWithDomain:DCXErrorDomain code:DCXErrorUnexpectedResponse
+                                   userInfo:@{ DCXHTTPStatusKey: @500 }];
+        }
+        return nil;
+    };
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"push"];
+    [DCXCompositeXfer pushComposite:composite usingSession:_session requestPriority:NSOperationQueuePriorityNormal
+                       handlerQueue:nil completionHandler:^(BOOL success, NSError *error) {
+                           XCTAssertFalse(success);
+                           [expectation fulfill];
+                       }];
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+
+    // The second push only needs to upload the chunks that haven't made it to the server
+    _session.errorInjector = nil;
+    int64_t transferredBytes = _session.transferredBytes;
+    [self pushAndAcceptComposite:composite];
+    XCTAssertLessThan(_session.transferredBytes - transferredBytes, (int64_t)length);
+
+    DCXComposite *pulledComposite = [self pullCompositeFromHref:composite.href minimal:NO];
+    DCXComponent *component = [self componentNamed:@"component0" ofComposite:pulledComposite];
+    XCTAssertEqualObjects([NSData dataWithContentsOfFile:[pulledComposite.current pathForComponent:component withError:&error]],
+                          [self sourceDataOfComponentNamed:@"component0"]);
+}
+
+#pragma mark - Resumed pulls
+
+/*
+ * Cancels a pull while the download of its largest component is in flight and verifies that the
+ * next pull neither downloads the completed components again nor restarts the partial download.
+ */
+- (void)testResumeCancelledPull {
+    NSError *error = nil;
+    NSUInteger largeLength = 400 * 1024;
+    DCXComposite *composite = [self createCompositeWithComponentLengths:@[ @1000, @2000, @(largeLength) ]];
+    [self pushAndAcceptComposite:composite];
+
+    NSString *compositeId = [[NSUUID UUID] UUIDString];
+    DCXComposite *pulledComposite = [DCXComposite compositeFromHref:composite.href andId:compositeId
+                                                            andPath:[_tempPath stringByAppendingPathComponent:compositeId]];
+
+    NSMutableDictionary *requestCounts = [NSMutableDictionary dictionary];
+    _session.errorInjector = ^NSError *(NSString *requestKind, NSString *href) {
+        @synchronized(requestCounts) {
+            requestCounts[requestKind] = @([requestCounts[requestKind] unsignedIntegerValue] + 1);
+        }
+        return nil;
+    };
+
+    // The small components arrive right away while the large one takes about two seconds
+    _session.bandwidth = 200 * 1024;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"cancelled pull"];
+    DCXHTTPRequest *request = [DCXCompositeXfer pullComposite:pulledComposite usingSession:_session
+                                              requestPriority:NSOperationQueuePriorityNormal
+                                                 handlerQueue:nil completionHandler:^(DCXBranch *branch, NSError *error) {
+                                                     XCTAssertNil(branch);
+                                                     XCTAssertNotNil(error);
+                                                     [expectation fulfill];
+                                                 }];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(1 * NSEC_PER_SEC)), dispatch_get_global_queue(0, 0), ^{
+        [request.progress cancel];
+    });
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+    XCTAssertEqualObjects(requestCounts[@"downloadComponent"], @3);
+
+    [requestCounts removeAllObjects];
+    _session.bandwidth = 0;
+    int64_t transferredBytes = _session.transferredBytes;
+    expectation = [self expectationWithDescription:@"resumed pull"];
+    [DCXCompositeXfer pullComposite:pulledComposite usingSession:_session requestPriority:NSOperationQueuePriorityNormal
+                       handlerQueue:nil completionHandler:^(DCXBranch *branch, NSError *error) {
+                           XCTAssertNotNil(branch, @"%@", error);
+                           [expectation fulfill];
+                       }];
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+
+    XCTAssertNil(requestCounts[@"downloadComponent"]);
+    XCTAssertEqualObjects(requestCounts[@"resumeDownloadComponent"], @1);
+    int64_t resumedBytes = _session.transferredBytes - transferredBytes;
+    XCTAssertGreaterThan(resumedBytes, 0);
+    XCTAssertLessThan(resumedBytes, (int64_t)largeLength);
+
+    XCTAssertTrue([pulledComposite resolvePullWithBranch:nil withError:&error], @"%@", error);
+    for (NSString *name in @[ @"component0", @"component1", @"component2" ]) {
+        DCXComponent *component = [self componentNamed:name ofComposite:pulledComposite];
+        NSString *path = [pulledComposite.current pathForComponent:component withError:&error];
+        XCTAssertNotNil(path, @"%@", error);
+        XCTAssertEqualObjects([NSData dataWithContentsOfFile:path], [self sourceDataOfComponentNamed:name]);
+    }
+}
+
+#pragma mark - Fetch
+
+/*
+ * Fetches a component of a minimally pulled composite and verifies that the download delivers the
+ * contents of the pushed file and that later fetches use the local file.
+ */
+- (void)testFetchPathForComponent {
+    NSError *error = nil;
+    DCXComposite *composite = [self createCompositeWithComponentLengths:@[ @1000, @2000 ]];
+    [self pushAndAcceptComposite:composite];
+    DCXComposite *pulledComposite = [self pullCompositeFromHref:composite.href minimal:YES];
+    DCXComponent *component = [self componentNamed:@"component1" ofComposite:pulledComposite];
+    XCTAssertNotNil(component);
+    XCTAssertNil([pulledComposite.current pathForComponent:component withError:&error], @"%@", error);
+
+    __block NSUInteger downloadCount = 0;
+    _session.errorInjector = ^NSError *(NSString *requestKind, NSString *href) {
+        if ([requestKind isEqualToString:@"downloadComponent"]) {
+            downloadCount++;
+        }
+        return nil;
+    };
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"fetch"];
+    __block NSString *fetchedPath = nil;
+    DCXHTTPRequest *request = [pulledComposite.current fetchPathForComponent:component usingSession:_session
+                                                             requestPriority:NSOperationQueuePriorityNormal
+                                                                handlerQueue:nil
+                                                           completionHandler:^(NSString *path, NSError *error) {
+                                                               XCTAssertNotNil(path, @"%@", error);
+                                                               fetchedPath = path;
+                                                               [expectation fulfill];
+                                                           }];
+    XCTAssertNotNil(request);
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+
+    XCTAssertEqual(downloadCount, 1);
+    XCTAssertEqualObjects([NSData dataWithContentsOfFile:fetchedPath], [self sourceDataOfComponentNamed:@"component1"]);
+    XCTAssertEqualObjects([pulledComposite.current pathForComponent:component withError:&error], fetchedPath, @"%@", error);
+
+    // The file is local now so the handler gets called right away without a download
+    __block NSString *localPath = nil;
+    request = [pulledComposite.current fetchPathForComponent:component usingSession:_session
+                                             requestPriority:NSOperationQueuePriorityNormal
+                                                handlerQueue:nil
+                                           completionHandler:^(NSString *path, NSError *error) {
+                                               localPath = path;
+                                           }];
+    XCTAssertNil(request);
+    XCTAssertEqualObjects(localPath, fetchedPath);
+    XCTAssertEqual(downloadCount, 1);
+}
+
+/*
+ * Fetches the same component twice while its download is in flight and verifies that the fetches
+ * share a single download, that both handlers get the path and that the second fetch raises the
+ * priority of the shared request.
+ */
+- (void)testFetchPathForComponentCoalescesDownloads {
+    NSError *error = nil;
+    DCXComposite *composite = [self createCompositeWithComponentLengths:@[ @1000 ]];
+    [self pushAndAcceptComposite:composite];
+    DCXComposite *pulledComposite = [self pullCompositeFromHref:composite.href minimal:YES];
+    DCXComponent *component = [self componentNamed:@"component0" ofComposite:pulledComposite];
+    XCTAssertNil([pulledComposite.current pathForComponent:component withError:&error], @"%@", error);
+
+    // Keep the download in flight long enough for the second fetch to join it
+    _session.latency = 0.2;
+    __block NSUInteger downloadCount = 0;
+    _session.errorInjector = ^NSError *(NSString *requestKind, NSString *href) {
+        if ([requestKind isEqualToString:@"downloadComponent"]) {
+            downloadCount++;
+        }
+        return nil;
+    };
+
+    XCTestExpectation *lowExpectation = [self expectationWithDescription:@"low priority fetch"];
+    XCTestExpectation *highExpectation = [self expectationWithDescription:@"high priority fetch"];
+    __block NSString *lowPath = nil;
+    __block NSString *highPath = nil;
+    DCXHTTPRequest *lowRequest = [pulledComposite.current fetchPathForComponent:component usingSession:_session
+                                                                requestPriority:NSOperationQueuePriorityLow
+                                                                   handlerQueue:nil
+                                                              completionHandler:^(NSString *path, NSError *error) {
+                                                                  XCTAssertNotNil(path, @"%@", error);
+                                                                  lowPath = path;
+                                                                  [lowExpectation fulfill];
+                                                              }];
+    XCTAssertNotNil(lowRequest);
+    XCTAssertEqual(lowRequest.priority, NSOperationQueuePriorityLow);
+
+    DCXHTTPRequest *highRequest = [pulledComposite.current fetchPathForComponent:component usingSession:_session
+                                                                 requestPriority:NSOperationQueuePriorityHigh
+                                                                    handlerQueue:nil
+                                                               completionHandler:^(NSString *path, NSError *error) {
+                                                                   XCTAssertNotNil(path, @"%@", error);
+                                                                   highPath = path;
+                                                                   [highExpectation fulfill];
+                                                               }];
+    XCTAssertEqual(highRequest, lowRequest);
+    XCTAssertEqual(lowRequest.priority, NSOperationQueuePriorityHigh);
+
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+
+    XCTAssertEqual(downloadCount, 1);
+    XCTAssertNotNil(lowPath);
+    XCTAssertEqualObjects(lowPath, highPath);
+    XCTAssertEqualObjects([NSData dataWithContentsOfFile:lowPath], [self sourceDataOfComponentNamed:@"component0"]);
+}
+
+/*
+ * Pulls a composite with a prefetch policy and verifies that only the selected components get
+ * downloaded during the pull and that the skipped ones can be fetched afterwards.
+ */
+- (void)testPullWithPrefetchPolicy {
+    NSError *error = nil;
+    DCXComposite *composite = [self createCompositeWithComponentLengths:@[ @1000, @200000, @2000 ]];
+    [self pushAndAcceptComposite:composite];
+
+    __block NSUInteger downloadCount = 0;
+    _session.errorInjector = ^NSError *(NSString *requestKind, NSString *href) {
+        if ([requestKind isEqualToString:@"downloadComponent"]) {
+            downloadCount++;
+        }
+        return nil;
+    };
+
+    DCXComponentPrefetchPolicy *policy = [[DCXComponentPrefetchPolicy alloc] init];
+    policy.maxLength = @10000;
+    DCXComposite *pulledComposite = [self pullCompositeFromHref:composite.href minimal:NO prefetchPolicy:policy];
+    XCTAssertEqual(downloadCount, 2);
+
+    for (NSString *name in @[ @"component0", @"component2" ]) {
+        DCXComponent *component = [self componentNamed:name ofComposite:pulledComposite];
+        NSString *path = [pulledComposite.current pathForComponent:component withError:&error];
+        XCTAssertNotNil(path, @"%@", error);
+        XCTAssertEqualObjects([NSData dataWithContentsOfFile:path], [self sourceDataOfComponentNamed:name]);
+    }
+
+    // The large component has been skipped and gets downloaded on demand
+    DCXComponent *skippedComponent = [self componentNamed:@"component1" ofComposite:pulledComposite];
+    XCTAssertNotNil(skippedComponent);
+    XCTAssertNil([pulledComposite.current pathForComponent:skippedComponent withError:&error], @"%@", error);
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"fetch"];
+    __block NSString *fetchedPath = nil;
+    [pulledComposite.current fetchPathForComponent:skippedComponent usingSession:_session
+                                   requestPriority:NSOperationQueuePriorityHigh
+                                      handlerQueue:nil
+                                 completionHandler:^(NSString *path, NSError *error) {
+                                     XCTAssertNotNil(path, @"%@", error);
+                                     fetchedPath = path;
+                                     [expectation fulfill];
+                                 }];
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+
+    XCTAssertEqual(downloadCount, 3);
+    XCTAssertEqualObjects([NSData dataWithContentsOfFile:fetchedPath], [self sourceDataOfComponentNamed:@"component1"]);
+    XCTAssertEqual([pulledComposite verifyIntegrityWithLogging:YES shouldBeComplete:YES].count, 0);
+}
+
+@end
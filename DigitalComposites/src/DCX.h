@@ -40,10 +40,13 @@
 #import "DCXError.h"
 
 #import "DCXCompositeXfer.h"
+#import "DCXStorageQuotaManager.h"
+#import "DCXPrefetchPolicy.h"
 
 #import "DCXDropboxSession.h"
 #import "DCXHTTPService.h"
 #import "DCXHTTPRequest.h"
 #import "DCXHTTPResponse.h"
+#import "DCXTransferMetrics.h"
 #import "DCXResource.h"
 #import "DCXResourceItem.h"
@@ -24,6 +24,17 @@
 
 @class DCXNode;
 @class DCXComponent;
+@class DCXHTTPRequest;
+
+@protocol DCXTransferSessionProtocol;
+
+/**
+ * \brief Gets called when DCXBranch fetchPathForComponent:... has completed.
+ *
+ * \param path  The file path of the local file asset of the component or nil if it couldn't be fetched.
+ * \param error The error that caused the fetch to fail. nil if path is not nil.
+ */
+typedef void (^DCXComponentPathCompletionHandler)(NSString *path, NSError *error);
 
 /**
  * Gives read-only access to the DOM of a specific branch of a composite.
@@ -121,6 +132,35 @@
  */
 - (NSString *)pathForComponent:(DCXComponent *)component withError:(NSError **)errorPtr;
 
+/**
+ * \brief Asynchronously returns the file path of the local file asset of the given component,
+ * downloading it first if it isn't available locally, e.g. because the composite has been pulled with
+ * pullMinimalComposite: or the file has been evicted by a DCXStorageQuotaManager.
+ *
+ * Concurrent requests for the same component of this branch share a single download. If a request
+ * joins a download that has been scheduled with a lower priority the download gets the higher
+ * priority so that e.g. components that are about to be displayed (NSOperationQueuePriorityHigh)
+ * overtake the components that get prefetched in the background (NSOperationQueuePriorityLow).
+ * Like pathForComponent:withError: it records the use of the component with the
+ * storageQuotaManager of the composite.
+ *
+ * \param component The component to get the path for.
+ * \param session   The session to use for the download.
+ * \param priority  The priority of the download.
+ * \param queue     Optional parameter. If not nil queue determines the operation queue handler gets
+ * executed on.
+ * \param handler   Gets called with the path once the file is available or with an error if the
+ * download has failed.
+ *
+ * \return The DCXHTTPRequest of the download, which might be shared with other requests for the same
+ * component, or nil if the file is already available locally.
+ */
+- (DCXHTTPRequest *)fetchPathForComponent:(DCXComponent *)component
+                             usingSession:(id<DCXTransferSessionProtocol>)session
+                          requestPriority:(NSOperationQueuePriority)priority
+                             handlerQueue:(NSOperationQueue *)queue
+                        completionHandler:(DCXComponentPathCompletionHandler)handler;
+
 
 #pragma mark - Child Nodes
 
@@ -23,7 +23,7 @@
 #import "DCXBranch_Internal.h"
 #import "DCXMutableBranch.h"
 
-#import "DCXComposite.h"
+#import "DCXComposite_Internal.h"
 #import "DCXComponent.h"
 #import "DCXManifest.h"
 #import "DCXConstants.h"
@@ -32,11 +32,38 @@
 #import "DCXMutableNode.h"
 #import "DCXErrorUtils.h"
 #import "DCXLocalStorage.h"
+#import "DCXStorageQuotaManager.h"
+#import "DCXCompositeXfer.h"
+#import "DCXHTTPRequest.h"
 
 
+// A download of a component that one or more callers of fetchPathForComponent:... are waiting for.
+@interface DCXComponentFetch : NSObject
+
+@property (nonatomic) DCXHTTPRequest *request;
+@property (nonatomic) NSOperationQueuePriority priority;
+@property (nonatomic, readonly) NSMutableArray *handlers;
+
+@end
+
+@implementation DCXComponentFetch
+
+- (instancetype)init
+{
+    if (self = [super init]) {
+        _handlers = [NSMutableArray array];
+    }
+    return self;
+}
+
+@end
+
 @implementation DCXBranch
 {
     DCXManifest *_manifest;
+
+    // Component id -> DCXComponentFetch. Guarded by itself.
+    NSMutableDictionary *_componentFetches;
 }
 
 #pragma mark Private manifest access
@@ -62,6 +89,7 @@
     if (self = [super init]) {
         _weakComposite = composite;
         _manifest = manifest;
+        _componentFetches = [NSMutableDictionary dictionary];
     }
     return self;
 }
@@ -74,8 +102,7 @@
 
 -(instancetype) mutableCopyWithZone:(NSZone *)zone
 {
-    NSData *manifestData = _manifest.localData;
-    DCXManifest *manifestCopy = [[DCXManifest allocWithZone:zone] initWithData:manifestData withError:nil];
+    DCXManifest *manifestCopy = [_manifest copyWithZone:zone];
     
     if (manifestCopy != nil) {
         DCXMutableBranch *copy = [DCXMutableBranch branchWithComposite:_weakComposite andManifest:manifestCopy];
@@ -192,15 +219,114 @@
                                            inManifest:_manifest
                                           ofComposite:composite
                                             withError:errorPtr];
-    if (isPulledBranch || [[NSFileManager defaultManager] fileExistsAtPath:path])
+    if (isPulledBranch)
+        return path;
+    if ([[NSFileManager defaultManager] fileExistsAtPath:path]) {
+        [composite.storageQuotaManager didAccessComponent:component ofComposite:composite];
         return path;
+    }
     return nil;
 }
 
+// Like pathForComponent:withError: but also returns nil for the pulled branch if the file doesn't exist
+-(NSString*) existingPathForComponent:(DCXComponent*)component withError:(NSError**)errorPtr
+{
+    NSString *path = [self pathForComponent:component withError:errorPtr];
+    return (path != nil && [[NSFileManager defaultManager] fileExistsAtPath:path]) ? path : nil;
+}
+
+-(DCXHTTPRequest*) fetchPathForComponent:(DCXComponent*)component
+                            usingSession:(id<DCXTransferSessionProtocol>)session
+                         requestPriority:(NSOperationQueuePriority)priority
+                            handlerQueue:(NSOperationQueue*)queue
+                       completionHandler:(DCXComponentPathCompletionHandler)handler
+{
+    NSAssert(component != nil, @"Parameter component must not be nil.");
+
+    DCXComponentPathCompletionHandler handlerWrapper = ^void(NSString *path, NSError *error) {
+        if (handler != nil) {
+            if (queue != nil) {
+                [queue addOperationWithBlock:^{
+                    handler(path, error);
+                }];
+            } else {
+                handler(path, error);
+            }
+        }
+    };
+
+    NSError *pathError = nil;
+    NSString *localPath = [self existingPathForComponent:component withError:&pathError];
+    if (localPath != nil || pathError != nil) {
+        handlerWrapper(localPath, pathError);
+        return nil;
+    }
+    NSAssert(session != nil, @"Parameter session must not be nil if the component needs to get downloaded.");
+
+    // Join the download of the component if there is one already
+    NSString *componentId = component.componentId;
+    DCXComponentFetch *fetch = nil;
+    @synchronized(_componentFetches) {
+        fetch = _componentFetches[componentId];
+        if (fetch != nil) {
+            [fetch.handlers addObject:handlerWrapper];
+            if (priority > fetch.priority) {
+                // A request that has not been assigned yet picks up the priority when it gets assigned
+                fetch.priority = priority;
+                fetch.request.priority = priority;
+            }
+            return fetch.request;
+        }
+        fetch = [[DCXComponentFetch alloc] init];
+        fetch.priority = priority;
+        [fetch.handlers addObject:handlerWrapper];
+        _componentFetches[componentId] = fetch;
+    }
+
+    DCXHTTPRequest *request = [DCXCompositeXfer downloadComponents:@[component] ofBranch:self usingSession:session
+                                                   requestPriority:priority handlerQueue:nil
+                                                 completionHandler:^(DCXBranch *branch, NSError *error) {
+        NSArray *handlers = nil;
+        @synchronized(_componentFetches) {
+            handlers = [fetch.handlers copy];
+            [_componentFetches removeObjectForKey:componentId];
+        }
+
+        NSString *path = nil;
+        if (branch != nil) {
+            // The download can replace the branch of the composite
+            DCXComponent *downloadedComponent = [branch getComponentWithId:componentId];
+            path = [branch existingPathForComponent:(downloadedComponent != nil ? downloadedComponent : component)
+                                           withError:&error];
+            if (path == nil && error == nil) {
+                error = [DCXErrorUtils ErrorWithCode:DCXErrorComponentReadFailure
+                                              domain:DCXErrorDomain
+                                             details:[NSString stringWithFormat:@"Component %@ has no local file after its download.",
+                                                      componentId]];
+            }
+        }
+        for (DCXComponentPathCompletionHandler fetchHandler in handlers) {
+            fetchHandler(path, error);
+        }
+    }];
+
+    @synchronized(_componentFetches) {
+        fetch.request = request;
+        if (fetch.priority != priority) {
+            request.priority = fetch.priority;
+        }
+    }
+
+    return request;
+}
+
 #pragma mark Storage
 
 - (BOOL) loadManifestFrom:(NSString*)path withError:(NSError**)errorPtr
-{    DCXManifest *newManifest = [DCXManifest manifestWithContentsOfFile:path withError:errorPtr];
+{
+    DCXComposite *composite = self.weakComposite;
+    DCXManifest *newManifest = composite != nil ? [composite loadManifestFromFile:path withError:errorPtr]
+                                                : [DCXManifest manifestWithContentsOfFile:path withError:errorPtr];
     
     if (newManifest == nil) {
         return NO;
@@ -27,6 +27,25 @@
 @class DCXManifest;
 @class DCXComponent;
 @class DCXNode;
+@class DCXStorageQuotaManager;
+@protocol DCXTransferMetricsSink;
+@protocol DCXPrefetchPolicy;
+
+/**
+ * \brief Determines how mergePulledBranchWithConflictPolicy:withError: resolves conflicting changes,
+ * i.e. changes that have been made both locally and on the server to the same child node or component.
+ */
+typedef NS_ENUM (NSInteger, DCXMergeConflictPolicy)
+{
+    /** The server's version wins. */
+    DCXMergeConflictPolicyServerWins = 0,
+    /** The local version wins. */
+    DCXMergeConflictPolicyClientWins = 1,
+    /** A component that has been changed on both sides is kept in both versions. The local version
+     * becomes a new component next to the server's with "-local" appended to its path. Other conflicts
+     * get resolved like with DCXMergeConflictPolicyServerWins. */
+    DCXMergeConflictPolicyKeepBoth = 2,
+};
 
 /**
  * \brief Represents a Digital Composite Technology composite.
@@ -60,7 +79,8 @@
  + After a successful call to DCXCompositeXfer's pullComposite: or pullMinimalComposite: the 'pulled'
  + branch contains the data that was pulled from the service. 'current' remains untouched. If you have
  + made changes to 'current' you can now merge those changes into 'pulled'. Call resolvePullWithBranch:withError:
- + in order to update 'current' from 'pulled' and dispose of 'pulled'.
+ + in order to update 'current' from 'pulled' and dispose of 'pulled'. Alternatively let
+ + resolvePullWithConflictPolicy:withError: merge the changes for you.
  +
  + After a successful call to DCXCompositeXfer's pushComposite: the 'pushed' branch contain updates
  + that stem from the push operation. Call acceptPushWithError: to merge the updated server state from the 'pushed'
@@ -168,6 +188,48 @@
  */
 @property (nonatomic, readwrite) BOOL autoRemoveUnusedLocalFiles;
 
+/** The minimum time in seconds between two full scans of the local component files for unused files.
+ * In between, removeUnusedLocalFilesWithError: only looks at the files that have been added or have lost
+ * their last reference since it last ran, based on an index that it keeps in local storage. Once a full
+ * scan is due the next removal performs it instead, which also catches files that the index doesn't know
+ * about, e.g. the downloads of a pull that has been cancelled. Defaults to one day. A value of 0 disables
+ * the full scans.
+ */
+@property (nonatomic, readwrite) NSTimeInterval unusedLocalFilesScanInterval;
+
+/** The quota manager that the composite has been added to or nil. See DCXStorageQuotaManager addComposite:. */
+@property (nonatomic, readonly, weak) DCXStorageQuotaManager *storageQuotaManager;
+
+/** Controls whether commitChangesWithError: appends the changes to a commit log next to the manifest file
+ * instead of rewriting the whole manifest. The log gets folded back into the manifest file in a background
+ * thread once it has grown large enough. Defaults to NO.
+ */
+@property (nonatomic, readwrite) BOOL commitsIncrementally;
+
+/** Controls whether component files are stored under a name derived from a SHA-256 digest of their
+ * content so that components with identical content share a single local file. Files that are shared
+ * this way must not be modified in place. Defaults to NO.
+ */
+@property (nonatomic, readwrite) BOOL storesComponentsByContent;
+
+/** Controls whether the manifests of the branches get read from compact binary cache files next to the
+ * manifest files, which is a lot faster than parsing their JSON. Stale cache files get detected and
+ * rewritten automatically. Defaults to YES.
+ */
+@property (nonatomic, readwrite) BOOL cachesManifests;
+
+/** Optional sink that gets the durations of the phases of pushes and pulls of this composite as
+ * well as of acceptPushWithError: and resolvePullWithBranch:withError:. If nil, pushes and pulls
+ * report to the metricsSink of the HTTP service of the session they use.
+ */
+@property (nonatomic, strong) id<DCXTransferMetricsSink> metricsSink;
+
+/** Optional policy that decides which components pullComposite:... downloads. The other components
+ * get downloaded on demand, e.g. by DCXBranch fetchPathForComponent:.... If nil, pulls download all
+ * components. See DCXComponentPrefetchPolicy.
+ */
+@property (nonatomic, strong) id<DCXPrefetchPolicy> prefetchPolicy;
+
 /** The state of the composite that has been committed (saved) to local storage.
  *  The string will be one of DCXAssetStateUnmodified, DCXAssetStateModified,
  *  DCXAssetStatePendingDelete, DCXAssetStateCommittedDelete, or nil if the
@@ -217,6 +279,35 @@
  */
 - (BOOL)resolvePullWithBranch:(DCXMutableBranch *)branch withError:(NSError **)errorPtr;
 
+/**
+ * \brief Merges the local changes made to the current branch since the base branch into the pulled
+ * branch and returns the result without modifying the composite.
+ *
+ * Child nodes and components that have been added, removed, moved, renamed or otherwise modified only
+ * on one side keep that change. Changes made on both sides get resolved according to policy. Local
+ * items whose path collides with an item of the server get "-local" appended to their path. The merge
+ * only visits the items that have changed and doesn't access any component files.
+ *
+ * \param policy   Determines how conflicting changes get resolved.
+ * \param errorPtr Gets set to an NSError if a local change cannot be applied.
+ *
+ * \return The merged branch that can be passed to resolvePullWithBranch:withError: or nil if there
+ * is no pulled branch or an error occurred.
+ */
+- (DCXMutableBranch *)mergePulledBranchWithConflictPolicy:(DCXMergeConflictPolicy)policy withError:(NSError **)errorPtr;
+
+/**
+ * \brief Merges the pulled branch with the current branch (see
+ * mergePulledBranchWithConflictPolicy:withError:) and resolves the pull with the result. Is a no-op
+ * if there is no pulled branch.
+ *
+ * \param policy   Determines how conflicting changes get resolved.
+ * \param errorPtr Gets set to an NSError if something goes wrong.
+ *
+ * \return YES on success.
+ */
+- (BOOL)resolvePullWithConflictPolicy:(DCXMergeConflictPolicy)policy withError:(NSError **)errorPtr;
+
 
 /**
  * \brief Accepts the result of a successful push operation by merging the server state in the resulting pushed
@@ -28,12 +28,15 @@
 #import "DCXMutableBranch_Internal.h"
 
 #import "DCXManifest.h"
+#import "DCXManifestMerger.h"
 #import "DCXError.h"
 #import "DCXMutableComponent.h"
 #import "DCXLocalStorage.h"
 #import "DCXPushJournal.h"
+#import "DCXStorageQuotaManager.h"
 
 #import "DCXResourceItem.h"
+#import "DCXTransferMetrics.h"
 #import "DCXConstants_Internal.h"
 #import "DCXFileUtils.h"
 #import "DCXErrorUtils.h"
@@ -50,12 +53,22 @@
     // Used to ensure that we don't start too many background deletion tasks.
     volatile int32_t _deleteFilesInBackgroundRequestCounter;
     
+    // The number of pulls and downloads in progress. See pullDidStart and pullDidFinish.
+    volatile int32_t _activePullCount;
+    
     NSString *_compositeId;
     NSString *_href;
     
     NSString *_committedCompositeState;
 
     NSMutableSet *_inflightLocalComponentFiles;
+    
+    // Component id and etag -> component dictionary. Lets the manifests of the branches share the
+    // dictionaries of their unchanged components (see DCXManifest shareComponentsWithPool:).
+    NSMapTable *_componentPool;
+    
+    // Storage ids of component files that removeUnusedLocalFilesWithError: should check. Guarded by itself.
+    NSMutableSet *_unusedLocalFileCandidates;
 }
 
 #pragma mark Initilizers
@@ -65,18 +78,21 @@
                    withError:(NSError**) errorPtr
 {
     if (self = [super init]) {
+        _componentPool = [NSMapTable strongToWeakObjectsMapTable];
+        _unusedLocalFileCandidates = [NSMutableSet set];
         _href = href;
         _compositeId = compositeId;
         _path = path;
         _deleteFilesInBackgroundRequestCounter = 0;
         _autoRemoveUnusedLocalFiles = YES;
+        _cachesManifests = YES;
+        _unusedLocalFilesScanInterval = 24 * 60 * 60;
         _inflightLocalComponentFiles = [NSMutableSet set];
         
         if (path == nil) {
             return self;
         } else {
-            DCXManifest *manifest = [DCXManifest manifestWithContentsOfFile:self.currentManifestPath
-                                                                            withError:errorPtr];
+            DCXManifest *manifest = [self loadManifestFromFile:self.currentManifestPath withError:errorPtr];
             if (manifest != nil) {
                 [self updateCurrentBranchWithManifest:manifest updateCommittedAtDate:YES];
                 return self;
@@ -85,8 +101,7 @@
                 // Use pulled manifest if no current manifest exists.  This is to support composites previously
                 // instantiated using initWithHref that have been successfully pulled to local storage and
                 // awaiting a resolve operation.
-                DCXManifest *pulledManifest = [DCXManifest manifestWithContentsOfFile:self.pulledManifestPath
-                                                                                      withError:errorPtr];
+                DCXManifest *pulledManifest = [self loadManifestFromFile:self.pulledManifestPath withError:errorPtr];
                 if (pulledManifest != nil) {
                     [self updatePulledBranchWithManifest:pulledManifest];
                     if (_href == nil) {
@@ -113,6 +128,8 @@
         _path = path;
         _deleteFilesInBackgroundRequestCounter = 0;
         _autoRemoveUnusedLocalFiles = YES;
+        _cachesManifests = YES;
+        _unusedLocalFilesScanInterval = 24 * 60 * 60;
         _inflightLocalComponentFiles = [NSMutableSet set];
         
         [self updateCurrentBranchWithManifest:[DCXManifest manifestWithName:name andType:type] updateCommittedAtDate:NO];
@@ -131,11 +148,15 @@
 - (instancetype)initWithManifest:(DCXManifest *)manifest andPath:(NSString *)path
 {
     if (self = [super init]) {
+        _componentPool = [NSMapTable strongToWeakObjectsMapTable];
+        _unusedLocalFileCandidates = [NSMutableSet set];
         [self updateCurrentBranchWithManifest:manifest updateCommittedAtDate:YES];
         _compositeId   = manifest.compositeId;
         _path        = path;
         _deleteFilesInBackgroundRequestCounter = 0;
         _autoRemoveUnusedLocalFiles = YES;
+        _cachesManifests = YES;
+        _unusedLocalFilesScanInterval = 24 * 60 * 60;
         _inflightLocalComponentFiles = [NSMutableSet set];
         
         return self;
@@ -287,12 +308,20 @@
 
 #pragma mark Branches
 
+-(DCXManifest*) loadManifestFromFile:(NSString*)path withError:(NSError**)errorPtr
+{
+    DCXManifest *manifest = [DCXManifest manifestWithContentsOfFile:path usingCache:self.cachesManifests
+                                                          withError:errorPtr];
+    [manifest shareComponentsWithPool:_componentPool];
+    
+    return manifest;
+}
+
 -(DCXMutableBranch *) current
 {
     if (_current == nil) {
         NSString *path = self.currentManifestPath;
-        DCXManifest *manifest = [DCXManifest manifestWithContentsOfFile:path
-                                                                        withError:nil];
+        DCXManifest *manifest = [self loadManifestFromFile:path withError:nil];
         if (manifest != nil) {
             _current = [DCXMutableBranch branchWithComposite:self
                                                                         andManifest:manifest];
@@ -305,6 +334,8 @@
 
 -(void) updateCurrentBranchWithManifest:(DCXManifest *)manifest updateCommittedAtDate:(BOOL)updateCommittedAt
 {
+    [self.storageQuotaManager localStorageOfCompositeDidChange:self];
+    [manifest shareComponentsWithPool:_componentPool];
     if (manifest == nil) {
         _current = nil;
         self.currentBranchCommittedAtDate = nil;
@@ -323,8 +354,7 @@
 {
     if (_localCommitted == nil) {
         NSString *path = self.currentManifestPath;
-        DCXManifest *manifest = [DCXManifest manifestWithContentsOfFile:path
-                                                                        withError:nil];
+        DCXManifest *manifest = [self loadManifestFromFile:path withError:nil];
         if (manifest != nil) {
             _localCommitted = [DCXBranch branchWithComposite:self
                                                                         andManifest:manifest];
@@ -336,6 +366,7 @@
 
 -(void) updateLocalBranch
 {
+    [self.storageQuotaManager localStorageOfCompositeDidChange:self];
     // Let the "localCommitted" property construct it lazily if anyone needs it.
     _localCommitted = nil;
 }
@@ -344,8 +375,7 @@
 {
     if (_pulled == nil) {
         NSString *path = self.pulledManifestPath;
-        DCXManifest *manifest = [DCXManifest manifestWithContentsOfFile:path
-                                                                        withError:nil];
+        DCXManifest *manifest = [self loadManifestFromFile:path withError:nil];
         if (manifest != nil) {
             _pulled = [DCXBranch branchWithComposite:self
                                                                        andManifest:manifest];
@@ -357,6 +387,8 @@
 
 -(void) updatePulledBranchWithManifest:(DCXManifest *)manifest
 {
+    [self.storageQuotaManager localStorageOfCompositeDidChange:self];
+    [manifest shareComponentsWithPool:_componentPool];
     if (manifest == nil) {
         _pulled = nil;
     } else if (_pulled == nil) {
@@ -371,8 +403,7 @@
 {
     if (_pushed == nil) {
         NSString *path = self.pushedManifestPath;
-        DCXManifest *manifest = [DCXManifest manifestWithContentsOfFile:path
-                                                                        withError:nil];
+        DCXManifest *manifest = [self loadManifestFromFile:path withError:nil];
         if (manifest != nil) {
             _pushed = [DCXBranch branchWithComposite:self
                                                                        andManifest:manifest];
@@ -384,6 +415,8 @@
 
 -(void) updatePushedBranchWithManifest:(DCXManifest *)manifest
 {
+    [self.storageQuotaManager localStorageOfCompositeDidChange:self];
+    [manifest shareComponentsWithPool:_componentPool];
     if (manifest == nil) {
         _pushed = nil;
     } else if (_pushed == nil) {
@@ -399,8 +432,7 @@
     if (_base == nil) {
         NSString *path = self.baseManifestPath;
         if (path) {
-            DCXManifest *manifest = [DCXManifest manifestWithContentsOfFile:path
-                                                                            withError:nil];
+            DCXManifest *manifest = [self loadManifestFromFile:path withError:nil];
             if (manifest != nil) {
                 _base = [DCXBranch branchWithComposite:self
                                                                            andManifest:manifest];
@@ -413,6 +445,7 @@
 
 -(void) updateBaseBranch
 {
+    [self.storageQuotaManager localStorageOfCompositeDidChange:self];
     // Let the "base" property construct it lazily if anyone needs it.
     // We don't need the withManifest variant because there are no cases where a base branch
     // is updated except when a pushed or pulled branch is accepted.
@@ -431,6 +464,7 @@
     NSFileManager *fm = [NSFileManager defaultManager];
     if ( [fm fileExistsAtPath:self.pushedManifestPath] ) {
         [fm removeItemAtPath:self.pushedManifestPath error:nil];
+        [DCXManifest removeCacheOfManifestPath:self.pushedManifestPath];
         [self updatePushedBranchWithManifest:nil];
     }
 }
@@ -462,6 +496,11 @@
     return _path == nil ? nil : [DCXLocalStorage pushJournalPathForComposite:self];
 }
 
+-(NSString*) pullJournalPath
+{
+    return _path == nil ? nil : [DCXLocalStorage pullJournalPathForComposite:self];
+}
+
 -(NSString*) clientDataPath
 {
     return _path == nil ? nil : [DCXLocalStorage clientDataPathForComposite:self];
@@ -578,9 +617,19 @@
 
     // Compute the size of any saved manifests
     unsigned long long manifestBytes = 0;
-    NSArray *manifestPaths = [NSArray arrayWithObjects:self.currentManifestPath, self.baseManifestPath, self.pushJournalPath, self.pushedManifestPath, self.pulledManifestPath,
+    NSArray *manifestPaths = [NSArray arrayWithObjects:self.currentManifestPath, [DCXManifest commitLogPathForManifestPath:self.currentManifestPath],
+                              self.baseManifestPath, self.pushJournalPath, [self.pushJournalPath stringByAppendingPathExtension:@"log"],
+                              self.pullJournalPath,
+                              self.pushedManifestPath, self.pulledManifestPath,
                               self.pushedManifestBasePath, self.pulledManifestBasePath, nil];
-    for ( NSString *filePath in manifestPaths ) {
+    // Include the cache files that accompany the manifests
+    NSMutableArray *filePaths = [manifestPaths mutableCopy];
+    for ( NSString *manifestPath in [NSArray arrayWithObjects:self.currentManifestPath, self.baseManifestPath,
+                                     self.pushedManifestPath, self.pulledManifestPath,
+                                     self.pushedManifestBasePath, self.pulledManifestBasePath, nil] ) {
+        [filePaths addObject:[DCXManifest cachePathForManifestPath:manifestPath]];
+    }
+    for ( NSString *filePath in filePaths ) {
         fileAttributes = [fm attributesOfItemAtPath:filePath error:nil];
         if ( fileAttributes != nil ) {
             manifestBytes += [[fileAttributes objectForKey:NSFileSize] unsignedLongLongValue];
@@ -630,7 +679,29 @@
 
 -(void) updateLocalStorageDataInManifest:(DCXManifest *)targetManifest fromManifestArray:(NSArray *)sourceManifests
 {
+    NSSet *storageIds = [NSSet setWithArray:[[targetManifest valueForKey:DCXLocalDataManifestKey][DCXLocalStorageAssetIdMapManifestKey] allValues]];
     [DCXLocalStorage updateLocalStorageDataInManifest:targetManifest fromManifestArray:sourceManifests];
+    
+    // The files of new storage ids get downloaded before the manifest gets written
+    NSMutableSet *newStorageIds = [NSMutableSet setWithArray:[[targetManifest valueForKey:DCXLocalDataManifestKey][DCXLocalStorageAssetIdMapManifestKey] allValues]];
+    [newStorageIds minusSet:storageIds];
+    [self addUnusedLocalFileCandidates:newStorageIds];
+}
+
+-(void) addUnusedLocalFileCandidates:(NSSet*)storageIds
+{
+    @synchronized(_unusedLocalFileCandidates) {
+        [_unusedLocalFileCandidates unionSet:storageIds];
+    }
+}
+
+-(NSSet*) takeUnusedLocalFileCandidates
+{
+    @synchronized(_unusedLocalFileCandidates) {
+        NSSet *candidates = [_unusedLocalFileCandidates copy];
+        [_unusedLocalFileCandidates removeAllObjects];
+        return candidates;
+    }
 }
 
 -(NSNumber*) removeLocalFilesForComponentsWithIDs:(NSArray*)componentIDs errorList:(NSArray**)errorListPtr
@@ -645,6 +716,35 @@
     DCXBranch *committedBranch = self.localCommitted;
     DCXBranch *baseBranch = self.base;
     
+    // Content-addressed files can be shared with components that are not getting evicted. We count
+    // the references once up front so that checking each evicted component doesn't search the manifests.
+    NSCountedSet *sharedStorageIDs = nil;
+    if ( self.storesComponentsByContent ) {
+        NSMutableArray *sharingManifests = [NSMutableArray arrayWithCapacity:6];
+        if ( self.current.manifest != nil ) {
+            [sharingManifests addObject:self.current.manifest];
+        }
+        if ( committedBranch.manifest != nil ) {
+            [sharingManifests addObject:committedBranch.manifest];
+        }
+        if ( baseBranch.manifest != nil ) {
+            [sharingManifests addObject:baseBranch.manifest];
+        }
+        // A pending pull or push still needs the files of its manifest
+        if ( self.pulled.manifest != nil ) {
+            [sharingManifests addObject:self.pulled.manifest];
+        }
+        if ( self.pushed.manifest != nil ) {
+            [sharingManifests addObject:self.pushed.manifest];
+        }
+        DCXManifest *activePushManifest = self.activePushManifest;
+        if ( activePushManifest != nil ) {
+            [sharingManifests addObject:activePushManifest];
+        }
+        sharedStorageIDs = [DCXLocalStorage contentStorageIdsOfComponentsOtherThan:[NSSet setWithArray:componentIDs]
+                                                                        inManifests:sharingManifests];
+    }
+    
     for ( NSString *componentID in componentIDs ) {
         DCXComponent *currentComponent = [self.current getComponentWithId:componentID];
         DCXComponent *committedComponent = [committedBranch getComponentWithId:componentID];
@@ -682,7 +782,9 @@
             if ( !componentFilePath ) {
                 [errors addObject:error];
             }
-            else if ( ![removedComponentPaths containsObject:componentFilePath] ) {
+            else if ( ![removedComponentPaths containsObject:componentFilePath]
+                     && ![DCXLocalStorage isLocalFileOfComponent:component inManifest:manifest
+                                             sharedByStorageIds:sharedStorageIDs] ) {
                 NSDictionary *attributes = [fm attributesOfItemAtPath:componentFilePath error:nil];
                 if ( attributes ) {
                     // Local file exists
@@ -928,6 +1030,31 @@
 
 #pragma mark Push & Pull Support
 
+-(BOOL) hasActivePull
+{
+    return _activePullCount > 0;
+}
+
+-(void) pullDidStart
+{
+    OSAtomicIncrement32Barrier(&_activePullCount);
+}
+
+-(void) pullDidFinish
+{
+    if (OSAtomicDecrement32Barrier(&_activePullCount) < 0) {
+        NSAssert(NO, @"Unbalanced call to pullDidFinish.");
+    }
+}
+
+-(void) reportPhase:(NSString*)phase startedAt:(NSDate*)start
+{
+    id<DCXTransferMetricsSink> sink = self.metricsSink;
+    if ([sink respondsToSelector:@selector(didFinishPhase:ofComposite:withDuration:)]) {
+        [sink didFinishPhase:phase ofComposite:self.compositeId withDuration:-[start timeIntervalSinceNow]];
+    }
+}
+
 -(BOOL) resolvePullWithBranch:(DCXMutableBranch *)branch withError:(NSError *__autoreleasing *)errorPtr
 {
     NSFileManager *fm = [NSFileManager defaultManager];
@@ -935,14 +1062,48 @@
         // Early return if there is no pulled manifest
         return YES;
     }
+    NSDate *start = [NSDate date];
     NSError *error = nil;
     BOOL result = [self internalResolvePulledBranch:branch withError:&error updateInMemory:YES];
+    [self reportPhase:DCXTransferPhaseResolvePull startedAt:start];
     if ( !result && errorPtr != NULL) {
         *errorPtr = error;
     }
     return result;
 }
 
+-(DCXMutableBranch *) mergePulledBranchWithConflictPolicy:(DCXMergeConflictPolicy)policy withError:(NSError **)errorPtr
+{
+    DCXBranch *pulled = self.pulled;
+    if (pulled == nil) {
+        return nil;
+    }
+    DCXManifest *serverManifest = pulled.manifest;
+    DCXManifest *localManifest = self.current.manifest;
+    if (localManifest == nil) {
+        return [DCXMutableBranch branchWithComposite:self andManifest:[serverManifest copy]];
+    }
+    // Without a base everything counts as added on both sides and items that exist on both sides keep
+    // the server's version
+    DCXManifest *baseManifest = self.base.manifest
+        ?: [[DCXManifest alloc] initWithName:serverManifest.name andType:serverManifest.type];
+    
+    DCXManifest *merged = [DCXManifestMerger mergeManifest:localManifest intoManifest:serverManifest
+                                              baseManifest:baseManifest conflictPolicy:policy withError:errorPtr];
+    
+    return merged == nil ? nil : [DCXMutableBranch branchWithComposite:self andManifest:merged];
+}
+
+-(BOOL) resolvePullWithConflictPolicy:(DCXMergeConflictPolicy)policy withError:(NSError **)errorPtr
+{
+    if (self.pulled == nil) {
+        return YES;
+    }
+    DCXMutableBranch *merged = [self mergePulledBranchWithConflictPolicy:policy withError:errorPtr];
+    
+    return merged != nil && [self resolvePullWithBranch:merged withError:errorPtr];
+}
+
 -(BOOL) internalResolvePulledBranch:(DCXMutableBranch *)branch withError:(NSError **)errorPtr
                     updateInMemory:(BOOL)updateCurrent
 {
@@ -958,8 +1119,7 @@
     
     if (success && updateCurrent) {
         // Instantiate new manifest
-        DCXManifest *manifest = [DCXManifest manifestWithContentsOfFile:self.currentManifestPath
-                                                                        withError:errorPtr];
+        DCXManifest *manifest = [self loadManifestFromFile:self.currentManifestPath withError:errorPtr];
         if (manifest != nil) {
             [self updateCurrentBranchWithManifest:manifest updateCommittedAtDate:NO];
         } else {
@@ -985,6 +1145,7 @@
         // No-op if no push data exists
         return YES;
     }
+    NSDate *start = [NSDate date];
 
     if ( !self.current.isDirty ) {
         // If there are no in-memory changes to the current branch then we only need to merge with current and commit the changes to disk
@@ -1015,6 +1176,7 @@
     if ( success && [DCXFileUtils moveFileAtomicallyFrom:self.pushedManifestPath
                                                       to:self.baseManifestPath
                                                withError:&error] ) {
+        [DCXManifest moveCacheOfManifestPath:self.pushedManifestPath toPath:self.baseManifestPath];
         [self updateBaseBranch];
     }
     else {
@@ -1031,6 +1193,7 @@
         [self updatePushedBranchWithManifest:nil];
         [self removeUnusedLocalFilesWithError:nil];
     }
+    [self reportPhase:DCXTransferPhaseAcceptPush startedAt:start];
     if ( !success && errorPtr != NULL ) {
         *errorPtr = error;
     }
@@ -1161,8 +1324,7 @@
     DCXManifest *result = nil;
     if ( _localCommitted == nil ) {
         NSString *path = self.currentManifestPath;
-        DCXManifest *manifest = [DCXManifest manifestWithContentsOfFile:path
-                                                                        withError:errorPtr];
+        DCXManifest *manifest = [self loadManifestFromFile:path withError:errorPtr];
         if ( manifest != nil ) {
             result = manifest;
         }
@@ -1203,8 +1365,7 @@
     // Read the pushed manifest
     DCXManifest *pushedManifest = nil;
     if (error == nil) {
-        pushedManifest = [DCXManifest manifestWithContentsOfFile:self.pushedManifestPath
-                                                            withError:&error];
+        pushedManifest = [self loadManifestFromFile:self.pushedManifestPath withError:&error];
     }
     DCXBranch *pushedBranch = nil;
     if (error == nil) {
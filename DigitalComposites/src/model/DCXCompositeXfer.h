@@ -28,6 +28,20 @@
 
 @protocol DCXTransferSessionProtocol;
 
+/**
+ * \brief The order in which a push uploads the component files that need to be uploaded.
+ */
+typedef NS_ENUM (NSInteger, DCXPushUploadOrder)
+{
+    /** Uploads the largest files first so that they don't end up holding up the end of the push. */
+    DCXPushUploadOrderLargestFirst = 0,
+    /** Uploads the smallest files first so that progress becomes visible as early as possible. */
+    DCXPushUploadOrderSmallestFirst = 1,
+};
+
+/** The number of component uploads a push keeps in flight unless specified otherwise. */
+extern const NSUInteger DCXPushDefaultMaxConcurrentUploads;
+
 /**
  * Implementation of the push & pull logic for composites.
  */
@@ -189,6 +203,33 @@ typedef void (^DCXPullCompletionHandler)(DCXBranch *, NSError *);
                      handlerQueue:(NSOperationQueue *)queue
                 completionHandler:(DCXPushCompletionHandler)handler;
 
+/**
+ * \brief Same as pushComposite:usingSession:requestPriority:handlerQueue:completionHandler: but
+ * lets the caller control how the component uploads get scheduled. The components that need to be
+ * uploaded get sorted according to order and are then fed into a window of at most
+ * maxConcurrentUploads in-flight requests. Requests for further components only get created once
+ * earlier uploads have finished.
+ *
+ * \param composite            The DCXComposite to push.
+ * \param session              The session to use for the required http requests.
+ * \param priority             The relative priority of the push.
+ * \param maxConcurrentUploads The maximum number of component uploads in flight. Must be at least 1.
+ * \param order                The order in which to upload the components.
+ * \param queue                Optional parameter. If not nil queue determines the operation queue handler
+ *                           gets executed on.
+ * \param handler              Gets called when the push has completed.
+ *
+ * \return                     A DCXHTTPRequest object that can be used to track progress, adjust the priority
+ *                           of the push and to cancel it.
+ */
++ (DCXHTTPRequest *)pushComposite:(DCXComposite *)composite
+                     usingSession:(id<DCXTransferSessionProtocol>)session
+                  requestPriority:(NSOperationQueuePriority)priority
+             maxConcurrentUploads:(NSUInteger)maxConcurrentUploads
+                      uploadOrder:(DCXPushUploadOrder)order
+                     handlerQueue:(NSOperationQueue *)queue
+                completionHandler:(DCXPushCompletionHandler)handler;
+
 #pragma mark - Pull
 
 /**
@@ -241,6 +282,9 @@ typedef void (^DCXPullCompletionHandler)(DCXBranch *, NSError *);
  * \note pullComposite:... doesn't modify the current state of the composite and thus is only the
  * first step of a 2-3 step pull operation. See below for details.
  *
+ * \note If the composite has a prefetchPolicy only the components selected by the policy get
+ * downloaded. The other components are missing their local files like after pullMinimalComposite:.
+ *
  * A Complete Pull Operation
  * -------------------------
  *
@@ -27,6 +27,7 @@
 
 #import "DCXCompositeRequest.h"
 #import "DCXPushJournal.h"
+#import "DCXPullJournal.h"
 #import "DCXComposite_Internal.h"
 #import "DCXManifest.h"
 #import "DCXMutableComponent.h"
@@ -34,11 +35,14 @@
 #import "DCXBranch_Internal.h"
 #import "DCXMutableBranch_Internal.h"
 #import "DCXNode.h"
+#import "DCXPrefetchPolicy.h"
 #import "DCXLocalStorage.h"
+#import "DCXStorageQuotaManager.h"
 #import "DCXResourceItem.h"
 
 #import "DCXServiceMapping.h"
 #import "DCXHTTPService.h"
+#import "DCXTransferMetrics.h"
 
 #import "DCXErrorUtils.h"
 #import "DCXFileUtils.h"
@@ -49,6 +53,9 @@ typedef void (^PullCompletionHandler)(NSMutableArray *downloadErrors);
 typedef void (^DCXCompositeManifestDownloadBlock)(DCXManifest*, DCXManifestRequestCompletionHandler);
 typedef DCXHTTPRequest* (^DCXCompositeManifestUploadRequest)(DCXManifest*, void(^)(DCXManifest*, NSError*));
 typedef DCXManifest* (^DCXCompositeManifestDownload)(DCXManifest*, NSError**);
+typedef void (^PushUploadBlock)(NSArray *upload, void(^uploadDidFinish)(void));
+
+const NSUInteger DCXPushDefaultMaxConcurrentUploads = 8;
 
 #pragma mark - Tracker
 
@@ -83,6 +90,10 @@ typedef DCXManifest* (^DCXCompositeManifestDownload)(DCXManifest*, NSError**);
 /** Record that a component was skipped over during the upload because it was unmodified */
 -(void) componentWasUnmodified:(DCXComponent*)component;
 
+/** Record that a modified component was skipped over during the upload because its local file
+ is identical to the one on the server */
+-(void) componentWasUnchanged:(DCXComponent*)component;
+
 /** Returns the list of errors that occurred, or nil if none did. */
 -(NSArray*) getErrors;
 
@@ -160,6 +171,19 @@ andPushCompletionHandler:(PushCompletionHandler)completionHandler
     }
 }
 
+-(void) componentWasUnchanged:(DCXComponent *)component
+{
+    DCXMutableComponent *unchangedComponent = [component mutableCopy];
+    unchangedComponent.state = DCXAssetStateUnmodified;
+    @synchronized(self){
+        [componentsToBeUpdated addObject:unchangedComponent];
+        pendingOperationCount--;
+        if(pendingOperationCount == 0){
+            [self onPushCompletion];
+        }
+    }
+}
+
 -(void) componentWasAdded:(DCXComponent *)component fromPath:(NSString*)path
               ofComposite:(DCXComposite*)composite error:(NSError *)error
 {
@@ -239,6 +263,84 @@ andPushCompletionHandler:(PushCompletionHandler)completionHandler
 @end
 
 
+#pragma mark - Upload Scheduler
+
+/**
+ Feeds a list of pending uploads into a bounded window of in-flight uploads. The upload block
+ gets called for each upload and must call the uploadDidFinish block it gets passed exactly once
+ when the upload has finished, successfully or not. All methods in this class are thread-safe.
+ */
+@interface PushUploadScheduler : NSObject
+
+-(id) initWithUploads:(NSArray*)uploads maxConcurrentUploads:(NSUInteger)maxConcurrentUploads
+          uploadBlock:(PushUploadBlock)uploadBlock;
+
+/** Starts as many uploads as the window allows. */
+-(void) start;
+
+@end
+
+@implementation PushUploadScheduler
+{
+    NSMutableArray  *_pendingUploads;
+    NSUInteger      _maxConcurrentUploads;
+    NSUInteger      _activeUploads;
+    BOOL            _isStartingUploads;
+    PushUploadBlock _uploadBlock;
+}
+
+-(id) initWithUploads:(NSArray*)uploads maxConcurrentUploads:(NSUInteger)maxConcurrentUploads
+          uploadBlock:(PushUploadBlock)uploadBlock
+{
+    NSAssert(maxConcurrentUploads > 0, @"Parameter maxConcurrentUploads must be at least 1.");
+    if (self = [super init]) {
+        _pendingUploads = [uploads mutableCopy];
+        _maxConcurrentUploads = maxConcurrentUploads;
+        _activeUploads = 0;
+        _isStartingUploads = NO;
+        _uploadBlock = uploadBlock;
+    }
+    return self;
+}
+
+-(void) start
+{
+    // Uploads can finish synchronously (e.g. when the push has been cancelled) so only one thread
+    // at a time starts uploads. It keeps going for as long as there are free slots in the window.
+    @synchronized(self){
+        if (_isStartingUploads) {
+            return;
+        }
+        _isStartingUploads = YES;
+    }
+    while (YES) {
+        NSArray *upload = nil;
+        @synchronized(self){
+            if (_activeUploads >= _maxConcurrentUploads || _pendingUploads.count == 0) {
+                _isStartingUploads = NO;
+                return;
+            }
+            upload = _pendingUploads[0];
+            [_pendingUploads removeObjectAtIndex:0];
+            _activeUploads++;
+        }
+        _uploadBlock(upload, ^{
+            [self uploadDidFinish];
+        });
+    }
+}
+
+-(void) uploadDidFinish
+{
+    @synchronized(self){
+        _activeUploads--;
+    }
+    [self start];
+}
+
+@end
+
+
 @interface PullComponentTracker:NSObject
 -(void) setPendingComponnents:(int)pendingComponents;
 -(void) componentWasDownloadedWithError:(NSError*)error;
@@ -290,6 +392,24 @@ andPushCompletionHandler:(PushCompletionHandler)completionHandler
 
 @implementation DCXCompositeXfer
 
+#pragma mark - Metrics
+
+/**
+Reports the time since start as the duration of the given phase of a push or pull to the metrics
+sink of the composite or, if it doesn't have one, to the metrics sink of the session's service.
+*/
++(void) reportPhase:(NSString*)phase ofComposite:(DCXComposite*)composite
+          startedAt:(NSDate*)start usingSession:(id<DCXTransferSessionProtocol>)session
+{
+    id<DCXTransferMetricsSink> sink = composite.metricsSink;
+    if (sink == nil && [session isKindOfClass:[DCXSession class]]) {
+        sink = ((DCXSession*)session).service.metricsSink;
+    }
+    if ([sink respondsToSelector:@selector(didFinishPhase:ofComposite:withDuration:)]) {
+        [sink didFinishPhase:phase ofComposite:composite.compositeId withDuration:-[start timeIntervalSinceNow]];
+    }
+}
+
 #pragma mark - Push - Public API
 
 +(DCXHTTPRequest*) pushComposite:(DCXComposite *)composite
@@ -298,6 +418,21 @@ andPushCompletionHandler:(PushCompletionHandler)completionHandler
                             handlerQueue :(NSOperationQueue *)queue
                         completionHandler:(DCXPushCompletionHandler)handler
 {
+    return [self pushComposite:composite usingSession:session requestPriority:priority
+          maxConcurrentUploads:DCXPushDefaultMaxConcurrentUploads uploadOrder:DCXPushUploadOrderLargestFirst
+                  handlerQueue:queue completionHandler:handler];
+}
+
++(DCXHTTPRequest*) pushComposite:(DCXComposite *)composite
+                    usingSession:(id<DCXTransferSessionProtocol>)session
+                 requestPriority:(NSOperationQueuePriority)priority
+            maxConcurrentUploads:(NSUInteger)maxConcurrentUploads
+                     uploadOrder:(DCXPushUploadOrder)order
+                    handlerQueue:(NSOperationQueue *)queue
+               completionHandler:(DCXPushCompletionHandler)handler
+{
+    NSAssert(maxConcurrentUploads > 0, @"Parameter maxConcurrentUploads must be at least 1.");
+    
     // Defining the callback that issues the upload request for the manifest
     DCXCompositeManifestUploadRequest uploadRequest = ^DCXHTTPRequest*(DCXManifest *manifest, void (^handler)(DCXManifest*, NSError*)) {
         NSAssert(composite.activePushManifest != nil, @"Unexpected composite state: activePushManifest should not be nil.");
@@ -315,10 +450,12 @@ andPushCompletionHandler:(PushCompletionHandler)completionHandler
     // if the caller starts modifying the current branch immediately after calling this method.
     NSError *manifestReadError = nil;
     __block DCXManifest *pushManifest = [composite copyCommittedManifestWithError:&manifestReadError];
+    NSDate *pushStart = [NSDate date];
     
     void(^pushCompletionHandler)(BOOL, NSError*) = ^void(BOOL success, NSError*  error){
         // push manifest not needed anymore
         composite.activePushManifest = nil;
+        [self reportPhase:DCXTransferPhasePush ofComposite:composite startedAt:pushStart usingSession:session];
         if(handler){
             if(queue != nil){
                 [queue addOperationWithBlock:^{
@@ -336,6 +473,8 @@ andPushCompletionHandler:(PushCompletionHandler)completionHandler
           pushManifestReadError:manifestReadError
                    usingSession:session
                compositeRequest:compRequest
+           maxConcurrentUploads:maxConcurrentUploads
+                    uploadOrder:order
             updateManifestBlock:uploadRequest
               completionHandler:pushCompletionHandler];
 
@@ -344,6 +483,30 @@ andPushCompletionHandler:(PushCompletionHandler)completionHandler
 
 #pragma mark Push - Internal
 
+/**
+Returns YES if the local file of the component has the same content as the file of the same
+version of the component in the base branch, i.e. the bytes that are already on the server.
+*/
++(BOOL) localFileOfComponent:(DCXComponent*)component
+                  inManifest:(DCXManifest*)manifest
+      matchesBaseOfComposite:(DCXComposite*)composite
+{
+    DCXManifest *baseManifest = composite.base.manifest;
+    DCXComponent *baseComponent = [baseManifest.allComponents objectForKey:component.componentId];
+    if (baseComponent == nil || baseComponent.etag == nil
+        || ![baseComponent.etag isEqualToString:component.etag]
+        || ![baseComponent.type isEqualToString:component.type]) {
+        return NO;
+    }
+    NSString *baseDigest = [DCXLocalStorage digestOfComponent:baseComponent inManifest:baseManifest
+                                                  ofComposite:composite];
+    if (baseDigest == nil) {
+        return NO;
+    }
+    return [baseDigest isEqualToString:[DCXLocalStorage digestOfComponent:component inManifest:manifest
+                                                               ofComposite:composite]];
+}
+
 /**
 This is a helper method for pushComposite; it handles _just_ the components.
 
@@ -351,16 +514,20 @@ Upon successful completion, ``manifest`` will have been modified to reflect the
 of pushing these components to the server: remaining components will have a state of 'unmodified',
 and components with a prior state of committedDelete will have been removed.
 
-This method will issue some operations in parallel, and therefore can collect a set of
-errors when something goes wrong. If everything succeeds, it returns YES and errorListPtr
-is not touched. If an error occurs, it returns NO and sets errorListPtr to an NSArray of
-NSError objects.
+The components that need to be uploaded are sorted according to ``order`` and then issued
+through a PushUploadScheduler so that no more than ``maxConcurrentUploads`` upload requests
+exist at any time. Everything else gets resolved synchronously before the first upload starts.
+
+This method can collect a set of errors when something goes wrong. They get reported to the
+completion handler of the tracker.
 */
 +(void) pushComponentsInManifest:(DCXManifest*)manifest
                      ofComposite:(DCXComposite*)composite
                     usingSession:(id<DCXTransferSessionProtocol>)session
                      withJournal:(DCXPushJournal*)journal
                 compositeRequest:(DCXCompositeRequest*)compRequest
+            maxConcurrentUploads:(NSUInteger)maxConcurrentUploads
+                     uploadOrder:(DCXPushUploadOrder)order
                 componentTracker:(PushComponentTracker*) tracker
 
 {
@@ -370,11 +537,11 @@ NSError objects.
     // Object to be used for synchronization
     NSString *const accessLock = @"accessLock";
     
-    // Implementation Note: Because we schedule as many operations as possibly asynchronously,
-    // we can easily traverse the full set of components, and have all operations scheduled,
-    // before we find out about any errors. So, rather than trying to abort early in those
-    // scenarios, we generally ignore errors until the end.
+    // Implementation Note: Because we schedule operations asynchronously, we can easily
+    // traverse the full set of components before we find out about any errors. So, rather
+    // than trying to abort early in those scenarios, we generally ignore errors until the end.
     NSFileManager *fm = [NSFileManager defaultManager];
+    NSDate *diffStart = [NSDate date];
     
     // Traverse the list of all components, dispatching each appropriately.
     NSArray *componentIds = [manifest.allComponents allKeys];
@@ -386,6 +553,10 @@ NSError objects.
 
     [tracker setPendingComponents: (int)componentIds.count];
     
+    // Tuples of component, local file path and whether the component is new
+    NSMutableArray *uploads = [NSMutableArray array];
+    int64_t totalUploadLength = 0;
+    
     for (id idKey in componentIds) {
         DCXComponent *component  = [manifest.allComponents objectForKey:idKey];
         NSError *error = nil;
@@ -425,65 +596,16 @@ NSError objects.
                 [journal clearComponent:component];
             }
             
-            // Now we can do the actual upload
-            if (progress.isCancelled) {
-                NSError *err = [DCXErrorUtils ErrorWithCode:DCXErrorCancelled
-                                                     domain:DCXErrorDomain details:nil];
-                [tracker componentWasAdded:component fromPath:nil ofComposite:composite error:err];
-            } else {
-                int64_t length = [component.length longLongValue] + DCXHTTPProgressCompletionFudge;
-                if (progress.totalUnitCount < 0) {
-                    progress.totalUnitCount = length;
-                    progress.completedUnitCount = 0;
-                } else {
-                    progress.totalUnitCount += length;
-                }
-                [progress becomeCurrentWithPendingUnitCount:length];
-                DCXHTTPRequest *request = [session uploadComponent:component ofComposite:composite
-                                                          fromPath:filePath componentIsNew:componentIsNew
-                                                   requestPriority:compRequest.priority
-                                                      handlerQueue:nil
-                                                 completionHandler:^(DCXComponent *c, NSError *err) {
-                                                     NSInteger statusCode = 200;
-                                                     if (err != nil) statusCode = [[err.userInfo objectForKey:DCXHTTPStatusKey] integerValue];
-                                                     if (statusCode == 404 || statusCode == 409 || statusCode == 412) {
-                                                         // Special case: Our assumption about the newness of the composite has
-                                                         // been proven wrong. We try it again this time reversing our assumption.
-                                                         [progress becomeCurrentWithPendingUnitCount:length];
-                                                         DCXHTTPRequest *request = [session uploadComponent:component ofComposite:composite
-                                                                                                   fromPath:filePath componentIsNew:!componentIsNew
-                                                                                            requestPriority:compRequest.priority
-                                                                                               handlerQueue:nil
-                                                                                          completionHandler:^(DCXComponent *c, NSError *err) {
-                                                                                              NSInteger statusCode = 200;
-                                                                                              if (err != nil) statusCode = [[err.userInfo objectForKey:DCXHTTPStatusKey] integerValue];
-                                                                                              [tracker componentWasAdded:c
-                                                                                                                fromPath:filePath
-                                                                                                             ofComposite:composite
-                                                                                                                   error:err];
-                                                                                          }];
-                                                         
-                                                         [progress resignCurrent];
-                                                         if (request != nil) {
-                                                             @synchronized(accessLock){
-                                                                 [compRequest addComponentRequest:request];
-                                                             } // end of synchronized block
-                                                         }
-                                                     } else {
-                                                         if (componentIsNew) {
-                                                             [tracker componentWasAdded:c fromPath:filePath ofComposite:composite error:nil];
-                                                         } else {
-                                                             [tracker componentWasUpdated:c fromPath:filePath ofComposite:composite error:nil];
-                                                         }
-                                                     }
-                                                 }];
-                [progress resignCurrent];
-                if (request != nil) {
-                    @synchronized(accessLock){
-                        [compRequest addComponentRequest:request];
-                    } // end of synchronized block
-                }
-            };
+            // Editors frequently rewrite files without changing their content so before uploading
+            // we compare the file with the one we have last pushed or pulled.
+            if (!componentIsNew && [self localFileOfComponent:component inManifest:manifest
+                                        matchesBaseOfComposite:composite]) {
+                [tracker componentWasUnchanged:component];
+                continue;
+            }
+            
+            [uploads addObject:@[component, filePath, @(componentIsNew)]];
+            totalUploadLength += [component.length longLongValue] + DCXHTTPProgressCompletionFudge;
             
         } else if ([componentState isEqualToString:DCXAssetStateUnmodified]) {
             // Clear state in journal in case the component was previously marked as uploaded or pending delete
@@ -494,6 +616,110 @@ NSError objects.
             NSLog(@"Unexpected component state: %@", componentState);
         }
     } // End of for loop over components
+    
+    [self reportPhase:DCXTransferPhasePushComponentDiff ofComposite:composite startedAt:diffStart usingSession:session];
+    
+    if (uploads.count == 0) {
+        return;
+    }
+    
+    [uploads sortUsingComparator:^NSComparisonResult(NSArray *upload1, NSArray *upload2) {
+        long long length1 = [((DCXComponent*)upload1[0]).length longLongValue];
+        long long length2 = [((DCXComponent*)upload2[0]).length longLongValue];
+        if (length1 == length2) {
+            return NSOrderedSame;
+        }
+        BOOL ascending = (length1 < length2) == (order == DCXPushUploadOrderSmallestFirst);
+        return ascending ? NSOrderedAscending : NSOrderedDescending;
+    }];
+    
+    // Account for all uploads up front so that progress doesn't jump backwards as uploads get started
+    if (progress.totalUnitCount < 0) {
+        progress.totalUnitCount = totalUploadLength;
+        progress.completedUnitCount = 0;
+    } else {
+        progress.totalUnitCount += totalUploadLength;
+    }
+    
+    PushUploadBlock uploadBlock = ^void(NSArray *upload, void(^uploadDidFinish)(void)) {
+        DCXComponent *component = upload[0];
+        NSString *filePath = upload[1];
+        BOOL componentIsNew = [upload[2] boolValue];
+        
+        if (progress.isCancelled) {
+            NSError *err = [DCXErrorUtils ErrorWithCode:DCXErrorCancelled
+                                                 domain:DCXErrorDomain details:nil];
+            [tracker componentWasAdded:component fromPath:nil ofComposite:composite error:err];
+            uploadDidFinish();
+            return;
+        }
+        
+        int64_t length = [component.length longLongValue] + DCXHTTPProgressCompletionFudge;
+        
+        // Large files get uploaded in chunks if the session supports it so that a failed upload can be
+        // resumed by a later push
+        DCXHTTPRequest* (^startUpload)(BOOL, DCXComponentRequestCompletionHandler) = ^DCXHTTPRequest*(BOOL isNew, DCXComponentRequestCompletionHandler handler) {
+            if ([session respondsToSelector:@selector(uploadComponent:ofComposite:fromPath:componentIsNew:uploadSession:sessionHandler:requestPriority:handlerQueue:completionHandler:)]) {
+                return [session uploadComponent:component ofComposite:composite
+                                       fromPath:filePath componentIsNew:isNew
+                                  uploadSession:[journal uploadSessionForComponent:component fromPath:filePath]
+                                 sessionHandler:^(NSDictionary *uploadSession) {
+                                     [journal recordUploadSession:uploadSession forComponent:component fromPath:filePath];
+                                 }
+                                requestPriority:compRequest.priority
+                                   handlerQueue:nil
+                              completionHandler:handler];
+            }
+            return [session uploadComponent:component ofComposite:composite
+                                   fromPath:filePath componentIsNew:isNew
+                            requestPriority:compRequest.priority
+                               handlerQueue:nil
+                          completionHandler:handler];
+        };
+        
+        [progress becomeCurrentWithPendingUnitCount:length];
+        DCXHTTPRequest *request = startUpload(componentIsNew, ^(DCXComponent *c, NSError *err) {
+            NSInteger statusCode = 200;
+            if (err != nil) statusCode = [[err.userInfo objectForKey:DCXHTTPStatusKey] integerValue];
+            if (statusCode == 404 || statusCode == 409 || statusCode == 412) {
+                // Special case: Our assumption about the newness of the composite has
+                // been proven wrong. We try it again this time reversing our assumption.
+                [progress becomeCurrentWithPendingUnitCount:length];
+                DCXHTTPRequest *request = startUpload(!componentIsNew, ^(DCXComponent *c, NSError *err) {
+                    [tracker componentWasAdded:c
+                                      fromPath:filePath
+                                   ofComposite:composite
+                                         error:err];
+                    uploadDidFinish();
+                });
+                
+                [progress resignCurrent];
+                if (request != nil) {
+                    @synchronized(accessLock){
+                        [compRequest addComponentRequest:request];
+                    } // end of synchronized block
+                }
+            } else {
+                if (componentIsNew) {
+                    [tracker componentWasAdded:c fromPath:filePath ofComposite:composite error:err];
+                } else {
+                    [tracker componentWasUpdated:c fromPath:filePath ofComposite:composite error:err];
+                }
+                uploadDidFinish();
+            }
+        });
+        [progress resignCurrent];
+        if (request != nil) {
+            @synchronized(accessLock){
+                [compRequest addComponentRequest:request];
+            } // end of synchronized block
+        }
+    };
+    
+    PushUploadScheduler *scheduler = [[PushUploadScheduler alloc] initWithUploads:uploads
+                                                             maxConcurrentUploads:maxConcurrentUploads
+                                                                      uploadBlock:uploadBlock];
+    [scheduler start];
 }
 
 +(void) internalPushComposite:(DCXComposite *)composite
@@ -501,6 +727,8 @@ NSError objects.
         pushManifestReadError:(NSError *)manifestReadError
                  usingSession:(id<DCXTransferSessionProtocol>)session
              compositeRequest:(DCXCompositeRequest*)compRequest
+         maxConcurrentUploads:(NSUInteger)maxConcurrentUploads
+                  uploadOrder:(DCXPushUploadOrder)order
           updateManifestBlock:(DCXCompositeManifestUploadRequest)updateManifestBlock
             completionHandler:(DCXPushCompletionHandler) completionHandler
 {
@@ -649,13 +877,20 @@ NSError objects.
         if (journal.isEmpty) {
             // Clean up the journal file if it is empty.
             [journal deleteFileWithError:nil];
+        } else {
+            // Make sure that a subsequent push can resume from where we are now
+            [journal flushWithError:nil];
         }
         return completionHandler(NO, error);
     };
     
     
+    __block NSDate *manifestUploadStart = nil;
+    
     void(^manifestUploadHandler)(DCXManifest*, NSError*) =  ^void(DCXManifest *m, NSError *e)
     {
+        [self reportPhase:DCXTransferPhasePushManifestUpload ofComposite:composite
+                startedAt:manifestUploadStart usingSession:session];
         pushManifest = m;
         if(pushManifest != nil) {
             // Manifest uploaded successfully
@@ -693,6 +928,7 @@ NSError objects.
         compRequest.progress.totalUnitCount += (newManifestSize - oldManifestSize);
         
         [compRequest.progress becomeCurrentWithPendingUnitCount:newManifestSize];
+        manifestUploadStart = [NSDate date];
         DCXHTTPRequest *request = updateManifestBlock(pushManifest, manifestUploadHandler);
         [compRequest.progress resignCurrent];
         if (request != nil) {
@@ -762,7 +998,11 @@ NSError objects.
     };
     
     
+    __block NSDate *pushComponentsStart = nil;
+    
     PushCompletionHandler pushCompletionHandler = ^void(NSArray* pushErrors){
+        [self reportPhase:DCXTransferPhasePushComponents ofComposite:composite
+                startedAt:pushComponentsStart usingSession:session];
         if(pushErrors != nil && [pushErrors count] > 0){
             // There are component push errors. CANNOT proceed with flow.
             pushComponentsErrorHandler(pushErrors);
@@ -776,6 +1016,7 @@ NSError objects.
     {
         compRequest.progress.totalUnitCount = oldManifestSize;
         compRequest.progress.completedUnitCount = 0;
+        pushComponentsStart = [NSDate date];
         
         // Process the components. Note that we resolve component names as relative to the parent directory
         // of the manifest.
@@ -787,6 +1028,8 @@ NSError objects.
                           usingSession:session
                            withJournal:journal
                       compositeRequest:compRequest
+                  maxConcurrentUploads:maxConcurrentUploads
+                           uploadOrder:order
                       componentTracker:tracker];
     };
     
@@ -854,14 +1097,17 @@ NSError objects.
                completionHandler:(DCXPullCompletionHandler)handler
 {
     __block DCXCompositeRequest *compRequest = [[DCXCompositeRequest alloc] initWithPriority:priority];
+    NSDate *pullStart = [NSDate date];
     
     void(^reportCompletion)(DCXBranch*, NSError*) = ^void(DCXBranch* pulledBranch, NSError* error){
+        [self reportPhase:DCXTransferPhasePull ofComposite:composite startedAt:pullStart usingSession:session];
         if(handler != nil){
             handler(pulledBranch, error);
         }
     };
     
     DCXPullCompletionHandler pullCompletionHandler = ^void(DCXBranch *pulledBranch, NSError *error){
+        [composite pullDidFinish];
         if(queue != nil){
             [queue addOperationWithBlock:^{
                 reportCompletion(pulledBranch, error);
@@ -871,6 +1117,7 @@ NSError objects.
         }
     };
     
+    [composite pullDidStart];
     [DCXCompositeXfer internalPullComposite:composite usingSession:session compositeRequest:compRequest pullCompletionHandler:pullCompletionHandler];
     
     return compRequest;
@@ -893,6 +1140,7 @@ NSError objects.
     DCXCompositeRequest *compRequest = [[DCXCompositeRequest alloc] initWithPriority:priority];
     
     DCXPullCompletionHandler pullCompletionHandler = ^void(DCXBranch *branch, NSError *error){
+        [composite pullDidFinish];
         if(handler){
             if(queue != nil){
                 [queue addOperationWithBlock:^{
@@ -905,6 +1153,7 @@ NSError objects.
         }
     };
     
+    [composite pullDidStart];
     [DCXCompositeXfer internalPullMinimalComposite:composite
                                            usingSession:session
                                        compositeRequest:compRequest
@@ -929,6 +1178,7 @@ NSError objects.
     DCXManifest *manifest = (branch == composite.current ? nil : branch.manifest);
     
     DCXPullCompletionHandler completionHandlerWrapper = ^void(DCXBranch* branch, NSError* error){
+        [composite pullDidFinish];
         if(handler != nil){
             if(queue != nil){
                 [queue addOperationWithBlock:^{
@@ -940,11 +1190,13 @@ NSError objects.
         }
     };
     
+    [composite pullDidStart];
     [DCXCompositeXfer internalDownloadComponents:components 
                                           ofComposite:composite
                                   usingPulledManifest:manifest
                                          usingSession:session
                                      compositeRequest:compRequest
+                                       prefetchPolicy:nil
                                 withCompletionHandler:completionHandlerWrapper];
     
     return compRequest;
@@ -969,6 +1221,7 @@ NSError objects.
                 // Somehow the ids of the next manifest (from a previous pull) and the current manifest
                 // don't match. We discard the next manifest.
                 [fm removeItemAtPath:pulledManifestPath error:nil];
+                [DCXManifest removeCacheOfManifestPath:pulledManifestPath];
                 previouslyPulledManifest = nil;
             }
         }
@@ -1053,7 +1306,17 @@ NSError objects.
             
         } else {
             // Need to update the pulled manifest with the local storage data from the previously pulled manifest
-            [composite updateLocalStorageDataInManifest:pulledManifest fromManifestArray:previouslyPulledManifest == nil ? nil : @[previouslyPulledManifest]];
+            NSMutableArray *sourceManifests = [NSMutableArray arrayWithObject:previouslyPulledManifest];
+            if (composite.storesComponentsByContent) {
+                // Local files are shared by content so we can also reuse the files of the local branches
+                if (currentManifest != nil) {
+                    [sourceManifests addObject:currentManifest];
+                }
+                if (baseManifest != nil) {
+                    [sourceManifests addObject:baseManifest];
+                }
+            }
+            [composite updateLocalStorageDataInManifest:pulledManifest fromManifestArray:sourceManifests];
         }
     } else {
         NSMutableArray *sourceManifests = [NSMutableArray array];
@@ -1110,8 +1373,11 @@ NSError objects.
         return completionHandler(nil, error);
     }
     DCXManifest *previouslyPulledManifest = [self getPreviouslyPulledManifestOfComposite:composite];
+    NSDate *manifestFetchStart = [NSDate date];
     DCXManifestRequestCompletionHandler compositeDownloadHandler = ^void(DCXManifest* pulledManifest, NSError *downloadError)
     {
+        [self reportPhase:DCXTransferPhasePullManifestFetch ofComposite:composite
+                startedAt:manifestFetchStart usingSession:session];
         if(downloadError != nil || compRequest.isCancelled){
             NSError *adjustedError = [self adjustErrorFromPulledManifest:downloadError withRequest:compRequest];
             return completionHandler(nil, adjustedError);
@@ -1148,6 +1414,7 @@ NSError objects.
                                     usingPulledManifest:branch.manifest
                                            usingSession:session
                                        compositeRequest:compRequest
+                                         prefetchPolicy:nil
                                   withCompletionHandler:completionHandler];
             }
         }
@@ -1166,9 +1433,13 @@ NSError objects.
                usingPulledManifest:(DCXManifest*)pulledManifest
                       usingSession:(id<DCXTransferSessionProtocol>)session
                   compositeRequest:(DCXCompositeRequest*)compRequest
+                    prefetchPolicy:(id<DCXPrefetchPolicy>)prefetchPolicy
              withCompletionHandler:(DCXPullCompletionHandler)completionHandler
 {
+    NSDate *downloadStart = [NSDate date];
     PullCompletionHandler wrapperHandler = ^void(NSMutableArray* downloadErrors){
+        [self reportPhase:DCXTransferPhasePullComponents ofComposite:composite
+                startedAt:downloadStart usingSession:session];
         [DCXCompositeXfer internalComponentDownloadCompletionForComposite:composite
                                                  withCompletionHandler:completionHandler
                                                     withPulledManifest:pulledManifest
@@ -1181,6 +1452,7 @@ NSError objects.
                               usingPulledManifest:pulledManifest
                                      usingSession:session
                                  compositeRequest:compRequest
+                                   prefetchPolicy:prefetchPolicy
                                   withPullTracker:tracker];
     
 }
@@ -1191,6 +1463,7 @@ NSError objects.
            usingPulledManifest:(DCXManifest*)pulledManifest
                   usingSession:(id<DCXTransferSessionProtocol>)session
               compositeRequest:(DCXCompositeRequest*)compRequest
+                prefetchPolicy:(id<DCXPrefetchPolicy>)prefetchPolicy
                withPullTracker:(PullComponentTracker*)tracker
 {
     
@@ -1233,6 +1506,53 @@ NSError objects.
     // Iterate over the components of the remote manifest to update those that have changed.
     NSProgress *progress = compRequest.progress;
     NSArray *allComponentsKeys = [pulledManifest.allComponents allKeys];
+    DCXBranch *prefetchBranch = nil;
+    if (prefetchPolicy != nil) {
+        prefetchBranch = [DCXBranch branchWithComposite:composite andManifest:pulledManifest];
+        if ([prefetchPolicy respondsToSelector:@selector(prefetchRankOfComponent:ofBranch:)]) {
+            // Schedule the downloads of the most important components first
+            NSDictionary *allComponents = pulledManifest.allComponents;
+            NSMutableDictionary *ranks = [NSMutableDictionary dictionaryWithCapacity:allComponentsKeys.count];
+            for (id idKey in allComponentsKeys) {
+                ranks[idKey] = @([prefetchPolicy prefetchRankOfComponent:allComponents[idKey] ofBranch:prefetchBranch]);
+            }
+            allComponentsKeys = [allComponentsKeys sortedArrayWithOptions:NSSortStable
+                                                          usingComparator:^NSComparisonResult(id key1, id key2) {
+                                                              return [ranks[key1] compare:ranks[key2]];
+                                                          }];
+        }
+    }
+    
+    // Components that an interrupted pull has already downloaded don't have to be downloaded again.
+    // Only pulls get journaled: downloads into the current branch, e.g. on-demand fetches, don't get
+    // resumed from the journal and could otherwise run concurrently with a pull that shares its file.
+    DCXPullJournal *journal = (composite.path == nil || !hasPulledManifest) ? nil
+                            : [DCXPullJournal journalForComposite:composite persistedAt:composite.pullJournalPath error:nil];
+    if (hasPulledManifest && !journal.isEmpty) {
+        BOOL adoptedFiles = NO;
+        NSDictionary *allComponents = pulledManifest.allComponents;
+        for (id idKey in allComponentsKeys) {
+            if (idsOfComponentsToPull != nil && ![idsOfComponentsToPull containsObject:idKey]) {
+                continue;
+            }
+            DCXComponent *pulledComponent = allComponents[idKey];
+            NSString *storageId = [journal storageIdOfDownloadedComponent:pulledComponent];
+            if (storageId == nil) {
+                continue;
+            }
+            NSString *path = [DCXLocalStorage pathOfComponent:pulledComponent inManifest:pulledManifest
+                                                  ofComposite:composite withError:nil];
+            if (![[path lastPathComponent] isEqualToString:storageId] && ![fm fileExistsAtPath:path]
+                && [DCXLocalStorage adoptLocalFileWithStorageId:storageId forComponent:pulledComponent
+                                                     ofManifest:pulledManifest ofComposite:composite]) {
+                adoptedFiles = YES;
+            }
+        }
+        if (adoptedFiles) {
+            [pulledManifest writeToFile:pulledManifestPath generateNewSaveId:NO withError:nil];
+        }
+    }
+    
     [tracker setPendingComponnents:(int)allComponentsKeys.count];
     for (id idKey in allComponentsKeys) {
         @synchronized(accessLock){
@@ -1327,7 +1647,10 @@ NSError objects.
             // Download the asset if necessary.
             if ( ![pulledComponent.etag isEqualToString:localEtag] ) {
                 
-                if (progress.isCancelled) {
+                if (prefetchBranch != nil && ![prefetchPolicy shouldPrefetchComponent:pulledComponent ofBranch:prefetchBranch]) {
+                    // Leave it to be downloaded on demand.
+                    decrementPendingCountWithError(nil);
+                } else if (progress.isCancelled) {
                     NSError *error = [DCXErrorUtils ErrorWithCode:DCXErrorCancelled domain:DCXErrorDomain details:nil];
                     decrementPendingCountWithError(error);
                 } else {
@@ -1342,22 +1665,57 @@ NSError objects.
                         }
                         [progress becomeCurrentWithPendingUnitCount:length];
                     }
+                    DCXComponent *downloadedComponent = pulledComponent;
+                    NSString *storageId = [componentDestinationPath lastPathComponent];
+                    DCXComponentRequestCompletionHandler handler = ^(DCXComponent *c, NSError *err) {
+                        if (err != nil) {
+                            NSData *resumeData = [DCXErrorUtils ResumeDataOfError:err];
+                            if (resumeData != nil) {
+                                [journal recordResumeData:resumeData forComponent:downloadedComponent];
+                            }
+                            if ([[err.userInfo objectForKey:DCXHTTPStatusKey] isEqual: @404]) {
+                                err = [DCXErrorUtils ErrorWithCode:DCXErrorMissingComponentAsset
+                                                                     domain:DCXErrorDomain userInfo:err.userInfo];
+                            }
+                        } else {
+                            [journal recordDownloadedComponent:downloadedComponent withStorageId:storageId];
+                            [composite.storageQuotaManager didDownloadComponent:downloadedComponent ofComposite:composite];
+                            if (hasPulledManifest && composite.storesComponentsByContent) {
+                                // Hash the file while the other downloads are still in flight so that
+                                // moving the files into content storage doesn't have to read them again.
+                                // The handler runs in the slot of the transfer queue so we hash elsewhere
+                                // and only count the download as done once the digest has been recorded.
+                                dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+                                    NSString *digest = [DCXFileUtils sha256DigestOfFile:componentDestinationPath withError:nil];
+                                    @synchronized(accessLock) {
+                                        [DCXLocalStorage setDigest:digest forComponent:downloadedComponent ofManifest:pulledManifest];
+                                    }
+                                    decrementPendingCountWithError(nil);
+                                });
+                                return;
+                            }
+                        }
+                        
+                        decrementPendingCountWithError(err);
+                    };
                     DCXHTTPRequest *request = nil;
-                    request = [session downloadComponent:pulledComponent
-                                             ofComposite:composite
-                                                  toPath:componentDestinationPath
-                                         requestPriority:compRequest.priority
-                                            handlerQueue:nil
-                                       completionHandler:^(DCXComponent *c, NSError *err) {
-                                           if (err != nil) {
-                                               if ([[err.userInfo objectForKey:DCXHTTPStatusKey] isEqual: @404]) {
-                                                   err = [DCXErrorUtils ErrorWithCode:DCXErrorMissingComponentAsset
-                                                                                        domain:DCXErrorDomain userInfo:err.userInfo];
-                                               }
-                                           }
-                                           
-                                           decrementPendingCountWithError(err);
-                                       }];
+                    NSData *resumeData = [journal takeResumeDataForComponent:pulledComponent];
+                    if (resumeData != nil && [session respondsToSelector:@selector(downloadComponent:ofComposite:toPath:resumeData:requestPriority:handlerQueue:completionHandler:)]) {
+                        request = [session downloadComponent:pulledComponent
+                                                 ofComposite:composite
+                                                      toPath:componentDestinationPath
+                                                  resumeData:resumeData
+                                             requestPriority:compRequest.priority
+                                                handlerQueue:nil
+                                           completionHandler:handler];
+                    } else {
+                        request = [session downloadComponent:pulledComponent
+                                                 ofComposite:composite
+                                                      toPath:componentDestinationPath
+                                             requestPriority:compRequest.priority
+                                                handlerQueue:nil
+                                           completionHandler:handler];
+                    }
                     if (length > 0 ) {
                         if (request != nil) {
                             [compRequest addComponentRequest:request];
@@ -1423,7 +1781,15 @@ NSError objects.
     
     if (pulledManifest != nil) {
         if (hasPulledManifest) {
+            if ([DCXLocalStorage moveComponentsOfManifest:pulledManifest intoContentStorageOfComposite:composite]) {
+                NSError *error = nil;
+                if (![pulledManifest writeToFile:composite.pulledManifestPath generateNewSaveId:NO withError:&error]) {
+                    return completionHandler(nil, error);
+                }
+            }
             [composite updatePulledBranchWithManifest:pulledManifest];
+            // All components are in place so the next pull starts from scratch
+            [DCXPullJournal removeJournalAtPath:composite.pullJournalPath withError:nil];
             return completionHandler(composite.pulled, nil);
         } else {
             return completionHandler(composite.current, nil);
@@ -1460,6 +1826,7 @@ NSError objects.
                          usingPulledManifest:(branch != nil ? branch.manifest : composite.current.manifest)
                                 usingSession:session 
                             compositeRequest:compRequest
+                              prefetchPolicy:composite.prefetchPolicy
                        withCompletionHandler:^(DCXBranch *branch, NSError *error) {
                            completionHandler(branch, error);
                        }];
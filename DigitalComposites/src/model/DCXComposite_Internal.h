@@ -32,6 +32,9 @@
  */
 @property (atomic, readwrite) NSDate *currentBranchCommittedAtDate;
 
+/** The quota manager that the composite has been added to. Set by DCXStorageQuotaManager. */
+@property (nonatomic, readwrite, weak) DCXStorageQuotaManager *storageQuotaManager;
+
 #pragma mark - Initialization
 
 /**
@@ -72,6 +75,15 @@
 
 #pragma mark - Branches
 
+/**
+ * \brief Loads the manifest file at path (honoring cachesManifests) and lets the new manifest share
+ * the dictionaries of its unchanged components with the manifests of the other branches of the composite.
+ *
+ * \param path     The path of the manifest file.
+ * \param errorPtr Gets set if the manifest cannot be read.
+ */
+-(DCXManifest*) loadManifestFromFile:(NSString*)path withError:(NSError**)errorPtr;
+
 -(void) updateCurrentBranchWithManifest:(DCXManifest*)manifest updateCommittedAtDate:(BOOL)updateCommittedAt;
 -(void) updatePulledBranchWithManifest:(DCXManifest*)manifest;
 -(void) updatePushedBranchWithManifest:(DCXManifest*)manifest;
@@ -174,6 +186,20 @@
  */
 -(void) updateLocalStorageDataInManifest:(DCXManifest *)targetManifest fromManifestArray:(NSArray *)sourceManifests;
 
+/**
+ * \brief Records the storage ids of component files that may end up unused without ever having been
+ * referenced by a manifest file, so that DCXLocalStorage removeUnusedLocalFilesOfComposite:withError:
+ * checks them.
+ *
+ * \param storageIds The storage ids.
+ */
+-(void) addUnusedLocalFileCandidates:(NSSet*)storageIds;
+
+/**
+ * \brief Returns the storage ids recorded by addUnusedLocalFileCandidates: and forgets them.
+ */
+-(NSSet*) takeUnusedLocalFileCandidates;
+
 
 /** The file path of the manifest of the current local composite.
  Notice that this file might not yet/anymore exist. */
@@ -202,9 +228,20 @@
  Notice that this file might not yet/anymore exist. */
 @property (readonly) NSString* pushJournalPath;
 
+/** The file path for the composite's pull journal.
+ Notice that this file might not yet/anymore exist. */
+@property (readonly) NSString* pullJournalPath;
+
 /** The manifest of an active push operation for this composite. */
 @property (readwrite) DCXManifest* activePushManifest;
 
+/** Whether a pull or a download of components of this composite is in progress. Thread-safe. */
+@property (readonly) BOOL hasActivePull;
+
+/** Thread-safe methods to record the start and the completion of a pull or download. Calls must be balanced. */
+-(void) pullDidStart;
+-(void) pullDidFinish;
+
 /** The set of component files that are currently being copied or moved into the components directory
  and may not yet have updated timestamps.  Retrieves a copy in a thread-safe manner. */
 @property (readonly) NSSet *inflightLocalComponentFiles;
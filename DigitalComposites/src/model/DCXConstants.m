@@ -46,6 +46,7 @@ NSString *const DCXVersionManifestKey       = @"version";
 NSString *const DCXLocalDataManifestKey     = @"local";
 NSString *const DCXLocalVersionManifestKey  = @"version";
 NSString *const DCXLocalStorageAssetIdMapManifestKey  = @"copyOnWrite#storageIds";
+NSString *const DCXLocalStorageDigestMapManifestKey  = @"copyOnWrite#digests";
 NSString *const DCXCompositeHrefManifestKey = @"compositeHref";
 NSString *const DCXManifestEtagManifestKey  =  @"manifestEtag";
 NSString *const DCXManifestSaveIdManifestKey = @"manifestSaveId";
@@ -63,6 +63,8 @@ extern NSString *const DCXLocalDataManifestKey;
 extern NSString *const DCXLocalVersionManifestKey;
 /** The local storage asset id of a component */
 extern NSString *const DCXLocalStorageAssetIdMapManifestKey;
+/** The content digest of the local file of a component */
+extern NSString *const DCXLocalStorageDigestMapManifestKey;
 /** The href of the composite */
 extern NSString *const DCXCompositeHrefManifestKey;
 /** The etag of the manifest */
@@ -88,6 +88,14 @@
  */
 +(NSString*) pushJournalPathForComposite:(DCXComposite*)composite;
 
+/**
+ \brief Returns the path to the pull journal of the specified composite.
+ \param composite The composite to return the path for.
+ 
+ \return The path.
+ */
++(NSString*) pullJournalPathForComposite:(DCXComposite*)composite;
+
 /**
  \brief Returns the file path for reading the component.
  
@@ -198,7 +206,12 @@
 +(BOOL) removeLocalFilesOfComposite:(DCXComposite*)composite withError:(NSError**)errorPtr;
 
 /**
- \brief Delete all unused local files of the composite.
+ \brief Delete the unused local files of the composite.
+ 
+ Only checks the files that have been added or have lost their last reference since the last time,
+ based on an index in the local storage of the composite. Manifest files only get read if they have
+ changed since then. Falls back to removeAllUnusedLocalFilesOfComposite:withError: if the index doesn't
+ exist yet or if the last full scan is older than the unusedLocalFilesScanInterval of the composite.
  
  \param composite The composite to act upon.
  \param errorPtr Gets set to an NSError if something goes wrong.
@@ -208,6 +221,18 @@
  */
 +(NSNumber*) removeUnusedLocalFilesOfComposite:(DCXComposite*)composite withError:(NSError**)errorPtr;
 
+/**
+ \brief Delete all unused local files of the composite by scanning its whole components directory, and
+ rebuild the index used by removeUnusedLocalFilesOfComposite:withError:.
+ 
+ \param composite The composite to act upon.
+ \param errorPtr Gets set to an NSError if something goes wrong.
+ 
+ \return NSNumber object containing an unsigned long long value with the total size of local storage
+ that was freed as a result of removing the unused files.
+ */
++(NSNumber*) removeAllUnusedLocalFilesOfComposite:(DCXComposite*)composite withError:(NSError**)errorPtr;
+
 /**
  \brief Used by the pull logic to give the local storage scheme an opportunity to
  verify, edit or insert its local storage-related data into a pulled manifest before
@@ -227,6 +252,32 @@
  */
 +(void) didRemoveComponent:(DCXComponent*)component fromManifest:(DCXManifest*)manifest;
 
+/**
+ \brief Copies the local storage data of a component from one manifest to another so that the
+ target component refers to the same local file. Doesn't access the file.
+ 
+ \param sourceComponent The component in sourceManifest.
+ \param sourceManifest  The manifest that has the storage data.
+ \param targetComponent The component in targetManifest. Its id may differ from the id of sourceComponent.
+ \param targetManifest  The manifest to update.
+ */
++(void) copyLocalStorageDataOfComponent:(DCXComponent*)sourceComponent fromManifest:(DCXManifest*)sourceManifest
+                            toComponent:(DCXComponent*)targetComponent ofManifest:(DCXManifest*)targetManifest;
+
+/**
+ \brief Makes a component of a manifest refer to a file that already exists in the local storage
+ of the composite, e.g. a file that an interrupted pull has downloaded (see DCXPullJournal).
+ 
+ \param storageId The storage id of the file.
+ \param component The component in manifest.
+ \param manifest  The manifest to update.
+ \param composite The composite.
+ 
+ \return YES if the file exists and the storage id of the component has been updated.
+ */
++(BOOL) adoptLocalFileWithStorageId:(NSString*)storageId forComponent:(DCXComponent*)component
+                         ofManifest:(DCXManifest*)manifest ofComposite:(DCXComposite*)composite;
+
 /**
  \brief Produces a dictionary which maps component ID to the local storage path for all of the
  components in the specified composite branch that have an existing local file
@@ -237,6 +288,80 @@
  */
 +(NSDictionary*) existingLocalStoragePathsForComponentsInBranch:(DCXBranch*)branch;
 
+#pragma mark - Content digests
+
+/**
+ \brief Returns the SHA-256 digest of the local file of the given component. Composites that store
+ their components by content record the digest whenever the file of a component is added or
+ updated. Otherwise the digest gets computed from the file the first time it is requested and then
+ recorded in the local storage data of the manifest until the file of the component changes.
+ 
+ \param component  The component.
+ \param manifest   The manifest containing this component.
+ \param composite  The composite the manifest belongs to.
+ 
+ \return The digest as a lowercase hex string or nil if the component doesn't have a local file.
+ */
++(NSString*) digestOfComponent:(DCXComponent*)component
+                    inManifest:(DCXManifest*)manifest
+                   ofComposite:(DCXComposite*)composite;
+
+/**
+ \brief Records the digest of the local file of the given component, e.g. one that the pull logic
+ has computed right after downloading the file. The digest gets discarded when the file of the
+ component changes.
+ 
+ \param digest     The SHA-256 digest as a lowercase hex string. Can be nil to discard the digest.
+ \param component  The component.
+ \param manifest   The manifest containing this component.
+ */
++(void) setDigest:(NSString*)digest forComponent:(DCXComponent*)component ofManifest:(DCXManifest*)manifest;
+
+#pragma mark - Content-addressed storage
+
+/**
+ \brief Used by the pull logic to move the downloaded component files of a pulled manifest into
+ content-addressed storage if the composite stores its components by content. Components whose
+ content matches an already existing local file end up sharing that file. The files that the
+ components have been moved away from are left for removeUnusedLocalFilesOfComposite:withError:.
+ Only files whose digest has been recorded with setDigest:forComponent:ofManifest: get moved.
+ 
+ \param manifest   The pulled manifest.
+ \param composite  The composite the manifest belongs to.
+ 
+ \return YES if the local storage data of the manifest has changed and needs to be written.
+ */
++(BOOL) moveComponentsOfManifest:(DCXManifest*)manifest
+   intoContentStorageOfComposite:(DCXComposite*)composite;
+
+/**
+ \brief Counts the references to content-addressed files by the components of the given manifests
+ other than the ones in componentIds. Pass the result to isLocalFileOfComponent:inManifest:sharedByStorageIds:
+ to check any number of components with a single pass over the manifests.
+ 
+ \param componentIds   The ids of the components that should not be considered.
+ \param manifests      The manifests to search for references.
+ 
+ \return The storage ids of the referenced files, counted once per reference.
+ */
++(NSCountedSet*) contentStorageIdsOfComponentsOtherThan:(NSSet*)componentIds
+                                            inManifests:(NSArray*)manifests;
+
+/**
+ \brief Returns whether the local file of the given component is shared with other components. Only
+ content-addressed files get shared.
+ 
+ \param component      The component whose local file to check.
+ \param manifest       The manifest containing this component.
+ \param storageIds     The references to content-addressed files as returned by
+ contentStorageIdsOfComponentsOtherThan:inManifests:.
+ 
+ \return YES if the local file is referenced by another component.
+ */
++(BOOL)  isLocalFileOfComponent:(DCXComponent*)component
+                     inManifest:(DCXManifest*)manifest
+             sharedByStorageIds:(NSCountedSet*)storageIds;
+
 #pragma mark - Partial composite support
 
 /**
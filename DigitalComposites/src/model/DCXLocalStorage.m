@@ -28,6 +28,7 @@
 #import "DCXBranch_Internal.h"
 #import "DCXMutableComponent.h"
 #import "DCXError.h"
+#import "DCXPullJournal.h"
 
 #import "DCXFileUtils.h"
 #import "DCXErrorUtils.h"
@@ -40,6 +41,17 @@ NSString *const DCXBaseManifestPath         = @"base.manifest";
 NSString *const DCXPullManifestPath         = @"pull.manifest";
 NSString *const DCXPushManifestPath         = @"push.manifest";
 NSString *const DCXPushJournalPath         = @"push.journal";
+NSString *const DCXPushJournalLogPath      = @"push.journal.log";
+NSString *const DCXPullJournalPath         = @"pull.journal";
+NSString *const DCXLocalStorageIndexPath    = @"components.index";
+
+static NSString *const DCXIndexVersionKey       = @"version";
+static NSString *const DCXIndexManifestsKey     = @"manifests";
+static NSString *const DCXIndexIdentityKey      = @"identity";
+static NSString *const DCXIndexStorageIdsKey    = @"storageIds";
+static NSString *const DCXIndexCandidatesKey    = @"candidates";
+static NSString *const DCXIndexLastScanKey      = @"lastScan";
+static NSInteger const DCXIndexVersion          = 1;
 
 static NSString* storageIdWithPathExtension(DCXComponent *component)
 {
@@ -52,6 +64,20 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
     return storageId;
 }
 
+static NSUInteger const DCXContentStorageIdLength = 64;
+
+// Returns YES if storageId is the name of a content-addressed file, i.e. a hex SHA-256 digest
+// optionally followed by a path extension.
+static BOOL isContentStorageId(NSString *storageId)
+{
+    NSString *digest = [storageId stringByDeletingPathExtension];
+    if (digest.length != DCXContentStorageIdLength) {
+        return NO;
+    }
+    NSCharacterSet *nonHexCharacters = [[NSCharacterSet characterSetWithCharactersInString:@"0123456789abcdef"] invertedSet];
+    return [digest rangeOfCharacterFromSet:nonHexCharacters].location == NSNotFound;
+}
+
 @implementation DCXLocalStorage
 
 #pragma mark Paths
@@ -104,7 +130,15 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
     return [composite.path stringByAppendingPathComponent:DCXPushJournalPath];
 }
 
-+(NSMutableDictionary*) getStorageIdLookupOfManifest:(DCXManifest*)manifest createIfNecessary:(BOOL)create
++(NSString*) pullJournalPathForComposite:(DCXComposite *)composite
+{
+    NSAssert(composite != nil, @"Parameter composite must not be nil.");
+    NSAssert(composite.path != nil, @"Parameter composite must have a non-nil path.");
+    
+    return [composite.path stringByAppendingPathComponent:DCXPullJournalPath];
+}
+
++(NSMutableDictionary*) getLookup:(NSString*)key ofManifest:(DCXManifest*)manifest createIfNecessary:(BOOL)create
 {
     NSMutableDictionary *localData = [manifest valueForKey:DCXLocalDataManifestKey];
     if (localData == nil) {
@@ -112,18 +146,23 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
             return nil;
         }
         localData = [NSMutableDictionary dictionaryWithObject:[NSMutableDictionary dictionary]
-                                                       forKey:DCXLocalStorageAssetIdMapManifestKey];
+                                                       forKey:key];
         [manifest setValue:localData forKey:DCXLocalDataManifestKey];
     }
-    NSMutableDictionary *storageIdLookup = [localData objectForKey:DCXLocalStorageAssetIdMapManifestKey];
-    if (storageIdLookup == nil) {
+    NSMutableDictionary *lookup = [localData objectForKey:key];
+    if (lookup == nil) {
         if (!create) {
             return nil;
         }
-        storageIdLookup = [NSMutableDictionary dictionary];
-        localData[DCXLocalStorageAssetIdMapManifestKey] = storageIdLookup;
+        lookup = [NSMutableDictionary dictionary];
+        localData[key] = lookup;
     }
-    return storageIdLookup;
+    return lookup;
+}
+
++(NSMutableDictionary*) getStorageIdLookupOfManifest:(DCXManifest*)manifest createIfNecessary:(BOOL)create
+{
+    return [self getLookup:DCXLocalStorageAssetIdMapManifestKey ofManifest:manifest createIfNecessary:create];
 }
 
 +(NSString*) storageIdForComponent:(DCXComponent*)component ofManifest:(DCXManifest*)manifest
@@ -135,6 +174,7 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
     if (storageId == nil) {
         storageId = storageIdWithPathExtension(component);
         storageIdLookup[component.componentId] = storageId;
+        [manifest localDataOfComponentDidChange:component.componentId];
     }
     return storageId;
 }
@@ -156,11 +196,28 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
 +(void) setStorageId:(NSString*)storageId forComponent:(DCXComponent*)component ofManifest:(DCXManifest*)manifest
 {
     NSMutableDictionary *storageIdLookup = [self getStorageIdLookupOfManifest:manifest createIfNecessary:YES];
+    if (![storageId isEqualToString:storageIdLookup[component.componentId]]) {
+        // A recorded digest only ever describes the file it was computed for
+        [self setDigest:nil forComponent:component ofManifest:manifest];
+    }
     if(storageId == nil){
         [storageIdLookup removeObjectForKey:component.componentId];
     }else{
         storageIdLookup[component.componentId] = storageId;
     }
+    [manifest localDataOfComponentDidChange:component.componentId];
+}
+
++(void) setDigest:(NSString*)digest forComponent:(DCXComponent*)component ofManifest:(DCXManifest*)manifest
+{
+    NSMutableDictionary *digestLookup = [self getLookup:DCXLocalStorageDigestMapManifestKey ofManifest:manifest
+                                      createIfNecessary:digest != nil];
+    if(digest == nil){
+        [digestLookup removeObjectForKey:component.componentId];
+    }else{
+        digestLookup[component.componentId] = digest;
+    }
+    [manifest localDataOfComponentDidChange:component.componentId];
 }
 
 +(NSString*) newPathOfComponent:(DCXMutableComponent *)component
@@ -174,6 +231,8 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
     
     NSString *newId = storageIdWithPathExtension(component);
     NSString *destPath = [[composite.path stringByAppendingPathComponent:DCXComponentsPath] stringByAppendingPathComponent:newId];
+    // The file is unused until a manifest that references it has been written
+    [composite addUnusedLocalFileCandidates:[NSSet setWithObject:newId]];
     NSFileManager *fm = [NSFileManager defaultManager];
     if ([fm fileExistsAtPath:destPath]) {
         if (errorPtr != NULL) {
@@ -211,8 +270,22 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
         return NO;
     }
     
+    // Outside of content-addressed storage the digest only gets computed once a push needs it
+    NSString *digest = nil;
+    if (composite.storesComponentsByContent) {
+        digest = [DCXFileUtils sha256DigestOfFile:assetPath withError:nil];
+    }
+    if (digest != nil) {
+        NSString *contentPath = [self contentAddressedPathOfFile:assetPath withDigest:digest forComponent:component inDirectory:dir];
+        if (![contentPath isEqualToString:assetPath]) {
+            [composite addUnusedLocalFileCandidates:[NSSet setWithObject:[assetPath lastPathComponent]]];
+            assetPath = contentPath;
+        }
+    }
+    
     NSString *newId = [assetPath lastPathComponent];
     [self setStorageId:newId forComponent:component ofManifest:manifest];
+    [self setDigest:digest forComponent:component ofManifest:manifest];
     
     // Need to make sure that the mod date of the file gets updated so that our garbage collection
     // doesn't delete this file prematurely.
@@ -226,6 +299,40 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
     return YES;
 }
 
+// Makes the file at path available under the name derived from its digest and returns the
+// resulting path. The file at path is left in place so that callers can still undo their
+// changes. It will get garbage-collected once it is no longer referenced. Falls back to
+// returning path if the file cannot be linked.
+//
+// Content files are made read-only: an in-place write would change every component that shares
+// the file and leave it with a name that no longer matches its content. Since the file at path is
+// a hard link to the same bytes it becomes read-only as well.
++(NSString*) contentAddressedPathOfFile:(NSString*)path
+                             withDigest:(NSString*)digest
+                           forComponent:(DCXComponent*)component
+                            inDirectory:(NSString*)dir
+{
+    NSString *contentId = digest;
+    NSString *pathExt = [component.path pathExtension];
+    if ( [pathExt length] > 0 ) {
+        contentId = [contentId stringByAppendingPathExtension:pathExt];
+    }
+    NSString *contentPath = [dir stringByAppendingPathComponent:contentId];
+    if ([contentPath isEqualToString:path]) {
+        return path;
+    }
+    
+    NSFileManager *fm = [NSFileManager defaultManager];
+    // Touching an existing file keeps the garbage collection from removing it before the new
+    // reference has been committed.
+    if ([DCXFileUtils touch:contentPath withError:nil]
+        || [fm linkItemAtPath:path toPath:contentPath error:nil] || [fm fileExistsAtPath:contentPath]) {
+        [fm setAttributes:@{ NSFilePosixPermissions: @0444 } ofItemAtPath:contentPath error:nil];
+        return contentPath;
+    }
+    return path;
+}
+
 +(NSString*) pathOfComponent:(DCXComponent *)component
                       inManifest:(DCXManifest*)manifest
                      ofComposite:(DCXComposite *)composite
@@ -277,9 +384,12 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
     }
     
     if (success) {
-        success = [DCXFileUtils moveFileAtomicallyFrom:[self pullManifestPathForComposite:composite]
+        success = [DCXFileUtils moveFileAtomicallyFrom:pulledManifestPath
                                                     to:[self baseManifestPathForComposite:composite]
                                                       withError:errorPtr];
+        if (success) {
+            [DCXManifest moveCacheOfManifestPath:pulledManifestPath toPath:[self baseManifestPathForComposite:composite]];
+        }
         [composite updateBaseBranch];
     }
     
@@ -290,7 +400,10 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
 {
     NSFileManager *fm = [NSFileManager defaultManager];
     NSString *path = [composite.path stringByAppendingPathComponent:DCXPullManifestPath];
-    return (![fm fileExistsAtPath:path]) || [fm removeItemAtPath:path error:errorPtr];
+    [DCXManifest removeCacheOfManifestPath:path];
+    return ((![fm fileExistsAtPath:path]) || [fm removeItemAtPath:path error:errorPtr])
+        && [DCXPullJournal removeJournalAtPath:[composite.path stringByAppendingPathComponent:DCXPullJournalPath]
+                                     withError:errorPtr];
 }
 
 +(BOOL) acceptPushedManifest_deprecated:(DCXManifest*)manifest forComposite:(DCXComposite*)composite
@@ -329,6 +442,7 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
         // Delete push journal
         NSString *path = [composite.path stringByAppendingPathComponent:DCXPushJournalPath];
         success = (![fm fileExistsAtPath:path]) || [fm removeItemAtPath:path error:errorPtr];
+        [fm removeItemAtPath:[composite.path stringByAppendingPathComponent:DCXPushJournalLogPath] error:nil];
     }
     
     if (success) {
@@ -343,6 +457,7 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
     NSFileManager *fm = [NSFileManager defaultManager];
     NSString *path = [composite.path stringByAppendingPathComponent:DCXPushJournalPath];
     BOOL success = (![fm fileExistsAtPath:path]) || [fm removeItemAtPath:path error:errorPtr];
+    [fm removeItemAtPath:[composite.path stringByAppendingPathComponent:DCXPushJournalLogPath] error:nil];
     if (success) {
         path = [composite.path stringByAppendingPathComponent:DCXPushManifestPath];
         success = (![fm fileExistsAtPath:path]) || [fm removeItemAtPath:path error:errorPtr];
@@ -412,41 +527,113 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
 }
 
 
-+(NSNumber*) removeUnusedLocalFilesOfComposite:(DCXComposite*)composite withError:(NSError**)errorPtr
+// The index lets removeUnusedLocalFilesOfComposite:withError: find unused component files without reading
+// every manifest and listing the components directory. For every manifest file it records the storage ids
+// that the file references along with the identity of the file and its commit log, so that a manifest only
+// needs to be read again after it has changed. It also records the storage ids of files that might be
+// unused but couldn't be removed yet, and the time of the last full scan of the components directory.
++(NSMutableDictionary*) readIndexOfComposite:(DCXComposite*)composite
+{
+    NSData *data = [NSData dataWithContentsOfFile:[composite.path stringByAppendingPathComponent:DCXLocalStorageIndexPath]];
+    if (data == nil) {
+        return nil;
+    }
+    NSMutableDictionary *index = [NSJSONSerialization JSONObjectWithData:data options:NSJSONReadingMutableContainers error:nil];
+    if (![index isKindOfClass:[NSDictionary class]] || ![index[DCXIndexVersionKey] isEqual:@(DCXIndexVersion)]
+        || ![index[DCXIndexManifestsKey] isKindOfClass:[NSDictionary class]]
+        || ![index[DCXIndexCandidatesKey] isKindOfClass:[NSArray class]]) {
+        return nil;
+    }
+    return index;
+}
+
++(void) writeIndex:(NSDictionary*)index ofComposite:(DCXComposite*)composite
+{
+    // The index can always be rebuilt from a full scan so failing to write it is not an error
+    NSData *data = [NSJSONSerialization dataWithJSONObject:index options:0 error:nil];
+    [data writeToFile:[composite.path stringByAppendingPathComponent:DCXLocalStorageIndexPath]
+              options:NSDataWritingAtomic error:nil];
+}
+
++(NSString*) identityOfManifestFileAtPath:(NSString*)path
+{
+    NSData *identity = [DCXManifest identityOfFileAtPath:path];
+    if (identity == nil) {
+        return nil;
+    }
+    NSString *result = [identity base64EncodedStringWithOptions:0];
+    NSData *logIdentity = [DCXManifest identityOfFileAtPath:[DCXManifest commitLogPathForManifestPath:path]];
+    if (logIdentity != nil) {
+        result = [result stringByAppendingFormat:@" %@", [logIdentity base64EncodedStringWithOptions:0]];
+    }
+    return result;
+}
+
+// Brings the manifest entries of index up to date with the manifest files of the composite and returns the
+// storage ids that are referenced by them or by an active push. Adds the storage ids that manifest files have
+// stopped referencing to droppedStorageIds. Sets *oldestDatePtr to the date before which unreferenced files
+// can safely be removed. Returns nil if no manifest has any storage ids, in which case nothing may be removed.
++(NSSet*) referencedStorageIdsOfComposite:(DCXComposite*)composite
+                            updatingIndex:(NSMutableDictionary*)index
+                        droppedStorageIds:(NSMutableSet*)droppedStorageIds
+                               oldestDate:(NSDate**)oldestDatePtr
+                                withError:(NSError**)errorPtr
 {
-    unsigned long long bytesFreed = 0;
-    NSError *error;
     NSFileManager *fm = [NSFileManager defaultManager];
     NSArray *manifestNames = @[DCXManifestPath, DCXBaseManifestPath, DCXPullManifestPath,
                                DCXPushManifestPath,];
-    NSMutableArray *manifestStorageIdLookups = [NSMutableArray arrayWithCapacity:manifestNames.count];
+    NSMutableDictionary *entries = index[DCXIndexManifestsKey];
+    NSMutableSet *referencedStorageIds = [NSMutableSet set];
+    BOOL haveStorageIds = NO;
     NSDate *oldestManifestModeDate = [NSDate distantFuture];
-    BOOL baseManifestExists = NO;
     
-    // Load all manifests and determine the mod date of the oldest manifest
     for (NSString *manifestName in manifestNames) {
         NSString *path = [composite.path stringByAppendingPathComponent:manifestName];
-        if ([fm fileExistsAtPath:path]) {
-            if ( [manifestName isEqualToString:DCXBaseManifestPath] ) {
-                baseManifestExists = YES;
+        NSDictionary *entry = entries[manifestName];
+        if (![fm fileExistsAtPath:path]) {
+            if (entry != nil) {
+                [droppedStorageIds addObjectsFromArray:entry[DCXIndexStorageIdsKey]];
+                [entries removeObjectForKey:manifestName];
             }
-            NSDictionary *attributes = [fm attributesOfItemAtPath:path error:&error];
-            if (attributes != nil && error == nil) {
-                NSDate *manifestModDate = attributes.fileModificationDate;
-                DCXManifest *manifest = [DCXManifest manifestWithContentsOfFile:path withError:&error];
-                if (manifest != nil && error == nil) {
-                    if (manifestModDate != nil) {
-                        oldestManifestModeDate = [manifestModDate earlierDate:oldestManifestModeDate];
-                    }
-                    NSDictionary *lookup = [self getStorageIdLookupOfManifest:manifest createIfNecessary:NO];
-                    if (lookup != nil) {
-                        [manifestStorageIdLookups addObject:lookup];
-                    }
-                }
+            continue;
+        }
+        NSDictionary *attributes = [fm attributesOfItemAtPath:path error:errorPtr];
+        if (attributes == nil) {
+            return nil;
+        }
+        
+        // The identity must be determined before the manifest gets read so that a manifest file that
+        // gets replaced while we read it is detected the next time around.
+        NSString *identity = [self identityOfManifestFileAtPath:path];
+        if (identity == nil || ![identity isEqualToString:entry[DCXIndexIdentityKey]]) {
+            DCXManifest *manifest = [composite loadManifestFromFile:path withError:errorPtr];
+            if (manifest == nil) {
+                return nil;
+            }
+            NSDictionary *lookup = [self getStorageIdLookupOfManifest:manifest createIfNecessary:NO];
+            NSMutableDictionary *newEntry = [NSMutableDictionary dictionary];
+            if (identity != nil) {
+                newEntry[DCXIndexIdentityKey] = identity;
+            }
+            if (lookup != nil) {
+                newEntry[DCXIndexStorageIdsKey] = [[NSSet setWithArray:lookup.allValues] allObjects];
             }
+            if (entry != nil) {
+                NSMutableSet *dropped = [NSMutableSet setWithArray:entry[DCXIndexStorageIdsKey]];
+                [dropped minusSet:[NSSet setWithArray:newEntry[DCXIndexStorageIdsKey]]];
+                [droppedStorageIds unionSet:dropped];
+            }
+            entries[manifestName] = newEntry;
+            entry = newEntry;
+        }
+        
+        NSArray *storageIds = entry[DCXIndexStorageIdsKey];
+        if (storageIds != nil) {
+            haveStorageIds = YES;
+            [referencedStorageIds addObjectsFromArray:storageIds];
         }
-        if (error != nil) {
-            break;
+        if (attributes.fileModificationDate != nil) {
+            oldestManifestModeDate = [attributes.fileModificationDate earlierDate:oldestManifestModeDate];
         }
     }
     
@@ -454,7 +641,7 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
     if ( composite.currentBranchCommittedAtDate != nil ) {
         oldestManifestModeDate = [composite.currentBranchCommittedAtDate earlierDate:oldestManifestModeDate];
     }
-
+    
     DCXManifest *activePushManifest = composite.activePushManifest; // get strong reference
     if ( activePushManifest != nil ) {
         // We need to include the components that are referenced in an active push operation, which
@@ -462,56 +649,170 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
         // by any on-disk manifests
         NSDictionary *lookup = [self getStorageIdLookupOfManifest:activePushManifest createIfNecessary:NO];
         if (lookup != nil) {
-            [manifestStorageIdLookups addObject:lookup];
+            haveStorageIds = YES;
+            [referencedStorageIds addObjectsFromArray:lookup.allValues];
         }
     }
+    
+    if (oldestDatePtr != NULL) {
+        *oldestDatePtr = oldestManifestModeDate;
+    }
+    return haveStorageIds ? referencedStorageIds : nil;
+}
 
-    if (error == nil && manifestStorageIdLookups.count > 0) {
-        
-        // Create a merged set of all referenced component storage ids
-        NSMutableSet *referencedStorageIds = nil;
-        for (NSDictionary *componentLookup in manifestStorageIdLookups) {
-            NSArray *storageIds = [componentLookup allValues];
-            if (storageIds.count > 0) {
-                if (referencedStorageIds == nil) {
-                    referencedStorageIds = [NSMutableSet setWithCapacity:storageIds.count];
-                }
-                for (NSString *storageId in storageIds) {
-                    [referencedStorageIds addObject:storageId];
+// Removes the files with the given names from the components directory unless they are referenced, in flight
+// or not older than oldestDate. Adds the names of the files that have been kept for the latter two reasons to
+// remainingFileNames. Returns the number of bytes freed and sets *errorPtr to the first error that occurs.
++(unsigned long long) removeFiles:(id<NSFastEnumeration>)fileNames ofComposite:(DCXComposite*)composite
+                    notReferencedIn:(NSSet*)referencedStorageIds olderThan:(NSDate*)oldestDate
+                 remainingFileNames:(NSMutableSet*)remainingFileNames withError:(NSError**)errorPtr
+{
+    unsigned long long bytesFreed = 0;
+    NSError *error = nil;
+    NSFileManager *fm = [NSFileManager defaultManager];
+    NSString *componentsDir = [composite.path stringByAppendingPathComponent:DCXComponentsPath];
+    NSSet *inflightComponentFiles = composite.inflightLocalComponentFiles;
+    
+    for (NSString *fileName in fileNames) {
+        NSError *loopError = nil;
+        if ([referencedStorageIds containsObject:fileName]) {
+            continue;
+        }
+        if ([inflightComponentFiles containsObject:fileName]) {
+            [remainingFileNames addObject:fileName];
+            continue;
+        }
+        // Get the mod date of the file
+        NSString *filePath = [componentsDir stringByAppendingPathComponent:fileName];
+        if (![fm fileExistsAtPath:filePath]) {
+            continue;
+        }
+        NSDictionary *attributes = [fm attributesOfItemAtPath:filePath error:&loopError];
+        if (loopError == nil) {
+            NSDate *componentModDate = attributes.fileModificationDate;
+            if ([componentModDate compare:oldestDate] == NSOrderedAscending) {
+                [fm removeItemAtPath:filePath error:&loopError];
+                if ( !loopError ) {
+                    bytesFreed += attributes.fileSize;
                 }
+            } else {
+                [remainingFileNames addObject:fileName];
             }
         }
-        
+        if (loopError != nil) {
+            [remainingFileNames addObject:fileName];
+            if (error == nil) {
+                // We are going to continue the loop but we want to preserve the first local error
+                error = loopError;
+            }
+        }
+    }
+    
+    if (error != nil && errorPtr != NULL) {
+        *errorPtr = error;
+    }
+    return bytesFreed;
+}
+
++(NSNumber*) removeUnusedLocalFilesOfComposite:(DCXComposite*)composite withError:(NSError**)errorPtr
+{
+    NSMutableDictionary *index = [self readIndexOfComposite:composite];
+    if (index == nil) {
+        return [self removeAllUnusedLocalFilesOfComposite:composite withError:errorPtr];
+    }
+    
+    NSTimeInterval scanInterval = composite.unusedLocalFilesScanInterval;
+    NSDate *lastScanDate = [NSDate dateWithTimeIntervalSince1970:[index[DCXIndexLastScanKey] doubleValue]];
+    if (scanInterval > 0 && -[lastScanDate timeIntervalSinceNow] >= scanInterval) {
+        // The full scan covers the candidates as well. Running it in place keeps it serialized with
+        // the other removals that the caller (usually the background deletion of the composite) guards.
+        return [self removeAllUnusedLocalFilesOfComposite:composite withError:errorPtr];
+    }
+    
+    // Only the files that have lost their last reference or might never have been referenced are candidates
+    NSSet *newCandidates = [composite takeUnusedLocalFileCandidates];
+    NSMutableSet *candidates = [NSMutableSet setWithArray:index[DCXIndexCandidatesKey]];
+    [candidates unionSet:newCandidates];
+    
+    NSError *error = nil;
+    NSDate *oldestDate = nil;
+    NSSet *referencedStorageIds = [self referencedStorageIdsOfComposite:composite updatingIndex:index
+                                                      droppedStorageIds:candidates oldestDate:&oldestDate
+                                                              withError:&error];
+    unsigned long long bytesFreed = 0;
+    NSMutableSet *remainingCandidates = candidates;
+    if (error != nil) {
+        // Try again next time
+        [composite addUnusedLocalFileCandidates:newCandidates];
+        if (errorPtr != NULL) {
+            *errorPtr = error;
+        }
+        return nil;
+    } else if (referencedStorageIds != nil) {
+        remainingCandidates = [NSMutableSet set];
+        bytesFreed = [self removeFiles:candidates ofComposite:composite notReferencedIn:referencedStorageIds
+                             olderThan:oldestDate remainingFileNames:remainingCandidates withError:&error];
+    }
+    
+    index[DCXIndexCandidatesKey] = remainingCandidates.allObjects;
+    [self writeIndex:index ofComposite:composite];
+    
+    if (error != nil && errorPtr != NULL) {
+        *errorPtr = error;
+    }
+    
+    if ( error == nil || bytesFreed > 0 ) {
+        // Return number of bytes freed even if an error occurs
+        return [NSNumber numberWithUnsignedLongLong:bytesFreed];
+    }
+    return nil;
+}
+
++(NSNumber*) removeAllUnusedLocalFilesOfComposite:(DCXComposite*)composite withError:(NSError**)errorPtr
+{
+    NSFileManager *fm = [NSFileManager defaultManager];
+    NSMutableDictionary *index = [self readIndexOfComposite:composite];
+    if (index == nil) {
+        index = [NSMutableDictionary dictionaryWithDictionary:@{DCXIndexVersionKey: @(DCXIndexVersion),
+                                                                DCXIndexManifestsKey: [NSMutableDictionary dictionary],
+                                                                DCXIndexCandidatesKey: @[]}];
+    }
+    NSDate *scanDate = [NSDate date];
+    // Candidates whose files don't exist yet when the directory gets listed must be kept
+    NSSet *newCandidates = [composite takeUnusedLocalFileCandidates];
+    
+    NSError *error = nil;
+    NSDate *oldestDate = nil;
+    NSSet *referencedStorageIds = [self referencedStorageIdsOfComposite:composite updatingIndex:index
+                                                      droppedStorageIds:nil oldestDate:&oldestDate
+                                                              withError:&error];
+    unsigned long long bytesFreed = 0;
+    NSMutableSet *remainingCandidates = [newCandidates mutableCopy];
+    
+    if (error == nil) {
         // Now iterate over all files in the components directory
         BOOL isDirectory = NO;
         NSString *componentsDir = [composite.path stringByAppendingPathComponent:DCXComponentsPath];
         if ([fm fileExistsAtPath:componentsDir isDirectory:&isDirectory] && isDirectory) {
             NSArray *fileNames = [fm contentsOfDirectoryAtPath:componentsDir error:&error];
-            NSSet *inflightComponentFiles = composite.inflightLocalComponentFiles;
-            if (error == nil) {
-                for (NSString *fileName in fileNames) {
-                    NSError *loopError = nil;
-                    if (![referencedStorageIds containsObject:fileName] && ![inflightComponentFiles containsObject:fileName]) {
-                        // Get the mod date of the file
-                        NSString *filePath = [componentsDir stringByAppendingPathComponent:fileName];
-                        NSDictionary *attributes = [fm attributesOfItemAtPath:filePath error:&loopError];
-                        if (loopError == nil) {
-                            NSDate *componentModDate = attributes.fileModificationDate;
-                            if ([componentModDate compare:oldestManifestModeDate] == NSOrderedAscending) {
-                                [fm removeItemAtPath:filePath error:&loopError];
-                                if ( !loopError ) {
-                                    bytesFreed += attributes.fileSize;
-                                }
-                            }
-                        }
-                    }
-                    if (loopError != nil && error == nil) {
-                        // We are going to continue the loop but we want to preserve the first local error
-                        error = loopError;
-                    }
+            if (fileNames != nil) {
+                [remainingCandidates minusSet:[NSSet setWithArray:fileNames]];
+                if (referencedStorageIds != nil) {
+                    bytesFreed = [self removeFiles:fileNames ofComposite:composite notReferencedIn:referencedStorageIds
+                                         olderThan:oldestDate remainingFileNames:remainingCandidates withError:&error];
+                } else {
+                    // Without any references we cannot tell which files are unused
+                    [remainingCandidates addObjectsFromArray:fileNames];
                 }
             }
         }
+        
+        index[DCXIndexCandidatesKey] = remainingCandidates.allObjects;
+        index[DCXIndexLastScanKey] = @([scanDate timeIntervalSince1970]);
+        [self writeIndex:index ofComposite:composite];
+    } else {
+        // Try again next time
+        [composite addUnusedLocalFileCandidates:newCandidates];
     }
     
     if (error != nil && errorPtr != NULL) {
@@ -533,6 +834,7 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
     
     NSArray *targetComponents = [[targetManifest allComponents] allValues];
     NSString *storageId;
+    NSString *digest;
     
     for (DCXComponent *targetComponent in targetComponents) {
         storageId = [self storageIdForComponent:targetComponent ofManifest:targetManifest createIfMissing:NO];
@@ -540,6 +842,7 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
             // Skip over target components that have already been assigned a storage ID
             continue;
         }
+        digest = nil;
         
         for (DCXManifest *sourceManifest in sourceManifests) {
             DCXComponent *sourceComponent = [sourceManifest.allComponents objectForKey:targetComponent.componentId];
@@ -548,6 +851,8 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
                 && ![sourceComponent.state isEqualToString:DCXAssetStateModified]) {
                 storageId = [self storageIdForComponent:sourceComponent ofManifest:sourceManifest];
                 if (storageId != nil) {
+                    digest = [self getLookup:DCXLocalStorageDigestMapManifestKey ofManifest:sourceManifest
+                           createIfNecessary:NO][sourceComponent.componentId];
                     break;
                 }
             }
@@ -557,14 +862,141 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
             storageId = storageIdWithPathExtension(targetComponent);
         }
         [self setStorageId:storageId forComponent:targetComponent ofManifest:targetManifest];
+        [self setDigest:digest forComponent:targetComponent ofManifest:targetManifest];
     }
 }
 
++(void) copyLocalStorageDataOfComponent:(DCXComponent*)sourceComponent fromManifest:(DCXManifest*)sourceManifest
+                            toComponent:(DCXComponent*)targetComponent ofManifest:(DCXManifest*)targetManifest
+{
+    NSString *storageId = [self storageIdForComponent:sourceComponent ofManifest:sourceManifest createIfMissing:NO];
+    NSString *digest = [self getLookup:DCXLocalStorageDigestMapManifestKey ofManifest:sourceManifest
+                     createIfNecessary:NO][sourceComponent.componentId];
+    // Set the digest last since a new storage id clears it
+    [self setStorageId:storageId forComponent:targetComponent ofManifest:targetManifest];
+    [self setDigest:digest forComponent:targetComponent ofManifest:targetManifest];
+}
+
++(BOOL) adoptLocalFileWithStorageId:(NSString*)storageId forComponent:(DCXComponent*)component
+                         ofManifest:(DCXManifest*)manifest ofComposite:(DCXComposite*)composite
+{
+    NSAssert(composite != nil, @"Parameter composite must not be nil.");
+    NSAssert(composite.path != nil, @"Parameter composite must have a non-nil path.");
+    
+    if (storageId.length == 0 || ![[storageId lastPathComponent] isEqualToString:storageId]) {
+        return NO;
+    }
+    NSString *path = [[composite.path stringByAppendingPathComponent:DCXComponentsPath] stringByAppendingPathComponent:storageId];
+    if (![[NSFileManager defaultManager] fileExistsAtPath:path]) {
+        return NO;
+    }
+    [self setStorageId:storageId forComponent:component ofManifest:manifest];
+    return YES;
+}
+
 +(void) didRemoveComponent:(DCXComponent*)component fromManifest:(DCXManifest*)manifest
 {
     return [DCXLocalStorage didRemoveLocalFileForComponent:component inManifest:manifest];
 }
 
+#pragma mark Content digests
+
++(NSString*) digestOfComponent:(DCXComponent*)component
+                    inManifest:(DCXManifest*)manifest
+                   ofComposite:(DCXComposite*)composite
+{
+    NSAssert(composite != nil, @"Parameter composite must not be nil.");
+    NSAssert(component != nil, @"Parameter component must not be nil.");
+    
+    NSString *digest = [self getLookup:DCXLocalStorageDigestMapManifestKey ofManifest:manifest
+                     createIfNecessary:NO][component.componentId];
+    if (digest != nil) {
+        return digest;
+    }
+    NSString *storageId = [self storageIdForComponent:component ofManifest:manifest createIfMissing:NO];
+    if (storageId == nil) {
+        return nil;
+    }
+    if (isContentStorageId(storageId)) {
+        return [storageId stringByDeletingPathExtension];
+    }
+    // Compute the digest from the file and keep it until the file of the component changes
+    NSString *path = [self pathOfComponent:component inManifest:manifest ofComposite:composite withError:nil];
+    digest = path == nil ? nil : [DCXFileUtils sha256DigestOfFile:path withError:nil];
+    if (digest != nil) {
+        [self setDigest:digest forComponent:component ofManifest:manifest];
+    }
+    return digest;
+}
+
+#pragma mark Content-addressed storage
+
++(BOOL) moveComponentsOfManifest:(DCXManifest*)manifest
+   intoContentStorageOfComposite:(DCXComposite*)composite
+{
+    NSAssert(composite != nil, @"Parameter composite must not be nil.");
+    
+    if (!composite.storesComponentsByContent) {
+        return NO;
+    }
+    NSDictionary *storageIdLookup = [[self getStorageIdLookupOfManifest:manifest createIfNecessary:NO] copy];
+    if (storageIdLookup == nil) {
+        return NO;
+    }
+    NSDictionary *digestLookup = [[self getLookup:DCXLocalStorageDigestMapManifestKey ofManifest:manifest
+                                createIfNecessary:NO] copy];
+    
+    BOOL changed = NO;
+    NSFileManager *fm = [NSFileManager defaultManager];
+    NSString *dir = [[composite.path stringByAppendingPathComponent:DCXComponentsPath] stringByStandardizingPath];
+    NSDictionary *allComponents = manifest.allComponents;
+    for (NSString *componentId in storageIdLookup) {
+        NSString *storageId = storageIdLookup[componentId];
+        DCXComponent *component = allComponents[componentId];
+        if (component == nil || isContentStorageId(storageId)) {
+            continue;
+        }
+        // Files without a recorded digest (e.g. ones adopted from an interrupted pull) stay where
+        // they are rather than being read again here
+        NSString *digest = digestLookup[componentId];
+        NSString *path = [dir stringByAppendingPathComponent:storageId];
+        if (digest == nil || ![fm fileExistsAtPath:path]) {
+            continue;
+        }
+        NSString *contentPath = [self contentAddressedPathOfFile:path withDigest:digest
+                                                    forComponent:component inDirectory:dir];
+        if (![contentPath isEqualToString:path]) {
+            [self setStorageId:[contentPath lastPathComponent] forComponent:component ofManifest:manifest];
+            [composite addUnusedLocalFileCandidates:[NSSet setWithObject:storageId]];
+            changed = YES;
+        }
+    }
+    return changed;
+}
+
++(NSCountedSet*) contentStorageIdsOfComponentsOtherThan:(NSSet*)componentIds
+                                            inManifests:(NSArray*)manifests
+{
+    NSCountedSet *storageIds = [NSCountedSet set];
+    for (DCXManifest *manifest in manifests) {
+        NSDictionary *storageIdLookup = [self getStorageIdLookupOfManifest:manifest createIfNecessary:NO];
+        [storageIdLookup enumerateKeysAndObjectsUsingBlock:^(NSString *componentId, NSString *storageId, BOOL *stop) {
+            if (isContentStorageId(storageId) && ![componentIds containsObject:componentId]) {
+                [storageIds addObject:storageId];
+            }
+        }];
+    }
+    return storageIds;
+}
+
++(BOOL)  isLocalFileOfComponent:(DCXComponent*)component
+                     inManifest:(DCXManifest*)manifest
+             sharedByStorageIds:(NSCountedSet*)storageIds
+{
+    NSString *storageId = [self storageIdForComponent:component ofManifest:manifest createIfMissing:NO];
+    return storageId != nil && [storageIds countForObject:storageId] > 0;
+}
+
 #pragma mark Partial composite support
 
 +(void) didRemoveLocalFileForComponent:(DCXComponent*)component
@@ -573,7 +1005,9 @@ static NSString* storageIdWithPathExtension(DCXComponent *component)
     NSMutableDictionary *lookup = [self getStorageIdLookupOfManifest:manifest createIfNecessary:NO];
     if (lookup != nil && [lookup objectForKey:component.componentId] != nil) {
         [lookup removeObjectForKey:component.componentId];
+        [manifest localDataOfComponentDidChange:component.componentId];
     }
+    [self setDigest:nil forComponent:component ofManifest:manifest];
 }
 
 +(NSDictionary*) existingLocalStoragePathsForComponentsInBranch:(DCXBranch*)branch
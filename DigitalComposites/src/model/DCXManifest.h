@@ -27,10 +27,17 @@
 @class DCXMutableNode;
 @class DCXResourceItem;
 @class DCXComponent;
+@class DCXManifestDiff;
 
 /**
  * \class DCXManifest
  * \brief Represents and manages a manifest of a composite.
+ *
+ * A copy shares the dictionaries of its child nodes and components with the manifest it has been
+ * copied from until either of them modifies them. Copying therefore counts as a mutation of the
+ * receiver: it must not run concurrently with edits of the receiver, e.g. taking a snapshot of the
+ * current branch for a push on a background queue while the app edits it. Concurrent copies of the
+ * same manifest are safe.
  */
 @interface DCXManifest : NSObject <NSCopying>
 
@@ -63,6 +70,19 @@
  */
 - (instancetype)initWithData:(NSData *)data withError:(NSError**)errorPtr;
 
+/**
+ \brief Initializes a manifest from a file containing the JSON model of a manifest file, e.g. the
+ body of a manifest response that has been streamed to disk.
+ 
+ The file gets memory-mapped so that its contents don't need to be held in memory while they are being
+ parsed. Unlike manifestWithContentsOfFile:withError: this ignores commit logs and cache files and
+ the manifest doesn't remember the path, so the file can be deleted right away.
+ 
+ \param path The path of the file.
+ \param errorPtr Gets set if the file cannot be read or its data cannot be parsed as valid JSON.
+ */
+- (instancetype)initWithContentsOfFile:(NSString *)path withError:(NSError**)errorPtr;
+
 
 #pragma mark - Storage
 
@@ -72,6 +92,20 @@
 /** The manifest in serialized form for remote storage. */
 - (NSData*) remoteData;
 
+/**
+ \brief Controls whether localData produces pretty-printed JSON.
+ 
+ Defaults to NO in which case localData writes compact JSON that is assembled from cached encodings
+ of the unmodified subtrees of the manifest. Pretty printing is mainly useful for debugging since it
+ requires the whole manifest to be re-encoded on every call.
+ 
+ \param prettyPrint YES to pretty print the local manifest data.
+ */
++ (void) setPrettyPrintsLocalData:(BOOL)prettyPrint;
+
+/** Whether localData produces pretty-printed JSON. */
++ (BOOL) prettyPrintsLocalData;
+
 /**
  \brief Write the manifest to local storage.
  
@@ -81,6 +115,66 @@
  */
 - (BOOL) writeToFile:(NSString*)path generateNewSaveId:(BOOL)newSaveId withError:(NSError**) errorPtr;
 
+/** Returns the path of the commit log that accompanies the manifest file at path. */
++ (NSString*) commitLogPathForManifestPath:(NSString*)path;
+
+/** Returns the path of the binary cache file that accompanies the manifest file at path. */
++ (NSString*) cachePathForManifestPath:(NSString*)path;
+
+/**
+ \brief Moves the cache file of the manifest file at sourcePath along with the manifest file. Must get
+ called after the manifest file itself has been moved. Removes the cache file of destPath if there is
+ no cache file to move.
+ 
+ \param sourcePath The path the manifest file has been moved from.
+ \param destPath The path the manifest file has been moved to.
+ */
++ (void) moveCacheOfManifestPath:(NSString*)sourcePath toPath:(NSString*)destPath;
+
+/** Removes the cache file of the manifest file at path. Must get called when the manifest file gets removed. */
++ (void) removeCacheOfManifestPath:(NSString*)path;
+
+/**
+ \brief Returns data that changes whenever the file at path gets modified or replaced, or nil if the file
+ doesn't exist. Manifest files and their commit logs can be compared by identity instead of by content.
+ 
+ \param path The path of the file.
+ */
++ (NSData*) identityOfFileAtPath:(NSString*)path;
+
+/**
+ \brief Whether the changes made to the manifest can be appended to the commit log of the manifest file at path.
+ 
+ This is only the case if the manifest has last been loaded from or written to that file and
+ has not been reset since.
+ 
+ \param path The path of the manifest file.
+ */
+- (BOOL) canAppendChangesToCommitLogOfFile:(NSString*)path;
+
+/**
+ \brief Appends the changes made since the manifest was last loaded, written or appended to the commit
+ log of the manifest file at path. Always generates a new manifestSaveId.
+ 
+ A record only contains the root and the nodes whose properties, children or components have changed.
+ The components of the root and the per-component local data only get included if they have changed.
+ manifestWithContentsOfFile:withError: replays the records that continue from the state of the manifest file.
+ 
+ \param path The path of the manifest file. Must satisfy canAppendChangesToCommitLogOfFile:.
+ \param lengthPtr Optional. Gets set to the length of the commit log after the record has been appended.
+ \param errorPtr Gets set if something goes wrong.
+ */
+- (BOOL) appendChangesToCommitLogOfFile:(NSString*)path logLength:(unsigned long long*)lengthPtr withError:(NSError**)errorPtr;
+
+/**
+ \brief Records that the per-component entries of the local data (e.g. the local storage id or digest of
+ the component) have been modified in place so that the next record appended to the commit log contains
+ them. Only these entries get logged instead of the whole lookup tables.
+ 
+ \param componentId The id of the component whose entries have changed.
+ */
+- (void) localDataOfComponentDidChange:(NSString*)componentId;
+
 /**
  \brief Remove all service-related data from the manifest so that
  it can be pushed again to the same or a different service.
@@ -110,6 +204,37 @@
  */
 -(void) resetIdentity;
 
+/**
+ \brief Lets the manifest share the dictionaries of its components with other manifests of the same
+ composite, e.g. the manifests of its current, base, pulled and pushed branches which tend to be mostly
+ identical.
+ 
+ Replaces the dictionary of every component with an equal dictionary from pool and adds the dictionaries
+ that pool doesn't have yet. Component dictionaries never get modified in place so sharing them is safe.
+ Should be called right after the manifest has been loaded since it replaces the component objects of
+ the manifest.
+ 
+ \param pool Maps component ids and etags to component dictionaries. Should hold its values weakly so
+ that dictionaries go away with the last manifest that uses them (see NSMapTable strongToWeakObjectsMapTable).
+ 
+ \return The number of components that now share their dictionary with another manifest.
+ */
+-(NSUInteger) shareComponentsWithPool:(NSMapTable*)pool;
+
+/**
+ \brief Returns the structural differences between another manifest of the same composite and this
+ manifest, i.e. the components and child nodes that have been added, removed, moved, renamed or
+ otherwise changed going from manifest to this manifest.
+ 
+ Runs in time linear in the number of items since it only looks up items by id. Returns right away if
+ both manifests have been read from the same save and haven't been modified since.
+ 
+ \param manifest The older manifest to compare this manifest with.
+ 
+ \return The differences. Use isEmpty to check whether the manifests are identical.
+ */
+-(DCXManifestDiff*) diffFromManifest:(DCXManifest*)manifest;
+
 
 #pragma mark - Convenience Constructor Methods
 
@@ -122,13 +247,28 @@
 + (instancetype)manifestWithName:(NSString*)name andType:(NSString*)type;
 
 /**
- \brief Creates a manifest from a manifest file.
+ \brief Creates a manifest from a manifest file and replays its commit log if there is one.
  
  \param path NSString containg the path of the manifest file to read and parse.
  \param errorPtr Gets set if the file cannot be read or the data from the file cannot be parsed as valid JSON.
  */
 + (instancetype)manifestWithContentsOfFile:(NSString*)path withError:(NSError**)errorPtr;
 
+/**
+ \brief Same as manifestWithContentsOfFile:withError: but optionally reads the manifest from a compact
+ binary cache file next to the manifest file which is a lot faster than parsing its JSON.
+ 
+ The cache file is only used if it has been created from the current manifest file, i.e. if the inode,
+ size and modification date of the manifest file are still the same and the save id of the manifest
+ matches. Otherwise the manifest gets read from the manifest file and the cache file gets rewritten.
+ Writing or replacing the manifest file automatically invalidates the cache file.
+ 
+ \param path NSString containg the path of the manifest file to read and parse.
+ \param useCache Whether to use (and create) the cache file.
+ \param errorPtr Gets set if the file cannot be read or the data from the file cannot be parsed as valid JSON.
+ */
++ (instancetype)manifestWithContentsOfFile:(NSString*)path usingCache:(BOOL)useCache withError:(NSError**)errorPtr;
+
 
 /** Dictionary of all components keyed by component id. Component objects are of type DCXComponent.*/
 @property (nonatomic, readonly) NSDictionary *allComponents;
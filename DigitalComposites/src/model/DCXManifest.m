@@ -31,15 +31,58 @@
 #import "DCXMutableComponent.h"
 #import "DCXMutableNode.h"
 #import "DCXManifestFormatConverter.h"
+#import "DCXManifestReader.h"
+#import "DCXManifestDiff_Internal.h"
 
 #import "DCXUtils.h"
 #import "DCXErrorUtils.h"
+#import "DCXFileUtils.h"
 #import "DCXCopyUtils.h"
 #import "DCXUtils.h"
 
 static NSDateFormatter *staticDateFormatter;
 static NSDateFormatter *staticRFC3339DateParser1;
 static NSDateFormatter *staticRFC3339DateParser2;
+static BOOL staticPrettyPrintsLocalData = NO;
+
+static NSString *const DCXCommitLogPreviousSaveIdKey = @"previous-save-id";
+static NSString *const DCXCommitLogNodesKey = @"nodes";
+static NSString *const DCXCommitLogLocalChangesKey = @"local-changes";
+static NSString *const DCXCommitLogRootComponentsUnchangedKey = @"root-components-unchanged";
+
+#pragma mark - Location
+
+/**
+ Records where a child node or a component lives in the DOM: the id of the node that
+ contains it and its index in that node's children or components array. The index is only
+ a hint since removing a sibling shifts the indexes of all subsequent items. It gets
+ verified and, if necessary, refreshed whenever it is used.
+ 
+ Locations are shared between copies of a manifest. They must get replaced rather than
+ modified when an item moves, with the exception of refreshing the index hint.
+ */
+@interface DCXManifestItemLocation : NSObject
+
+@property (nonatomic) NSString *parentId;
+@property (atomic) NSUInteger index;
+
++(instancetype) locationWithParentId:(NSString*)parentId atIndex:(NSUInteger)index;
+
+@end
+
+@implementation DCXManifestItemLocation
+
++(instancetype) locationWithParentId:(NSString*)parentId atIndex:(NSUInteger)index
+{
+    DCXManifestItemLocation *location = [[self alloc] init];
+    location.parentId = parentId;
+    location.index = index;
+    return location;
+}
+
+@end
+
+#pragma mark - Manifest
 
 @implementation DCXManifest
 {
@@ -49,7 +92,40 @@ static NSDateFormatter *staticRFC3339DateParser2;
     // Hashes that make lookups faster and allow us to catch duplicate ids/paths.
     NSMutableDictionary *_allComponents;
     NSMutableDictionary *_allChildren;
+    
+    // Lowercased absolute path -> component or node. Built on first use by absolutePaths since it
+    // needs a path string per item and manifests that only get read never use it. Updates to the
+    // hash while it is nil can be skipped since it gets built from _allComponents and _allChildren.
     NSMutableDictionary *_absolutePaths;
+    
+    // Hashes that allow us to locate the dictionary of a node and the parent of a
+    // node or component without having to search the DOM.
+    NSMutableDictionary *_nodeDicts;            // node id -> node dictionary (including the root)
+    NSMutableDictionary *_childLocations;       // node id -> DCXManifestItemLocation
+    NSMutableDictionary *_componentLocations;   // component id -> DCXManifestItemLocation
+    
+    // Cache of the compact JSON encodings of child node and component dictionaries. Keys are the
+    // dictionaries themselves (compared by identity) so that replacing a dictionary automatically
+    // invalidates its entry. Mutating the children or components of a node in place requires a call
+    // to nodeDictDidChange: since that changes the encodings of the node and its ancestors.
+    NSMapTable *_encodingCache;
+    
+    // State of the commit log. _writtenPath is the manifest file that the manifest was last loaded from or
+    // written to. Changes can only be appended to the commit log of that file. _modifiedNodeIds holds the
+    // ids of the nodes whose properties, children or components have changed since then.
+    // _modifiedLocalDataIds holds the ids of the components whose entries in the lookup tables of the
+    // local data have changed and _localDataReplaced whether the local data has been replaced as a whole.
+    NSString *_writtenPath;
+    NSMutableSet *_modifiedNodeIds;
+    NSMutableSet *_modifiedLocalDataIds;
+    BOOL _localDataReplaced;
+    
+    // Copies of a manifest share the dictionaries of their child nodes and components. Once a manifest
+    // has been copied it may only modify the node dictionaries in _ownedNodeDicts in place. All others
+    // get replaced by private copies first (see findMutableNodeById:). nil if the manifest has never
+    // been copied, in which case it owns all of its node dictionaries. Guarded by self so that copying
+    // the manifest and checking or taking ownership of a node dictionary don't interleave.
+    NSHashTable *_ownedNodeDicts;
 }
 
 + (void) initialize
@@ -80,6 +156,13 @@ static NSDateFormatter *staticRFC3339DateParser2;
 #pragma mark Initializers
 
 - (instancetype)initWithDictionary:(NSMutableDictionary*)dictionary withError:(NSError**)errorPtr
+{
+    return [self initWithDictionary:dictionary fromReader:nil withError:errorPtr];
+}
+
+// reader is the DCXManifestReader that has produced dictionary or nil
+- (instancetype)initWithDictionary:(NSMutableDictionary*)dictionary fromReader:(DCXManifestReader*)reader
+                         withError:(NSError**)errorPtr
 {
     if (self = [super init]) {
         // first figure out the format version of the manifest in the dictionary and see
@@ -89,6 +172,8 @@ static NSDateFormatter *staticRFC3339DateParser2;
             if (![DCXManifestFormatConverter updateManifestDictionary:dictionary fromVersion:fversion withError:errorPtr]) {
                 return nil;
             }
+            // The conversion may have replaced the dictionaries that the reader has seen
+            reader = nil;
         } else if (fversion > DCXManifestFormatVersion) {
             // We downgrade the manifest format version number to match the format that
             // this version of the code can produce.
@@ -102,12 +187,20 @@ static NSDateFormatter *staticRFC3339DateParser2;
         }
         
         _rootNode = [DCXMutableNode rootNodeFromDict:dictionary andManifest:self];
+        _encodingCache = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsWeakMemory | NSPointerFunctionsObjectPointerPersonality
+                                               valueOptions:NSPointerFunctionsStrongMemory];
+        _modifiedNodeIds = [NSMutableSet set];
+        _modifiedLocalDataIds = [NSMutableSet set];
         
         if (![self verifyWithError:errorPtr]) {
             return nil;
         }
         
-        [self buildHashes];
+        if (reader != nil) {
+            [self buildHashesFromReader:reader];
+        } else {
+            [self buildHashes];
+        }
         
         _isDirty = NO;
     }
@@ -132,19 +225,27 @@ static NSDateFormatter *staticRFC3339DateParser2;
 
 - (instancetype)initWithData:(NSData*)data withError:(NSError**)errorPtr
 {
-    NSError *parseError;
-    NSMutableDictionary *dictionary = [DCXUtils JSONObjectWithData:data options:NSJSONReadingMutableContainers error:&parseError];
-    if(dictionary == nil) {
-        if (errorPtr != NULL) {
-            *errorPtr = [DCXErrorUtils ErrorWithCode:DCXErrorInvalidManifest domain:DCXErrorDomain
-                                              underlyingError:parseError details:@"Invalid JSON"];
-        }
+    return [self initWithReader:[[DCXManifestReader alloc] initWithData:data] withError:errorPtr];
+}
+
+- (instancetype)initWithContentsOfFile:(NSString*)path withError:(NSError**)errorPtr
+{
+    DCXManifestReader *reader = [[DCXManifestReader alloc] initWithContentsOfFile:path withError:errorPtr];
+    if(reader == nil) {
         return nil;
     }
     
-    [self recursiveRemoveEmptyArrays:dictionary]; // See explanation below
+    return [self initWithReader:reader withError:errorPtr];
+}
+
+- (instancetype)initWithReader:(DCXManifestReader*)reader withError:(NSError**)errorPtr
+{
+    NSMutableDictionary *dictionary = [reader readWithError:errorPtr];
+    if(dictionary == nil) {
+        return nil;
+    }
     
-    return [self initWithDictionary:dictionary withError:errorPtr];
+    return [self initWithDictionary:dictionary fromReader:reader withError:errorPtr];
 }
 
 -(NSMutableDictionary *) getManifestDictionaryFrom:(NSDictionary*)dict {
@@ -170,40 +271,15 @@ static NSDateFormatter *staticRFC3339DateParser2;
 }
 
 
--(BOOL) removeArrayIfEmptyWithName:(NSString*)name fromDict:(NSMutableDictionary*)dict
-{
-    NSArray *array = [dict objectForKey:name];
-    if (array != nil && [array count] == 0) {
-        [dict removeObjectForKey:name];
-        return YES;
-    } else {
-        return NO;
-    }
-}
-
-// Workaround for OS X 10.7 NSJSONSerialization bug:
-// Empty collections are immutable
-// http://stackoverflow.com/questions/9912707/nsjsonserialization-not-creating-mutable-containers
--(void) recursiveRemoveEmptyArrays:(NSMutableDictionary*)dict
-{
-    [self removeArrayIfEmptyWithName:DCXLinksManifestKey fromDict:dict];
-    [self removeArrayIfEmptyWithName:DCXComponentsManifestKey fromDict:dict];
-    if (![self removeArrayIfEmptyWithName:DCXChildrenManifestKey fromDict:dict]) {
-        NSArray *children = [dict objectForKey:DCXChildrenManifestKey];
-        if (children != nil) {
-            for (NSMutableDictionary *child in children) {
-                [self recursiveRemoveEmptyArrays:child];
-            }
-        }
-    }
-}
-
 -(void) recursiveBuildHashesFrom:(NSDictionary*)dict parentPath:(NSString*)parentPath;
 {
     __weak __typeof(self)weakSelf = self;
 
+    NSString *parentId = [dict objectForKey:DCXIdManifestKey];
+    
     NSArray *components = [dict objectForKey:DCXComponentsManifestKey];
     if (components != nil) {
+        NSUInteger index = 0;
         for (id componentData in components) {
             NSString *componentId = [componentData objectForKey:DCXIdManifestKey];
             if (componentId == nil) {
@@ -213,11 +289,12 @@ static NSDateFormatter *staticRFC3339DateParser2;
             
             DCXComponent *comp = [DCXComponent componentFromDictionary:componentData andManifest:weakSelf withParentPath:parentPath];
             [_allComponents setObject:comp forKey:componentId];
-            [_absolutePaths setObject:comp forKey:comp.absolutePath.lowercaseString];
+            [_componentLocations setObject:[DCXManifestItemLocation locationWithParentId:parentId atIndex:index++] forKey:componentId];
         }
     }
     NSArray *children = [dict objectForKey:DCXChildrenManifestKey];
     if (children != nil) {
+        NSUInteger index = 0;
         for (id nodeData in children) {
             NSString *nodeId = [nodeData objectForKey:DCXIdManifestKey];
             if (nodeId == nil) {
@@ -226,8 +303,9 @@ static NSDateFormatter *staticRFC3339DateParser2;
             }
             DCXNode *node = [DCXNode nodeFromDictionary:nodeData andManifest:weakSelf withParentPath:parentPath];
             [_allChildren setObject:node forKey:nodeId];
+            [_nodeDicts setObject:nodeData forKey:nodeId];
+            [_childLocations setObject:[DCXManifestItemLocation locationWithParentId:parentId atIndex:index++] forKey:nodeId];
             if (node.path != nil) {
-                [_absolutePaths setObject:node forKey:node.absolutePath.lowercaseString];
                 [self recursiveBuildHashesFrom:nodeData parentPath:[parentPath stringByAppendingPathComponent:node.path]];
             } else {
                 [self recursiveBuildHashesFrom:nodeData parentPath:parentPath];
@@ -241,12 +319,71 @@ static NSDateFormatter *staticRFC3339DateParser2;
     NSUInteger numComponents = [[_rootNode.dict objectForKey:DCXComponentsManifestKey] count];
     _allComponents = [NSMutableDictionary dictionaryWithCapacity:numComponents];
     _allChildren = [NSMutableDictionary dictionaryWithCapacity:[[_rootNode.dict objectForKey:DCXChildrenManifestKey] count]];
-    _absolutePaths = [NSMutableDictionary dictionaryWithCapacity:numComponents];
+    _absolutePaths = nil;
+    _nodeDicts = [NSMutableDictionary dictionaryWithCapacity:[_allChildren count]];
+    _childLocations = [NSMutableDictionary dictionaryWithCapacity:[_allChildren count]];
+    _componentLocations = [NSMutableDictionary dictionaryWithCapacity:numComponents];
     
     [self recursiveBuildHashesFrom:_rootNode.dict parentPath:@"/"];
     
     [_allChildren setObject:_rootNode forKey:_rootNode.nodeId];
-    [_absolutePaths setObject:_rootNode forKey:@"/"];
+    [_nodeDicts setObject:[_rootNode getMutableDictionary] forKey:_rootNode.nodeId];
+}
+
+// Same as buildHashes but uses the items recorded by the reader that has parsed the manifest
+// instead of walking the DOM.
+- (void) buildHashesFromReader:(DCXManifestReader*)reader
+{
+    __weak __typeof(self)weakSelf = self;
+    
+    NSUInteger numChildren = reader.nodeCount + 1;
+    NSUInteger numComponents = reader.componentCount;
+    _allComponents = [NSMutableDictionary dictionaryWithCapacity:numComponents];
+    _allChildren = [NSMutableDictionary dictionaryWithCapacity:numChildren];
+    _absolutePaths = nil;
+    _nodeDicts = [NSMutableDictionary dictionaryWithCapacity:numChildren];
+    _childLocations = [NSMutableDictionary dictionaryWithCapacity:numChildren];
+    _componentLocations = [NSMutableDictionary dictionaryWithCapacity:numComponents];
+    
+    [reader enumerateItemsWithRootId:_rootNode.nodeId usingBlock:^(NSMutableDictionary *dict, BOOL isComponent, NSString *itemId,
+                                                                  NSString *parentId, NSUInteger index, NSString *parentPath) {
+        DCXManifestItemLocation *location = [DCXManifestItemLocation locationWithParentId:parentId atIndex:index];
+        if (isComponent) {
+            [_allComponents setObject:[DCXComponent componentFromDictionary:dict andManifest:weakSelf withParentPath:parentPath]
+                               forKey:itemId];
+            [_componentLocations setObject:location forKey:itemId];
+        } else {
+            [_allChildren setObject:[DCXNode nodeFromDictionary:dict andManifest:weakSelf withParentPath:parentPath]
+                             forKey:itemId];
+            [_nodeDicts setObject:dict forKey:itemId];
+            [_childLocations setObject:location forKey:itemId];
+        }
+    }];
+    
+    [_allChildren setObject:_rootNode forKey:_rootNode.nodeId];
+    [_nodeDicts setObject:[_rootNode getMutableDictionary] forKey:_rootNode.nodeId];
+}
+
+-(NSMutableDictionary*) absolutePaths
+{
+    if (_absolutePaths == nil) {
+        @synchronized(self) {
+            if (_absolutePaths == nil) {
+                NSMutableDictionary *absolutePaths = [NSMutableDictionary dictionaryWithCapacity:_allComponents.count + _allChildren.count];
+                [_allComponents enumerateKeysAndObjectsUsingBlock:^(NSString *componentId, DCXComponent *component, BOOL *stop) {
+                    [absolutePaths setObject:component forKey:component.absolutePath.lowercaseString];
+                }];
+                [_allChildren enumerateKeysAndObjectsUsingBlock:^(NSString *nodeId, DCXNode *node, BOOL *stop) {
+                    if (node != _rootNode && node.path != nil) {
+                        [absolutePaths setObject:node forKey:node.absolutePath.lowercaseString];
+                    }
+                }];
+                [absolutePaths setObject:_rootNode forKey:@"/"];
+                _absolutePaths = absolutePaths;
+            }
+        }
+    }
+    return _absolutePaths;
 }
 
 
@@ -259,16 +396,114 @@ static NSDateFormatter *staticRFC3339DateParser2;
 
 + (instancetype)manifestWithContentsOfFile:(NSString*)path withError:(NSError**) errorPtr
 {
-    NSData *data = [[NSFileManager defaultManager] contentsAtPath:path];
-    if(data == nil) {
-        if (errorPtr != nil) {
-            *errorPtr = [DCXErrorUtils ErrorWithCode:DCXErrorManifestReadFailure domain:DCXErrorDomain
-                                              underlyingError:nil path:path details:nil];
+    return [self manifestWithContentsOfFile:path usingCache:NO withError:errorPtr];
+}
+
++ (instancetype)manifestWithContentsOfFile:(NSString*)path usingCache:(BOOL)useCache withError:(NSError**)errorPtr
+{
+    // The commit log must be read before the manifest file since compaction writes the manifest file
+    // before it truncates the commit log.
+    NSData *logData = [[NSFileManager defaultManager] contentsAtPath:[self commitLogPathForManifestPath:path]];
+    
+    // The identity must be determined before the manifest file gets read. Otherwise the cache could
+    // end up claiming to be derived from a manifest file that has replaced the one that we have read.
+    NSData *fileIdentity = useCache ? [self identityOfFileAtPath:path] : nil;
+    DCXManifest *manifest = nil;
+    if (fileIdentity != nil) {
+        manifest = [self manifestFromCacheOfFileWithIdentity:fileIdentity atPath:path];
+    }
+    
+    if (manifest == nil) {
+        DCXManifestReader *reader = [[DCXManifestReader alloc] initWithContentsOfFile:path withError:errorPtr];
+        if(reader == nil) {
+            return nil;
         }
+        
+        manifest = [[self alloc] initWithReader:reader withError:errorPtr];
+        if (manifest != nil && fileIdentity != nil) {
+            // Must happen before the commit log gets replayed since the cache mirrors the manifest file
+            [manifest writeCacheOfFileWithIdentity:fileIdentity atPath:path];
+        }
+    }
+    
+    if (manifest != nil) {
+        if (logData.length > 0) {
+            [manifest replayCommitLog:logData];
+        }
+        manifest->_writtenPath = path;
+    }
+    
+    return manifest;
+}
+
+#pragma mark Binary cache
+
++ (NSString*)cachePathForManifestPath:(NSString *)path
+{
+    return [path stringByAppendingPathExtension:@"bin"];
+}
+
++ (void)moveCacheOfManifestPath:(NSString *)sourcePath toPath:(NSString *)destPath
+{
+    NSString *sourceCachePath = [self cachePathForManifestPath:sourcePath];
+    NSString *destCachePath = [self cachePathForManifestPath:destPath];
+    NSFileManager *fm = [NSFileManager defaultManager];
+    // The cache files are optional so failing to move them is not an error. A cache file that
+    // doesn't match its manifest file anymore just gets ignored and rewritten.
+    if (![fm fileExistsAtPath:sourceCachePath]
+        || ![DCXFileUtils moveFileAtomicallyFrom:sourceCachePath to:destCachePath withError:nil]) {
+        [fm removeItemAtPath:destCachePath error:nil];
+    }
+}
+
++ (void)removeCacheOfManifestPath:(NSString *)path
+{
+    [[NSFileManager defaultManager] removeItemAtPath:[self cachePathForManifestPath:path] error:nil];
+}
+
+// Manifest files get written atomically and moved around which gives them a new inode every time.
++ (NSData*)identityOfFileAtPath:(NSString*)path
+{
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil];
+    if (attributes == nil) {
+        return nil;
+    }
+    uint64_t fileNumber = [attributes[NSFileSystemFileNumber] unsignedLongLongValue];
+    uint64_t fileSize = attributes.fileSize;
+    NSTimeInterval modificationTime = attributes.fileModificationDate.timeIntervalSinceReferenceDate;
+    NSMutableData *identity = [NSMutableData dataWithCapacity:24];
+    [identity appendBytes:&fileNumber length:sizeof(fileNumber)];
+    [identity appendBytes:&fileSize length:sizeof(fileSize)];
+    [identity appendBytes:&modificationTime length:sizeof(modificationTime)];
+    return identity;
+}
+
+// Returns the manifest stored in the cache file of the manifest file at path or nil if there is no
+// cache file or if it is stale or corrupt.
++ (instancetype)manifestFromCacheOfFileWithIdentity:(NSData*)fileIdentity atPath:(NSString*)path
+{
+    NSData *data = [NSData dataWithContentsOfFile:[self cachePathForManifestPath:path] options:NSDataReadingMappedIfSafe error:nil];
+    if (data == nil) {
+        return nil;
+    }
+    
+    // The key of a cache file is the identity of the manifest file it has been created from. The
+    // checksum of the binary format takes care of detecting a corrupt cache file.
+    DCXManifestReader *reader = [[DCXManifestReader alloc] initWithBinaryData:data];
+    if (![reader.binaryKey isEqualToData:fileIdentity]) {
         return nil;
     }
     
-    return [[self alloc] initWithData:data withError:errorPtr];
+    return [[self alloc] initWithReader:reader withError:nil];
+}
+
+-(void) writeCacheOfFileWithIdentity:(NSData*)fileIdentity atPath:(NSString*)path
+{
+    NSMutableDictionary *dict = [_rootNode.dict mutableCopy];
+    [dict addEntriesFromDictionary:_dictionary];
+    NSData *data = [DCXManifestReader binaryDataWithDictionary:dict key:fileIdentity];
+    // The cache is optional so failing to write it is not an error
+    [data writeToFile:[DCXManifest cachePathForManifestPath:path] options:NSDataWritingAtomic error:nil];
 }
 
 // IMPORTANT NODE : Make sure that this is called AFTER the initialization of the root Node
@@ -301,19 +536,13 @@ static NSDateFormatter *staticRFC3339DateParser2;
 {
     NSError *writeError = nil;
     if ( newSaveId ) {
-        NSString *saveID = [[NSUUID UUID] UUIDString];
-        NSMutableDictionary *local = [_dictionary objectForKey:DCXLocalDataManifestKey];
-        if ( local != nil ) {
-            [local setObject:saveID forKey:DCXManifestSaveIdManifestKey];
-        }
-        else {
-            [_dictionary setObject:[NSMutableDictionary dictionaryWithObject:saveID forKey:DCXManifestSaveIdManifestKey]
-                            forKey:DCXLocalDataManifestKey];
-        }
+        [self generateNewSaveId];
     }
     
     if ([self.localData writeToFile:path options:NSDataWritingAtomic error:&writeError]) {
         _isDirty = NO;
+        _writtenPath = path;
+        [self clearLoggedChanges];
         return YES;
     }
     if (errorPtr != NULL) {
@@ -324,35 +553,269 @@ static NSDateFormatter *staticRFC3339DateParser2;
     return NO;
 }
 
-- (void)recursiveReset:(NSMutableDictionary*)node
+- (void)generateNewSaveId
+{
+    NSString *saveID = [[NSUUID UUID] UUIDString];
+    NSMutableDictionary *local = [_dictionary objectForKey:DCXLocalDataManifestKey];
+    if ( local != nil ) {
+        [local setObject:saveID forKey:DCXManifestSaveIdManifestKey];
+    }
+    else {
+        [_dictionary setObject:[NSMutableDictionary dictionaryWithObject:saveID forKey:DCXManifestSaveIdManifestKey]
+                        forKey:DCXLocalDataManifestKey];
+    }
+}
+
++ (NSString*)commitLogPathForManifestPath:(NSString *)path
+{
+    return [path stringByAppendingPathExtension:@"log"];
+}
+
+- (BOOL)canAppendChangesToCommitLogOfFile:(NSString *)path
+{
+    return _writtenPath != nil && [_writtenPath isEqualToString:path] && self.saveId != nil;
+}
+
+- (BOOL)appendChangesToCommitLogOfFile:(NSString *)path logLength:(unsigned long long *)lengthPtr withError:(NSError **)errorPtr
+{
+    NSAssert([self canAppendChangesToCommitLogOfFile:path], @"Changes can only be appended to the commit log of the file the manifest was last written to");
+    
+    // A record consists of the root and all modified nodes. Children are referenced by id so that
+    // unmodified descendants don't need to get written. The record gets chained to the previous state
+    // via its save id which lets us detect stale records when replaying the log.
+    NSString *previousSaveId = self.saveId;
+    [self generateNewSaveId];
+    
+    // The root always gets recorded since it holds the manifest-specific properties, but its components
+    // only if they have changed. The same goes for the lookup tables of the local data which have an
+    // entry for every component.
+    BOOL rootComponentsChanged = [_modifiedNodeIds containsObject:_rootNode.nodeId];
+    NSMutableDictionary *rootProperties = [_rootNode.dict mutableCopy];
+    if (!rootComponentsChanged) {
+        [rootProperties removeObjectForKey:DCXComponentsManifestKey];
+    }
+    [rootProperties addEntriesFromDictionary:_dictionary];
+    NSDictionary *localChanges = nil;
+    if (!_localDataReplaced) {
+        NSMutableDictionary *local = [NSMutableDictionary dictionary];
+        NSMutableDictionary *changes = [NSMutableDictionary dictionary];
+        [_dictionary[DCXLocalDataManifestKey] enumerateKeysAndObjectsUsingBlock:^(NSString *key, id value, BOOL *stop) {
+            if (![value isKindOfClass:[NSDictionary class]]) {
+                local[key] = value;
+                return;
+            }
+            NSMutableDictionary *lookupChanges = [NSMutableDictionary dictionary];
+            for (NSString *componentId in _modifiedLocalDataIds) {
+                lookupChanges[componentId] = value[componentId] ?: [NSNull null];
+            }
+            if (lookupChanges.count > 0) {
+                changes[key] = lookupChanges;
+            }
+        }];
+        rootProperties[DCXLocalDataManifestKey] = local;
+        localChanges = changes;
+    }
+    NSMutableArray *nodeRecords = [NSMutableArray arrayWithCapacity:_modifiedNodeIds.count + 1];
+    [nodeRecords addObject:[self commitLogRecordOfNodeDict:_rootNode.dict withProperties:rootProperties]];
+    for (NSString *nodeId in _modifiedNodeIds) {
+        NSDictionary *nodeDict = _nodeDicts[nodeId];
+        if (nodeDict != nil && nodeDict != _rootNode.dict) {
+            [nodeRecords addObject:[self commitLogRecordOfNodeDict:nodeDict withProperties:nodeDict]];
+        }
+    }
+    NSMutableDictionary *record = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                   previousSaveId, DCXCommitLogPreviousSaveIdKey,
+                                   nodeRecords, DCXCommitLogNodesKey, nil];
+    if (localChanges != nil) {
+        record[DCXCommitLogLocalChangesKey] = localChanges;
+    }
+    if (!rootComponentsChanged) {
+        record[DCXCommitLogRootComponentsUnchangedKey] = @YES;
+    }
+    
+    NSString *logPath = [DCXManifest commitLogPathForManifestPath:path];
+    BOOL success = [DCXFileUtils appendData:[DCXFileUtils dataOfLogRecord:record] toFile:logPath resultingLength:lengthPtr];
+    
+    if (!success) {
+        // The state of the log is unknown at this point so the next write must be a full one.
+        _writtenPath = nil;
+        if (errorPtr != NULL) {
+            *errorPtr = [DCXErrorUtils ErrorWithCode:DCXErrorManifestWriteFailure domain:DCXErrorDomain
+                                              underlyingError:nil path:logPath details:@"Failed to append to the commit log"];
+        }
+        return NO;
+    }
+    
+    _isDirty = NO;
+    [self clearLoggedChanges];
+    
+    return YES;
+}
+
+-(void) clearLoggedChanges
+{
+    [_modifiedNodeIds removeAllObjects];
+    [_modifiedLocalDataIds removeAllObjects];
+    _localDataReplaced = NO;
+}
+
+- (void)localDataOfComponentDidChange:(NSString *)componentId
+{
+    if (componentId != nil) {
+        [_modifiedLocalDataIds addObject:componentId];
+    }
+}
+
+-(NSDictionary*) commitLogRecordOfNodeDict:(NSDictionary*)nodeDict withProperties:(NSDictionary*)properties
+{
+    NSMutableDictionary *record = [properties mutableCopy];
+    NSArray *children = nodeDict[DCXChildrenManifestKey];
+    if (children.count > 0) {
+        record[DCXChildrenManifestKey] = [children valueForKey:DCXIdManifestKey];
+    }
+    return record;
+}
+
+-(void) replayCommitLog:(NSData*)logData
+{
+    __block NSString *saveId = self.saveId;
+    if (saveId == nil) {
+        return;
+    }
+    
+    __block BOOL replayed = NO;
+    // Records that don't continue from the current state (e.g. because they predate the manifest
+    // file) get skipped.
+    [DCXFileUtils enumerateLogRecordsOfData:logData options:NSJSONReadingMutableContainers
+                                 usingBlock:^(NSDictionary *record, BOOL *stop) {
+        if ([record[DCXCommitLogPreviousSaveIdKey] isEqualToString:saveId]) {
+            [self applyCommitLogRecord:record];
+            saveId = self.saveId;
+            replayed = YES;
+        }
+    }];
+    
+    if (replayed) {
+        [self buildHashes];
+        [self invalidateAllEncodings];
+    }
+}
+
+-(void) applyCommitLogRecord:(NSDictionary*)record
+{
+    NSArray *nodeRecords = record[DCXCommitLogNodesKey];
+    NSMutableArray *nodeDicts = [NSMutableArray arrayWithCapacity:nodeRecords.count];
+    NSMutableArray *childIdLists = [NSMutableArray arrayWithCapacity:nodeRecords.count];
+    
+    // First update the properties and components of all recorded nodes. Existing node dictionaries
+    // get updated in place since their unmodified parents still refer to them.
+    for (NSUInteger i = 0; i < nodeRecords.count; i++) {
+        NSMutableDictionary *nodeRecord = nodeRecords[i];
+        NSArray *childIds = nodeRecord[DCXChildrenManifestKey];
+        [nodeRecord removeObjectForKey:DCXChildrenManifestKey];
+        NSMutableDictionary *nodeDict;
+        if (i == 0) {
+            // The first record is always the root which also holds the manifest-specific properties
+            nodeDict = [_rootNode getMutableDictionary];
+            NSDictionary *localChanges = record[DCXCommitLogLocalChangesKey];
+            if (localChanges != nil) {
+                // The record only holds the scalar local data and the changed entries of the lookup tables
+                NSMutableDictionary *local = [NSMutableDictionary dictionary];
+                [_dictionary[DCXLocalDataManifestKey] enumerateKeysAndObjectsUsingBlock:^(NSString *key, id value, BOOL *stop) {
+                    if ([value isKindOfClass:[NSDictionary class]]) {
+                        local[key] = value;
+                    }
+                }];
+                [local addEntriesFromDictionary:nodeRecord[DCXLocalDataManifestKey]];
+                [localChanges enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSDictionary *changes, BOOL *stop) {
+                    NSMutableDictionary *lookup = [local[key] mutableCopy] ?: [NSMutableDictionary dictionary];
+                    [changes enumerateKeysAndObjectsUsingBlock:^(NSString *componentId, id value, BOOL *stop) {
+                        if (value == [NSNull null]) {
+                            [lookup removeObjectForKey:componentId];
+                        } else {
+                            lookup[componentId] = value;
+                        }
+                    }];
+                    local[key] = lookup;
+                }];
+                nodeRecord[DCXLocalDataManifestKey] = local;
+            }
+            if ([record[DCXCommitLogRootComponentsUnchangedKey] boolValue] && nodeDict[DCXComponentsManifestKey] != nil) {
+                nodeRecord[DCXComponentsManifestKey] = nodeDict[DCXComponentsManifestKey];
+            }
+            _dictionary = [self getManifestDictionaryFrom:nodeRecord];
+            [nodeRecord removeObjectsForKeys:[DCXManifest manifestSpecificProperties]];
+            nodeRecord[DCXIdManifestKey] = _dictionary[DCXIdManifestKey];
+        } else {
+            nodeDict = _nodeDicts[nodeRecord[DCXIdManifestKey]];
+            if (nodeDict == nil) {
+                nodeDict = [NSMutableDictionary dictionaryWithCapacity:nodeRecord.count];
+                _nodeDicts[nodeRecord[DCXIdManifestKey]] = nodeDict;
+            }
+        }
+        [nodeDict removeAllObjects];
+        [nodeDict addEntriesFromDictionary:nodeRecord];
+        [nodeDicts addObject:nodeDict];
+        [childIdLists addObject:childIds == nil ? @[] : childIds];
+    }
+    
+    // Now that all nodes exist we can resolve the children
+    for (NSUInteger i = 0; i < nodeDicts.count; i++) {
+        NSMutableDictionary *nodeDict = nodeDicts[i];
+        NSArray *childIds = childIdLists[i];
+        NSMutableArray *children = [NSMutableArray arrayWithCapacity:childIds.count];
+        for (NSString *childId in childIds) {
+            NSMutableDictionary *childDict = _nodeDicts[childId];
+            NSAssert(childDict != nil, @"Commit log refers to unknown child node %@", childId);
+            if (childDict != nil) {
+                [children addObject:childDict];
+            }
+        }
+        if (children.count > 0) {
+            nodeDict[DCXChildrenManifestKey] = children;
+        }
+    }
+}
+
+- (void)recursiveReset:(NSDictionary*)node
 {
     // Iterate over components
-    NSMutableArray *components = [node objectForKey:DCXComponentsManifestKey];
+    NSMutableArray *components = nil;
+    if (node[DCXComponentsManifestKey] != nil) {
+        components = [self findMutableNodeById:node[DCXIdManifestKey]][DCXComponentsManifestKey];
+    }
     // Iterate from back to front so that we can safely remove components
     for (NSInteger i=[components count]-1; i>=0; i--) {
-        NSMutableDictionary *component = [components objectAtIndex:i];
+        NSDictionary *component = [components objectAtIndex:i];
         NSString *componentState = [component objectForKey:DCXStateManifestKey];
+        NSString *componentId = [component objectForKey:DCXIdManifestKey];
+        DCXComponent *c = _allComponents[componentId];
         
         if ([componentState isEqualToString:DCXAssetStateCommittedDelete] || [componentState isEqualToString:DCXAssetStatePendingDelete]) {
             // The component has been deleted, we need to remove it.
             [components removeObjectAtIndex:i];
             // Update components hash
-            NSString *componentId = [component objectForKey:DCXIdManifestKey];
-            DCXComponent *c = _allComponents[componentId];
             [_absolutePaths removeObjectForKey:c.absolutePath.lowercaseString];
             [_allComponents removeObjectForKey:componentId];
+            [_componentLocations removeObjectForKey:componentId];
         } else {
-            [component removeObjectForKey:DCXEtagManifestKey];
-            [component removeObjectForKey:DCXVersionManifestKey];
-            [component removeObjectForKey:DCXLengthManifestKey];
+            // Component dictionaries can be shared with copies of the manifest so we replace them
+            NSMutableDictionary *resetComponent = [component mutableCopy];
+            [resetComponent removeObjectForKey:DCXEtagManifestKey];
+            [resetComponent removeObjectForKey:DCXVersionManifestKey];
+            [resetComponent removeObjectForKey:DCXLengthManifestKey];
             // Resetting state to modified
-            [component setObject:DCXAssetStateModified forKey:DCXStateManifestKey];
+            [resetComponent setObject:DCXAssetStateModified forKey:DCXStateManifestKey];
+            [components replaceObjectAtIndex:i withObject:resetComponent];
+            c = [DCXComponent componentFromDictionary:resetComponent andManifest:self withParentPath:c.parentPath];
+            _allComponents[componentId] = c;
+            _absolutePaths[c.absolutePath.lowercaseString] = c;
         }
     }
     
-    // Iterate over children
-    NSArray *children = [node objectForKey:DCXChildrenManifestKey];
-    for (NSMutableDictionary *child in children) {
+    // Iterate over a copy of the children since making them mutable replaces them
+    NSArray *children = [[node objectForKey:DCXChildrenManifestKey] copy];
+    for (NSDictionary *child in children) {
         [self recursiveReset:child];
     }
 }
@@ -368,8 +831,11 @@ static NSDateFormatter *staticRFC3339DateParser2;
     // Set composite state
     [_dictionary setObject:DCXAssetStateModified forKey:DCXStateManifestKey];
     
-    // Recurse through the DOM
+    // Recurse through the DOM. Since this doesn't keep track of the nodes whose components it
+    // modifies we also have to drop all cached encodings.
     [self recursiveReset:[_rootNode getMutableDictionary]];
+    [self invalidateAllEncodings];
+    _writtenPath = nil;
     
     self.etag = nil;
     self.compositeHref = nil;
@@ -445,32 +911,31 @@ static NSDateFormatter *staticRFC3339DateParser2;
 
 - (NSData*)localData
 {
-    NSMutableDictionary *mergedDictionary = [_rootNode.dict mutableCopy];
-    NSAssert([_rootNode.dict objectForKey:DCXIdManifestKey] == [_dictionary objectForKey:DCXIdManifestKey], @"RootNode Id is not equal to the composite Id");
-    // Merge the contents of root node and the manifest dictionary before writing out
-    [mergedDictionary addEntriesFromDictionary:_dictionary];
+    if (staticPrettyPrintsLocalData) {
+        NSMutableDictionary *mergedDictionary = [_rootNode.dict mutableCopy];
+        NSAssert([_rootNode.dict objectForKey:DCXIdManifestKey] == [_dictionary objectForKey:DCXIdManifestKey], @"RootNode Id is not equal to the composite Id");
+        // Merge the contents of root node and the manifest dictionary before writing out
+        [mergedDictionary addEntriesFromDictionary:_dictionary];
+        
+        return [NSJSONSerialization dataWithJSONObject:mergedDictionary options:NSJSONWritingPrettyPrinted error:nil];
+    }
     
-    return [NSJSONSerialization dataWithJSONObject:mergedDictionary options:NSJSONWritingPrettyPrinted error:nil];
+    return [self encodeIncludingLocalData:YES];
 }
 
 - (NSData*)remoteData
 {
-    // We need to temporarily remove the local property
-    NSMutableDictionary *local = [_dictionary objectForKey:DCXLocalDataManifestKey];
-    if (local != nil) {
-        [_dictionary removeObjectForKey:DCXLocalDataManifestKey];
-    }
+    return [self encodeIncludingLocalData:NO];
+}
 
-    // Merge the contents of root node and the manifest dictionary before writing out
-    NSMutableDictionary *mergedDictionary = [_rootNode.dict mutableCopy];
-    NSAssert([_rootNode.dict objectForKey:DCXIdManifestKey] == [_dictionary objectForKey:DCXIdManifestKey], @"RootNode Id is not equal to the composite Id");
-    [mergedDictionary addEntriesFromDictionary:_dictionary];
-    
-    NSData *data = [NSJSONSerialization dataWithJSONObject:mergedDictionary options:0 error:nil];
-    if (local != nil) {
-        [_dictionary setObject:local forKey:DCXLocalDataManifestKey];
-    }
-    return data;
++ (void)setPrettyPrintsLocalData:(BOOL)prettyPrint
+{
+    staticPrettyPrintsLocalData = prettyPrint;
+}
+
++ (BOOL)prettyPrintsLocalData
+{
+    return staticPrettyPrintsLocalData;
 }
 
 - (NSDictionary*)links
@@ -573,6 +1038,9 @@ static NSDateFormatter *staticRFC3339DateParser2;
 
     if([[DCXManifest manifestSpecificProperties] containsObject:key] ){
         [_dictionary setObject:value forKey:key];
+        if ([key isEqualToString:DCXLocalDataManifestKey]) {
+            _localDataReplaced = YES;
+        }
     }else{
         [_rootNode setValue:value forKey:key];
     }
@@ -583,6 +1051,9 @@ static NSDateFormatter *staticRFC3339DateParser2;
 {
     if([[DCXManifest manifestSpecificProperties] containsObject:key] ){
         [_dictionary removeObjectForKey:key];
+        if ([key isEqualToString:DCXLocalDataManifestKey]) {
+            _localDataReplaced = YES;
+        }
     }else{
         [_rootNode removeValueForKey:key];
     }
@@ -590,6 +1061,116 @@ static NSDateFormatter *staticRFC3339DateParser2;
     [self markAsModifiedAndDirty];
 }
 
+#pragma mark Serialization
+
+-(NSData*) encodeIncludingLocalData:(BOOL)includeLocalData
+{
+    NSAssert([_rootNode.dict objectForKey:DCXIdManifestKey] == [_dictionary objectForKey:DCXIdManifestKey], @"RootNode Id is not equal to the composite Id");
+    
+    // Merge the properties of root node and the manifest dictionary. These get encoded on every call
+    // while the children and components get spliced in from their cached encodings.
+    NSMutableDictionary *properties = [_rootNode.dict mutableCopy];
+    [properties removeObjectForKey:DCXChildrenManifestKey];
+    [properties removeObjectForKey:DCXComponentsManifestKey];
+    [properties addEntriesFromDictionary:_dictionary];
+    if (!includeLocalData) {
+        [properties removeObjectForKey:DCXLocalDataManifestKey];
+    }
+    
+    @synchronized(_encodingCache) {
+        return [self encodeNodeDict:_rootNode.dict withProperties:properties];
+    }
+}
+
+-(NSData*) encodingOfNodeDict:(NSDictionary*)nodeDict
+{
+    NSData *data = [_encodingCache objectForKey:nodeDict];
+    if (data == nil) {
+        NSMutableDictionary *properties = [nodeDict mutableCopy];
+        [properties removeObjectForKey:DCXChildrenManifestKey];
+        [properties removeObjectForKey:DCXComponentsManifestKey];
+        data = [self encodeNodeDict:nodeDict withProperties:properties];
+        [_encodingCache setObject:data forKey:nodeDict];
+    }
+    return data;
+}
+
+-(NSData*) encodingOfComponentDict:(NSDictionary*)componentDict
+{
+    NSData *data = [_encodingCache objectForKey:componentDict];
+    if (data == nil) {
+        data = [NSJSONSerialization dataWithJSONObject:componentDict options:0 error:nil];
+        [_encodingCache setObject:data forKey:componentDict];
+    }
+    return data;
+}
+
+// Encodes properties as a JSON object and appends the encodings of the children and components of nodeDict.
+-(NSMutableData*) encodeNodeDict:(NSDictionary*)nodeDict withProperties:(NSDictionary*)properties
+{
+    NSData *encodedProperties = [NSJSONSerialization dataWithJSONObject:properties options:0 error:nil];
+    NSMutableData *data = [NSMutableData dataWithBytes:encodedProperties.bytes length:encodedProperties.length - 1]; // Strip the closing brace
+    BOOL needsSeparator = properties.count > 0;
+    
+    NSArray *children = nodeDict[DCXChildrenManifestKey];
+    if (children.count > 0) {
+        [self appendKey:DCXChildrenManifestKey to:data withSeparator:needsSeparator];
+        for (NSUInteger i = 0; i < children.count; i++) {
+            if (i > 0) {
+                [data appendBytes:"," length:1];
+            }
+            [data appendData:[self encodingOfNodeDict:children[i]]];
+        }
+        [data appendBytes:"]" length:1];
+        needsSeparator = YES;
+    }
+    
+    NSArray *components = nodeDict[DCXComponentsManifestKey];
+    if (components.count > 0) {
+        [self appendKey:DCXComponentsManifestKey to:data withSeparator:needsSeparator];
+        for (NSUInteger i = 0; i < components.count; i++) {
+            if (i > 0) {
+                [data appendBytes:"," length:1];
+            }
+            [data appendData:[self encodingOfComponentDict:components[i]]];
+        }
+        [data appendBytes:"]" length:1];
+    }
+    
+    [data appendBytes:"}" length:1];
+    
+    return data;
+}
+
+-(void) appendKey:(NSString*)key to:(NSMutableData*)data withSeparator:(BOOL)separator
+{
+    NSString *prefix = [NSString stringWithFormat:@"%@\"%@\":[", separator ? @"," : @"", key];
+    [data appendData:[prefix dataUsingEncoding:NSUTF8StringEncoding]];
+}
+
+// Must get called whenever the properties, children or components of a node get modified.
+-(void) nodeDictDidChange:(NSDictionary*)nodeDict
+{
+    NSString *nodeId = nodeDict[DCXIdManifestKey];
+    if (nodeId != nil) {
+        [_modifiedNodeIds addObject:nodeId];
+    }
+    @synchronized(_encodingCache) {
+        while (nodeDict != nil) {
+            [_encodingCache removeObjectForKey:nodeDict];
+            DCXManifestItemLocation *location = _childLocations[nodeDict[DCXIdManifestKey]];
+            nodeDict = location == nil ? nil : _nodeDicts[location.parentId];
+        }
+    }
+}
+
+-(void) invalidateAllEncodings
+{
+    @synchronized(_encodingCache) {
+        [_encodingCache removeAllObjects];
+    }
+}
+
 #pragma mark Debugging
 
 -(void) recursivelyVerifyIntegrityFromNodeDict:(NSDictionary*)nodeDict
@@ -609,6 +1190,9 @@ static NSDateFormatter *staticRFC3339DateParser2;
             if (assertBlock(nodesEncountered[nodeId] == nil, @"Encountered node %@ a second time.", nodeId)) {
                 nodesEncountered[nodeId] = nodeId;
                 DCXNode *childNode = allChildren[nodeId];
+                assertBlock(_nodeDicts[nodeId] == childDict, @"Node %@ is not in the node dictionary cache", nodeId);
+                assertBlock([[_childLocations[nodeId] parentId] isEqualToString:nodeDict[DCXIdManifestKey]],
+                            @"Node %@ has the wrong parent in the location cache", nodeId);
                 if (assertBlock(childNode != nil, @"Node %@ is not in cache", nodeId)) {
                     NSString *newCurrentPath = currentPath;
                     [allChildren removeObjectForKey:nodeId];
@@ -645,6 +1229,8 @@ static NSDateFormatter *staticRFC3339DateParser2;
             if (assertBlock(componentsEncountered[componentId] == nil, @"Encountered component %@ a second time.", componentId)) {
                 componentsEncountered[componentId] = componentId;
                 DCXComponent *component = allComponents[componentId];
+                assertBlock([[_componentLocations[componentId] parentId] isEqualToString:nodeDict[DCXIdManifestKey]],
+                            @"Component %@ has the wrong parent in the location cache", componentId);
                 if (assertBlock(component != nil, @"Component %@ is not in cache", componentId)) {
                     [allComponents removeObjectForKey:componentId];
                     assertBlock([component.parentPath isEqualToString:currentPath], @"Component %@ has the wrong parent path %@ (expected: %@)", componentId, component.parentPath, currentPath);
@@ -667,7 +1253,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
     
     NSMutableDictionary *allChildren = [_allChildren mutableCopy];
     NSMutableDictionary *allComponents = [_allComponents mutableCopy];
-    NSMutableDictionary *absolutePaths = [_absolutePaths mutableCopy];
+    NSMutableDictionary *absolutePaths = [[self absolutePaths] mutableCopy];
     NSMutableDictionary *componentsEncountered = [NSMutableDictionary dictionary];
     NSMutableDictionary *nodesEncountered = [NSMutableDictionary dictionary];
     
@@ -720,6 +1306,10 @@ static NSDateFormatter *staticRFC3339DateParser2;
     for (NSString *path in [absolutePaths allKeys]) {
         logInconsistency([NSString stringWithFormat:@"Path %@ is in cache but not in DOM.", path]);
     }
+    if (_nodeDicts.count != _allChildren.count || _childLocations.count + 1 != _allChildren.count
+        || _componentLocations.count != _allComponents.count) {
+        logInconsistency(@"The location caches are out of sync with the component and children caches.");
+    }
     
     // verify local storage mapping
     
@@ -743,7 +1333,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
 
 -(DCXComponent*) componentWithAbsolutePath:(NSString *)absPath
 {
-    id item = _absolutePaths[absPath.lowercaseString];
+    id item = [self absolutePaths][absPath.lowercaseString];
     
     return [item isKindOfClass:[DCXComponent class]] ? item : nil;
 }
@@ -788,7 +1378,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
     
     // find the node the component belongs to
     NSUInteger index;
-    NSMutableDictionary *nodeDict = [self findNodeOfComponentById:component.componentId foundAtIndex:&index];
+    NSMutableDictionary *nodeDict = [self findMutableNodeOfComponentById:component.componentId foundAtIndex:&index];
     NSAssert(nodeDict != nil, @"Component with id %@ not found in manifest.", component.componentId);
     
     return [self updateComponent:component at:nodeDict atIndex:index withError:errorPtr];
@@ -805,7 +1395,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
                            toChild:(DCXNode *)node newPath:(NSString*)newPath withError:(NSError**)errorPtr
 {
     NSAssert(node != nil, @"Node must not be nil");
-    NSMutableDictionary *nodeDict = [self findNodeById:node.nodeId];
+    NSMutableDictionary *nodeDict = [self findMutableNodeById:node.nodeId];
     NSAssert(nodeDict != nil, @"Node with id %@ not found in manifest.", node.nodeId);
 
     DCXComponent *newComponent = [self addComponent:component to:nodeDict newPath:newPath replaceExisting:NO withError:errorPtr];
@@ -827,12 +1417,12 @@ static NSDateFormatter *staticRFC3339DateParser2;
     
     // Find the current parent node the component belongs to
     NSUInteger index;
-    NSMutableDictionary *currentParentNodeDict = [self findNodeOfComponentById:component.componentId foundAtIndex:&index];
+    NSMutableDictionary *currentParentNodeDict = [self findMutableNodeOfComponentById:component.componentId foundAtIndex:&index];
     NSAssert(currentParentNodeDict != nil, @"Component with id %@ not found in manifest.", component.componentId);
     NSMutableArray *components = [currentParentNodeDict objectForKey:DCXComponentsManifestKey];
     
     // Find the new parent node
-    NSMutableDictionary *newParentNodeDict = node == nil ? [_rootNode getMutableDictionary] : [self findNodeById:node.nodeId];
+    NSMutableDictionary *newParentNodeDict = node == nil ? [_rootNode getMutableDictionary] : [self findMutableNodeById:node.nodeId];
     NSAssert(newParentNodeDict != nil, @"Node with id %@ not found in manifest.", node.nodeId);
     
     // We need to create a new component object because it will likely have a different parent path
@@ -844,7 +1434,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
     NSString *newAbsPath = updatedComponent.absolutePath.lowercaseString;
     NSString *oldAbsPath = component.absolutePath.lowercaseString;
     if (![newAbsPath isEqualToString:oldAbsPath]) {
-        if (_absolutePaths[newAbsPath] != nil) {
+        if ([self absolutePaths][newAbsPath] != nil) {
             if (errorPtr != NULL) {
                 *errorPtr = [DCXErrorUtils ErrorWithCode:DCXErrorDuplicatePath domain:DCXErrorDomain
                                                           details:[NSString stringWithFormat:@"Duplicate absolute path: %@", newAbsPath]];
@@ -858,14 +1448,18 @@ static NSDateFormatter *staticRFC3339DateParser2;
     
     // Remove from old parent
     [components removeObjectAtIndex:index];
+    [self nodeDictDidChange:currentParentNodeDict];
     
     // Add to new parent
     components = [newParentNodeDict objectForKey:DCXComponentsManifestKey];
     if (components == nil) {
-        [newParentNodeDict setObject:[NSMutableArray arrayWithObject:componentDict] forKey:DCXComponentsManifestKey];
+        components = [NSMutableArray arrayWithObject:componentDict];
+        [newParentNodeDict setObject:components forKey:DCXComponentsManifestKey];
     } else {
         [components addObject:componentDict];
     }
+    [self setLocationOfComponentWithId:updatedComponent.componentId inParent:newParentNodeDict atIndex:components.count - 1];
+    [self nodeDictDidChange:newParentNodeDict];
     
     [self markAsModifiedAndDirty];
     
@@ -892,7 +1486,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
     NSAssert(component, @"Component must not be nil");
     // find the node the component belongs to
     NSUInteger index;
-    NSMutableDictionary *nodeDict = [self findNodeOfComponentById:component.componentId foundAtIndex:&index];
+    NSMutableDictionary *nodeDict = [self findMutableNodeOfComponentById:component.componentId foundAtIndex:&index];
     NSAssert(nodeDict != nil, @"Component with id %@ not found in manifest.", component.componentId);
     
     return [self removeComponent:component at:nodeDict atIndex:index];
@@ -911,7 +1505,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
 - (void) removeAllComponentsFromChild:(DCXNode *)node
 {
     NSAssert(node != nil, @"Node must not be nil");
-    NSMutableDictionary *nodeDict = [self findNodeById:node.nodeId];
+    NSMutableDictionary *nodeDict = [self findMutableNodeById:node.nodeId];
     NSAssert(nodeDict != nil, @"Node with id %@ not found", node.nodeId);
     [self removeAllComponentsAt:nodeDict];
 }
@@ -952,7 +1546,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
             }
             return nil;
         }
-        if (_absolutePaths[updatedComponent.absolutePath.lowercaseString] != nil) {
+        if ([self absolutePaths][updatedComponent.absolutePath.lowercaseString] != nil) {
             if (errorPtr != NULL) {
                 *errorPtr = [DCXErrorUtils ErrorWithCode:DCXErrorDuplicatePath domain:DCXErrorDomain
                                                           details:[NSString stringWithFormat:@"Duplicate path: %@", updatedComponent.absolutePath]];
@@ -964,6 +1558,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
     
     NSMutableArray *components = [nodeDict objectForKey:DCXComponentsManifestKey];
     [components replaceObjectAtIndex:index withObject:updatedComponentDict];
+    [self nodeDictDidChange:nodeDict];
     
     component = _allComponents[componentId];
     [_absolutePaths removeObjectForKey:component.absolutePath.lowercaseString];
@@ -1014,7 +1609,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
     NSUInteger index;
     DCXNode *parent;
     if (replace) {
-        nodeDict = [self findNodeOfComponentById:componentId foundAtIndex:&index];
+        nodeDict = [self findMutableNodeOfComponentById:componentId foundAtIndex:&index];
         NSAssert(nodeDict != nil, @"Couldn't find parent node of component.");
     } else {
         index = nodeDict.count;
@@ -1028,7 +1623,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
     NSString *existingComponentAbsolutePath = replace ? existingComponent.absolutePath.lowercaseString : nil;
     
     if (!replace || ![absolutePath isEqualToString:existingComponentAbsolutePath]) {
-        if (_absolutePaths[absolutePath] != nil) {
+        if ([self absolutePaths][absolutePath] != nil) {
             if (errorPtr != NULL) {
                 *errorPtr = [DCXErrorUtils ErrorWithCode:DCXErrorDuplicatePath domain:DCXErrorDomain
                                                           details:[NSString stringWithFormat:@"Duplicate absolute path: %@", absolutePath]];
@@ -1039,12 +1634,16 @@ static NSDateFormatter *staticRFC3339DateParser2;
     
     NSMutableArray *components = [nodeDict objectForKey:DCXComponentsManifestKey];
     if (components == nil) {
+        index = 0;
         [nodeDict setObject:[NSMutableArray arrayWithObject:newComponentDict] forKey:DCXComponentsManifestKey];
     } else if (replace) {
         [components replaceObjectAtIndex:index withObject:newComponentDict];
     } else {
+        index = components.count;
         [components addObject:newComponentDict];
     }
+    [self setLocationOfComponentWithId:componentId inParent:nodeDict atIndex:index];
+    [self nodeDictDidChange:nodeDict];
     
     [_allComponents setObject:newComponent forKey:componentId];
     [_absolutePaths setObject:newComponent forKey:absolutePath];
@@ -1067,8 +1666,10 @@ static NSDateFormatter *staticRFC3339DateParser2;
     if ([components count] == 0) {
         [nodeDict removeObjectForKey:DCXComponentsManifestKey];
     }
+    [self nodeDictDidChange:nodeDict];
     [_allComponents removeObjectForKey:componentId];
     [_absolutePaths removeObjectForKey:component.absolutePath.lowercaseString];
+    [_componentLocations removeObjectForKey:componentId];
     
     [self markAsModifiedAndDirty];
     
@@ -1085,42 +1686,35 @@ static NSDateFormatter *staticRFC3339DateParser2;
             DCXComponent *comp = _allComponents[componentId];
             [_absolutePaths removeObjectForKey:comp.absolutePath.lowercaseString];
             [_allComponents removeObjectForKey:componentId];
+            [_componentLocations removeObjectForKey:componentId];
         }
         
         [nodeDict removeObjectForKey:DCXComponentsManifestKey];
+        [self nodeDictDidChange:nodeDict];
         
         [self markAsModifiedAndDirty];
     }
 }
 
-- (void) recursiveRemoveAllComponentsAt:(NSMutableDictionary*)nodeDict
+- (void) recursiveRemoveAllComponentsAt:(NSDictionary*)nodeDict
 {
-    [self removeAllComponentsAt:nodeDict];
+    if ([nodeDict objectForKey:DCXComponentsManifestKey] != nil) {
+        [self removeAllComponentsAt:[self findMutableNodeById:nodeDict[DCXIdManifestKey]]];
+    }
     
-    NSArray *children = [nodeDict objectForKey:DCXChildrenManifestKey];
+    // Iterate over a copy of the children since making them mutable replaces them
+    NSArray *children = [[nodeDict objectForKey:DCXChildrenManifestKey] copy];
     
     if (children != nil) {
-        for (NSMutableDictionary *child in children) {
+        for (NSDictionary *child in children) {
             [self recursiveRemoveAllComponentsAt:child];
         }
     }
 }
 
-- (NSUInteger) indexOfComponentWithId:(NSString*)componentId in:(NSArray*)listOfComponents
-{
-    return [listOfComponents indexOfObjectPassingTest:^BOOL(id component, NSUInteger idx, BOOL *stop) {
-        NSString *compId = [component valueForKey:DCXIdManifestKey];
-        if (compId != nil && [compId isEqualToString:componentId]) {
-            *stop = YES;
-            return YES;
-        }
-        return NO;
-    }];
-}
-
 - (void) componentsDescendedFromParent:(DCXNode *)node intoArray:(NSMutableArray*)resultArray
 {
-    [self recursiveComponentsDescendedFrom:node.dict intoArray:resultArray];
+    [self recursiveComponentsDescendedFrom:[self findNodeById:node.nodeId] intoArray:resultArray];
     
 }
 - (void) recursiveComponentsDescendedFrom:(NSDictionary *)nodeDict intoArray:(NSMutableArray*)resultArray
@@ -1144,7 +1738,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
 #pragma mark Children (public methods)
 -(DCXNode*) childWithAbsolutePath:(NSString *)absPath
 {
-    id item = _absolutePaths[absPath.lowercaseString];
+    id item = [self absolutePaths][absPath.lowercaseString];
     
     return [item isKindOfClass:[DCXNode class]] ? item : nil;
 }
@@ -1184,15 +1778,18 @@ static NSDateFormatter *staticRFC3339DateParser2;
 
 -(void) copyChildrenAndComponentsTo:(NSMutableDictionary*)modifiedNodeDict from:(NSDictionary*)existingNodeDict
 {
+    // The arrays of a node dictionary that is shared with a copy of the manifest must not end up in a
+    // dictionary that gets modified in place (see privateCopyOfNodeDict:)
+    BOOL shared = ![self ownsNodeDict:existingNodeDict];
     id children = [existingNodeDict objectForKey:DCXChildrenManifestKey];
     if (children != nil) {
-        [modifiedNodeDict setObject:children forKey:DCXChildrenManifestKey];
+        [modifiedNodeDict setObject:(shared ? [children mutableCopy] : children) forKey:DCXChildrenManifestKey];
     } else {
         [modifiedNodeDict removeObjectForKey:DCXChildrenManifestKey];
     }
     id components = [existingNodeDict objectForKey:DCXComponentsManifestKey];
     if (components != nil) {
-        [modifiedNodeDict setObject:components forKey:DCXComponentsManifestKey];
+        [modifiedNodeDict setObject:(shared ? [components mutableCopy] : components) forKey:DCXComponentsManifestKey];
     } else {
         [modifiedNodeDict removeObjectForKey:DCXComponentsManifestKey];
     }
@@ -1215,12 +1812,15 @@ static NSDateFormatter *staticRFC3339DateParser2;
         rootNode.isRoot = YES;
         modifiedNode = _rootNode = rootNode;
         [_allChildren setObject:_rootNode forKey:_rootNode.nodeId];
+        [_nodeDicts setObject:modifiedNodeDict forKey:_rootNode.nodeId];
+        // The root always belongs to the manifest (see findMutableNodeById:)
+        [self takeOwnershipOfNodeDict:modifiedNodeDict];
     }
     else
     {
         // Find the node's parent in the dictionary and get the existing data.
         NSUInteger index;
-        NSMutableDictionary *parentDict = [self findParentOfNodeById:nodeId foundAtIndex:&index];
+        NSMutableDictionary *parentDict = [self findMutableParentOfNodeById:nodeId foundAtIndex:&index];
         NSAssert(parentDict != nil, @"Child node with id %@ could not be found in manifest.", nodeId);
         NSMutableArray *parentsChildren = [parentDict objectForKey:DCXChildrenManifestKey];
         NSMutableDictionary *existingNodeDict = [parentsChildren objectAtIndex:index];
@@ -1257,7 +1857,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
             
             allComponents = [_allComponents mutableCopy];
             allChildren = [_allChildren mutableCopy];
-            absolutePaths = [_absolutePaths mutableCopy];
+            absolutePaths = [[self absolutePaths] mutableCopy];
             
             if (![self recursivelyRemoveNode:existingNode fromChildrenLU:allChildren fromComponentLU:allComponents
                                   fromPathLU:absolutePaths removedComponents:nil withError:errorPtr]) {
@@ -1273,6 +1873,10 @@ static NSDateFormatter *staticRFC3339DateParser2;
         
         // finally replace the node in its parent's children array
         [parentsChildren replaceObjectAtIndex:index withObject:modifiedNodeDict];
+        [_nodeDicts setObject:modifiedNodeDict forKey:nodeId];
+        [self takeOwnershipOfNodeDict:modifiedNodeDict];
+        [self nodeDictDidChange:parentDict];
+        [_modifiedNodeIds addObject:nodeId];
         if (allChildren != nil) {
             _allChildren = allChildren;
             _allComponents = allComponents;
@@ -1305,7 +1909,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
 {
     NSAssert(node != nil, @"Node must not be nil");
     
-    NSMutableDictionary *parentDict = [self findNodeById:parentNode.nodeId];
+    NSMutableDictionary *parentDict = [self findMutableNodeById:parentNode.nodeId];
     NSAssert(parentDict != nil, @"Parent node with id %@ could not be found in manifest.", parentNode.nodeId);
     
     return [self insertChild:node in:parentDict at:[[parentDict objectForKey:DCXChildrenManifestKey] count]
@@ -1324,7 +1928,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
 {
     NSAssert(node != nil, @"Node must not be nil");
     
-    NSMutableDictionary *parentDict = [self findNodeById:parentNode.nodeId];
+    NSMutableDictionary *parentDict = [self findMutableNodeById:parentNode.nodeId];
     NSAssert(parentDict != nil, @"Parent node with id %@ could not be found in manifest.", parentNode.nodeId);
     
     return [self insertChild:node in:parentDict at:index
@@ -1376,10 +1980,10 @@ static NSDateFormatter *staticRFC3339DateParser2;
     // Determine the new parent
     NSMutableDictionary *parentDict;
     if (!replaceExisting) {
-        parentDict = parentNode != nil ? [self findNodeById:parentNode.nodeId] : [_rootNode getMutableDictionary];
+        parentDict = parentNode != nil ? [self findMutableNodeById:parentNode.nodeId] : [_rootNode getMutableDictionary];
         NSAssert(parentDict != nil, @"Can't find new parent");
     } else {
-        parentDict = [self findParentOfNodeById:nodeId foundAtIndex:&index];
+        parentDict = [self findMutableParentOfNodeById:nodeId foundAtIndex:&index];
         NSAssert(parentDict != nil, @"Can't find existing parent");
         parentNode = _allChildren[parentDict[DCXIdManifestKey]];
     }
@@ -1390,7 +1994,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
     
     // Verify new path
     if (newNode.path != nil) {
-        DCXNode *itemWithSamePath = _absolutePaths[newNode.absolutePath.lowercaseString];
+        DCXNode *itemWithSamePath = [self absolutePaths][newNode.absolutePath.lowercaseString];
         if (itemWithSamePath != nil && ![itemWithSamePath.nodeId isEqualToString:existingNode.nodeId]) {
             // The absolute path of the new node would conflict with an existing path
             if (errorPtr != NULL) {
@@ -1410,7 +2014,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
     
     NSMutableDictionary *allChildren = [_allChildren mutableCopy];
     NSMutableDictionary *allComponents = [_allComponents mutableCopy];
-    NSMutableDictionary *absolutePaths = [_absolutePaths mutableCopy];
+    NSMutableDictionary *absolutePaths = [[self absolutePaths] mutableCopy];
 
     if (existingNode != nil) {
         // Remove all traces of the existing node from our temorary lookups.
@@ -1435,10 +2039,12 @@ static NSDateFormatter *staticRFC3339DateParser2;
     
     // Insert the node dictionary
     if (replaceExisting ) {
+        [self removeLocationsOfNodeDict:[self findNodeById:nodeId]];
         parentDict[DCXChildrenManifestKey][index] = nodeDict;
     } else {
         NSMutableArray *children = [parentDict objectForKey:DCXChildrenManifestKey];
         if (children == nil) {
+            index = 0;
             [parentDict setObject:[NSMutableArray arrayWithObject:nodeDict] forKey:DCXChildrenManifestKey];
         } else {
             if (index > children.count - 1) {
@@ -1447,6 +2053,8 @@ static NSDateFormatter *staticRFC3339DateParser2;
             [children insertObject:nodeDict atIndex:index];
         }
     }
+    [self addLocationsOfNodeDict:nodeDict inParent:parentDict atIndex:index];
+    [self nodeDictDidChange:parentDict];
     
     // Update lookup tables
     _allChildren = allChildren;
@@ -1464,7 +2072,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
 {
     NSAssert(node != nil, @"Node must not be nil");
     NSAssert(!node.isRoot, @"Root Node cannot be moved");
-    NSMutableDictionary *parentDict = [self findNodeById:parentNode.nodeId];
+    NSMutableDictionary *parentDict = [self findMutableNodeById:parentNode.nodeId];
     NSAssert(parentDict != nil, @"Parent node with id %@ could not be found.", parentNode.nodeId);
     
     return [self moveChild:node to:parentDict at:index withError:errorPtr];
@@ -1487,20 +2095,22 @@ static NSDateFormatter *staticRFC3339DateParser2;
     
     // Find the node's parent in the dictionary and get the existing data.
     NSUInteger index;
-    NSMutableDictionary *parent = [self findParentOfNodeById:nodeId foundAtIndex:&index];
+    NSMutableDictionary *parent = [self findMutableParentOfNodeById:nodeId foundAtIndex:&index];
     NSAssert(parent != nil, @"Child node with id %@ could not be found.", nodeId);
     
     NSMutableArray *children = [parent objectForKey:DCXChildrenManifestKey];
     
     // Update the hashes for children and components
     [self recursivelyRemoveNode:node fromChildrenLU:_allChildren fromComponentLU:_allComponents
-                     fromPathLU:_absolutePaths removedComponents:removedComponents withError:nil];
+                     fromPathLU:[self absolutePaths] removedComponents:removedComponents withError:nil];
+    [self removeLocationsOfNodeDict:[children objectAtIndex:index]];
     
     // Remove the node.
     [children removeObjectAtIndex:index];
     if ([children count] == 0) {
         [parent removeObjectForKey:DCXChildrenManifestKey];
     }
+    [self nodeDictDidChange:parent];
     
     [self markAsModifiedAndDirty];
     
@@ -1515,7 +2125,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
 
 - (void) removeAllChildrenFromParent:(DCXNode *)node removedComponents:(NSMutableArray *)removedComponents
 {
-    NSMutableDictionary *nodeDict = [self findNodeById:node.nodeId];
+    NSMutableDictionary *nodeDict = [self findMutableNodeById:node.nodeId];
     [self removeAllChildrenAt:nodeDict removedComponents:removedComponents];
 }
 
@@ -1708,7 +2318,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
     }
     // take absPath as nil when the node being added is root node (i.e. with the path "/" )
     NSString *absPath = ((node.path == nil || [node.path isEqualToString:@"/"]) ? nil : [parentPath stringByAppendingPathComponent:node.path].lowercaseString);
-    if (absPath != nil && _absolutePaths[absPath] != nil) {
+    if (absPath != nil && [self absolutePaths][absPath] != nil) {
         if (errorPtr != NULL) {
             *errorPtr = [DCXErrorUtils ErrorWithCode:DCXErrorDuplicatePath domain:DCXErrorDomain
                                                       details:[NSString stringWithFormat:@"Duplicate absolute path: %@", absPath]];
@@ -1724,6 +2334,11 @@ static NSDateFormatter *staticRFC3339DateParser2;
     } else {
         [children insertObject:newNodeDict atIndex:index];
     }
+    [_nodeDicts setObject:newNodeDict forKey:nodeId];
+    [self takeOwnershipOfNodeDict:newNodeDict];
+    [_childLocations setObject:[DCXManifestItemLocation locationWithParentId:dict[DCXIdManifestKey] atIndex:index] forKey:nodeId];
+    [self nodeDictDidChange:dict];
+    [_modifiedNodeIds addObject:nodeId];
     
     DCXNode *newNode = [DCXNode nodeFromDictionary:newNodeDict andManifest:self
                                                               withParentPath:parentPath];
@@ -1742,7 +2357,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
 {
     // Find the old location
     NSUInteger oldIndex;
-    NSMutableDictionary *oldParent = [self findParentOfNodeById:node.nodeId foundAtIndex:&oldIndex];
+    NSMutableDictionary *oldParent = [self findMutableParentOfNodeById:node.nodeId foundAtIndex:&oldIndex];
     NSAssert(oldParent != nil, @"Couldn't find the specified node to move");
     
     DCXNode *updatedNode = node;
@@ -1750,7 +2365,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
         // The node gets moved to a different parent node. This means that it and its child
         // nodes/components might end up with different absolutePaths which we have to verify.
         
-        NSMutableDictionary *absoluePaths = [_absolutePaths mutableCopy];
+        NSMutableDictionary *absoluePaths = [[self absolutePaths] mutableCopy];
         NSMutableDictionary *allChildren = [_allChildren mutableCopy];
         NSMutableDictionary *allComponents = [_allComponents mutableCopy];
         if (![self recursivelyRemoveNode:node fromChildrenLU:allChildren fromComponentLU:allComponents
@@ -1758,7 +2373,7 @@ static NSDateFormatter *staticRFC3339DateParser2;
             return nil;
         }
         DCXNode *newParent = _allChildren[dict[DCXIdManifestKey]];
-        updatedNode = [DCXNode nodeFromDictionary:node.dict
+        updatedNode = [DCXNode nodeFromDictionary:[self findNodeById:node.nodeId]
                                                                          andManifest:self
                                                                       withParentPath:[self parentPathForDescendantsOf:newParent]];
         if (![self recursivelyAddNode:updatedNode withDict:updatedNode.dict assignNewIds:NO toChildrenLU:allChildren
@@ -1777,14 +2392,19 @@ static NSDateFormatter *staticRFC3339DateParser2;
     NSMutableArray *children = [oldParent objectForKey:DCXChildrenManifestKey];
     id childDict = [children objectAtIndex:oldIndex];
     [children removeObjectAtIndex:oldIndex];
+    [self nodeDictDidChange:oldParent];
     
     // Insert the child at the new location
     children = [dict objectForKey:DCXChildrenManifestKey];
     if (children == nil) {
+        index = 0;
         [dict setObject:[NSMutableArray arrayWithObject:childDict] forKey:DCXChildrenManifestKey];
     } else {
         [children insertObject:childDict atIndex:index];
     }
+    [_childLocations setObject:[DCXManifestItemLocation locationWithParentId:dict[DCXIdManifestKey] atIndex:index]
+                        forKey:node.nodeId];
+    [self nodeDictDidChange:dict];
     [self markAsModifiedAndDirty];
     
     return updatedNode;
@@ -1797,80 +2417,67 @@ static NSDateFormatter *staticRFC3339DateParser2;
     if (children != nil) {
         for (NSDictionary *nodeDict in children) {
             [self recursivelyRemoveNode:_allChildren[nodeDict[DCXIdManifestKey]] fromChildrenLU:_allChildren
-                        fromComponentLU:_allComponents fromPathLU:_absolutePaths removedComponents:removedComponents withError:nil];
+                        fromComponentLU:_allComponents fromPathLU:[self absolutePaths] removedComponents:removedComponents withError:nil];
+            [self removeLocationsOfNodeDict:nodeDict];
         }
         
         [nodeDict removeObjectForKey:DCXChildrenManifestKey];
+        [self nodeDictDidChange:nodeDict];
         
         [self markAsModifiedAndDirty];
     }
 }
 
 
--(NSMutableDictionary*) recursiveFindNodeById:(NSString*)nodeId startAt:(NSMutableDictionary*)dict
+-(NSMutableDictionary*) findNodeById:(NSString*)nodeId
 {
-    if ([[dict objectForKey:DCXIdManifestKey] isEqualToString:nodeId]) {
-        return dict;
+    return nodeId == nil ? nil : _nodeDicts[nodeId];
+}
+
+// Returns the actual index of the item with the given id in list. Uses the index
+// stored in location if it is still accurate, otherwise searches the list and updates location.
+-(NSUInteger) indexOfItemWithId:(NSString*)itemId at:(DCXManifestItemLocation*)location in:(NSArray*)list
+{
+    NSUInteger count = list.count;
+    NSUInteger hint = MIN(location.index, count);
+    if (hint < count && [list[hint][DCXIdManifestKey] isEqualToString:itemId]) {
+        return hint;
     }
     
-    NSMutableArray *children = [dict objectForKey:DCXChildrenManifestKey];
-    
-    if (children != nil) {
-        for (id child in children) {
-            NSMutableDictionary *found = [self recursiveFindNodeById:nodeId startAt:child];
-            if (found != nil) {
-                return found;
-            }
+    // Inserting or removing siblings in front of the item shifts it by as many positions so we search
+    // outward from the recorded index, which finds it after a number of steps proportional to the shift
+    for (NSUInteger distance = 1; distance <= hint || hint + distance < count; distance++) {
+        if (hint + distance < count && [list[hint + distance][DCXIdManifestKey] isEqualToString:itemId]) {
+            location.index = hint + distance;
+            return hint + distance;
+        }
+        if (distance <= hint && [list[hint - distance][DCXIdManifestKey] isEqualToString:itemId]) {
+            location.index = hint - distance;
+            return hint - distance;
         }
     }
     
-    return nil;
+    return NSNotFound;
 }
 
--(NSMutableDictionary*) findNodeById:(NSString*)nodeId
+-(NSMutableDictionary*) findParentOfNodeById:(NSString*)nodeId foundAtIndex:(NSUInteger*)indexPtr
 {
-    // findNodeById searches recursively through top level dict, which has no idead about rootNode.
-    if([nodeId isEqualToString:_rootNode.nodeId]){
-        return [_rootNode getMutableDictionary];
+    DCXManifestItemLocation *location = nodeId == nil ? nil : _childLocations[nodeId];
+    NSMutableDictionary *parentDict = _nodeDicts[location.parentId];
+    if (parentDict == nil) {
+        return nil;
     }
-    return [self recursiveFindNodeById:nodeId startAt:[_rootNode getMutableDictionary]];
-}
-
-
-- (NSUInteger) indexOfChildWithId:(NSString*)nodeId in:(NSArray*)listOfChildren
-{
-    return [listOfChildren indexOfObjectPassingTest:^BOOL(id node, NSUInteger idx, BOOL *stop) {
-        NSString *nId = [node valueForKey:DCXIdManifestKey];
-        if (nId != nil && [nId isEqualToString:nodeId]) {
-            *stop = YES;
-            return YES;
-        }
-        return NO;
-    }];
-}
-
-
--(NSMutableDictionary*) recursiveFindParentOfNodeById:(NSString*)nodeId startAt:(NSMutableDictionary*)dict foundAtIndex:(NSUInteger*)indexPtr
-{
-    NSMutableArray *children = [dict objectForKey:DCXChildrenManifestKey];
     
-    if (children != nil) {
-        NSUInteger index = [self indexOfChildWithId:nodeId in:children];
-        if (index != NSNotFound) {
-            if (indexPtr != NULL) {
-                *indexPtr = index;
-            }
-            return dict;
-        }
-        for (id child in children) {
-            NSMutableDictionary *found = [self recursiveFindParentOfNodeById:nodeId startAt:child foundAtIndex:indexPtr];
-            if (found != nil) {
-                return found;
-            }
-        }
+    NSUInteger index = [self indexOfItemWithId:nodeId at:location in:parentDict[DCXChildrenManifestKey]];
+    NSAssert(index != NSNotFound, @"Location of node %@ is out of sync with the DOM.", nodeId);
+    if (index == NSNotFound) {
+        return nil;
+    }
+    if (indexPtr != NULL) {
+        *indexPtr = index;
     }
     
-    return nil;
+    return parentDict;
 }
 
 -(NSUInteger) recursiveGetAbsoluteIndexOfNodeId:(NSString*)nodeId startAt:(NSMutableDictionary*)dict withRunningIndex:(NSUInteger*)runningIndex
@@ -1894,40 +2501,69 @@ static NSDateFormatter *staticRFC3339DateParser2;
     return NSNotFound;
 }
 
--(NSMutableDictionary*) findParentOfNodeById:(NSString*)nodeId foundAtIndex:(NSUInteger*)indexPtr
+-(NSMutableDictionary*) findNodeOfComponentById:(NSString*)componentId foundAtIndex:(NSUInteger*)indexPtr
 {
-    return [self recursiveFindParentOfNodeById:nodeId startAt:[_rootNode getMutableDictionary] foundAtIndex:indexPtr];
+    DCXManifestItemLocation *location = componentId == nil ? nil : _componentLocations[componentId];
+    NSMutableDictionary *parentDict = _nodeDicts[location.parentId];
+    if (parentDict == nil) {
+        return nil;
+    }
+    
+    NSUInteger index = [self indexOfItemWithId:componentId at:location in:parentDict[DCXComponentsManifestKey]];
+    NSAssert(index != NSNotFound, @"Location of component %@ is out of sync with the DOM.", componentId);
+    if (index == NSNotFound) {
+        return nil;
+    }
+    if (indexPtr != NULL) {
+        *indexPtr = index;
+    }
+    
+    return parentDict;
 }
 
--(NSMutableDictionary*) recursiveFindNodeOfComponentById:(NSString*)componentId startAt:(NSMutableDictionary*)dict foundAtIndex:(NSUInteger*)indexPtr
+-(void) setLocationOfComponentWithId:(NSString*)componentId inParent:(NSDictionary*)parentDict atIndex:(NSUInteger)index
 {
-    NSArray *components = [dict objectForKey:DCXComponentsManifestKey];
+    _componentLocations[componentId] = [DCXManifestItemLocation locationWithParentId:parentDict[DCXIdManifestKey] atIndex:index];
+}
+
+// Records the locations of the node and of all of its descendants. Since they are fresh copies the
+// manifest also takes ownership of their dictionaries.
+-(void) addLocationsOfNodeDict:(NSMutableDictionary*)nodeDict inParent:(NSDictionary*)parentDict atIndex:(NSUInteger)index
+{
+    NSString *nodeId = nodeDict[DCXIdManifestKey];
+    _nodeDicts[nodeId] = nodeDict;
+    [self takeOwnershipOfNodeDict:nodeDict];
+    _childLocations[nodeId] = [DCXManifestItemLocation locationWithParentId:parentDict[DCXIdManifestKey] atIndex:index];
+    [_modifiedNodeIds addObject:nodeId];
     
-    if (components != nil) {
-        NSUInteger index = [self indexOfComponentWithId:componentId in:components];
-        if (index != NSNotFound) {
-            if (indexPtr != NULL) {
-                *indexPtr = index;
-            }
-            return dict;
-        }
+    NSUInteger i = 0;
+    for (NSMutableDictionary *childDict in nodeDict[DCXChildrenManifestKey]) {
+        [self addLocationsOfNodeDict:childDict inParent:nodeDict atIndex:i++];
     }
-    NSMutableArray *children = [dict objectForKey:DCXChildrenManifestKey];
-    if (children != nil) {
-        for (id child in children) {
-            NSMutableDictionary *found = [self recursiveFindNodeOfComponentById:componentId startAt:child foundAtIndex:indexPtr];
-            if (found != nil) {
-                return found;
-            }
-        }
+    i = 0;
+    for (NSDictionary *componentDict in nodeDict[DCXComponentsManifestKey]) {
+        [self setLocationOfComponentWithId:componentDict[DCXIdManifestKey] inParent:nodeDict atIndex:i++];
     }
-    
-    return nil;
 }
 
--(NSMutableDictionary*) findNodeOfComponentById:(NSString*)componentId foundAtIndex:(NSUInteger*)indexPr
+// Removes the locations of the node and of all of its descendants.
+-(void) removeLocationsOfNodeDict:(NSDictionary*)nodeDict
 {
-    return [self recursiveFindNodeOfComponentById:(NSString*)componentId startAt:[_rootNode getMutableDictionary] foundAtIndex:indexPr];
+    NSString *nodeId = nodeDict[DCXIdManifestKey];
+    if (nodeId != nil) {
+        [_nodeDicts removeObjectForKey:nodeId];
+        [_childLocations removeObjectForKey:nodeId];
+    }
+    
+    for (NSDictionary *childDict in nodeDict[DCXChildrenManifestKey]) {
+        [self removeLocationsOfNodeDict:childDict];
+    }
+    for (NSDictionary *componentDict in nodeDict[DCXComponentsManifestKey]) {
+        NSString *componentId = componentDict[DCXIdManifestKey];
+        if (componentId != nil) {
+            [_componentLocations removeObjectForKey:componentId];
+        }
+    }
 }
 
 -(NSString*) parentPathForDescendantsOf:(DCXNode*)parentNode
@@ -1941,10 +2577,325 @@ static NSDateFormatter *staticRFC3339DateParser2;
     [_dictionary setObject:newCompositeId forKey:DCXIdManifestKey];
     // Remove the entry for the old node from allChildren
     [_allChildren removeObjectForKey:_rootNode.nodeId];
+    [_nodeDicts removeObjectForKey:_rootNode.nodeId];
     // Change the root nodeId
     [_rootNode setNodeId:newCompositeId];
     // add the node back into allChildren
     [_allChildren setObject:_rootNode forKey:_rootNode.nodeId];
+    [_nodeDicts setObject:[_rootNode getMutableDictionary] forKey:_rootNode.nodeId];
+    // update the locations of the items at the root level
+    NSUInteger index = 0;
+    for (NSDictionary *childDict in _rootNode.dict[DCXChildrenManifestKey]) {
+        _childLocations[childDict[DCXIdManifestKey]] = [DCXManifestItemLocation locationWithParentId:newCompositeId atIndex:index++];
+    }
+    index = 0;
+    for (NSDictionary *componentDict in _rootNode.dict[DCXComponentsManifestKey]) {
+        _componentLocations[componentDict[DCXIdManifestKey]] = [DCXManifestItemLocation locationWithParentId:newCompositeId atIndex:index++];
+    }
+}
+
+
+#pragma mark Copy-on-write
+
+// Returns a copy of nodeDict that shares the dictionaries of its children and components but not the arrays
+// holding them.
+-(NSMutableDictionary*) privateCopyOfNodeDict:(NSDictionary*)nodeDict
+{
+    NSMutableDictionary *copy = [nodeDict mutableCopy];
+    NSArray *children = nodeDict[DCXChildrenManifestKey];
+    if (children != nil) {
+        copy[DCXChildrenManifestKey] = [children mutableCopy];
+    }
+    NSArray *components = nodeDict[DCXComponentsManifestKey];
+    if (components != nil) {
+        copy[DCXComponentsManifestKey] = [components mutableCopy];
+    }
+    return copy;
+}
+
+-(BOOL) ownsNodeDict:(NSDictionary*)nodeDict
+{
+    @synchronized(self) {
+        return _ownedNodeDicts == nil || [_ownedNodeDicts containsObject:nodeDict];
+    }
+}
+
+// Records that the node dictionary is not shared with any copy of the manifest, e.g. because it has
+// just been created, so that it can be modified in place.
+-(void) takeOwnershipOfNodeDict:(NSDictionary*)nodeDict
+{
+    @synchronized(self) {
+        [_ownedNodeDicts addObject:nodeDict];
+    }
+}
+
+// Same as findNodeById: but the returned dictionary may get modified in place. If the node dictionary is
+// shared with a copy of the manifest it gets replaced with a private copy. Since that changes the children
+// of its parent the same happens to its ancestors. The root is never shared which ends the recursion.
+-(NSMutableDictionary*) findMutableNodeById:(NSString*)nodeId
+{
+    // A copy taken between the check and the replacement would share the replaced dictionary
+    @synchronized(self) {
+        return [self lockedFindMutableNodeById:nodeId];
+    }
+}
+
+-(NSMutableDictionary*) lockedFindMutableNodeById:(NSString*)nodeId
+{
+    NSMutableDictionary *nodeDict = [self findNodeById:nodeId];
+    if (nodeDict == nil || [self ownsNodeDict:nodeDict]) {
+        return nodeDict;
+    }
+    
+    DCXManifestItemLocation *location = _childLocations[nodeId];
+    NSMutableDictionary *parentDict = [self lockedFindMutableNodeById:location.parentId];
+    NSAssert(parentDict != nil, @"Node %@ is shared but its parent is not known.", nodeId);
+    NSUInteger index = [self indexOfItemWithId:nodeId at:location in:parentDict[DCXChildrenManifestKey]];
+    NSAssert(index != NSNotFound, @"Location of node %@ is out of sync with the DOM.", nodeId);
+    
+    NSMutableDictionary *copy = [self privateCopyOfNodeDict:nodeDict];
+    parentDict[DCXChildrenManifestKey][index] = copy;
+    _nodeDicts[nodeId] = copy;
+    [self takeOwnershipOfNodeDict:copy];
+    @synchronized(_encodingCache) {
+        NSData *encoding = [_encodingCache objectForKey:nodeDict];
+        if (encoding != nil) {
+            [_encodingCache setObject:encoding forKey:copy];
+        }
+    }
+    
+    // The node object must refer to the dictionary that is part of the DOM
+    DCXNode *node = [DCXNode nodeFromDictionary:copy andManifest:self withParentPath:[_allChildren[nodeId] parentPath]];
+    _allChildren[nodeId] = node;
+    if (node.path != nil) {
+        _absolutePaths[node.absolutePath.lowercaseString] = node;
+    }
+    
+    return copy;
+}
+
+// Same as findParentOfNodeById:foundAtIndex: but the returned dictionary may get modified in place.
+-(NSMutableDictionary*) findMutableParentOfNodeById:(NSString*)nodeId foundAtIndex:(NSUInteger*)indexPtr
+{
+    NSMutableDictionary *parentDict = [self findParentOfNodeById:nodeId foundAtIndex:indexPtr];
+    return parentDict == nil ? nil : [self findMutableNodeById:parentDict[DCXIdManifestKey]];
+}
+
+// Same as findNodeOfComponentById:foundAtIndex: but the returned dictionary may get modified in place.
+-(NSMutableDictionary*) findMutableNodeOfComponentById:(NSString*)componentId foundAtIndex:(NSUInteger*)indexPtr
+{
+    NSMutableDictionary *nodeDict = [self findNodeOfComponentById:componentId foundAtIndex:indexPtr];
+    return nodeDict == nil ? nil : [self findMutableNodeById:nodeDict[DCXIdManifestKey]];
+}
+
+-(NSUInteger) shareComponentsWithPool:(NSMapTable*)pool
+{
+    __block NSUInteger sharedCount = 0;
+    @synchronized(pool) {
+        [[_componentLocations copy] enumerateKeysAndObjectsUsingBlock:^(NSString *componentId, DCXManifestItemLocation *location, BOOL *stop) {
+            // Replacing a component in a node that is shared with a copy would change the DOM of the copy
+            NSMutableDictionary *nodeDict = [self findNodeById:location.parentId];
+            if (nodeDict == nil || ![self ownsNodeDict:nodeDict]) {
+                return;
+            }
+            NSMutableArray *components = nodeDict[DCXComponentsManifestKey];
+            NSUInteger index = [self indexOfItemWithId:componentId at:location in:components];
+            if (index == NSNotFound) {
+                return;
+            }
+            NSDictionary *componentDict = components[index];
+            NSString *etag = componentDict[DCXEtagManifestKey];
+            NSString *key = etag == nil ? componentId : [NSString stringWithFormat:@"%@ %@", componentId, etag];
+            NSDictionary *pooledDict = [pool objectForKey:key];
+            if (pooledDict == componentDict) {
+                sharedCount++;
+            } else if (pooledDict != nil && [pooledDict isEqualToDictionary:componentDict]) {
+                components[index] = pooledDict;
+                @synchronized(_encodingCache) {
+                    NSData *encoding = [_encodingCache objectForKey:componentDict];
+                    if (encoding != nil) {
+                        [_encodingCache setObject:encoding forKey:pooledDict];
+                    }
+                }
+                DCXComponent *component = [DCXComponent componentFromDictionary:pooledDict andManifest:self
+                                                                 withParentPath:[_allComponents[componentId] parentPath]];
+                _allComponents[componentId] = component;
+                if (_absolutePaths != nil && component.path != nil) {
+                    _absolutePaths[component.absolutePath.lowercaseString] = component;
+                }
+                sharedCount++;
+            } else {
+                [pool setObject:componentDict forKey:key];
+            }
+        }];
+    }
+    return sharedCount;
+}
+
+
+
+#pragma mark - Comparison
+
+// Returns YES if the two dictionaries have different values for any of keys
+static BOOL DCXValuesDifferForKeys(NSDictionary *dict1, NSDictionary *dict2, NSArray *keys)
+{
+    for (NSString *key in keys) {
+        id value1 = dict1[key];
+        id value2 = dict2[key];
+        if (value1 != value2 && ![value1 isEqual:value2]) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+// Returns YES if the two dictionaries have different values for any key that is not in ignoredKeys
+static BOOL DCXValuesDifferExceptForKeys(NSDictionary *dict1, NSDictionary *dict2, NSSet *ignoredKeys)
+{
+    for (NSString *key in dict1) {
+        id value1 = dict1[key];
+        id value2 = dict2[key];
+        if (value1 != value2 && ![value1 isEqual:value2] && ![ignoredKeys containsObject:key]) {
+            return YES;
+        }
+    }
+    for (NSString *key in dict2) {
+        if (dict1[key] == nil && ![ignoredKeys containsObject:key]) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+// Returns the parent id of the item at location or nil if the item is at the root level so that items
+// can be compared across manifests with different root ids
+-(NSString*) parentIdOfItemAt:(DCXManifestItemLocation*)location
+{
+    return [location.parentId isEqualToString:_rootNode.nodeId] ? nil : location.parentId;
+}
+
+-(DCXManifestDiff*) diffFromManifest:(DCXManifest*)manifest
+{
+    NSAssert(manifest != nil, @"Parameter manifest must not be nil.");
+    
+    DCXManifestDiff *diff = [[DCXManifestDiff alloc] init];
+    
+    // Manifests that have been read from the same save and haven't been modified since are identical
+    NSString *saveId = self.saveId;
+    if (manifest == self || (!_isDirty && !manifest.isDirty && saveId != nil && [saveId isEqualToString:manifest.saveId])) {
+        return diff;
+    }
+    
+    static NSArray *renameKeys, *contentKeys;
+    static NSSet *componentStructureKeys, *nodeStructureKeys, *rootStructureKeys;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        renameKeys = @[ DCXPathManifestKey, DCXNameManifestKey ];
+        contentKeys = @[ DCXEtagManifestKey, DCXVersionManifestKey, DCXLengthManifestKey ];
+        componentStructureKeys = [NSSet setWithObjects:DCXIdManifestKey, DCXPathManifestKey, DCXNameManifestKey,
+                                  DCXEtagManifestKey, DCXVersionManifestKey, DCXLengthManifestKey, nil];
+        nodeStructureKeys = [NSSet setWithObjects:DCXIdManifestKey, DCXPathManifestKey, DCXNameManifestKey,
+                             DCXChildrenManifestKey, DCXComponentsManifestKey, nil];
+        rootStructureKeys = [NSSet setWithObjects:DCXChildrenManifestKey, DCXComponentsManifestKey,
+                             DCXLocalDataManifestKey, nil];
+    });
+    
+    // Components. Dictionaries that are shared between the manifests (see shareComponentsWithPool:)
+    // are known to be equal so that only their location needs to be compared.
+    NSMutableSet *added = [NSMutableSet set];
+    NSMutableSet *moved = [NSMutableSet set];
+    NSMutableSet *renamed = [NSMutableSet set];
+    NSMutableSet *contentChanged = [NSMutableSet set];
+    NSMutableSet *propertyChanged = [NSMutableSet set];
+    NSDictionary *storageIds = _dictionary[DCXLocalDataManifestKey][DCXLocalStorageAssetIdMapManifestKey];
+    NSDictionary *otherStorageIds = manifest->_dictionary[DCXLocalDataManifestKey][DCXLocalStorageAssetIdMapManifestKey];
+    for (NSString *componentId in _allComponents) {
+        DCXComponent *otherComponent = manifest->_allComponents[componentId];
+        if (otherComponent == nil) {
+            [added addObject:componentId];
+            continue;
+        }
+        NSString *parentId = [self parentIdOfItemAt:_componentLocations[componentId]];
+        NSString *otherParentId = [manifest parentIdOfItemAt:manifest->_componentLocations[componentId]];
+        if (parentId != otherParentId && ![parentId isEqualToString:otherParentId]) {
+            [moved addObject:componentId];
+        }
+        NSDictionary *dict = [_allComponents[componentId] dict];
+        NSDictionary *otherDict = otherComponent.dict;
+        if (dict != otherDict) {
+            if (DCXValuesDifferForKeys(dict, otherDict, renameKeys)) {
+                [renamed addObject:componentId];
+            }
+            if (DCXValuesDifferForKeys(dict, otherDict, contentKeys)) {
+                [contentChanged addObject:componentId];
+            }
+            if (DCXValuesDifferExceptForKeys(dict, otherDict, componentStructureKeys)) {
+                [propertyChanged addObject:componentId];
+            }
+        }
+        // Local modifications of the asset don't change the etag but get a new local file
+        NSString *storageId = storageIds[componentId];
+        NSString *otherStorageId = otherStorageIds[componentId];
+        if (storageId != nil && otherStorageId != nil && ![storageId isEqualToString:otherStorageId]) {
+            [contentChanged addObject:componentId];
+        }
+    }
+    NSMutableSet *removed = [NSMutableSet set];
+    for (NSString *componentId in manifest->_allComponents) {
+        if (_allComponents[componentId] == nil) {
+            [removed addObject:componentId];
+        }
+    }
+    diff.addedComponentIds = added;
+    diff.removedComponentIds = removed;
+    diff.movedComponentIds = moved;
+    diff.renamedComponentIds = renamed;
+    diff.contentChangedComponentIds = contentChanged;
+    diff.propertyChangedComponentIds = propertyChanged;
+    
+    // Child nodes
+    added = [NSMutableSet set];
+    moved = [NSMutableSet set];
+    renamed = [NSMutableSet set];
+    propertyChanged = [NSMutableSet set];
+    for (NSString *nodeId in _allChildren) {
+        NSDictionary *otherDict = manifest->_nodeDicts[nodeId];
+        if (manifest->_allChildren[nodeId] == nil || otherDict == nil) {
+            [added addObject:nodeId];
+            continue;
+        }
+        NSString *parentId = [self parentIdOfItemAt:_childLocations[nodeId]];
+        NSString *otherParentId = [manifest parentIdOfItemAt:manifest->_childLocations[nodeId]];
+        if (parentId != otherParentId && ![parentId isEqualToString:otherParentId]) {
+            [moved addObject:nodeId];
+        }
+        NSDictionary *dict = _nodeDicts[nodeId];
+        if (dict != otherDict) {
+            if (DCXValuesDifferForKeys(dict, otherDict, renameKeys)) {
+                [renamed addObject:nodeId];
+            }
+            if (DCXValuesDifferExceptForKeys(dict, otherDict, nodeStructureKeys)) {
+                [propertyChanged addObject:nodeId];
+            }
+        }
+    }
+    removed = [NSMutableSet set];
+    for (NSString *nodeId in manifest->_allChildren) {
+        if (_allChildren[nodeId] == nil) {
+            [removed addObject:nodeId];
+        }
+    }
+    diff.addedChildIds = added;
+    diff.removedChildIds = removed;
+    diff.movedChildIds = moved;
+    diff.renamedChildIds = renamed;
+    diff.propertyChangedChildIds = propertyChanged;
+    
+    // The manifest itself
+    diff.manifestPropertiesChanged = DCXValuesDifferExceptForKeys(_rootNode.dict, manifest->_rootNode.dict, rootStructureKeys)
+                                  || DCXValuesDifferExceptForKeys(_dictionary, manifest->_dictionary, rootStructureKeys);
+    
+    return diff;
 }
 
 
@@ -1952,7 +2903,62 @@ static NSDateFormatter *staticRFC3339DateParser2;
 
 -(id)copyWithZone:(NSZone *)zone
 {
-    DCXManifest *copy = [[DCXManifest alloc] initWithData:[self localData] withError:nil];
+    // Copying hands the ownership of the node dictionaries over so concurrent copies must not interleave
+    // with each other or with the ownership checks of findMutableNodeById:
+    @synchronized(self) {
+        return [self lockedCopyWithZone:zone];
+    }
+}
+
+-(DCXManifest*) lockedCopyWithZone:(NSZone *)zone
+{
+    // The copy shares all node and component dictionaries except for the root with this manifest. From
+    // now on neither manifest modifies a shared node dictionary in place. Instead it gets replaced along
+    // with its ancestors the first time it gets modified. The lookup tables only refer to the DOM so they
+    // can be copied shallowly, except for the item objects which must refer to the copy.
+    DCXManifest *copy = [[DCXManifest allocWithZone:zone] init];
+    
+    copy->_dictionary = [DCXCopyUtils deepMutableCopyOfDictionary:_dictionary];
+    NSMutableDictionary *rootDict = [self privateCopyOfNodeDict:_rootNode.dict];
+    DCXMutableNode *rootNode = [[DCXMutableNode alloc] initWithDictionary:rootDict withParentPath:@""];
+    rootNode.isRoot = YES;
+    copy->_rootNode = rootNode;
+    
+    copy->_nodeDicts = [_nodeDicts mutableCopy];
+    copy->_nodeDicts[rootNode.nodeId] = rootDict;
+    copy->_childLocations = [_childLocations mutableCopy];
+    copy->_componentLocations = [_componentLocations mutableCopy];
+    
+    NSMutableDictionary *allChildren = [NSMutableDictionary dictionaryWithCapacity:_allChildren.count];
+    [_allChildren enumerateKeysAndObjectsUsingBlock:^(NSString *nodeId, DCXNode *node, BOOL *stop) {
+        allChildren[nodeId] = [DCXNode nodeFromDictionary:_nodeDicts[nodeId] andManifest:copy withParentPath:node.parentPath];
+    }];
+    allChildren[rootNode.nodeId] = rootNode;
+    NSMutableDictionary *allComponents = [NSMutableDictionary dictionaryWithCapacity:_allComponents.count];
+    [_allComponents enumerateKeysAndObjectsUsingBlock:^(NSString *componentId, DCXComponent *component, BOOL *stop) {
+        allComponents[componentId] = [DCXComponent componentFromDictionary:component.dict andManifest:copy
+                                                            withParentPath:component.parentPath];
+    }];
+    NSMutableDictionary *absolutePaths = nil;
+    if (_absolutePaths != nil) {
+        absolutePaths = [NSMutableDictionary dictionaryWithCapacity:_absolutePaths.count];
+        [_absolutePaths enumerateKeysAndObjectsUsingBlock:^(NSString *path, id item, BOOL *stop) {
+            absolutePaths[path] = [item isKindOfClass:[DCXComponent class]] ? allComponents[[item componentId]] : allChildren[[item nodeId]];
+        }];
+    }
+    copy->_allChildren = allChildren;
+    copy->_allComponents = allComponents;
+    copy->_absolutePaths = absolutePaths;
+    
+    // Encodings are keyed by the dictionaries they encode so they remain valid for both manifests
+    copy->_encodingCache = _encodingCache;
+    copy->_modifiedNodeIds = [NSMutableSet set];
+    copy->_modifiedLocalDataIds = [NSMutableSet set];
+    
+    copy->_ownedNodeDicts = [NSHashTable hashTableWithOptions:NSPointerFunctionsWeakMemory | NSPointerFunctionsObjectPointerPersonality];
+    [copy->_ownedNodeDicts addObject:rootDict];
+    _ownedNodeDicts = [NSHashTable hashTableWithOptions:NSPointerFunctionsWeakMemory | NSPointerFunctionsObjectPointerPersonality];
+    [_ownedNodeDicts addObject:_rootNode.dict];
     
     return copy;
 }
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ * \class DCXManifestDiff
+ * \brief The structural differences between two manifests of a composite, see
+ * DCXManifest diffFromManifest:.
+ *
+ * Items get identified by their ids. An item that exists in both manifests can be part of several of
+ * the sets, e.g. when it has been moved and renamed. Changes in the order of the children or
+ * components of a node don't count as moves.
+ */
+@interface DCXManifestDiff : NSObject
+
+/** The ids of the components that only exist in the newer manifest. */
+@property (nonatomic, readonly) NSSet *addedComponentIds;
+
+/** The ids of the components that only exist in the older manifest. */
+@property (nonatomic, readonly) NSSet *removedComponentIds;
+
+/** The ids of the components that have a different parent node. */
+@property (nonatomic, readonly) NSSet *movedComponentIds;
+
+/** The ids of the components whose path or name has changed. */
+@property (nonatomic, readonly) NSSet *renamedComponentIds;
+
+/** The ids of the components whose asset has changed, i.e. whose etag, version, length or local
+ * storage file differs. */
+@property (nonatomic, readonly) NSSet *contentChangedComponentIds;
+
+/** The ids of the components with changes to any other properties, e.g. their state or type. */
+@property (nonatomic, readonly) NSSet *propertyChangedComponentIds;
+
+/** The ids of the child nodes that only exist in the newer manifest. */
+@property (nonatomic, readonly) NSSet *addedChildIds;
+
+/** The ids of the child nodes that only exist in the older manifest. */
+@property (nonatomic, readonly) NSSet *removedChildIds;
+
+/** The ids of the child nodes that have a different parent node. */
+@property (nonatomic, readonly) NSSet *movedChildIds;
+
+/** The ids of the child nodes whose path or name has changed. */
+@property (nonatomic, readonly) NSSet *renamedChildIds;
+
+/** The ids of the child nodes with changes to any other properties. */
+@property (nonatomic, readonly) NSSet *propertyChangedChildIds;
+
+/** Whether the properties of the manifest itself (name, type, state, links etc.) have changed. */
+@property (nonatomic, readonly) BOOL manifestPropertiesChanged;
+
+/** YES if the manifests don't differ in any of the above. */
+@property (nonatomic, readonly) BOOL isEmpty;
+
+/** The ids of all components that have been added, removed or changed in any way. */
+- (NSSet *)changedComponentIds;
+
+/** The ids of all child nodes that have been added, removed or changed in any way. */
+- (NSSet *)changedChildIds;
+
+@end
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#import "DCXManifestDiff_Internal.h"
+
+@implementation DCXManifestDiff
+
+- (instancetype)init
+{
+    if (self = [super init]) {
+        NSSet *empty = [NSSet set];
+        _addedComponentIds = empty;
+        _removedComponentIds = empty;
+        _movedComponentIds = empty;
+        _renamedComponentIds = empty;
+        _contentChangedComponentIds = empty;
+        _propertyChangedComponentIds = empty;
+        _addedChildIds = empty;
+        _removedChildIds = empty;
+        _movedChildIds = empty;
+        _renamedChildIds = empty;
+        _propertyChangedChildIds = empty;
+    }
+    return self;
+}
+
+- (BOOL)isEmpty
+{
+    return !self.manifestPropertiesChanged && self.changedComponentIds.count == 0 && self.changedChildIds.count == 0;
+}
+
+- (NSSet *)changedComponentIds
+{
+    NSMutableSet *ids = [self.addedComponentIds mutableCopy];
+    [ids unionSet:self.removedComponentIds];
+    [ids unionSet:self.movedComponentIds];
+    [ids unionSet:self.renamedComponentIds];
+    [ids unionSet:self.contentChangedComponentIds];
+    [ids unionSet:self.propertyChangedComponentIds];
+    return ids;
+}
+
+- (NSSet *)changedChildIds
+{
+    NSMutableSet *ids = [self.addedChildIds mutableCopy];
+    [ids unionSet:self.removedChildIds];
+    [ids unionSet:self.movedChildIds];
+    [ids unionSet:self.renamedChildIds];
+    [ids unionSet:self.propertyChangedChildIds];
+    return ids;
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@: components +%lu -%lu moved %lu renamed %lu content %lu properties %lu, "
+            "children +%lu -%lu moved %lu renamed %lu properties %lu, manifest properties %@>",
+            NSStringFromClass([self class]),
+            (unsigned long)self.addedComponentIds.count, (unsigned long)self.removedComponentIds.count,
+            (unsigned long)self.movedComponentIds.count, (unsigned long)self.renamedComponentIds.count,
+            (unsigned long)self.contentChangedComponentIds.count, (unsigned long)self.propertyChangedComponentIds.count,
+            (unsigned long)self.addedChildIds.count, (unsigned long)self.removedChildIds.count,
+            (unsigned long)self.movedChildIds.count, (unsigned long)self.renamedChildIds.count,
+            (unsigned long)self.propertyChangedChildIds.count, self.manifestPropertiesChanged ? @"changed" : @"unchanged"];
+}
+
+@end
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import <Foundation/Foundation.h>
+
+#import "DCXComposite.h"
+
+@class DCXManifest;
+
+/**
+ * \brief Merges the local changes of a composite into the manifest pulled from the server based
+ * on the common base manifest (see DCXComposite mergePulledBranchWithConflictPolicy:withError:).
+ */
+@interface DCXManifestMerger : NSObject
+
+/**
+ * \brief Performs a three-way merge of localManifest and serverManifest.
+ *
+ * The merge starts out with a copy of serverManifest and applies the child nodes and components
+ * that have been added, removed, moved or otherwise changed going from baseManifest to
+ * localManifest. Changes that the server has made to the same item get resolved according to
+ * policy. Local files are never accessed. Components taken from localManifest keep referring to their
+ * local files.
+ *
+ * Copying serverManifest and computing the diffs of both manifests against baseManifest take time
+ * linear in the size of the manifests, but both are passes over the lookup tables that don't touch
+ * the DOM. Applying the changes only visits the changed items.
+ *
+ * \param localManifest  The manifest with the local changes.
+ * \param serverManifest The manifest pulled from the server. Doesn't get modified.
+ * \param baseManifest   The manifest both of the others are derived from.
+ * \param policy         Determines how conflicting changes get resolved.
+ * \param errorPtr       Gets set to an error if a local change cannot be applied.
+ *
+ * \return The merged manifest or nil.
+ */
++ (DCXManifest *)mergeManifest:(DCXManifest *)localManifest
+                  intoManifest:(DCXManifest *)serverManifest
+                  baseManifest:(DCXManifest *)baseManifest
+                conflictPolicy:(DCXMergeConflictPolicy)policy
+                     withError:(NSError **)errorPtr;
+
+@end
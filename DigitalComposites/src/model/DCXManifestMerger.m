@@ -0,0 +1,450 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import "DCXManifestMerger.h"
+
+#import "DCXComponent.h"
+#import "DCXConstants_Internal.h"
+#import "DCXError.h"
+#import "DCXLocalStorage.h"
+#import "DCXManifest.h"
+#import "DCXManifestDiff.h"
+#import "DCXMutableComponent.h"
+#import "DCXMutableNode.h"
+
+// Gets inserted before the extension of the path of a local item that collides with an item of the server
+static NSString *const DCXLocalConflictSuffix = @"-local";
+
+// Gives up on finding a unique path after this many attempts
+static const NSUInteger DCXMaxConflictPathAttempts = 100;
+
+// Returns path with the conflict suffix for the given attempt, e.g. images/a-local.png or images/a-local-2.png
+static NSString *DCXConflictPath(NSString *path, NSUInteger attempt)
+{
+    if (attempt == 0) {
+        return path;
+    }
+    NSString *suffix = attempt == 1 ? DCXLocalConflictSuffix
+                                    : [NSString stringWithFormat:@"%@-%lu", DCXLocalConflictSuffix, (unsigned long)attempt];
+    NSString *extension = path.pathExtension;
+    NSString *result = [path.stringByDeletingPathExtension stringByAppendingString:suffix];
+    return extension.length > 0 ? [result stringByAppendingPathExtension:extension] : result;
+}
+
+static BOOL DCXValueChanged(id value, id baseValue)
+{
+    return value != baseValue && ![value isEqual:baseValue];
+}
+
+// Returns the id of the parent node of the child node with nodeId or nil if it is at the root level or unknown
+static NSString *DCXParentIdOfChild(DCXManifest *manifest, NSString *nodeId)
+{
+    DCXNode *node = manifest.allChildren[nodeId];
+    if (node == nil || node.isRoot) {
+        return nil;
+    }
+    NSUInteger index;
+    DCXNode *parent = [manifest findParentOfChild:node foundIndex:&index];
+    return parent.isRoot ? nil : parent.nodeId;
+}
+
+// Returns the id of the node that contains the component with componentId or nil if it is at the root level or unknown
+static NSString *DCXParentIdOfComponent(DCXManifest *manifest, NSString *componentId)
+{
+    DCXComponent *component = manifest.allComponents[componentId];
+    if (component == nil) {
+        return nil;
+    }
+    DCXNode *parent = [manifest findParentOfComponent:component];
+    return parent.isRoot ? nil : parent.nodeId;
+}
+
+typedef id (^DCXMergeChangeBlock)(NSString *path, NSError **errorPtr);
+
+@implementation DCXManifestMerger
+{
+    DCXManifest *_merged;
+    DCXManifest *_local;
+    DCXManifest *_server;
+    DCXManifest *_base;
+    DCXManifestDiff *_localDiff;
+    DCXManifestDiff *_serverDiff;
+    DCXMergeConflictPolicy _policy;
+}
+
++ (DCXManifest *)mergeManifest:(DCXManifest *)localManifest
+                  intoManifest:(DCXManifest *)serverManifest
+                  baseManifest:(DCXManifest *)baseManifest
+                conflictPolicy:(DCXMergeConflictPolicy)policy
+                     withError:(NSError **)errorPtr
+{
+    NSAssert(localManifest != nil, @"Parameter localManifest must not be nil.");
+    NSAssert(serverManifest != nil, @"Parameter serverManifest must not be nil.");
+    NSAssert(baseManifest != nil, @"Parameter baseManifest must not be nil.");
+
+    DCXManifestMerger *merger = [[DCXManifestMerger alloc] init];
+    merger->_local = localManifest;
+    merger->_server = serverManifest;
+    merger->_base = baseManifest;
+    merger->_policy = policy;
+
+    return [merger mergeWithError:errorPtr];
+}
+
+- (DCXManifest *)mergeWithError:(NSError **)errorPtr
+{
+    _merged = [_server copy];
+    _localDiff = [_local diffFromManifest:_base];
+    if (_localDiff.isEmpty) {
+        return _merged;
+    }
+    _serverDiff = [_server diffFromManifest:_base];
+
+    [self mergeManifestProperties];
+
+    // Nodes get added before the components that go into them and removed last so that removals can
+    // take the merged components into account
+    if (![self mergeChildrenWithError:errorPtr]
+        || ![self mergeComponentsWithError:errorPtr]
+        || ![self removeChildrenWithError:errorPtr]) {
+        return nil;
+    }
+
+    return _merged;
+}
+
+#pragma mark Helpers
+
+// Whether the local side of a conflicting change wins
+- (BOOL)localWins
+{
+    return _policy == DCXMergeConflictPolicyClientWins;
+}
+
+// Returns the node of the merged manifest with nodeId or the root node if nodeId is nil
+- (DCXNode *)mergedNodeWithId:(NSString *)nodeId
+{
+    return nodeId == nil ? _merged.rootNode : _merged.allChildren[nodeId];
+}
+
+// Calls change with path and, as long as it fails because the path collides with an existing item, with
+// paths that carry the conflict suffix. Starts with the suffix for firstAttempt. Returns the result of the
+// successful call.
+- (id)applyChange:(DCXMergeChangeBlock)change withPath:(NSString *)path firstAttempt:(NSUInteger)firstAttempt
+        withError:(NSError **)errorPtr
+{
+    for (NSUInteger attempt = firstAttempt; ; attempt++) {
+        NSError *error = nil;
+        id result = change(DCXConflictPath(path, attempt), &error);
+        if (result != nil) {
+            return result;
+        }
+        if (path == nil || attempt >= DCXMaxConflictPathAttempts
+            || ![error.domain isEqualToString:DCXErrorDomain] || error.code != DCXErrorDuplicatePath) {
+            if (errorPtr != NULL) {
+                *errorPtr = error;
+            }
+            return nil;
+        }
+    }
+}
+
+#pragma mark Manifest properties
+
+- (void)mergeManifestProperties
+{
+    if (!_localDiff.manifestPropertiesChanged) {
+        return;
+    }
+    if (DCXValueChanged(_local.name, _base.name)
+        && (self.localWins || !DCXValueChanged(_server.name, _base.name))) {
+        _merged.name = _local.name;
+    }
+    if (DCXValueChanged(_local.type, _base.type)
+        && (self.localWins || !DCXValueChanged(_server.type, _base.type))) {
+        _merged.type = _local.type;
+    }
+    if (DCXValueChanged(_local.links, _base.links)
+        && (self.localWins || !DCXValueChanged(_server.links, _base.links))) {
+        _merged.links = _local.links;
+    }
+}
+
+#pragma mark Child nodes
+
+- (BOOL)mergeChildrenWithError:(NSError **)errorPtr
+{
+    for (NSString *nodeId in _localDiff.addedChildIds) {
+        if (![self addLocalChildWithId:nodeId withError:errorPtr]) {
+            return NO;
+        }
+    }
+
+    NSMutableSet *changed = [_localDiff.renamedChildIds mutableCopy];
+    [changed unionSet:_localDiff.propertyChangedChildIds];
+    NSMutableSet *serverChanged = [_serverDiff.renamedChildIds mutableCopy];
+    [serverChanged unionSet:_serverDiff.propertyChangedChildIds];
+    for (NSString *nodeId in changed) {
+        DCXNode *localNode = _local.allChildren[nodeId];
+        if (localNode.isRoot) {
+            // The properties of the root get merged with the manifest properties
+            continue;
+        }
+        if (_merged.allChildren[nodeId] == nil) {
+            // Changed locally but removed on the server
+            if (_policy != DCXMergeConflictPolicyServerWins && ![self addLocalChildWithId:nodeId withError:errorPtr]) {
+                return NO;
+            }
+        } else if (![serverChanged containsObject:nodeId] || self.localWins) {
+            NSDictionary *dict = localNode.dict;
+            DCXNode *updated = [self applyChange:^id(NSString *path, NSError **changeErrorPtr) {
+                NSMutableDictionary *nodeDict = [dict mutableCopy];
+                if (path != nil) {
+                    nodeDict[DCXPathManifestKey] = path;
+                }
+                DCXMutableNode *node = [[DCXMutableNode alloc] initWithDictionary:nodeDict withParentPath:nil];
+                return [_merged updateChild:node withError:changeErrorPtr];
+            } withPath:localNode.path firstAttempt:0 withError:errorPtr];
+            if (updated == nil) {
+                return NO;
+            }
+        }
+    }
+
+    for (NSString *nodeId in _localDiff.movedChildIds) {
+        DCXNode *node = _merged.allChildren[nodeId];
+        if (node == nil || ([_serverDiff.movedChildIds containsObject:nodeId] && !self.localWins)) {
+            continue;
+        }
+        NSString *parentId = DCXParentIdOfChild(_local, nodeId);
+        DCXNode *parent = [self mergedNodeWithId:parentId];
+        if (parent == nil || [DCXParentIdOfChild(_merged, nodeId) isEqualToString:parentId]) {
+            // The new parent has been removed on the server or the node is already there
+            continue;
+        }
+        // The server may have moved the new parent into the node
+        BOOL isDescendant = NO;
+        for (NSString *ancestorId = parentId; ancestorId != nil; ancestorId = DCXParentIdOfChild(_merged, ancestorId)) {
+            if ([ancestorId isEqualToString:nodeId]) {
+                isDescendant = YES;
+                break;
+            }
+        }
+        if (isDescendant) {
+            continue;
+        }
+        NSError *error = nil;
+        if ([_merged moveChild:node toParent:parent toIndex:[_merged childrenOf:parent].count withError:&error] == nil
+            && error.code != DCXErrorDuplicatePath) {
+            // A path collision leaves the node where the server has put it
+            if (errorPtr != NULL) {
+                *errorPtr = error;
+            }
+            return NO;
+        }
+    }
+
+    return YES;
+}
+
+// Adds a child node of the local manifest without its children and components, which get merged separately
+- (BOOL)addLocalChildWithId:(NSString *)nodeId withError:(NSError **)errorPtr
+{
+    DCXNode *localNode = _local.allChildren[nodeId];
+    if (localNode.isRoot || _merged.allChildren[nodeId] != nil) {
+        // Already added as the parent of another node or it also got added on the server, in which
+        // case the server's version wins
+        return YES;
+    }
+
+    NSString *parentId = DCXParentIdOfChild(_local, nodeId);
+    if (parentId != nil && [_localDiff.addedChildIds containsObject:parentId]
+        && ![self addLocalChildWithId:parentId withError:errorPtr]) {
+        return NO;
+    }
+    // Nodes whose parent has been removed on the server end up at the root level
+    DCXNode *parent = [self mergedNodeWithId:parentId] ?: _merged.rootNode;
+
+    NSMutableDictionary *dict = [localNode.dict mutableCopy];
+    [dict removeObjectForKey:DCXChildrenManifestKey];
+    [dict removeObjectForKey:DCXComponentsManifestKey];
+    DCXNode *added = [self applyChange:^id(NSString *path, NSError **changeErrorPtr) {
+        if (path != nil) {
+            dict[DCXPathManifestKey] = path;
+        }
+        DCXMutableNode *node = [[DCXMutableNode alloc] initWithDictionary:[dict mutableCopy] withParentPath:nil];
+        return [_merged addChild:node toParent:parent withError:changeErrorPtr];
+    } withPath:localNode.path firstAttempt:0 withError:errorPtr];
+
+    return added != nil;
+}
+
+// Removes the nodes that have been removed locally unless the server has changed them or any of their descendants
+- (BOOL)removeChildrenWithError:(NSError **)errorPtr
+{
+    if (_localDiff.removedChildIds.count == 0) {
+        return YES;
+    }
+
+    NSMutableSet *touched = [NSMutableSet set];
+    void (^touch)(NSString *) = ^(NSString *nodeId) {
+        while (nodeId != nil && ![touched containsObject:nodeId]) {
+            [touched addObject:nodeId];
+            nodeId = DCXParentIdOfChild(_server, nodeId);
+        }
+    };
+    if (!self.localWins) {
+        for (NSString *nodeId in [_serverDiff changedChildIds]) {
+            touch(nodeId);
+        }
+        for (NSString *componentId in [_serverDiff changedComponentIds]) {
+            touch(DCXParentIdOfComponent(_server, componentId) ?: DCXParentIdOfComponent(_base, componentId));
+        }
+    }
+
+    for (NSString *nodeId in _localDiff.removedChildIds) {
+        DCXNode *node = _merged.allChildren[nodeId];
+        // The node might already be gone along with its parent
+        if (node != nil && !node.isRoot && ![touched containsObject:nodeId]) {
+            [_merged removeChild:node removedComponents:nil];
+        }
+    }
+
+    return YES;
+}
+
+#pragma mark Components
+
+- (BOOL)mergeComponentsWithError:(NSError **)errorPtr
+{
+    for (NSString *componentId in _localDiff.addedComponentIds) {
+        // Components that also got added on the server keep the server's version
+        if (_merged.allComponents[componentId] == nil
+            && ![self addLocalComponentWithId:componentId withError:errorPtr]) {
+            return NO;
+        }
+    }
+
+    NSMutableSet *changed = [_localDiff.renamedComponentIds mutableCopy];
+    [changed unionSet:_localDiff.contentChangedComponentIds];
+    [changed unionSet:_localDiff.propertyChangedComponentIds];
+    NSMutableSet *serverChanged = [_serverDiff.renamedComponentIds mutableCopy];
+    [serverChanged unionSet:_serverDiff.contentChangedComponentIds];
+    [serverChanged unionSet:_serverDiff.propertyChangedComponentIds];
+    for (NSString *componentId in changed) {
+        DCXComponent *localComponent = _local.allComponents[componentId];
+        DCXComponent *mergedComponent = _merged.allComponents[componentId];
+        if (mergedComponent == nil) {
+            // Changed locally but removed on the server
+            if (_policy != DCXMergeConflictPolicyServerWins
+                && ![self addLocalComponentWithId:componentId withError:errorPtr]) {
+                return NO;
+            }
+        } else if (![serverChanged containsObject:componentId] || self.localWins) {
+            DCXComponent *updated = [self applyChange:^id(NSString *path, NSError **changeErrorPtr) {
+                DCXMutableComponent *component = [localComponent mutableCopy];
+                component.path = path;
+                return [_merged updateComponent:component withError:changeErrorPtr];
+            } withPath:localComponent.path firstAttempt:0 withError:errorPtr];
+            if (updated == nil) {
+                return NO;
+            }
+            [DCXLocalStorage copyLocalStorageDataOfComponent:localComponent fromManifest:_local
+                                                 toComponent:updated ofManifest:_merged];
+        } else if (_policy == DCXMergeConflictPolicyKeepBoth) {
+            // Keep the local version next to the server's as a new component
+            DCXNode *parent = [_merged findParentOfComponent:mergedComponent];
+            DCXComponent *added = [self applyChange:^id(NSString *path, NSError **changeErrorPtr) {
+                return [self addComponent:localComponent toNode:parent newPath:path withError:changeErrorPtr];
+            } withPath:localComponent.path firstAttempt:1 withError:errorPtr];
+            if (added == nil) {
+                return NO;
+            }
+            [DCXLocalStorage copyLocalStorageDataOfComponent:localComponent fromManifest:_local
+                                                 toComponent:added ofManifest:_merged];
+        }
+    }
+
+    for (NSString *componentId in _localDiff.movedComponentIds) {
+        DCXComponent *component = _merged.allComponents[componentId];
+        if (component == nil || ([_serverDiff.movedComponentIds containsObject:componentId] && !self.localWins)) {
+            continue;
+        }
+        NSString *parentId = DCXParentIdOfComponent(_local, componentId);
+        DCXNode *parent = [self mergedNodeWithId:parentId];
+        if (parent == nil || [DCXParentIdOfComponent(_merged, componentId) isEqualToString:parentId]) {
+            // The new parent has been removed on the server or the component is already there
+            continue;
+        }
+        NSError *error = nil;
+        if ([_merged moveComponent:component toChild:(parent.isRoot ? nil : parent) withError:&error] == nil
+            && error.code != DCXErrorDuplicatePath) {
+            // A path collision leaves the component where the server has put it
+            if (errorPtr != NULL) {
+                *errorPtr = error;
+            }
+            return NO;
+        }
+    }
+
+    NSSet *serverChangedAny = [_serverDiff changedComponentIds];
+    for (NSString *componentId in _localDiff.removedComponentIds) {
+        DCXComponent *component = _merged.allComponents[componentId];
+        if (component != nil && (![serverChangedAny containsObject:componentId] || self.localWins)) {
+            [_merged removeComponent:component];
+        }
+    }
+
+    return YES;
+}
+
+// Adds a component of the local manifest with its id to the node that contains it locally
+- (BOOL)addLocalComponentWithId:(NSString *)componentId withError:(NSError **)errorPtr
+{
+    DCXComponent *localComponent = _local.allComponents[componentId];
+    // Components whose node has been removed on the server end up at the root level
+    DCXNode *parent = [self mergedNodeWithId:DCXParentIdOfComponent(_local, componentId)] ?: _merged.rootNode;
+
+    DCXComponent *added = [self applyChange:^id(NSString *path, NSError **changeErrorPtr) {
+        DCXMutableComponent *component = [localComponent mutableCopy];
+        component.path = path;
+        return [self addComponent:component toNode:parent newPath:nil withError:changeErrorPtr];
+    } withPath:localComponent.path firstAttempt:0 withError:errorPtr];
+    if (added == nil) {
+        return NO;
+    }
+    [DCXLocalStorage copyLocalStorageDataOfComponent:localComponent fromManifest:_local
+                                         toComponent:added ofManifest:_merged];
+    return YES;
+}
+
+- (DCXComponent *)addComponent:(DCXComponent *)component toNode:(DCXNode *)node newPath:(NSString *)newPath
+                     withError:(NSError **)errorPtr
+{
+    if (node.isRoot) {
+        return [_merged addComponent:component fromManifest:_local newPath:newPath withError:errorPtr];
+    }
+    return [_merged addComponent:component fromManifest:_local toChild:node newPath:newPath withError:errorPtr];
+}
+
+@end
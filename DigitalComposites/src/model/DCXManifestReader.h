@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ * \brief Block that gets called for every child node and component of a manifest read by
+ * DCXManifestReader.
+ *
+ * \param dict        The dictionary of the node or component.
+ * \param isComponent YES if dict is a component, NO if it is a child node.
+ * \param itemId      The id of the item. Items without an id get assigned a new one.
+ * \param parentId    The id of the node that contains the item.
+ * \param index       The index of the item in the children or components array of its parent.
+ * \param parentPath  The absolute path that the path of the item is relative to.
+ */
+typedef void (^DCXManifestReaderItemBlock)(NSMutableDictionary *dict, BOOL isComponent, NSString *itemId,
+                                           NSString *parentId, NSUInteger index, NSString *parentPath);
+
+/**
+ * \brief Reads the JSON of a manifest in a single pass over its bytes.
+ *
+ * The reader produces the same mutable containers as NSJSONSerialization with
+ * NSJSONReadingMutableContainers (minus the empty children, components and links arrays of nodes
+ * which DCXManifest doesn't keep) and at the same time records the dictionaries of all child nodes
+ * and components in document order, so that DCXManifest can build its lookup tables without
+ * having to walk the DOM again. Short strings such as keys and states get shared between
+ * dictionaries.
+ *
+ * The reader only accepts UTF-8 encoded JSON whose top level value is an object.
+ *
+ * Alternatively the reader can read a compact binary encoding of a manifest produced by
+ * binaryDataWithDictionary:key:. Its strings are stored once in a string table and the values
+ * refer to them by index so that reading it is a lot cheaper than parsing JSON. The binary data is
+ * versioned and checksummed and carries an opaque key which lets the caller check what the data
+ * has been derived from before reading it.
+ */
+@interface DCXManifestReader : NSObject
+
+/**
+ * \brief Initializes a reader for the given data.
+ *
+ * \param data The UTF-8 encoded JSON of a manifest. The data only needs to stay valid during
+ * readWithError:, so it can be memory-mapped.
+ */
+- (instancetype)initWithData:(NSData *)data;
+
+/**
+ * \brief Initializes a reader for data produced by binaryDataWithDictionary:key:.
+ *
+ * \param data The binary data. Like with initWithData: it can be memory-mapped.
+ */
+- (instancetype)initWithBinaryData:(NSData *)data;
+
+/**
+ * \brief Initializes a reader for the contents of the file at path. The file gets memory-mapped if
+ * that is safe.
+ *
+ * \param path     The path of the manifest file.
+ * \param errorPtr Gets set to an error if the file cannot be read.
+ */
+- (instancetype)initWithContentsOfFile:(NSString *)path withError:(NSError **)errorPtr;
+
+/**
+ * \brief Parses the data of the reader.
+ *
+ * \param errorPtr Gets set to a DCXErrorInvalidManifest error if the data is not valid (JSON or
+ * binary data with a matching checksum) or its top level value is not an object.
+ *
+ * \return The mutable dictionary of the top level object or nil.
+ */
+- (NSMutableDictionary *)readWithError:(NSError **)errorPtr;
+
+/**
+ * \brief Calls block for every child node and component read by readWithError: in document order,
+ * i.e. a node always gets reported before its descendants.
+ *
+ * \param rootId The id to report as the parent id of the items that are directly contained in the
+ * top level object.
+ * \param block  The block to call.
+ */
+- (void)enumerateItemsWithRootId:(NSString *)rootId usingBlock:(DCXManifestReaderItemBlock)block;
+
+/** The key that has been passed to binaryDataWithDictionary:key: when the binary data of the
+ * reader was created. nil if the reader hasn't been initialized with binary data or if the data
+ * has an unknown format or version. Doesn't verify the checksum of the data. */
+@property (nonatomic, readonly) NSData *binaryKey;
+
+/** The number of child nodes that have been read. */
+@property (nonatomic, readonly) NSUInteger nodeCount;
+
+/** The number of components that have been read. */
+@property (nonatomic, readonly) NSUInteger componentCount;
+
+/**
+ * \brief Encodes the dictionary of a manifest in the binary format that initWithBinaryData: reads.
+ *
+ * \param dict The manifest dictionary, i.e. the root node including the manifest-specific properties.
+ * It may only contain the types that NSJSONSerialization produces.
+ * \param key  Opaque data that gets stored with the encoding and can be retrieved via binaryKey.
+ *
+ * \return The binary data or nil if dict contains values that cannot be encoded.
+ */
++ (NSData *)binaryDataWithDictionary:(NSDictionary *)dict key:(NSData *)key;
+
+@end
@@ -0,0 +1,1157 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#import "DCXManifestReader.h"
+
+#import <libkern/OSByteOrder.h>
+#import <xlocale.h>
+
+#import "DCXConstants_Internal.h"
+#import "DCXError.h"
+
+#import "DCXErrorUtils.h"
+
+// Maximum nesting depth of arrays and objects. Every level of the node hierarchy takes up two
+// levels (the node object and its children array).
+static const NSUInteger DCXManifestReaderMaxDepth = 1024;
+
+// Strings of up to this many bytes get shared through the string cache.
+#define DCXManifestReaderMaxCachedStringLength 32
+
+// Number of entries of the string cache. Must be a power of two.
+#define DCXManifestReaderStringCacheSize 256
+
+// Layout of the binary format. All integers are little-endian.
+//
+//   header         "DCXB", uint32 version, uint64 checksum of everything after the header,
+//                  uint32 length of the key, uint32 number of strings
+//   key            the bytes of the key
+//   string table   for every string a uint32 length followed by its UTF-8 bytes
+//   value          the top level dictionary
+//
+// Values start with a tag byte:
+//   null, false, true      nothing else
+//   integer, double        8 bytes
+//   string                 uint32 index into the string table
+//   array                  uint32 count followed by the values
+//   dictionary             uint32 count followed by pairs of a uint32 string index (the key) and a value
+static const uint8_t DCXManifestReaderBinaryMagic[4] = { 'D', 'C', 'X', 'B' };
+static const uint32_t DCXManifestReaderBinaryVersion = 1;
+static const NSUInteger DCXManifestReaderBinaryHeaderLength = 24;
+
+typedef NS_ENUM(uint8_t, DCXManifestReaderBinaryTag) {
+    DCXManifestReaderBinaryTagNull,
+    DCXManifestReaderBinaryTagFalse,
+    DCXManifestReaderBinaryTagTrue,
+    DCXManifestReaderBinaryTagInteger,
+    DCXManifestReaderBinaryTagDouble,
+    DCXManifestReaderBinaryTagString,
+    DCXManifestReaderBinaryTagArray,
+    DCXManifestReaderBinaryTagDictionary,
+};
+
+// What a value means to the manifest. Determines how the reader treats the contained values.
+typedef NS_ENUM(NSInteger, DCXManifestReaderRole) {
+    DCXManifestReaderRoleValue,         // Any value that the reader doesn't need to know about
+    DCXManifestReaderRoleNode,          // The top level object or a child node
+    DCXManifestReaderRoleChildren,      // The children array of a node
+    DCXManifestReaderRoleComponents,    // The components array of a node
+};
+
+// A child node or component. The dictionary is owned by the DOM.
+typedef struct {
+    __unsafe_unretained NSMutableDictionary *dict;
+    NSUInteger parentSlot;      // Slot of the parent node, 0 is the top level object
+    NSUInteger index;           // Index in the children or components array of the parent
+    BOOL isComponent;
+} DCXManifestReaderItem;
+
+// An entry of the string cache. The string is owned by _cachedStrings.
+typedef struct {
+    NSUInteger length;
+    uint8_t bytes[DCXManifestReaderMaxCachedStringLength];
+    __unsafe_unretained NSString *string;
+} DCXManifestReaderCachedString;
+
+@implementation DCXManifestReader
+{
+    NSData *_data;
+    NSMutableDictionary *_root;
+
+    // Parser state
+    const uint8_t *_start;
+    const uint8_t *_p;
+    const uint8_t *_end;
+    NSUInteger _depth;
+    NSString *_errorReason;
+    NSUInteger _errorOffset;
+
+    // Buffer for strings with escape sequences and for numbers
+    char *_scratch;
+    NSUInteger _scratchCapacity;
+
+    // The nodes and components in document order
+    DCXManifestReaderItem *_items;
+    NSUInteger _itemCount;
+    NSUInteger _itemCapacity;
+
+    DCXManifestReaderCachedString _stringCache[DCXManifestReaderStringCacheSize];
+    NSMutableArray *_cachedStrings;
+    
+    // State for the binary format. _strings holds the string table, _stringPointers gives fast
+    // access to its elements.
+    BOOL _isBinary;
+    NSArray *_strings;
+    __unsafe_unretained NSString **_stringPointers;
+}
+
+- (instancetype)initWithData:(NSData *)data
+{
+    if (self = [super init]) {
+        _data = data;
+    }
+    return self;
+}
+
+- (instancetype)initWithBinaryData:(NSData *)data
+{
+    if (self = [self initWithData:data]) {
+        _isBinary = YES;
+    }
+    return self;
+}
+
+- (instancetype)initWithContentsOfFile:(NSString *)path withError:(NSError **)errorPtr
+{
+    NSError *readError;
+    NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:&readError];
+    if (data == nil) {
+        if (errorPtr != NULL) {
+            *errorPtr = [DCXErrorUtils ErrorWithCode:DCXErrorManifestReadFailure domain:DCXErrorDomain
+                                     underlyingError:readError path:path details:nil];
+        }
+        return nil;
+    }
+    return [self initWithData:data];
+}
+
+- (void)dealloc
+{
+    free(_scratch);
+    free(_items);
+    free(_stringPointers);
+}
+
+#pragma mark - Parsing
+
+static void DCXManifestReaderFail(DCXManifestReader *reader, NSString *reason)
+{
+    if (reader->_errorReason == nil) {
+        reader->_errorReason = reason;
+        reader->_errorOffset = reader->_p - reader->_start;
+    }
+}
+
+static inline void DCXManifestReaderSkipWhitespace(DCXManifestReader *reader)
+{
+    const uint8_t *p = reader->_p;
+    const uint8_t *end = reader->_end;
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+        p++;
+    }
+    reader->_p = p;
+}
+
+static char *DCXManifestReaderScratch(DCXManifestReader *reader, NSUInteger capacity)
+{
+    if (capacity > reader->_scratchCapacity) {
+        NSUInteger newCapacity = MAX(capacity, MAX(reader->_scratchCapacity * 2, 256));
+        reader->_scratch = reallocf(reader->_scratch, newCapacity);
+        reader->_scratchCapacity = reader->_scratch == NULL ? 0 : newCapacity;
+    }
+    return reader->_scratch;
+}
+
+static void DCXManifestReaderAddItem(DCXManifestReader *reader, NSMutableDictionary *dict, NSUInteger parentSlot,
+                                     NSUInteger index, BOOL isComponent)
+{
+    if (reader->_itemCount == reader->_itemCapacity) {
+        reader->_itemCapacity = MAX(reader->_itemCapacity * 2, 64);
+        reader->_items = reallocf(reader->_items, reader->_itemCapacity * sizeof(DCXManifestReaderItem));
+        NSCAssert(reader->_items != NULL, @"Out of memory");
+    }
+    DCXManifestReaderItem *item = &reader->_items[reader->_itemCount++];
+    item->dict = dict;
+    item->parentSlot = parentSlot;
+    item->index = index;
+    item->isComponent = isComponent;
+}
+
+// Returns a string for the given UTF-8 bytes. Short strings come from the string cache since keys
+// and many values (states, types, rels) repeat throughout a manifest.
+static NSString *DCXManifestReaderString(DCXManifestReader *reader, const uint8_t *bytes, NSUInteger length)
+{
+    DCXManifestReaderCachedString *entry = NULL;
+    if (length <= DCXManifestReaderMaxCachedStringLength) {
+        uint32_t hash = 2166136261u;
+        for (NSUInteger i = 0; i < length; i++) {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+        entry = &reader->_stringCache[hash & (DCXManifestReaderStringCacheSize - 1)];
+        if (entry->string != nil && entry->length == length && memcmp(entry->bytes, bytes, length) == 0) {
+            return entry->string;
+        }
+    }
+
+    NSString *string = [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+    if (string == nil) {
+        DCXManifestReaderFail(reader, @"invalid UTF-8");
+        return nil;
+    }
+
+    if (entry != NULL) {
+        NSUInteger slot = entry - reader->_stringCache;
+        reader->_cachedStrings[slot] = string;
+        entry->string = string;
+        entry->length = length;
+        memcpy(entry->bytes, bytes, length);
+    }
+    return string;
+}
+
+static int DCXManifestReaderHexDigit(uint8_t c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Reads the four hex digits of a \u escape sequence. _p must point at the 'u'.
+static int32_t DCXManifestReaderReadUnicodeEscape(DCXManifestReader *reader)
+{
+    const uint8_t *p = reader->_p;
+    if (reader->_end - p < 5) {
+        return -1;
+    }
+    int32_t value = 0;
+    for (int i = 1; i <= 4; i++) {
+        int digit = DCXManifestReaderHexDigit(p[i]);
+        if (digit < 0) {
+            return -1;
+        }
+        value = (value << 4) | digit;
+    }
+    reader->_p = p + 5;
+    return value;
+}
+
+// Decodes a string with escape sequences into the scratch buffer. _p must point at the first
+// backslash and start at the first character of the string.
+static NSString *DCXManifestReaderEscapedString(DCXManifestReader *reader, const uint8_t *start)
+{
+    // Unescaping never makes a string longer
+    NSUInteger capacity = reader->_end - start;
+    uint8_t *out = (uint8_t *)DCXManifestReaderScratch(reader, capacity);
+    if (out == NULL) {
+        DCXManifestReaderFail(reader, @"out of memory");
+        return nil;
+    }
+    NSUInteger length = reader->_p - start;
+    memcpy(out, start, length);
+
+    while (reader->_p < reader->_end) {
+        uint8_t c = *reader->_p;
+        if (c == '"') {
+            reader->_p++;
+            return DCXManifestReaderString(reader, out, length);
+        } else if (c < 0x20) {
+            DCXManifestReaderFail(reader, @"unescaped control character in string");
+            return nil;
+        } else if (c != '\\') {
+            out[length++] = c;
+            reader->_p++;
+            continue;
+        }
+
+        if (++reader->_p == reader->_end) {
+            break;
+        }
+        c = *reader->_p;
+        switch (c) {
+            case '"':  out[length++] = '"';  reader->_p++; break;
+            case '\\': out[length++] = '\\'; reader->_p++; break;
+            case '/':  out[length++] = '/';  reader->_p++; break;
+            case 'b':  out[length++] = '\b'; reader->_p++; break;
+            case 'f':  out[length++] = '\f'; reader->_p++; break;
+            case 'n':  out[length++] = '\n'; reader->_p++; break;
+            case 'r':  out[length++] = '\r'; reader->_p++; break;
+            case 't':  out[length++] = '\t'; reader->_p++; break;
+            case 'u': {
+                int32_t codePoint = DCXManifestReaderReadUnicodeEscape(reader);
+                if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+                    // A high surrogate must be followed by an escaped low surrogate
+                    int32_t low = -1;
+                    if (reader->_end - reader->_p >= 2 && reader->_p[0] == '\\' && reader->_p[1] == 'u') {
+                        reader->_p++;
+                        low = DCXManifestReaderReadUnicodeEscape(reader);
+                    }
+                    if (low < 0xDC00 || low > 0xDFFF) {
+                        DCXManifestReaderFail(reader, @"invalid surrogate pair");
+                        return nil;
+                    }
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                } else if (codePoint < 0 || (codePoint >= 0xDC00 && codePoint <= 0xDFFF)) {
+                    DCXManifestReaderFail(reader, @"invalid unicode escape sequence");
+                    return nil;
+                }
+                // The escape sequence takes at least as many bytes as the UTF-8 encoding
+                if (codePoint < 0x80) {
+                    out[length++] = codePoint;
+                } else if (codePoint < 0x800) {
+                    out[length++] = 0xC0 | (codePoint >> 6);
+                    out[length++] = 0x80 | (codePoint & 0x3F);
+                } else if (codePoint < 0x10000) {
+                    out[length++] = 0xE0 | (codePoint >> 12);
+                    out[length++] = 0x80 | ((codePoint >> 6) & 0x3F);
+                    out[length++] = 0x80 | (codePoint & 0x3F);
+                } else {
+                    out[length++] = 0xF0 | (codePoint >> 18);
+                    out[length++] = 0x80 | ((codePoint >> 12) & 0x3F);
+                    out[length++] = 0x80 | ((codePoint >> 6) & 0x3F);
+                    out[length++] = 0x80 | (codePoint & 0x3F);
+                }
+                break;
+            }
+            default:
+                DCXManifestReaderFail(reader, @"invalid escape sequence");
+                return nil;
+        }
+    }
+
+    DCXManifestReaderFail(reader, @"unterminated string");
+    return nil;
+}
+
+// Reads a string. _p must point at the opening quote.
+static NSString *DCXManifestReaderReadString(DCXManifestReader *reader)
+{
+    const uint8_t *start = ++reader->_p;
+    const uint8_t *p = start;
+    const uint8_t *end = reader->_end;
+    while (p < end) {
+        uint8_t c = *p;
+        if (c == '"') {
+            reader->_p = p + 1;
+            return DCXManifestReaderString(reader, start, p - start);
+        } else if (c == '\\') {
+            reader->_p = p;
+            return DCXManifestReaderEscapedString(reader, start);
+        } else if (c < 0x20) {
+            reader->_p = p;
+            DCXManifestReaderFail(reader, @"unescaped control character in string");
+            return nil;
+        }
+        p++;
+    }
+    reader->_p = p;
+    DCXManifestReaderFail(reader, @"unterminated string");
+    return nil;
+}
+
+static NSNumber *DCXManifestReaderReadNumber(DCXManifestReader *reader)
+{
+    const uint8_t *start = reader->_p;
+    const uint8_t *p = start;
+    const uint8_t *end = reader->_end;
+    BOOL isInteger = YES;
+
+    if (p < end && *p == '-') {
+        p++;
+    }
+    if (p < end && *p == '0') {
+        p++;
+    } else if (p < end && *p >= '1' && *p <= '9') {
+        while (p < end && *p >= '0' && *p <= '9') p++;
+    } else {
+        reader->_p = p;
+        DCXManifestReaderFail(reader, @"invalid number");
+        return nil;
+    }
+    if (p < end && *p == '.') {
+        isInteger = NO;
+        if (++p == end || *p < '0' || *p > '9') {
+            reader->_p = p;
+            DCXManifestReaderFail(reader, @"invalid number");
+            return nil;
+        }
+        while (p < end && *p >= '0' && *p <= '9') p++;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        isInteger = NO;
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) p++;
+        if (p == end || *p < '0' || *p > '9') {
+            reader->_p = p;
+            DCXManifestReaderFail(reader, @"invalid number");
+            return nil;
+        }
+        while (p < end && *p >= '0' && *p <= '9') p++;
+    }
+    reader->_p = p;
+
+    NSUInteger length = p - start;
+    BOOL isNegative = *start == '-';
+
+    // Integers with up to 18 digits always fit into a long long
+    if (isInteger && length - isNegative <= 18) {
+        long long value = 0;
+        for (const uint8_t *digit = start + isNegative; digit < p; digit++) {
+            value = value * 10 + (*digit - '0');
+        }
+        return [NSNumber numberWithLongLong:isNegative ? -value : value];
+    }
+
+    char *buffer = DCXManifestReaderScratch(reader, length + 1);
+    if (buffer == NULL) {
+        DCXManifestReaderFail(reader, @"out of memory");
+        return nil;
+    }
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+    if (isInteger) {
+        errno = 0;
+        long long value = strtoll_l(buffer, NULL, 10, NULL);
+        if (errno == 0) {
+            return [NSNumber numberWithLongLong:value];
+        }
+    }
+    // A NULL locale is the C locale, so the decimal separator is always a period
+    return [NSNumber numberWithDouble:strtod_l(buffer, NULL, NULL)];
+}
+
+static BOOL DCXManifestReaderReadLiteral(DCXManifestReader *reader, const char *literal, NSUInteger length)
+{
+    if ((NSUInteger)(reader->_end - reader->_p) < length || memcmp(reader->_p, literal, length) != 0) {
+        DCXManifestReaderFail(reader, @"invalid literal");
+        return NO;
+    }
+    reader->_p += length;
+    return YES;
+}
+
+// Returns the role of the value of the member key of an object with the given role. dropIfEmptyPtr
+// gets set to whether the member should be dropped if its value is an empty array since
+// DCXManifest doesn't keep empty children, components or links arrays around.
+static DCXManifestReaderRole DCXManifestReaderRoleOfMember(DCXManifestReaderRole role, NSString *key, BOOL *dropIfEmptyPtr)
+{
+    *dropIfEmptyPtr = NO;
+    if (role != DCXManifestReaderRoleNode) {
+        return DCXManifestReaderRoleValue;
+    }
+    if ([key isEqualToString:DCXChildrenManifestKey]) {
+        *dropIfEmptyPtr = YES;
+        return DCXManifestReaderRoleChildren;
+    } else if ([key isEqualToString:DCXComponentsManifestKey]) {
+        *dropIfEmptyPtr = YES;
+        return DCXManifestReaderRoleComponents;
+    }
+    *dropIfEmptyPtr = [key isEqualToString:DCXLinksManifestKey];
+    return DCXManifestReaderRoleValue;
+}
+
+// Fails if a node has more than one children or components array. _items doesn't retain the
+// dictionaries of the items so the items of a replaced array would be left dangling.
+static BOOL DCXManifestReaderCheckItemArray(DCXManifestReader *reader, DCXManifestReaderRole valueRole,
+                                            NSUInteger *seenItemArraysPtr)
+{
+    if (valueRole == DCXManifestReaderRoleChildren || valueRole == DCXManifestReaderRoleComponents) {
+        NSUInteger mask = 1 << valueRole;
+        if (*seenItemArraysPtr & mask) {
+            DCXManifestReaderFail(reader, valueRole == DCXManifestReaderRoleChildren ? @"duplicate children array"
+                                                                                     : @"duplicate components array");
+            return NO;
+        }
+        *seenItemArraysPtr |= mask;
+    }
+    return YES;
+}
+
+static void DCXManifestReaderSetMember(NSMutableDictionary *dict, NSString *key, id value, BOOL dropIfEmpty)
+{
+    if (!(dropIfEmpty && [value isKindOfClass:[NSArray class]] && [value count] == 0)) {
+        [dict setObject:value forKey:key];
+    }
+}
+
+// Creates and records the dictionary of the element at index of a children or components array.
+// Sets itemSlotPtr to the slot of the new node or to 0 for components.
+static NSMutableDictionary *DCXManifestReaderAddItemDict(DCXManifestReader *reader, DCXManifestReaderRole role,
+                                                        NSUInteger parentSlot, NSUInteger index, NSUInteger *itemSlotPtr)
+{
+    // Record the item before its members so that parents precede their descendants
+    BOOL isComponent = role == DCXManifestReaderRoleComponents;
+    NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+    DCXManifestReaderAddItem(reader, dict, parentSlot, index, isComponent);
+    if (isComponent) {
+        reader->_componentCount++;
+        *itemSlotPtr = 0;
+    } else {
+        *itemSlotPtr = ++reader->_nodeCount;
+    }
+    return dict;
+}
+
+static id DCXManifestReaderReadValue(DCXManifestReader *reader, DCXManifestReaderRole role, NSUInteger slot);
+
+// Reads the members of an object into dict. _p must point at the opening brace. slot is the slot
+// of the node if role is DCXManifestReaderRoleNode.
+static BOOL DCXManifestReaderReadMembers(DCXManifestReader *reader, NSMutableDictionary *dict,
+                                         DCXManifestReaderRole role, NSUInteger slot)
+{
+    if (++reader->_depth > DCXManifestReaderMaxDepth) {
+        DCXManifestReaderFail(reader, @"nesting too deep");
+        return NO;
+    }
+    reader->_p++;
+    DCXManifestReaderSkipWhitespace(reader);
+    if (reader->_p < reader->_end && *reader->_p == '}') {
+        reader->_p++;
+        reader->_depth--;
+        return YES;
+    }
+
+    NSUInteger seenItemArrays = 0;
+    while (YES) {
+        if (reader->_p == reader->_end || *reader->_p != '"') {
+            DCXManifestReaderFail(reader, @"expected a key");
+            return NO;
+        }
+        NSString *key = DCXManifestReaderReadString(reader);
+        if (key == nil) {
+            return NO;
+        }
+        DCXManifestReaderSkipWhitespace(reader);
+        if (reader->_p == reader->_end || *reader->_p != ':') {
+            DCXManifestReaderFail(reader, @"expected a colon");
+            return NO;
+        }
+        reader->_p++;
+        DCXManifestReaderSkipWhitespace(reader);
+
+        BOOL dropIfEmpty;
+        DCXManifestReaderRole valueRole = DCXManifestReaderRoleOfMember(role, key, &dropIfEmpty);
+        if (!DCXManifestReaderCheckItemArray(reader, valueRole, &seenItemArrays)) {
+            return NO;
+        }
+        id value = DCXManifestReaderReadValue(reader, valueRole, slot);
+        if (value == nil) {
+            return NO;
+        }
+        DCXManifestReaderSetMember(dict, key, value, dropIfEmpty);
+
+        DCXManifestReaderSkipWhitespace(reader);
+        if (reader->_p < reader->_end && *reader->_p == ',') {
+            reader->_p++;
+            DCXManifestReaderSkipWhitespace(reader);
+        } else if (reader->_p < reader->_end && *reader->_p == '}') {
+            reader->_p++;
+            reader->_depth--;
+            return YES;
+        } else {
+            DCXManifestReaderFail(reader, @"expected a comma or a closing brace");
+            return NO;
+        }
+    }
+}
+
+// Reads an array. _p must point at the opening bracket. For the children and components arrays
+// slot is the slot of the node that contains the array.
+static NSMutableArray *DCXManifestReaderReadArray(DCXManifestReader *reader, DCXManifestReaderRole role, NSUInteger slot)
+{
+    if (++reader->_depth > DCXManifestReaderMaxDepth) {
+        DCXManifestReaderFail(reader, @"nesting too deep");
+        return nil;
+    }
+    NSMutableArray *array = [NSMutableArray array];
+    reader->_p++;
+    DCXManifestReaderSkipWhitespace(reader);
+    if (reader->_p < reader->_end && *reader->_p == ']') {
+        reader->_p++;
+        reader->_depth--;
+        return array;
+    }
+
+    BOOL isItemArray = role == DCXManifestReaderRoleChildren || role == DCXManifestReaderRoleComponents;
+    while (YES) {
+        id value;
+        if (isItemArray) {
+            if (reader->_p == reader->_end || *reader->_p != '{') {
+                DCXManifestReaderFail(reader, role == DCXManifestReaderRoleChildren ? @"child node is not an object"
+                                                                                    : @"component is not an object");
+                return nil;
+            }
+            NSUInteger itemSlot;
+            NSMutableDictionary *dict = DCXManifestReaderAddItemDict(reader, role, slot, array.count, &itemSlot);
+            if (!DCXManifestReaderReadMembers(reader, dict, itemSlot == 0 ? DCXManifestReaderRoleValue : DCXManifestReaderRoleNode,
+                                              itemSlot)) {
+                return nil;
+            }
+            value = dict;
+        } else {
+            value = DCXManifestReaderReadValue(reader, DCXManifestReaderRoleValue, 0);
+            if (value == nil) {
+                return nil;
+            }
+        }
+        [array addObject:value];
+
+        DCXManifestReaderSkipWhitespace(reader);
+        if (reader->_p < reader->_end && *reader->_p == ',') {
+            reader->_p++;
+            DCXManifestReaderSkipWhitespace(reader);
+        } else if (reader->_p < reader->_end && *reader->_p == ']') {
+            reader->_p++;
+            reader->_depth--;
+            return array;
+        } else {
+            DCXManifestReaderFail(reader, @"expected a comma or a closing bracket");
+            return nil;
+        }
+    }
+}
+
+// Reads any value. _p must point at its first character.
+static id DCXManifestReaderReadValue(DCXManifestReader *reader, DCXManifestReaderRole role, NSUInteger slot)
+{
+    if (reader->_p == reader->_end) {
+        DCXManifestReaderFail(reader, @"unexpected end of data");
+        return nil;
+    }
+    switch (*reader->_p) {
+        case '{': {
+            NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+            // Only child nodes (handled by DCXManifestReaderReadArray) have a meaning inside of a node
+            return DCXManifestReaderReadMembers(reader, dict, DCXManifestReaderRoleValue, 0) ? dict : nil;
+        }
+        case '[':
+            return DCXManifestReaderReadArray(reader, role, slot);
+        case '"':
+            return DCXManifestReaderReadString(reader);
+        case 't':
+            return DCXManifestReaderReadLiteral(reader, "true", 4) ? @YES : nil;
+        case 'f':
+            return DCXManifestReaderReadLiteral(reader, "false", 5) ? @NO : nil;
+        case 'n':
+            return DCXManifestReaderReadLiteral(reader, "null", 4) ? [NSNull null] : nil;
+        default:
+            return DCXManifestReaderReadNumber(reader);
+    }
+}
+
+static NSMutableDictionary *DCXManifestReaderReadJSON(DCXManifestReader *reader)
+{
+    reader->_cachedStrings = [NSMutableArray arrayWithCapacity:DCXManifestReaderStringCacheSize];
+    for (NSUInteger i = 0; i < DCXManifestReaderStringCacheSize; i++) {
+        [reader->_cachedStrings addObject:[NSNull null]];
+    }
+
+    // Skip a UTF-8 byte order mark
+    if (reader->_end - reader->_p >= 3 && reader->_p[0] == 0xEF && reader->_p[1] == 0xBB && reader->_p[2] == 0xBF) {
+        reader->_p += 3;
+    }
+
+    NSMutableDictionary *root = nil;
+    DCXManifestReaderSkipWhitespace(reader);
+    if (reader->_p < reader->_end && *reader->_p == '{') {
+        root = [NSMutableDictionary dictionary];
+        if (DCXManifestReaderReadMembers(reader, root, DCXManifestReaderRoleNode, 0)) {
+            DCXManifestReaderSkipWhitespace(reader);
+            if (reader->_p != reader->_end) {
+                DCXManifestReaderFail(reader, @"unexpected data after the top level object");
+            }
+        }
+    } else {
+        DCXManifestReaderFail(reader, @"top level value is not an object");
+    }
+
+    // The cache is only needed while parsing
+    reader->_cachedStrings = nil;
+    memset(reader->_stringCache, 0, sizeof(reader->_stringCache));
+    return root;
+}
+
+#pragma mark - Binary format
+
+static uint64_t DCXManifestReaderChecksum(const uint8_t *bytes, NSUInteger length)
+{
+    // FNV-1a over 64 bit words
+    uint64_t hash = 14695981039346656037ULL;
+    NSUInteger i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+    for (; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash ^ (hash >> 29);
+}
+
+static inline uint32_t DCXManifestReaderUInt32At(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return OSSwapLittleToHostInt32(value);
+}
+
+static inline uint64_t DCXManifestReaderUInt64At(const uint8_t *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return OSSwapLittleToHostInt64(value);
+}
+
+static BOOL DCXManifestReaderReadUInt32(DCXManifestReader *reader, uint32_t *valuePtr)
+{
+    if (reader->_end - reader->_p < 4) {
+        DCXManifestReaderFail(reader, @"unexpected end of data");
+        return NO;
+    }
+    *valuePtr = DCXManifestReaderUInt32At(reader->_p);
+    reader->_p += 4;
+    return YES;
+}
+
+static NSString *DCXManifestReaderReadBinaryString(DCXManifestReader *reader)
+{
+    uint32_t index;
+    if (!DCXManifestReaderReadUInt32(reader, &index)) {
+        return nil;
+    }
+    if (index >= reader->_strings.count) {
+        DCXManifestReaderFail(reader, @"invalid string index");
+        return nil;
+    }
+    return reader->_stringPointers[index];
+}
+
+static id DCXManifestReaderReadBinaryValue(DCXManifestReader *reader, DCXManifestReaderRole role, NSUInteger slot);
+
+// Reads the members of a dictionary into dict. _p must point at the count.
+static BOOL DCXManifestReaderReadBinaryMembers(DCXManifestReader *reader, NSMutableDictionary *dict,
+                                               DCXManifestReaderRole role, NSUInteger slot)
+{
+    uint32_t count;
+    if (!DCXManifestReaderReadUInt32(reader, &count)) {
+        return NO;
+    }
+    if (++reader->_depth > DCXManifestReaderMaxDepth) {
+        DCXManifestReaderFail(reader, @"nesting too deep");
+        return NO;
+    }
+    NSUInteger seenItemArrays = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        NSString *key = DCXManifestReaderReadBinaryString(reader);
+        if (key == nil) {
+            return NO;
+        }
+        BOOL dropIfEmpty;
+        DCXManifestReaderRole valueRole = DCXManifestReaderRoleOfMember(role, key, &dropIfEmpty);
+        if (!DCXManifestReaderCheckItemArray(reader, valueRole, &seenItemArrays)) {
+            return NO;
+        }
+        id value = DCXManifestReaderReadBinaryValue(reader, valueRole, slot);
+        if (value == nil) {
+            return NO;
+        }
+        DCXManifestReaderSetMember(dict, key, value, dropIfEmpty);
+    }
+    reader->_depth--;
+    return YES;
+}
+
+// Reads an array. _p must point at the count.
+static NSMutableArray *DCXManifestReaderReadBinaryArray(DCXManifestReader *reader, DCXManifestReaderRole role, NSUInteger slot)
+{
+    uint32_t count;
+    if (!DCXManifestReaderReadUInt32(reader, &count)) {
+        return nil;
+    }
+    // Every element takes at least one byte
+    if (count > (NSUInteger)(reader->_end - reader->_p)) {
+        DCXManifestReaderFail(reader, @"invalid array length");
+        return nil;
+    }
+    if (++reader->_depth > DCXManifestReaderMaxDepth) {
+        DCXManifestReaderFail(reader, @"nesting too deep");
+        return nil;
+    }
+    NSMutableArray *array = [NSMutableArray arrayWithCapacity:count];
+    BOOL isItemArray = role == DCXManifestReaderRoleChildren || role == DCXManifestReaderRoleComponents;
+    for (uint32_t i = 0; i < count; i++) {
+        id value;
+        if (isItemArray) {
+            if (reader->_p == reader->_end || *reader->_p != DCXManifestReaderBinaryTagDictionary) {
+                DCXManifestReaderFail(reader, role == DCXManifestReaderRoleChildren ? @"child node is not an object"
+                                                                                    : @"component is not an object");
+                return nil;
+            }
+            reader->_p++;
+            NSUInteger itemSlot;
+            NSMutableDictionary *dict = DCXManifestReaderAddItemDict(reader, role, slot, i, &itemSlot);
+            if (!DCXManifestReaderReadBinaryMembers(reader, dict, itemSlot == 0 ? DCXManifestReaderRoleValue : DCXManifestReaderRoleNode,
+                                                    itemSlot)) {
+                return nil;
+            }
+            value = dict;
+        } else {
+            value = DCXManifestReaderReadBinaryValue(reader, DCXManifestReaderRoleValue, 0);
+            if (value == nil) {
+                return nil;
+            }
+        }
+        [array addObject:value];
+    }
+    reader->_depth--;
+    return array;
+}
+
+static id DCXManifestReaderReadBinaryValue(DCXManifestReader *reader, DCXManifestReaderRole role, NSUInteger slot)
+{
+    if (reader->_p == reader->_end) {
+        DCXManifestReaderFail(reader, @"unexpected end of data");
+        return nil;
+    }
+    DCXManifestReaderBinaryTag tag = *reader->_p++;
+    switch (tag) {
+        case DCXManifestReaderBinaryTagNull:
+            return [NSNull null];
+        case DCXManifestReaderBinaryTagFalse:
+            return @NO;
+        case DCXManifestReaderBinaryTagTrue:
+            return @YES;
+        case DCXManifestReaderBinaryTagInteger:
+        case DCXManifestReaderBinaryTagDouble: {
+            if (reader->_end - reader->_p < 8) {
+                DCXManifestReaderFail(reader, @"unexpected end of data");
+                return nil;
+            }
+            uint64_t bits = DCXManifestReaderUInt64At(reader->_p);
+            reader->_p += 8;
+            if (tag == DCXManifestReaderBinaryTagInteger) {
+                return [NSNumber numberWithLongLong:(long long)bits];
+            }
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+            return [NSNumber numberWithDouble:value];
+        }
+        case DCXManifestReaderBinaryTagString:
+            return DCXManifestReaderReadBinaryString(reader);
+        case DCXManifestReaderBinaryTagArray:
+            return DCXManifestReaderReadBinaryArray(reader, role, slot);
+        case DCXManifestReaderBinaryTagDictionary: {
+            NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+            return DCXManifestReaderReadBinaryMembers(reader, dict, DCXManifestReaderRoleValue, 0) ? dict : nil;
+        }
+        default:
+            reader->_p--;
+            DCXManifestReaderFail(reader, @"invalid tag");
+            return nil;
+    }
+}
+
+// Returns YES if the data has the header of the current version of the binary format
+static BOOL DCXManifestReaderHasBinaryHeader(NSData *data)
+{
+    const uint8_t *bytes = data.bytes;
+    return data.length >= DCXManifestReaderBinaryHeaderLength
+        && memcmp(bytes, DCXManifestReaderBinaryMagic, sizeof(DCXManifestReaderBinaryMagic)) == 0
+        && DCXManifestReaderUInt32At(bytes + 4) == DCXManifestReaderBinaryVersion;
+}
+
+static NSMutableDictionary *DCXManifestReaderReadBinary(DCXManifestReader *reader)
+{
+    if (!DCXManifestReaderHasBinaryHeader(reader->_data)) {
+        DCXManifestReaderFail(reader, @"unknown format or version");
+        return nil;
+    }
+    const uint8_t *header = reader->_start;
+    NSUInteger length = reader->_end - reader->_start;
+    if (DCXManifestReaderUInt64At(header + 8) != DCXManifestReaderChecksum(header + DCXManifestReaderBinaryHeaderLength,
+                                                                          length - DCXManifestReaderBinaryHeaderLength)) {
+        DCXManifestReaderFail(reader, @"checksum mismatch");
+        return nil;
+    }
+    uint32_t keyLength = DCXManifestReaderUInt32At(header + 16);
+    uint32_t stringCount = DCXManifestReaderUInt32At(header + 20);
+    reader->_p = header + DCXManifestReaderBinaryHeaderLength;
+    // Every string takes at least four bytes
+    if (keyLength > length - DCXManifestReaderBinaryHeaderLength
+        || stringCount > (length - DCXManifestReaderBinaryHeaderLength - keyLength) / 4) {
+        DCXManifestReaderFail(reader, @"invalid header");
+        return nil;
+    }
+    reader->_p += keyLength;
+
+    // Read the string table
+    NSMutableArray *strings = [NSMutableArray arrayWithCapacity:stringCount];
+    reader->_stringPointers = (__unsafe_unretained NSString **)calloc(MAX(stringCount, 1), sizeof(NSString *));
+    if (reader->_stringPointers == NULL) {
+        DCXManifestReaderFail(reader, @"out of memory");
+        return nil;
+    }
+    for (uint32_t i = 0; i < stringCount; i++) {
+        uint32_t stringLength;
+        if (!DCXManifestReaderReadUInt32(reader, &stringLength)) {
+            return nil;
+        }
+        if (stringLength > (NSUInteger)(reader->_end - reader->_p)) {
+            DCXManifestReaderFail(reader, @"invalid string length");
+            return nil;
+        }
+        NSString *string = [[NSString alloc] initWithBytes:reader->_p length:stringLength encoding:NSUTF8StringEncoding];
+        if (string == nil) {
+            DCXManifestReaderFail(reader, @"invalid UTF-8");
+            return nil;
+        }
+        [strings addObject:string];
+        reader->_stringPointers[i] = string;
+        reader->_p += stringLength;
+    }
+    reader->_strings = strings;
+
+    NSMutableDictionary *root = nil;
+    if (reader->_p < reader->_end && *reader->_p == DCXManifestReaderBinaryTagDictionary) {
+        reader->_p++;
+        root = [NSMutableDictionary dictionary];
+        if (DCXManifestReaderReadBinaryMembers(reader, root, DCXManifestReaderRoleNode, 0) && reader->_p != reader->_end) {
+            DCXManifestReaderFail(reader, @"unexpected data after the top level dictionary");
+        }
+    } else {
+        DCXManifestReaderFail(reader, @"top level value is not a dictionary");
+    }
+
+    reader->_strings = nil;
+    free(reader->_stringPointers);
+    reader->_stringPointers = NULL;
+    return root;
+}
+
+- (NSData *)binaryKey
+{
+    if (!_isBinary || _data == nil || !DCXManifestReaderHasBinaryHeader(_data)) {
+        return nil;
+    }
+    NSUInteger keyLength = DCXManifestReaderUInt32At((const uint8_t *)_data.bytes + 16);
+    if (keyLength > _data.length - DCXManifestReaderBinaryHeaderLength) {
+        return nil;
+    }
+    return [_data subdataWithRange:NSMakeRange(DCXManifestReaderBinaryHeaderLength, keyLength)];
+}
+
+static void DCXManifestReaderAppendUInt32(NSMutableData *data, uint32_t value)
+{
+    value = OSSwapHostToLittleInt32(value);
+    [data appendBytes:&value length:sizeof(value)];
+}
+
+static void DCXManifestReaderAppendUInt64(NSMutableData *data, uint64_t value)
+{
+    value = OSSwapHostToLittleInt64(value);
+    [data appendBytes:&value length:sizeof(value)];
+}
+
+static void DCXManifestReaderAppendTag(NSMutableData *data, DCXManifestReaderBinaryTag tag)
+{
+    [data appendBytes:&tag length:1];
+}
+
+// Appends the index of string to values. New strings get added to the string table.
+static void DCXManifestReaderEncodeString(NSString *string, NSMutableDictionary *stringIndexes, NSMutableData *strings,
+                                          NSMutableData *values)
+{
+    NSNumber *index = stringIndexes[string];
+    if (index == nil) {
+        index = [NSNumber numberWithUnsignedInteger:stringIndexes.count];
+        stringIndexes[string] = index;
+        NSData *utf8 = [string dataUsingEncoding:NSUTF8StringEncoding];
+        DCXManifestReaderAppendUInt32(strings, (uint32_t)utf8.length);
+        [strings appendData:utf8];
+    }
+    DCXManifestReaderAppendUInt32(values, (uint32_t)index.unsignedIntegerValue);
+}
+
+static BOOL DCXManifestReaderEncodeValue(id value, NSMutableDictionary *stringIndexes, NSMutableData *strings,
+                                         NSMutableData *values)
+{
+    if ([value isKindOfClass:[NSString class]]) {
+        DCXManifestReaderAppendTag(values, DCXManifestReaderBinaryTagString);
+        DCXManifestReaderEncodeString(value, stringIndexes, strings, values);
+    } else if ([value isKindOfClass:[NSDictionary class]]) {
+        DCXManifestReaderAppendTag(values, DCXManifestReaderBinaryTagDictionary);
+        DCXManifestReaderAppendUInt32(values, (uint32_t)[value count]);
+        for (id key in value) {
+            if (![key isKindOfClass:[NSString class]]) {
+                return NO;
+            }
+            DCXManifestReaderEncodeString(key, stringIndexes, strings, values);
+            if (!DCXManifestReaderEncodeValue([value objectForKey:key], stringIndexes, strings, values)) {
+                return NO;
+            }
+        }
+    } else if ([value isKindOfClass:[NSArray class]]) {
+        DCXManifestReaderAppendTag(values, DCXManifestReaderBinaryTagArray);
+        DCXManifestReaderAppendUInt32(values, (uint32_t)[value count]);
+        for (id element in value) {
+            if (!DCXManifestReaderEncodeValue(element, stringIndexes, strings, values)) {
+                return NO;
+            }
+        }
+    } else if ([value isKindOfClass:[NSNumber class]]) {
+        // Booleans are singletons
+        const char *type = [value objCType];
+        if (value == (id)@YES || value == (id)@NO) {
+            DCXManifestReaderAppendTag(values, [value boolValue] ? DCXManifestReaderBinaryTagTrue : DCXManifestReaderBinaryTagFalse);
+        } else if (strcmp(type, @encode(double)) == 0 || strcmp(type, @encode(float)) == 0
+                   || (strcmp(type, @encode(unsigned long long)) == 0 && [value unsignedLongLongValue] > LLONG_MAX)) {
+            double doubleValue = [value doubleValue];
+            uint64_t bits;
+            memcpy(&bits, &doubleValue, sizeof(bits));
+            DCXManifestReaderAppendTag(values, DCXManifestReaderBinaryTagDouble);
+            DCXManifestReaderAppendUInt64(values, bits);
+        } else {
+            DCXManifestReaderAppendTag(values, DCXManifestReaderBinaryTagInteger);
+            DCXManifestReaderAppendUInt64(values, (uint64_t)[value longLongValue]);
+        }
+    } else if (value == [NSNull null]) {
+        DCXManifestReaderAppendTag(values, DCXManifestReaderBinaryTagNull);
+    } else {
+        return NO;
+    }
+    return YES;
+}
+
++ (NSData *)binaryDataWithDictionary:(NSDictionary *)dict key:(NSData *)key
+{
+    NSMutableDictionary *stringIndexes = [NSMutableDictionary dictionary];
+    NSMutableData *strings = [NSMutableData data];
+    NSMutableData *values = [NSMutableData data];
+    if (!DCXManifestReaderEncodeValue(dict, stringIndexes, strings, values)) {
+        return nil;
+    }
+
+    NSMutableData *data = [NSMutableData dataWithCapacity:DCXManifestReaderBinaryHeaderLength + key.length + strings.length + values.length];
+    [data appendBytes:DCXManifestReaderBinaryMagic length:sizeof(DCXManifestReaderBinaryMagic)];
+    DCXManifestReaderAppendUInt32(data, DCXManifestReaderBinaryVersion);
+    DCXManifestReaderAppendUInt64(data, 0); // Checksum, see below
+    DCXManifestReaderAppendUInt32(data, (uint32_t)key.length);
+    DCXManifestReaderAppendUInt32(data, (uint32_t)stringIndexes.count);
+    if (key != nil) {
+        [data appendData:key];
+    }
+    [data appendData:strings];
+    [data appendData:values];
+
+    uint64_t checksum = OSSwapHostToLittleInt64(DCXManifestReaderChecksum((const uint8_t *)data.bytes + DCXManifestReaderBinaryHeaderLength,
+                                                                          data.length - DCXManifestReaderBinaryHeaderLength));
+    [data replaceBytesInRange:NSMakeRange(8, sizeof(checksum)) withBytes:&checksum];
+    return data;
+}
+
+#pragma mark - Reading
+
+- (NSMutableDictionary *)readWithError:(NSError **)errorPtr
+{
+    NSAssert(_start == NULL, @"A reader can only be used once");
+
+    if (_data == nil) {
+        if (errorPtr != NULL) {
+            NSError *missingDataError = [DCXErrorUtils ErrorWithCode:DCXErrorMissingJSONData domain:DCXErrorDomain userInfo:nil];
+            *errorPtr = [DCXErrorUtils ErrorWithCode:DCXErrorInvalidManifest domain:DCXErrorDomain
+                                     underlyingError:missingDataError details:@"Invalid JSON"];
+        }
+        return nil;
+    }
+
+    _start = _p = _data.bytes;
+    _end = _start + _data.length;
+
+    NSMutableDictionary *root = _isBinary ? DCXManifestReaderReadBinary(self) : DCXManifestReaderReadJSON(self);
+
+    // The data may be a mapped file
+    free(_scratch);
+    _scratch = NULL;
+    _scratchCapacity = 0;
+    _data = nil;
+
+    if (_errorReason != nil) {
+        _itemCount = 0;
+        if (errorPtr != NULL) {
+            *errorPtr = [DCXErrorUtils ErrorWithCode:DCXErrorInvalidManifest domain:DCXErrorDomain
+                                             details:[NSString stringWithFormat:@"Invalid %@: %@ at offset %lu",
+                                                      _isBinary ? @"binary manifest" : @"JSON",
+                                                      _errorReason, (unsigned long)_errorOffset]];
+        }
+        return nil;
+    }
+
+    // Keep the DOM alive since _items doesn't retain the dictionaries
+    _root = root;
+    return root;
+}
+
+#pragma mark - Items
+
+- (void)enumerateItemsWithRootId:(NSString *)rootId usingBlock:(DCXManifestReaderItemBlock)block
+{
+    NSAssert(rootId != nil, @"The root id must not be nil");
+
+    // Ids and absolute paths of the nodes by slot. Since the items are in document order the
+    // parent of an item has always been visited before the item itself.
+    NSMutableArray *nodeIds = [NSMutableArray arrayWithCapacity:_nodeCount + 1];
+    NSMutableArray *nodePaths = [NSMutableArray arrayWithCapacity:_nodeCount + 1];
+    [nodeIds addObject:rootId];
+    [nodePaths addObject:@"/"];
+
+    for (NSUInteger i = 0; i < _itemCount; i++) {
+        DCXManifestReaderItem item = _items[i];
+        NSMutableDictionary *dict = item.dict;
+        NSString *itemId = [dict objectForKey:DCXIdManifestKey];
+        if (itemId == nil) {
+            itemId = [[NSUUID UUID] UUIDString];
+            [dict setObject:itemId forKey:DCXIdManifestKey];
+        }
+        NSString *parentPath = nodePaths[item.parentSlot];
+
+        block(dict, item.isComponent, itemId, nodeIds[item.parentSlot], item.index, parentPath);
+
+        if (!item.isComponent) {
+            NSString *path = [dict objectForKey:DCXPathManifestKey];
+            [nodeIds addObject:itemId];
+            [nodePaths addObject:path == nil ? parentPath : [parentPath stringByAppendingPathComponent:path]];
+        }
+    }
+}
+
+@end
@@ -33,7 +33,25 @@
 
 #import "DCXErrorUtils.h"
 
-@implementation DCXMutableBranch
+// The commit log of a manifest gets compacted once it holds this many records or bytes.
+static const NSUInteger DCXCommitLogCompactionRecordCount = 100;
+static const unsigned long long DCXCommitLogCompactionLength = 1024 * 1024;
+
+// Serializes all writes to manifest files and commit logs so that a background compaction can't
+// interfere with a subsequent commit.
+static dispatch_queue_t manifestStorageQueue()
+{
+    static dispatch_queue_t queue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = dispatch_queue_create("DCXManifestStorageQueue", DISPATCH_QUEUE_SERIAL);
+    });
+    return queue;
+}
+
+@implementation DCXMutableBranch {
+    NSUInteger _commitLogRecordCount;
+}
 
 @dynamic name;
 @dynamic type;
@@ -526,20 +544,85 @@
 #pragma mark - Storage
 
 - (BOOL) writeManifestTo:(NSString*)path withError:(NSError **)errorPtr {
-    BOOL success = ( [[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent]
-                                               withIntermediateDirectories:YES
-                                                                attributes:0
-                                                                     error:errorPtr]
-                    && [self.manifest writeToFile:path generateNewSaveId:YES withError:errorPtr] );
+    // Get a strong reference to the composite
+    DCXComposite *composite = self.weakComposite;
+    NSAssert(composite != nil, @"Using branch after the composite has been released");
+    
+    __block BOOL success = NO;
+    __block NSError *error = nil;
+    if (composite.commitsIncrementally && [self.manifest canAppendChangesToCommitLogOfFile:path]) {
+        __block unsigned long long logLength = 0;
+        __block NSNumber *fileNumber = nil;
+        dispatch_sync(manifestStorageQueue(), ^{
+            success = [self.manifest appendChangesToCommitLogOfFile:path logLength:&logLength withError:&error];
+            fileNumber = [[[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil] objectForKey:NSFileSystemFileNumber];
+        });
+        if (success && (++_commitLogRecordCount >= DCXCommitLogCompactionRecordCount
+                        || logLength >= DCXCommitLogCompactionLength)) {
+            [self compactCommitLogOf:path upTo:logLength ifFileNumberIs:fileNumber];
+        }
+    } else {
+        success = [[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent]
+                                            withIntermediateDirectories:YES
+                                                             attributes:0
+                                                                  error:&error];
+        if (success) {
+            dispatch_sync(manifestStorageQueue(), ^{
+                success = [self.manifest writeToFile:path generateNewSaveId:YES withError:&error];
+                if (success) {
+                    // The manifest file now contains all changes so any commit log is obsolete.
+                    [[NSFileManager defaultManager] removeItemAtPath:[DCXManifest commitLogPathForManifestPath:path] error:nil];
+                }
+            });
+            _commitLogRecordCount = 0;
+        }
+    }
     
     if (success) {
-        // Get a strong reference to the composite
-        DCXComposite *composite = self.weakComposite;
-        NSAssert(composite != nil, @"Using branch after the composite has been released");
         [composite requestDeletionOfUnsusedLocalFiles];
+    } else if (errorPtr != NULL) {
+        *errorPtr = error;
     }
     
     return success;
 }
 
+// Writes the current state of the manifest to the manifest file in a background thread and drops the
+// first logLength bytes of the commit log which at that point are contained in the manifest file.
+// Other code paths may replace the manifest file without going through the storage queue in which
+// case fileNumber won't match anymore and the compaction gets skipped.
+- (void) compactCommitLogOf:(NSString*)path upTo:(unsigned long long)logLength ifFileNumberIs:(NSNumber*)fileNumber {
+    NSData *data = self.manifest.localData;
+    NSString *logPath = [DCXManifest commitLogPathForManifestPath:path];
+    
+    _commitLogRecordCount = 0;
+    
+    dispatch_async(manifestStorageQueue(), ^{
+        NSFileManager *fm = [NSFileManager defaultManager];
+        NSNumber *currentFileNumber = [[fm attributesOfItemAtPath:path error:nil] objectForKey:NSFileSystemFileNumber];
+        if (fileNumber == nil || ![fileNumber isEqualToNumber:currentFileNumber]) {
+            return;
+        }
+        if (![data writeToFile:path options:NSDataWritingAtomic error:nil]) {
+            // The commit log still holds all changes so we can just try again later.
+            return;
+        }
+        NSFileHandle *fileHandle = [NSFileHandle fileHandleForReadingAtPath:logPath];
+        NSData *remainingRecords = nil;
+        @try {
+            [fileHandle seekToFileOffset:logLength];
+            remainingRecords = [fileHandle readDataToEndOfFile];
+        }
+        @catch (NSException *exception) {
+            remainingRecords = nil;
+        }
+        [fileHandle closeFile];
+        if (remainingRecords.length == 0) {
+            [fm removeItemAtPath:logPath error:nil];
+        } else {
+            [remainingRecords writeToFile:logPath options:NSDataWritingAtomic error:nil];
+        }
+    });
+}
+
 @end
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class DCXBranch;
+@class DCXComponent;
+
+/**
+ * \brief Protocol for objects that decide which components DCXCompositeXfer pullComposite:... downloads
+ * right away. See DCXComposite prefetchPolicy.
+ *
+ * The components that don't get prefetched are missing their local files after the pull just like the
+ * components of a composite pulled with pullMinimalComposite:. DCXBranch fetchPathForComponent:...
+ * downloads them when they get used.
+ *
+ * Policies get called on arbitrary threads and must not modify the branch.
+ */
+@protocol DCXPrefetchPolicy <NSObject>
+
+/**
+ * \brief Returns whether a component of a pulled branch gets downloaded during the pull.
+ *
+ * \param component The component.
+ * \param branch    The branch that is being pulled.
+ */
+- (BOOL)shouldPrefetchComponent:(DCXComponent *)component ofBranch:(DCXBranch *)branch;
+
+@optional
+
+/**
+ * \brief Returns the rank of a component that gets prefetched. Components with a lower rank get
+ * scheduled for download first. If not implemented all components have the same rank.
+ *
+ * \param component The component.
+ * \param branch    The branch that is being pulled.
+ */
+- (NSInteger)prefetchRankOfComponent:(DCXComponent *)component ofBranch:(DCXBranch *)branch;
+
+@end
+
+/**
+ * \brief A prefetch policy that selects components by the child nodes that contain them, their
+ * relationship, their type and their size.
+ *
+ * A component gets prefetched if it satisfies all the criteria that have been set. A policy without
+ * any criteria prefetches all components, which is what pullComposite:... does without a policy.
+ * Components whose relationship is listed in rankedRelationships get downloaded first, in the order
+ * of that list, so e.g. @[ @"thumbnail", @"rendition" ] gets the components that are needed to
+ * display a composite onto the disk as soon as possible.
+ */
+@interface DCXComponentPrefetchPolicy : NSObject <DCXPrefetchPolicy>
+
+/** If not nil only components inside the subtrees of the child nodes with these ids get prefetched.
+ * The id of the root node selects all components. */
+@property (nonatomic, copy) NSSet *nodeIds;
+
+/** If not nil only components with one of these relationships get prefetched. */
+@property (nonatomic, copy) NSSet *relationships;
+
+/** If not nil only components with one of these types get prefetched. A type ending in "/*" such as
+ * "image/*" matches all types with the given prefix. */
+@property (nonatomic, copy) NSSet *types;
+
+/** If not nil only components whose length doesn't exceed this number of bytes get prefetched.
+ * Components of unknown length pass. */
+@property (nonatomic, copy) NSNumber *maxLength;
+
+/** The relationships of the components that get downloaded first, most important first. */
+@property (nonatomic, copy) NSArray *rankedRelationships;
+
+@end
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#import "DCXPrefetchPolicy.h"
+
+#import "DCXBranch.h"
+#import "DCXComponent.h"
+#import "DCXNode.h"
+
+@implementation DCXComponentPrefetchPolicy
+
+- (BOOL)shouldPrefetchComponent:(DCXComponent *)component ofBranch:(DCXBranch *)branch
+{
+    if (self.relationships != nil && ![self.relationships containsObject:component.relationship]) {
+        return NO;
+    }
+    if (self.types != nil && ![self matchesType:component.type]) {
+        return NO;
+    }
+    if (self.maxLength != nil && component.length != nil
+        && component.length.unsignedLongLongValue > self.maxLength.unsignedLongLongValue) {
+        return NO;
+    }
+    if (self.nodeIds != nil) {
+        // Walk up from the parent of the component until we hit one of the nodes
+        DCXNode *node = [branch findParentOfComponent:component];
+        while (node != nil) {
+            if ([self.nodeIds containsObject:node.nodeId]) {
+                return YES;
+            }
+            node = node.isRoot ? nil : [branch findParentOfChild:node foundIndex:NULL];
+        }
+        return NO;
+    }
+    return YES;
+}
+
+- (NSInteger)prefetchRankOfComponent:(DCXComponent *)component ofBranch:(DCXBranch *)branch
+{
+    NSUInteger index = component.relationship != nil ? [self.rankedRelationships indexOfObject:component.relationship]
+                                                     : NSNotFound;
+    return index != NSNotFound ? (NSInteger)index : (NSInteger)self.rankedRelationships.count;
+}
+
+- (BOOL)matchesType:(NSString *)type
+{
+    if (type == nil) {
+        return NO;
+    }
+    for (NSString *pattern in self.types) {
+        if ([pattern hasSuffix:@"/*"] ? [type hasPrefix:[pattern substringToIndex:pattern.length - 1]]
+                                      : [type isEqualToString:pattern]) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+@end
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import <Foundation/Foundation.h>
+
+@class DCXComposite;
+@class DCXComponent;
+
+/**
+ \brief Records the progress of the component downloads of a pull so that a pull that gets
+ interrupted (e.g. because the app gets terminated or the network goes away) can be resumed without
+ downloading the components again that had already been downloaded.
+ 
+ For every downloaded component the journal records its etag, its length and the storage id of the
+ downloaded file. For every failed download that can be resumed it keeps the resume data of the
+ download (see DCXErrorUtils ResumeDataOfError:).
+ 
+ The journal is an append-only log of JSON records, one per line, so that recording a download
+ only requires a small append. Lines that can't be parsed (e.g. because a crash cut them short) get
+ ignored. The resume data gets stored in separate files in a directory next to the journal file.
+ */
+@interface DCXPullJournal : NSObject
+
+/**
+ \brief Creates a file-backed journal for composite initialized from the contents of filePath (if the file
+ exists).
+ 
+ \param composite   The DCXComposite the journal is for.
+ \param filePath    The path were the journal should be persisted to. If there is already a file at
+ filePath its contents are going to be read in to initialize the journal.
+ \param errorPtr    Gets set to an NSError if an error occurs. Can be nil.
+ 
+ \return            The newly created journal.
+ 
+ \note Like DCXPushJournal this method returns an empty journal if the file can't be read or
+ belongs to a different composite since the loss of the journal only means that components get
+ downloaded again. The errorPtr param is for informational purposes only.
+ */
++(instancetype) journalForComposite:(DCXComposite*)composite persistedAt:(NSString*)filePath error:(NSError**)errorPtr;
+
+/**
+ \brief Deletes the journal file at filePath together with its resume data.
+ 
+ \param filePath    The path of the journal.
+ \param errorPtr    Gets set to an NSError if an error occurs. Can be nil.
+ 
+ \return            YES if successful or if there was no journal.
+ */
++(BOOL) removeJournalAtPath:(NSString*)filePath withError:(NSError**)errorPtr;
+
+
+/** A path for a file to be used to persist the journal to. */
+@property (readonly) NSString* filePath;
+
+
+/** The href of the associated composite. */
+@property (readonly) NSString* compositeHref;
+
+
+/** Is YES if the journal doesn't contain any records. */
+@property (readonly) BOOL isEmpty;
+
+/**
+ \brief Records that component has been downloaded to the file with the given storage id.
+ 
+ \param component The downloaded DCXComponent.
+ \param storageId The storage id of the file the component has been downloaded to.
+ 
+ Also discards the resume data of component. This method synchronizes access to the journal's
+ underlying storage and thus can be called from different threads.
+ */
+-(void) recordDownloadedComponent:(DCXComponent*)component withStorageId:(NSString*)storageId;
+
+/**
+ \brief Returns the storage id of the file that component has been downloaded to.
+ 
+ \param component The component in question.
+ 
+ \return The storage id recorded by recordDownloadedComponent:withStorageId: or nil if the
+ component hasn't been downloaded or the recorded download has a different etag or length.
+ */
+-(NSString*) storageIdOfDownloadedComponent:(DCXComponent*)component;
+
+/**
+ \brief Keeps the resume data of a failed download of component.
+ 
+ \param resumeData The resume data.
+ \param component  The component whose download has failed.
+ 
+ This method synchronizes access to the journal's underlying storage and thus can be called from
+ different threads.
+ */
+-(void) recordResumeData:(NSData*)resumeData forComponent:(DCXComponent*)component;
+
+/**
+ \brief Returns and discards the resume data of component. Resume data can only be used once.
+ 
+ \param component The component to download.
+ 
+ \return The resume data recorded by recordResumeData:forComponent: or nil if there is none for
+ the etag of component.
+ */
+-(NSData*) takeResumeDataForComponent:(DCXComponent*)component;
+
+@end
@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import "DCXPullJournal.h"
+
+#import "DCXComposite.h"
+#import "DCXComponent.h"
+#import "DCXError.h"
+
+#import "DCXErrorUtils.h"
+#import "DCXFileUtils.h"
+
+// Keys used in the header line of a pull journal
+NSString *const DCXPullJournalFormatVersionKey              = @"pull-journal-format-version";
+NSString *const DCXPullJournalCompositeHrefKey              = @"composite-href";
+
+// Keys used in the records of a pull journal
+NSString *const DCXPullJournalComponentIdKey                = @"component-id";
+NSString *const DCXPullJournalDownloadedKey                 = @"downloaded";
+NSString *const DCXPullJournalResumeKey                     = @"resume";
+NSString *const DCXPullJournalEtagKey                       = @"etag";
+NSString *const DCXPullJournalLengthKey                     = @"length";
+NSString *const DCXPullJournalStorageIdKey                  = @"storage-id";
+NSString *const DCXPullJournalFileKey                       = @"file";
+
+// The journal gets rewritten when it is loaded if less than half of its records are still relevant
+static const NSUInteger DCXPullJournalMinRecordsToCompact   = 64;
+
+@implementation DCXPullJournal{
+    
+    NSString *_compositeHref;
+    
+    // Component id -> the latest downloaded/resume record of the component
+    NSMutableDictionary *_downloadedComponents;
+    NSMutableDictionary *_resumeData;
+    
+    NSFileHandle *_fileHandle;
+}
+
+-(instancetype) initWithCompositeHref:(NSString*)href andPath:(NSString*)filePath
+{
+    if (self = [super init]) {
+        _filePath = filePath;
+        _compositeHref = href;
+        _downloadedComponents = [NSMutableDictionary dictionary];
+        _resumeData = [NSMutableDictionary dictionary];
+    }
+    
+    return self;
+}
+
+-(void) dealloc
+{
+    [_fileHandle closeFile];
+}
+
+-(NSString*) resumeDataDirectory
+{
+    return [_filePath stringByAppendingPathExtension:@"resume"];
+}
+
++(instancetype) journalForComposite:(DCXComposite *)composite persistedAt:(NSString*)filePath error:(NSError**)errorPtr
+{
+    NSAssert(composite != nil, @"Parameter composite must not be nil");
+    NSAssert(filePath != nil, @"Parameter filePath must not be nil");
+    
+    DCXPullJournal *journal = [[self alloc] initWithCompositeHref:composite.href andPath:filePath];
+    
+    if ([[NSFileManager defaultManager] fileExistsAtPath:filePath]) {
+        NSError *error = nil;
+        NSData *data = [NSData dataWithContentsOfFile:filePath options:0 error:&error];
+        if (data == nil) {
+            error = [DCXErrorUtils ErrorWithCode:DCXErrorInvalidJournal domain:DCXErrorDomain
+                                 underlyingError:error path:filePath details:@"Failed to read from journal file."];
+        } else {
+            [journal readData:data forComposite:composite withError:&error];
+        }
+        if (error != nil) {
+            // Start over with an empty journal
+            [self removeJournalAtPath:filePath withError:nil];
+            journal = [[self alloc] initWithCompositeHref:composite.href andPath:filePath];
+            if (errorPtr != NULL) *errorPtr = error;
+        }
+    }
+    
+    return journal;
+}
+
++(BOOL) removeJournalAtPath:(NSString*)filePath withError:(NSError**)errorPtr
+{
+    NSFileManager *fm = [NSFileManager defaultManager];
+    NSString *resumeDataDirectory = [filePath stringByAppendingPathExtension:@"resume"];
+    
+    if ([fm fileExistsAtPath:resumeDataDirectory] && ![fm removeItemAtPath:resumeDataDirectory error:errorPtr]) {
+        return NO;
+    }
+    return ![fm fileExistsAtPath:filePath] || [fm removeItemAtPath:filePath error:errorPtr];
+}
+
+// Replays the records of data. Sets errorPtr if the header doesn't match composite.
+-(BOOL) readData:(NSData*)data forComposite:(DCXComposite*)composite withError:(NSError**)errorPtr
+{
+    __block NSUInteger recordCount = 0;
+    __block BOOL haveHeader = NO;
+    __block NSError *error = nil;
+    
+    [DCXFileUtils enumerateLogRecordsOfData:data options:0 usingBlock:^(NSDictionary *record, BOOL *stop) {
+        if (!haveHeader) {
+            NSNumber *journalFormatVersion = [record objectForKey:DCXPullJournalFormatVersionKey];
+            NSString *href = [record objectForKey:DCXPullJournalCompositeHrefKey];
+            if (![journalFormatVersion isEqual:@1]) {
+                error = [DCXErrorUtils ErrorWithCode:DCXErrorInvalidJournal domain:DCXErrorDomain
+                                             details:[NSString stringWithFormat:@"Format version expected: %@ -- found: %@.", @1, journalFormatVersion]];
+                *stop = YES;
+            } else if (composite.href != nil && href != nil && ![href isEqualToString:composite.href]) {
+                error = [DCXErrorUtils ErrorWithCode:DCXErrorInvalidJournal domain:DCXErrorDomain
+                                             details:@"Composite's and journal's hrefs don't match."];
+                *stop = YES;
+            }
+            haveHeader = YES;
+            return;
+        }
+        
+        NSString *componentId = [record objectForKey:DCXPullJournalComponentIdKey];
+        if (![componentId isKindOfClass:[NSString class]]) {
+            return;
+        }
+        recordCount++;
+        NSDictionary *downloaded = [record objectForKey:DCXPullJournalDownloadedKey];
+        NSDictionary *resume = [record objectForKey:DCXPullJournalResumeKey];
+        if ([downloaded isKindOfClass:[NSDictionary class]]) {
+            _downloadedComponents[componentId] = downloaded;
+            [_resumeData removeObjectForKey:componentId];
+        } else if ([resume isKindOfClass:[NSDictionary class]]) {
+            _resumeData[componentId] = resume;
+        } else {
+            [_resumeData removeObjectForKey:componentId];
+        }
+    }];
+    
+    if (error == nil && !haveHeader) {
+        error = [DCXErrorUtils ErrorWithCode:DCXErrorInvalidJournal domain:DCXErrorDomain
+                                     details:@"Failed to parse the journal data."];
+    }
+    if (error != nil) {
+        if (errorPtr != NULL) *errorPtr = error;
+        return NO;
+    }
+    
+    if (recordCount >= DCXPullJournalMinRecordsToCompact
+        && recordCount > 2 * (_downloadedComponents.count + _resumeData.count)) {
+        [self compact];
+    }
+    return YES;
+}
+
+-(NSData*) headerData
+{
+    NSMutableDictionary *header = [NSMutableDictionary dictionaryWithObject:@1 forKey:DCXPullJournalFormatVersionKey];
+    if (_compositeHref != nil) {
+        header[DCXPullJournalCompositeHrefKey] = _compositeHref;
+    }
+    return [NSJSONSerialization dataWithJSONObject:header options:0 error:nil];
+}
+
+// Rewrites the journal file with just the records that are still relevant. Must be called while holding
+// the lock on self.
+-(void) compact
+{
+    NSMutableData *data = [NSMutableData dataWithData:[self headerData]];
+    for (NSString *componentId in _downloadedComponents) {
+        [data appendData:[DCXFileUtils dataOfLogRecord:@{ DCXPullJournalComponentIdKey: componentId,
+                                                          DCXPullJournalDownloadedKey: _downloadedComponents[componentId] }]];
+    }
+    for (NSString *componentId in _resumeData) {
+        [data appendData:[DCXFileUtils dataOfLogRecord:@{ DCXPullJournalComponentIdKey: componentId,
+                                                          DCXPullJournalResumeKey: _resumeData[componentId] }]];
+    }
+    [_fileHandle closeFile];
+    _fileHandle = nil;
+    [data writeToFile:_filePath options:NSDataWritingAtomic error:nil];
+}
+
+// Appends record to the journal file. Creates the file if necessary. Must be called while holding
+// the lock on self.
+-(void) appendRecord:(NSDictionary*)record
+{
+    if (_fileHandle == nil) {
+        if (![[NSFileManager defaultManager] fileExistsAtPath:_filePath]
+            && ![[self headerData] writeToFile:_filePath options:NSDataWritingAtomic error:nil]) {
+            return;
+        }
+        _fileHandle = [NSFileHandle fileHandleForWritingAtPath:_filePath];
+    }
+    @try {
+        [_fileHandle seekToEndOfFile];
+        [_fileHandle writeData:[DCXFileUtils dataOfLogRecord:record]];
+    } @catch (NSException *exception) {
+        // Losing a record only means that a component gets downloaded again
+        [_fileHandle closeFile];
+        _fileHandle = nil;
+    }
+}
+
+-(NSString*) compositeHref
+{
+    return _compositeHref;
+}
+
+-(BOOL) isEmpty
+{
+    @synchronized(self) {
+        return _downloadedComponents.count == 0 && _resumeData.count == 0;
+    }
+}
+
+-(void) recordDownloadedComponent:(DCXComponent*)component withStorageId:(NSString*)storageId
+{
+    NSAssert(component != nil, @"Parameter component must not be nil");
+    NSAssert(storageId != nil, @"Parameter storageId must not be nil");
+    
+    if (component.etag == nil) {
+        return;
+    }
+    NSMutableDictionary *downloaded = [NSMutableDictionary dictionaryWithCapacity:3];
+    downloaded[DCXPullJournalEtagKey] = component.etag;
+    downloaded[DCXPullJournalStorageIdKey] = storageId;
+    if (component.length != nil) {
+        downloaded[DCXPullJournalLengthKey] = component.length;
+    }
+    
+    @synchronized(self) {
+        [self discardResumeDataOfComponentWithId:component.componentId];
+        _downloadedComponents[component.componentId] = downloaded;
+        [self appendRecord:@{ DCXPullJournalComponentIdKey: component.componentId,
+                              DCXPullJournalDownloadedKey: downloaded }];
+    }
+}
+
+-(NSString*) storageIdOfDownloadedComponent:(DCXComponent*)component
+{
+    NSDictionary *downloaded = nil;
+    @synchronized(self) {
+        downloaded = _downloadedComponents[component.componentId];
+    }
+    
+    if (downloaded == nil || component.etag == nil || ![downloaded[DCXPullJournalEtagKey] isEqual:component.etag]) {
+        return nil;
+    }
+    NSNumber *length = downloaded[DCXPullJournalLengthKey];
+    if (component.length != nil && length != nil && ![length isEqual:component.length]) {
+        return nil;
+    }
+    NSString *storageId = downloaded[DCXPullJournalStorageIdKey];
+    return [storageId isKindOfClass:[NSString class]] ? storageId : nil;
+}
+
+-(void) recordResumeData:(NSData*)resumeData forComponent:(DCXComponent*)component
+{
+    NSAssert(resumeData != nil, @"Parameter resumeData must not be nil");
+    NSAssert(component != nil, @"Parameter component must not be nil");
+    
+    if (component.etag == nil) {
+        return;
+    }
+    NSString *fileName = [[NSUUID UUID] UUIDString];
+    NSString *dir = [self resumeDataDirectory];
+    [[NSFileManager defaultManager] createDirectoryAtPath:dir withIntermediateDirectories:YES attributes:nil error:nil];
+    if (![resumeData writeToFile:[dir stringByAppendingPathComponent:fileName] options:NSDataWritingAtomic error:nil]) {
+        return;
+    }
+    NSDictionary *resume = @{ DCXPullJournalEtagKey: component.etag, DCXPullJournalFileKey: fileName };
+    
+    @synchronized(self) {
+        [self discardResumeDataOfComponentWithId:component.componentId];
+        _resumeData[component.componentId] = resume;
+        [self appendRecord:@{ DCXPullJournalComponentIdKey: component.componentId,
+                              DCXPullJournalResumeKey: resume }];
+    }
+}
+
+-(NSData*) takeResumeDataForComponent:(DCXComponent*)component
+{
+    NSData *resumeData = nil;
+    @synchronized(self) {
+        NSDictionary *resume = _resumeData[component.componentId];
+        if (resume == nil) {
+            return nil;
+        }
+        NSString *path = [self pathOfResumeDataFile:resume[DCXPullJournalFileKey]];
+        if (path != nil && component.etag != nil && [resume[DCXPullJournalEtagKey] isEqual:component.etag]) {
+            resumeData = [NSData dataWithContentsOfFile:path];
+        }
+        [self discardResumeDataOfComponentWithId:component.componentId];
+        [self appendRecord:@{ DCXPullJournalComponentIdKey: component.componentId }];
+    }
+    return resumeData;
+}
+
+-(NSString*) pathOfResumeDataFile:(NSString*)fileName
+{
+    if (![fileName isKindOfClass:[NSString class]] || fileName.length == 0) {
+        return nil;
+    }
+    return [[self resumeDataDirectory] stringByAppendingPathComponent:[fileName lastPathComponent]];
+}
+
+// Must be called while holding the lock on self.
+-(void) discardResumeDataOfComponentWithId:(NSString*)componentId
+{
+    NSDictionary *resume = _resumeData[componentId];
+    if (resume == nil) {
+        return;
+    }
+    [_resumeData removeObjectForKey:componentId];
+    NSString *path = [self pathOfResumeDataFile:resume[DCXPullJournalFileKey]];
+    if (path != nil) {
+        [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    }
+}
+
+@end
@@ -92,6 +92,15 @@
 /** Is YES if the push has completed successfully. */
 @property (readonly) BOOL isComplete;
 
+/** The number of component records that get buffered before they get appended to the log file of
+ the journal. Defaults to 32. */
+@property (nonatomic) NSUInteger flushCount;
+
+
+/** The maximum time in seconds that component records get buffered before they get appended to the
+ log file of the journal. Defaults to 1 second. A value of 0 disables time-based flushing. */
+@property (nonatomic) NSTimeInterval flushInterval;
+
 /** The etag of current branch from the most recent call to pushComposite. */
 @property (readonly) NSString *currentBranchEtag;
 
@@ -148,6 +157,32 @@
  */
 -(DCXMutableComponent*) getUploadedComponent:(DCXComponent*)component fromPath:(NSString*)filePath;
 
+/**
+ \brief Records the state of an unfinished chunked upload of the component so that a later push can
+ resume it (see DCXChunkedUpload).
+ 
+ \param uploadSession The state of the upload as passed to a DCXUploadSessionHandler. Pass nil to
+ discard the recorded state.
+ \param component     The DCXComponent that is being uploaded.
+ \param filePath      The file that is being uploaded.
+ 
+ The state gets discarded when the upload of the component gets recorded with
+ recordUploadedComponent:fromPath:. This method synchronizes access to the journal's underlying
+ storage and thus can be called from different threads.
+ */
+-(void) recordUploadSession:(NSDictionary*)uploadSession forComponent:(DCXComponent*)component fromPath:(NSString*)filePath;
+
+/**
+ \brief Returns the state of an unfinished chunked upload of the component.
+ 
+ \param component The component in question.
+ \param filePath  The file to upload.
+ 
+ \return The state recorded by recordUploadSession:forComponent:fromPath: or nil if there is none
+ for filePath.
+ */
+-(NSDictionary*) uploadSessionForComponent:(DCXComponent*)component fromPath:(NSString*)filePath;
+
 
 /**
  \brief Clears the journaled component state by removing the component from lists
@@ -160,6 +195,19 @@
  */
 -(void) clearComponent:(DCXComponent*)component;
 
+/**
+ \brief Appends all buffered component records to the log file of the journal.
+ 
+ \param errorPtr Gets set to an NSError if something goes wrong.
+ 
+ \return YES if successful.
+ 
+ Changes to the uploaded components get buffered and appended to a log file next to the journal
+ file in batches (see flushCount and flushInterval). All other changes (e.g. recordUploadedManifest:)
+ rewrite the journal file and discard the log.
+ */
+-(BOOL) flushWithError:(NSError**)errorPtr;
+
 /**
  \brief Sets the composite href to the given NSURL.
  
@@ -30,6 +30,7 @@
 
 #import "DCXCopyUtils.h"
 #import "DCXErrorUtils.h"
+#import "DCXFileUtils.h"
 #import "DCXUtils.h"
 
 // Keys used in a push context
@@ -44,6 +45,18 @@ NSString *const DCXPushJournalVersionKey                    = @"version";
 NSString *const DCXPushJournalFileKey                       = @"file";
 NSString *const DCXPushJournalPushCompletedKey              = @"push-completed";
 NSString *const DCXPushJournalCurrentBranchEtagKey          = @"current-branch-etag";
+NSString *const DCXPushJournalLogGenerationKey              = @"log-generation";
+NSString *const DCXPushJournalUploadSessionsKey             = @"upload-sessions";
+NSString *const DCXPushJournalUploadSessionKey              = @"session";
+
+// Keys used in the records of the log of a push journal
+NSString *const DCXPushJournalLogComponentIdKey             = @"component-id";
+NSString *const DCXPushJournalLogUploadedKey                = @"uploaded";
+NSString *const DCXPushJournalLogUploadSessionKey           = @"upload-session";
+
+// Default batching of the log of a push journal
+static const NSUInteger DCXPushJournalDefaultFlushCount     = 32;
+static const NSTimeInterval DCXPushJournalDefaultFlushInterval = 1.0;
 
 @implementation DCXPushJournal{
     
@@ -51,7 +64,21 @@ NSString *const DCXPushJournalCurrentBranchEtagKey          = @"current-branch-e
     
     NSMutableDictionary *_uploadedComponents;
     
+    // Component id -> file and state of an unfinished chunked upload of the component
+    NSMutableDictionary *_uploadSessions;
+    
     DCXComposite __weak *_weakComposite;
+    
+    // Component records that haven't been appended to the log file yet. Changes to the uploaded
+    // components get appended to the log file in batches while everything else causes the whole
+    // journal to be written (which also truncates the log). Records only apply to the journal file
+    // whose generation they carry.
+    NSMutableData *_pendingRecords;
+    NSUInteger _pendingRecordCount;
+    NSString *_generation;
+    
+    // Serializes writes to the journal and log files. Must not be acquired while holding the lock on self.
+    NSObject *_fileLock;
 }
 
 // Private method used for testing only
@@ -68,11 +95,34 @@ NSString *const DCXPushJournalCurrentBranchEtagKey          = @"current-branch-e
         _weakComposite = composite;
         
         _uploadedComponents = [_dict objectForKey:DCXPushJournalComponentsUploadedKey];
+        _uploadSessions = [_dict objectForKey:DCXPushJournalUploadSessionsKey];
+        if (_uploadSessions == nil) {
+            // Journals written before chunked uploads don't have this section
+            _uploadSessions = [NSMutableDictionary dictionary];
+            [_dict setObject:_uploadSessions forKey:DCXPushJournalUploadSessionsKey];
+        }
+        
+        _pendingRecords = [NSMutableData data];
+        _pendingRecordCount = 0;
+        _generation = [_dict objectForKey:DCXPushJournalLogGenerationKey];
+        _fileLock = [[NSObject alloc] init];
+        _flushCount = DCXPushJournalDefaultFlushCount;
+        _flushInterval = DCXPushJournalDefaultFlushInterval;
     }
     
     return self;
 }
 
+-(void) dealloc
+{
+    [self flushWithError:nil];
+}
+
+-(NSString*) logFilePath
+{
+    return [_filePath stringByAppendingPathExtension:@"log"];
+}
+
 -(instancetype) initWithComposite:(DCXComposite *)composite data:(NSData*)data path:(NSString*)filePath
          failIfInvalid:(BOOL)failIfInvalid withError:(NSError**)errorPtr
 {
@@ -106,7 +156,9 @@ NSString *const DCXPushJournalCurrentBranchEtagKey          = @"current-branch-e
     }
     
     if (error == nil) {
-        return [self initWithDictionary:dict andPath:filePath andComposite:composite];
+        self = [self initWithDictionary:dict andPath:filePath andComposite:composite];
+        [self replayLog];
+        return self;
     } else {
         if (errorPtr != nil) *errorPtr = error;
         if (failIfInvalid) {
@@ -228,6 +280,7 @@ NSString *const DCXPushJournalCurrentBranchEtagKey          = @"current-branch-e
 -(BOOL) isEmpty
 {
     return _dict == nil || (  [[_dict objectForKey:DCXPushJournalComponentsUploadedKey] count] == 0
+                           && _uploadSessions.count == 0
                            && !self.isComplete);
 }
 
@@ -260,12 +313,7 @@ NSString *const DCXPushJournalCurrentBranchEtagKey          = @"current-branch-e
     }
     [componentData setObject:filePath forKey:DCXPushJournalFileKey];
     
-    @synchronized(self) {
-        
-        [_uploadedComponents setObject:componentData forKey:component.componentId];
-        [self clearPushCompleted]; // mark the journal as being incomplete
-        [self writeToFileWithError:nil];
-    }
+    [self updateUploadedComponentWithId:component.componentId withData:componentData];
 }
 
 -(BOOL) hasUploadedComponent:(DCXComponent *)component fromPath:(NSString*)filePath
@@ -290,37 +338,219 @@ NSString *const DCXPushJournalCurrentBranchEtagKey          = @"current-branch-e
             if (filePath == nil || [componentRecord[DCXPushJournalFileKey] isEqualToString:filePath]) {
                 result = [component mutableCopy];
                 [self copyPropertiesFrom:componentRecord toComponent:result];
-            } else {
-                // We have previously pushed a different file so we clear this entry
-                [_uploadedComponents removeObjectForKey:component.componentId];
-                [self clearPushCompleted]; // mark the journal as being incomplete
-                [self writeToFileWithError:nil];
             }
         }
     }
     
+    if (result == nil && filePath != nil) {
+        // We might have previously pushed a different file in which case we clear this entry
+        [self updateUploadedComponentWithId:component.componentId withData:nil];
+    }
+    
     return result;
 }
 
 -(void) clearComponent:(DCXComponent*)component
 {
+    [self updateUploadedComponentWithId:component.componentId withData:nil];
+}
+
+// Records componentData (or the removal of the entry if componentData is nil) for the component with
+// the given id. Marks the journal as being incomplete.
+-(void) updateUploadedComponentWithId:(NSString*)componentId withData:(NSDictionary*)componentData
+{
+    BOOL wasComplete = NO;
+    BOOL needsFlush = NO;
+    
     @synchronized(self) {
-        [_uploadedComponents removeObjectForKey:component.componentId];
+        if (componentData == nil && [_uploadedComponents objectForKey:componentId] == nil) {
+            return;
+        }
         
+        wasComplete = [_dict objectForKey:DCXPushJournalPushCompletedKey] != nil;
+        if (componentData == nil) {
+            [_uploadedComponents removeObjectForKey:componentId];
+        } else {
+            [_uploadedComponents setObject:componentData forKey:componentId];
+            // The upload has been completed
+            [_uploadSessions removeObjectForKey:componentId];
+        }
         [self clearPushCompleted]; // mark the journal as being incomplete
+        
+        NSMutableDictionary *record = [NSMutableDictionary dictionaryWithObject:componentId forKey:DCXPushJournalLogComponentIdKey];
+        if (componentData != nil) {
+            [record setObject:componentData forKey:DCXPushJournalLogUploadedKey];
+        }
+        needsFlush = [self appendRecord:record];
+    }
+    
+    if (wasComplete) {
+        // The completion of the push must not get lost since the pushed manifest has been discarded
         [self writeToFileWithError:nil];
+    } else if (needsFlush) {
+        [self flushWithError:nil];
     }
 }
 
+-(void) recordUploadSession:(NSDictionary*)uploadSession forComponent:(DCXComponent*)component fromPath:(NSString*)filePath
+{
+    BOOL needsFlush = NO;
+    
+    @synchronized(self) {
+        NSString *componentId = component.componentId;
+        NSMutableDictionary *record = [NSMutableDictionary dictionaryWithObject:componentId forKey:DCXPushJournalLogComponentIdKey];
+        if (uploadSession == nil || filePath == nil) {
+            if ([_uploadSessions objectForKey:componentId] == nil) {
+                return;
+            }
+            [_uploadSessions removeObjectForKey:componentId];
+            [record setObject:[NSNull null] forKey:DCXPushJournalLogUploadSessionKey];
+        } else {
+            NSDictionary *sessionData = @{ DCXPushJournalFileKey: filePath,
+                                           DCXPushJournalUploadSessionKey: uploadSession };
+            [_uploadSessions setObject:sessionData forKey:componentId];
+            [record setObject:sessionData forKey:DCXPushJournalLogUploadSessionKey];
+        }
+        needsFlush = [self appendRecord:record];
+    }
+    
+    if (needsFlush) {
+        [self flushWithError:nil];
+    }
+}
 
--(BOOL) writeToFileWithError:(NSError**)errorPtr
+-(NSDictionary*) uploadSessionForComponent:(DCXComponent*)component fromPath:(NSString*)filePath
 {
-    NSString *fileToWriteTo = self.filePath;
+    @synchronized(self) {
+        NSDictionary *sessionData = [_uploadSessions objectForKey:component.componentId];
+        if (sessionData != nil && [sessionData[DCXPushJournalFileKey] isEqual:filePath]) {
+            return sessionData[DCXPushJournalUploadSessionKey];
+        }
+        return nil;
+    }
+}
+
+// Adds record to the records that get appended to the log file with the next flush and schedules the
+// flush. Returns YES if the caller needs to flush right away. Must be called while holding the lock on self.
+-(BOOL) appendRecord:(NSMutableDictionary*)record
+{
+    if (_generation != nil) {
+        [record setObject:_generation forKey:DCXPushJournalLogGenerationKey];
+    }
+    [_pendingRecords appendData:[DCXFileUtils dataOfLogRecord:record]];
+    _pendingRecordCount++;
+    BOOL needsFlush = _pendingRecordCount >= _flushCount;
+    
+    if (_pendingRecordCount == 1 && !needsFlush && _flushInterval > 0) {
+        DCXPushJournal __weak *weakSelf = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_flushInterval * NSEC_PER_SEC)),
+                       dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+                           [weakSelf flushWithError:nil];
+                       });
+    }
+    return needsFlush;
+}
+
+-(BOOL) flushWithError:(NSError**)errorPtr
+{
+    @synchronized(_fileLock) {
+        NSData *records = nil;
+        BOOL hasJournalFile = NO;
+        @synchronized(self) {
+            if (_pendingRecordCount == 0) {
+                return YES;
+            }
+            hasJournalFile = _generation != nil;
+            if (hasJournalFile) {
+                records = _pendingRecords;
+                _pendingRecords = [NSMutableData data];
+                _pendingRecordCount = 0;
+            }
+        }
+        
+        NSFileManager *fm = [NSFileManager defaultManager];
+        if (!hasJournalFile || ![fm fileExistsAtPath:self.filePath]) {
+            // The records can only be replayed on top of a journal file so we need to write that first
+            return [self writeToFileWithError:errorPtr];
+        }
+        
+        NSString *logPath = self.logFilePath;
+        BOOL success = [DCXFileUtils appendData:records toFile:logPath resultingLength:NULL];
+        
+        if (!success) {
+            if (errorPtr != NULL) {
+                *errorPtr = [DCXErrorUtils ErrorWithCode:DCXErrorInvalidJournal domain:DCXErrorDomain
+                                                  underlyingError:nil path:logPath details:@"Failed to append to the journal log."];
+            }
+            // Fall back to writing the whole journal
+            return [self writeToFileWithError:nil];
+        }
+        
+        return YES;
+    }
+}
+
+-(void) replayLog
+{
+    if (_generation == nil || _filePath == nil) {
+        return;
+    }
     
-    // Make sure the directory we write to exists
-    NSString *destDir = [fileToWriteTo stringByDeletingLastPathComponent];
-    return [[NSFileManager defaultManager] createDirectoryAtPath:destDir withIntermediateDirectories:YES attributes:nil error:errorPtr]
-                    && [self.data writeToFile:self.filePath options:NSDataWritingAtomic error:errorPtr];
+    NSData *logData = [NSData dataWithContentsOfFile:self.logFilePath];
+    [DCXFileUtils enumerateLogRecordsOfData:logData options:NSJSONReadingMutableContainers
+                                 usingBlock:^(NSDictionary *record, BOOL *stop) {
+        // Skip records that belong to a previous generation of the journal file
+        NSString *componentId = [record objectForKey:DCXPushJournalLogComponentIdKey];
+        if (componentId == nil || ![[record objectForKey:DCXPushJournalLogGenerationKey] isEqual:_generation]) {
+            return;
+        }
+        id sessionData = [record objectForKey:DCXPushJournalLogUploadSessionKey];
+        if (sessionData != nil) {
+            // Progress of a chunked upload
+            if ([sessionData isKindOfClass:[NSDictionary class]]) {
+                [_uploadSessions setObject:sessionData forKey:componentId];
+            } else {
+                [_uploadSessions removeObjectForKey:componentId];
+            }
+        } else {
+            NSDictionary *componentData = [record objectForKey:DCXPushJournalLogUploadedKey];
+            if (componentData == nil) {
+                [_uploadedComponents removeObjectForKey:componentId];
+            } else {
+                [_uploadedComponents setObject:componentData forKey:componentId];
+                [_uploadSessions removeObjectForKey:componentId];
+            }
+            [_dict removeObjectForKey:DCXPushJournalPushCompletedKey];
+        }
+    }];
+}
+
+-(BOOL) writeToFileWithError:(NSError**)errorPtr
+{
+    @synchronized(_fileLock) {
+        NSData *data = nil;
+        @synchronized(self) {
+            // Start a new generation which invalidates all records in the current log. Pending records
+            // are obsolete as well since they are contained in the data we are about to write.
+            _generation = [[NSUUID UUID] UUIDString];
+            [_dict setObject:_generation forKey:DCXPushJournalLogGenerationKey];
+            data = self.data;
+            _pendingRecords = [NSMutableData data];
+            _pendingRecordCount = 0;
+        }
+        
+        NSString *fileToWriteTo = self.filePath;
+        
+        // Make sure the directory we write to exists
+        NSString *destDir = [fileToWriteTo stringByDeletingLastPathComponent];
+        NSFileManager *fm = [NSFileManager defaultManager];
+        if ([fm createDirectoryAtPath:destDir withIntermediateDirectories:YES attributes:nil error:errorPtr]
+            && [data writeToFile:fileToWriteTo options:NSDataWritingAtomic error:errorPtr]) {
+            [fm removeItemAtPath:self.logFilePath error:nil];
+            return YES;
+        }
+        return NO;
+    }
 }
 
 -(void) setCompositeHref:(NSString *)href
@@ -364,11 +594,18 @@ NSString *const DCXPushJournalCurrentBranchEtagKey          = @"current-branch-e
     if (_filePath == nil) {
         return YES;
     }
-    NSFileManager *fm = [NSFileManager defaultManager];
-    if (![fm fileExistsAtPath:self.filePath]) {
-        return YES;
-    } else {
-        return [fm removeItemAtPath:self.filePath error:errorPtr];
+    @synchronized(_fileLock) {
+        @synchronized(self) {
+            _pendingRecords = [NSMutableData data];
+            _pendingRecordCount = 0;
+        }
+        NSFileManager *fm = [NSFileManager defaultManager];
+        [fm removeItemAtPath:self.logFilePath error:nil];
+        if (![fm fileExistsAtPath:self.filePath]) {
+            return YES;
+        } else {
+            return [fm removeItemAtPath:self.filePath error:errorPtr];
+        }
     }
 }
 
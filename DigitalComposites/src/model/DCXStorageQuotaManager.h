@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "DCXCompositeXfer.h"
+
+@class DCXComposite;
+@class DCXComponent;
+@class DCXHTTPRequest;
+
+@protocol DCXTransferSessionProtocol;
+
+/**
+ * \brief Keeps the local storage of a set of composites that live under a common root directory
+ * within a byte budget by evicting the local files of the least recently used components.
+ *
+ * Only the files of components that can be downloaded again get evicted, i.e. components of bound
+ * composites that are unmodified and have an etag. Eviction works like
+ * DCXComposite removeLocalFilesForComponentsWithIDs:errorList: so evicted components are missing
+ * their local files just like the components of a composite pulled with pullMinimalComposite:.
+ * downloadComponents:ofComposite:... brings them back.
+ *
+ * A composite takes part once it has been added with addComposite:. From then on
+ * DCXBranch pathForComponent:withError: and fetchPathForComponent:... record when a component has
+ * been used. The times of use get written to a file in the root directory a few seconds after they
+ * change so that they survive restarts.
+ *
+ * The quota manager measures the local storage of a composite the first time it needs it and keeps
+ * the count up to date as components get downloaded or evicted. Committing changes or updating a
+ * branch of the composite makes it measure the composite again.
+ *
+ * The budget only gets enforced when the app calls enforceBudgetWithError:, e.g. after a pull or when
+ * the app goes into the background.
+ *
+ * ### Threading
+ *
+ * Enforcing the budget reads and edits the manifests of the composites, which aren't thread-safe.
+ * enforceBudgetWithError: must therefore be called on the thread or queue that the app uses to access
+ * the composites. The other methods may be called on any thread.
+ */
+@interface DCXStorageQuotaManager : NSObject
+
+/**
+ * \brief Initializes a quota manager.
+ *
+ * \param rootPath   The directory that contains the local directories of the composites. The times of
+ * use of the components get stored in a file in this directory.
+ * \param byteBudget The number of bytes that the composites may use.
+ */
+- (instancetype)initWithRootPath:(NSString *)rootPath byteBudget:(unsigned long long)byteBudget;
+
+/** The directory that contains the local directories of the composites. */
+@property (nonatomic, readonly) NSString *rootPath;
+
+/** The number of bytes that the composites may use. */
+@property (atomic, readwrite) unsigned long long byteBudget;
+
+/** The composites that have been added. */
+@property (nonatomic, readonly) NSArray *composites;
+
+/**
+ * \brief Adds a composite. The quota manager only holds a weak reference to it.
+ *
+ * \param composite The composite. Its local directory must be inside rootPath.
+ */
+- (void)addComposite:(DCXComposite *)composite;
+
+/**
+ * \brief Removes a composite that has been added with addComposite:.
+ *
+ * \param composite The composite.
+ */
+- (void)removeComposite:(DCXComposite *)composite;
+
+/**
+ * \brief Records that the local file of a component has just been used.
+ *
+ * \param component The component.
+ * \param composite The composite the component belongs to.
+ */
+- (void)didAccessComponent:(DCXComponent *)component ofComposite:(DCXComposite *)composite;
+
+/**
+ * \brief Records that the local file of a component has just been downloaded. Gets called by
+ * DCXCompositeXfer.
+ *
+ * \param component The component.
+ * \param composite The composite the component belongs to.
+ */
+- (void)didDownloadComponent:(DCXComponent *)component ofComposite:(DCXComposite *)composite;
+
+/**
+ * \brief Makes the quota manager measure the local storage of a composite again the next time it
+ * needs it. Gets called by DCXComposite whenever one of its branches changes.
+ *
+ * \param composite The composite.
+ */
+- (void)localStorageOfCompositeDidChange:(DCXComposite *)composite;
+
+/**
+ * \brief Returns the number of bytes of local storage consumed by all composites. Only composites
+ * that have changed since they were last measured get measured again.
+ */
+- (unsigned long long)bytesConsumed;
+
+/**
+ * \brief Evicts the local files of the least recently used components until the composites fit
+ * into byteBudget or no more files can be evicted.
+ *
+ * Must be called on the thread or queue that the app uses to access the composites. Composites with
+ * an active push or pull are skipped.
+ *
+ * \param errorPtr Gets set to the first error that occurs. Eviction continues after errors.
+ *
+ * \return An NSNumber with the number of bytes that have been freed.
+ */
+- (NSNumber *)enforceBudgetWithError:(NSError **)errorPtr;
+
+/**
+ * \brief Writes the times of use to the file in rootPath right away instead of waiting for the
+ * scheduled write, e.g. when the app is about to get suspended.
+ */
+- (void)writeAccessTimes;
+
+/**
+ * \brief Downloads the local files of components of the current branch of a composite, e.g. after
+ * they have been evicted, and records that they have been used.
+ *
+ * \param components The components to download. Pass nil to download all missing components.
+ * \param composite  The composite.
+ * \param session    The session to use for the required http requests.
+ * \param priority   The relative priority of the download.
+ * \param queue      Optional parameter. If not nil queue determines the operation queue handler gets
+ * executed on.
+ * \param handler    Gets called when the download has completed (see
+ * DCXCompositeXfer downloadComponents:ofBranch:usingSession:requestPriority:handlerQueue:completionHandler:).
+ *
+ * \return An DCXHTTPRequest object that can be used to track progress, adjust the priority of the
+ * download and to cancel it.
+ */
+- (DCXHTTPRequest *)downloadComponents:(NSArray *)components
+                           ofComposite:(DCXComposite *)composite
+                          usingSession:(id<DCXTransferSessionProtocol>)session
+                       requestPriority:(NSOperationQueuePriority)priority
+                          handlerQueue:(NSOperationQueue *)queue
+                     completionHandler:(DCXPullCompletionHandler)handler;
+
+@end
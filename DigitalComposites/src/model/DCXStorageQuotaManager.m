@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#import "DCXStorageQuotaManager.h"
+
+#import "DCXComposite_Internal.h"
+#import "DCXBranch_Internal.h"
+#import "DCXComponent.h"
+#import "DCXConstants.h"
+#import "DCXLocalStorage.h"
+
+static NSString *const DCXAccessTimesFileName = @"component-access-times.json";
+
+// Delay in seconds between the first unsaved change of the times of use and writing them to disk
+static const NSTimeInterval DCXAccessTimesWriteDelay = 5.0;
+
+// A component whose local file can be evicted.
+@interface DCXEvictionCandidate : NSObject
+
+@property (nonatomic) DCXComposite *composite;
+@property (nonatomic) NSString *componentId;
+@property (nonatomic) NSTimeInterval accessTime;
+@property (nonatomic) unsigned long long length;
+
+@end
+
+@implementation DCXEvictionCandidate
+@end
+
+@implementation DCXStorageQuotaManager
+{
+    NSHashTable *_composites;
+
+    // Composite id -> component id -> time of last use in seconds since 1970. Guarded by itself.
+    NSMutableDictionary *_accessTimes;
+    BOOL _accessTimesChanged;
+
+    // Keeps writeAccessTimes from running more than once at a time
+    NSObject *_accessTimesFileLock;
+
+    // Composite id -> NSNumber with the bytes of local storage it consumes. Guarded by itself.
+    NSMutableDictionary *_bytesConsumed;
+
+    // Keeps enforceBudgetWithError: from running more than once at a time
+    NSObject *_enforceLock;
+}
+
+- (instancetype)initWithRootPath:(NSString *)rootPath byteBudget:(unsigned long long)byteBudget
+{
+    NSAssert(rootPath != nil, @"Parameter rootPath must not be nil.");
+
+    if (self = [super init]) {
+        _rootPath = [rootPath stringByStandardizingPath];
+        _byteBudget = byteBudget;
+        _composites = [NSHashTable weakObjectsHashTable];
+        _enforceLock = [[NSObject alloc] init];
+        _accessTimesFileLock = [[NSObject alloc] init];
+        _bytesConsumed = [NSMutableDictionary dictionary];
+
+        NSData *data = [NSData dataWithContentsOfFile:[_rootPath stringByAppendingPathComponent:DCXAccessTimesFileName]];
+        if (data != nil) {
+            _accessTimes = [NSJSONSerialization JSONObjectWithData:data options:NSJSONReadingMutableContainers error:nil];
+        }
+        if (![_accessTimes isKindOfClass:[NSMutableDictionary class]]) {
+            // The times only improve the choice of components to evict so we can do without them
+            _accessTimes = [NSMutableDictionary dictionary];
+        }
+    }
+
+    return self;
+}
+
+#pragma mark Composites
+
+- (NSArray *)composites
+{
+    @synchronized(_composites) {
+        return [_composites allObjects];
+    }
+}
+
+- (void)addComposite:(DCXComposite *)composite
+{
+    NSAssert(composite != nil, @"Parameter composite must not be nil.");
+    NSAssert(composite.path == nil || [[composite.path stringByStandardizingPath] hasPrefix:_rootPath],
+             @"The composite must be stored inside the root path of the quota manager.");
+
+    @synchronized(_composites) {
+        [_composites addObject:composite];
+    }
+    composite.storageQuotaManager = self;
+}
+
+- (void)removeComposite:(DCXComposite *)composite
+{
+    @synchronized(_composites) {
+        [_composites removeObject:composite];
+    }
+    [self localStorageOfCompositeDidChange:composite];
+    if (composite.storageQuotaManager == self) {
+        composite.storageQuotaManager = nil;
+    }
+}
+
+#pragma mark Usage
+
+- (void)didAccessComponent:(DCXComponent *)component ofComposite:(DCXComposite *)composite
+{
+    NSString *compositeId = composite.compositeId;
+    NSString *componentId = component.componentId;
+    if (compositeId == nil || componentId == nil) {
+        return;
+    }
+    NSNumber *now = @([[NSDate date] timeIntervalSince1970]);
+    @synchronized(_accessTimes) {
+        NSMutableDictionary *times = _accessTimes[compositeId];
+        if (times == nil) {
+            times = [NSMutableDictionary dictionary];
+            _accessTimes[compositeId] = times;
+        }
+        times[componentId] = now;
+        [self accessTimesDidChange];
+    }
+}
+
+// Must be called while holding the lock on _accessTimes
+- (void)accessTimesDidChange
+{
+    if (_accessTimesChanged) {
+        // A write is already scheduled
+        return;
+    }
+    _accessTimesChanged = YES;
+
+    DCXStorageQuotaManager __weak *weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(DCXAccessTimesWriteDelay * NSEC_PER_SEC)),
+                   dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+                       [weakSelf writeAccessTimes];
+                   });
+}
+
+- (void)didDownloadComponent:(DCXComponent *)component ofComposite:(DCXComposite *)composite
+{
+    NSString *compositeId = composite.compositeId;
+    if (compositeId == nil) {
+        return;
+    }
+    @synchronized(_bytesConsumed) {
+        // Composites that haven't been measured yet get measured in full when the count is needed
+        NSNumber *bytes = _bytesConsumed[compositeId];
+        if (bytes != nil) {
+            _bytesConsumed[compositeId] = @(bytes.unsignedLongLongValue + component.length.unsignedLongLongValue);
+        }
+    }
+}
+
+- (void)localStorageOfCompositeDidChange:(DCXComposite *)composite
+{
+    NSString *compositeId = composite.compositeId;
+    if (compositeId == nil) {
+        return;
+    }
+    @synchronized(_bytesConsumed) {
+        [_bytesConsumed removeObjectForKey:compositeId];
+    }
+}
+
+- (unsigned long long)bytesConsumedByComposite:(DCXComposite *)composite
+{
+    NSString *compositeId = composite.compositeId;
+    if (composite.path == nil || compositeId == nil) {
+        return 0;
+    }
+    @synchronized(_bytesConsumed) {
+        NSNumber *bytes = _bytesConsumed[compositeId];
+        if (bytes != nil) {
+            return bytes.unsignedLongLongValue;
+        }
+    }
+    NSNumber *bytes = [composite localStorageBytesConsumed];
+    @synchronized(_bytesConsumed) {
+        _bytesConsumed[compositeId] = bytes;
+    }
+    return bytes.unsignedLongLongValue;
+}
+
+- (void)composite:(DCXComposite *)composite didFreeBytes:(unsigned long long)freed
+{
+    @synchronized(_bytesConsumed) {
+        NSNumber *bytes = _bytesConsumed[composite.compositeId];
+        if (bytes != nil) {
+            _bytesConsumed[composite.compositeId] = @(bytes.unsignedLongLongValue - MIN(bytes.unsignedLongLongValue, freed));
+        }
+    }
+}
+
+- (unsigned long long)bytesConsumed
+{
+    unsigned long long bytes = 0;
+    for (DCXComposite *composite in self.composites) {
+        bytes += [self bytesConsumedByComposite:composite];
+    }
+    return bytes;
+}
+
+#pragma mark Eviction
+
+// Returns the components whose local files can be evicted, least recently used first
+- (NSArray *)evictionCandidates
+{
+    NSFileManager *fm = [NSFileManager defaultManager];
+    NSMutableArray *candidates = [NSMutableArray array];
+
+    for (DCXComposite *composite in self.composites) {
+        // A push or pull may still need the files or be about to reference them from a new manifest
+        if (composite.path == nil || !composite.isBound || composite.activePushManifest != nil || composite.hasActivePull) {
+            continue;
+        }
+        DCXBranch *current = composite.current;
+        if (current == nil) {
+            continue;
+        }
+        NSDictionary *times;
+        @synchronized(_accessTimes) {
+            times = [_accessTimes[composite.compositeId] copy];
+        }
+        NSDictionary *localPaths = [DCXLocalStorage existingLocalStoragePathsForComponentsInBranch:current];
+        for (NSString *componentId in localPaths) {
+            DCXComponent *component = [current getComponentWithId:componentId];
+            // Only components that can be downloaded again qualify
+            if (![component.state isEqualToString:DCXAssetStateUnmodified] || component.etag == nil) {
+                continue;
+            }
+            DCXEvictionCandidate *candidate = [[DCXEvictionCandidate alloc] init];
+            candidate.composite = composite;
+            candidate.componentId = componentId;
+            NSNumber *accessTime = times[componentId];
+            NSDictionary *attributes = nil;
+            if (accessTime == nil || component.length == nil) {
+                attributes = [fm attributesOfItemAtPath:localPaths[componentId] error:nil];
+            }
+            // Components that haven't been used since the composite got added count as used when their
+            // file was last written
+            candidate.accessTime = accessTime != nil ? accessTime.doubleValue
+                                                     : attributes.fileModificationDate.timeIntervalSince1970;
+            candidate.length = component.length != nil ? component.length.unsignedLongLongValue : attributes.fileSize;
+            [candidates addObject:candidate];
+        }
+    }
+
+    [candidates sortUsingComparator:^NSComparisonResult(DCXEvictionCandidate *c1, DCXEvictionCandidate *c2) {
+        return c1.accessTime < c2.accessTime ? NSOrderedAscending
+             : c1.accessTime > c2.accessTime ? NSOrderedDescending : NSOrderedSame;
+    }];
+    return candidates;
+}
+
+- (NSNumber *)enforceBudgetWithError:(NSError **)errorPtr
+{
+    unsigned long long bytesFreed = 0;
+    NSError *error = nil;
+
+    @synchronized(_enforceLock) {
+        unsigned long long budget = self.byteBudget;
+        unsigned long long consumed = [self bytesConsumed];
+
+        if (consumed > budget) {
+            NSArray *candidates = [self evictionCandidates];
+            NSUInteger next = 0;
+            while (consumed > budget && next < candidates.count) {
+                // Evict the least recently used files that are expected to cover the excess, grouped by composite.
+                // Shared files free less than expected in which case we carry on with the next batch.
+                unsigned long long excess = consumed - budget;
+                unsigned long long expected = 0;
+                NSMapTable *batch = [NSMapTable strongToStrongObjectsMapTable];
+                for (; next < candidates.count && expected < excess; next++) {
+                    DCXEvictionCandidate *candidate = candidates[next];
+                    NSMutableArray *componentIds = [batch objectForKey:candidate.composite];
+                    if (componentIds == nil) {
+                        componentIds = [NSMutableArray array];
+                        [batch setObject:componentIds forKey:candidate.composite];
+                    }
+                    [componentIds addObject:candidate.componentId];
+                    expected += MAX(candidate.length, 1);
+                }
+
+                for (DCXComposite *composite in batch) {
+                    NSArray *componentIds = [batch objectForKey:composite];
+                    NSArray *errors = nil;
+                    unsigned long long freed = [[composite removeLocalFilesForComponentsWithIDs:componentIds
+                                                                                      errorList:&errors] unsignedLongLongValue];
+                    bytesFreed += freed;
+                    consumed -= MIN(consumed, freed);
+                    [self composite:composite didFreeBytes:freed];
+                    if (errors.count > 0 && error == nil) {
+                        error = errors[0];
+                    }
+                    @synchronized(_accessTimes) {
+                        [_accessTimes[composite.compositeId] removeObjectsForKeys:componentIds];
+                        [self accessTimesDidChange];
+                    }
+                }
+            }
+        }
+    }
+
+    if (error != nil && errorPtr != NULL) {
+        *errorPtr = error;
+    }
+    return [NSNumber numberWithUnsignedLongLong:bytesFreed];
+}
+
+- (void)writeAccessTimes
+{
+    // Holding the file lock while taking the snapshot keeps an older snapshot from overwriting a newer one
+    @synchronized(_accessTimesFileLock) {
+        NSData *data = nil;
+        @synchronized(_accessTimes) {
+            if (!_accessTimesChanged) {
+                return;
+            }
+            data = [NSJSONSerialization dataWithJSONObject:_accessTimes options:0 error:nil];
+            _accessTimesChanged = NO;
+        }
+        [data writeToFile:[_rootPath stringByAppendingPathComponent:DCXAccessTimesFileName]
+                  options:NSDataWritingAtomic error:nil];
+    }
+}
+
+#pragma mark Downloads
+
+- (DCXHTTPRequest *)downloadComponents:(NSArray *)components
+                           ofComposite:(DCXComposite *)composite
+                          usingSession:(id<DCXTransferSessionProtocol>)session
+                       requestPriority:(NSOperationQueuePriority)priority
+                          handlerQueue:(NSOperationQueue *)queue
+                     completionHandler:(DCXPullCompletionHandler)handler
+{
+    NSAssert(composite.current != nil, @"The composite must have a current branch.");
+
+    return [DCXCompositeXfer downloadComponents:components ofBranch:composite.current usingSession:session
+                                requestPriority:priority handlerQueue:queue
+                              completionHandler:^(DCXBranch *branch, NSError *error) {
+                                  if (branch != nil) {
+                                      // Downloaded components are about to get used
+                                      for (DCXComponent *component in (components ?: [branch getAllComponents])) {
+                                          [self didAccessComponent:component ofComposite:composite];
+                                      }
+                                  }
+                                  if (handler != nil) {
+                                      handler(branch, error);
+                                  }
+                              }];
+}
+
+@end
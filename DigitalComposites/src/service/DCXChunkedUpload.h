@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import <Foundation/Foundation.h>
+
+#import "DCXTransferSessionProtocol.h"
+
+@class DCXHTTPRequest;
+
+/**
+ * \brief Gets called when a chunk has been uploaded.
+ *
+ * \param uploadId The id of the upload session on the server.
+ * \param offset   The number of bytes the server has received so far. Can differ from the offset that
+ * has been requested if the server reports that it has received a different number of bytes.
+ * \param error    The error if the chunk couldn't be uploaded. The other params are ignored in that case.
+ */
+typedef void (^DCXChunkCompletionHandler)(NSString *uploadId, unsigned long long offset, NSError *error);
+
+/**
+ * \brief Uploads a chunk of a file.
+ *
+ * \param chunk    The bytes of the chunk.
+ * \param uploadId The id of the upload session on the server. nil for the first chunk of a new session.
+ * \param offset   The offset of chunk in the file.
+ * \param handler  Must get called when the chunk has been uploaded or has failed.
+ *
+ * \return The request that uploads the chunk.
+ */
+typedef DCXHTTPRequest* (^DCXChunkUploadBlock)(NSData *chunk, NSString *uploadId, unsigned long long offset,
+                                               DCXChunkCompletionHandler handler);
+
+/**
+ * \brief Turns the chunks that have been uploaded into the component.
+ *
+ * \param uploadId The id of the upload session on the server.
+ * \param handler  Must get called with the updated component or an error.
+ *
+ * \return The request that commits the upload.
+ */
+typedef DCXHTTPRequest* (^DCXChunkCommitBlock)(NSString *uploadId, DCXComponentRequestCompletionHandler handler);
+
+/**
+ * \brief Drives the upload of a file as a sequence of chunks so that a failed upload can be resumed
+ * at the last chunk the server has received instead of starting over.
+ *
+ * The class only implements the client side of the protocol: the actual requests get issued by
+ * the blocks that a DCXTransferSessionProtocol implementation passes in. The state of an upload
+ * session is exposed as an opaque dictionary (see DCXUploadSessionHandler) which can be persisted
+ * and passed back in to resume the upload later, e.g. after the app has been restarted.
+ *
+ * The size of the chunks adapts to the throughput measured for the previous chunk so that every
+ * chunk takes about targetChunkDuration seconds.
+ */
+@interface DCXChunkedUpload : NSObject
+
+/**
+ * \brief Initializes an upload.
+ *
+ * \param path          The file to upload.
+ * \param uploadSession Optional parameter. The state of an earlier upload of the file as passed to a
+ * DCXUploadSessionHandler. Gets ignored if the file has changed since.
+ * \param chunkBlock    Uploads a chunk.
+ * \param commitBlock   Commits the upload once all chunks have been uploaded.
+ */
+- (instancetype)initWithPath:(NSString *)path
+               uploadSession:(NSDictionary *)uploadSession
+                  chunkBlock:(DCXChunkUploadBlock)chunkBlock
+                 commitBlock:(DCXChunkCommitBlock)commitBlock;
+
+/** The size in bytes of the first chunk. Defaults to 4 MB. */
+@property (nonatomic) NSUInteger chunkSize;
+
+/** The smallest chunk size in bytes. Defaults to 256 KB. */
+@property (nonatomic) NSUInteger minChunkSize;
+
+/** The largest chunk size in bytes. Defaults to 32 MB. */
+@property (nonatomic) NSUInteger maxChunkSize;
+
+/** The time in seconds that the upload of a chunk should take. Defaults to 5 seconds. */
+@property (nonatomic) NSTimeInterval targetChunkDuration;
+
+/** The offset that the upload starts at. Non-zero if a valid upload session has been passed in. */
+@property (nonatomic, readonly) unsigned long long startOffset;
+
+/**
+ * \brief Starts the upload.
+ *
+ * \param priority       The priority of the requests.
+ * \param sessionHandler Optional parameter. Gets called with the state of the upload session after
+ * every chunk and with nil once the session can't be resumed anymore.
+ * \param queue          Optional parameter. If not nil queue determines the operation queue handler
+ * gets executed on.
+ * \param handler        Gets called with the result of the commit block or with the first error.
+ *
+ * \return A DCXHTTPRequest object that tracks the progress of all the requests of the upload and
+ * can be used to cancel it.
+ */
+- (DCXHTTPRequest *)startWithPriority:(NSOperationQueuePriority)priority
+                       sessionHandler:(DCXUploadSessionHandler)sessionHandler
+                         handlerQueue:(NSOperationQueue *)queue
+                    completionHandler:(DCXComponentRequestCompletionHandler)handler;
+
+/**
+ * \brief Returns the size of the next chunk given the size and duration of the previous one.
+ *
+ * \param chunkSize The size of the previous chunk in bytes.
+ * \param duration  The time in seconds it took to upload the previous chunk.
+ */
+- (NSUInteger)nextChunkSizeAfterChunkOfSize:(NSUInteger)chunkSize tookDuration:(NSTimeInterval)duration;
+
+@end
@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#import "DCXChunkedUpload.h"
+
+#import "DCXCompositeRequest.h"
+#import "DCXError.h"
+
+#import "DCXErrorUtils.h"
+
+// Keys of the upload session dictionary
+static NSString *const DCXUploadSessionIdKey            = @"upload-id";
+static NSString *const DCXUploadSessionOffsetKey        = @"offset";
+static NSString *const DCXUploadSessionFileLengthKey    = @"file-length";
+static NSString *const DCXUploadSessionFileModifiedKey  = @"file-modified";
+
+static const NSUInteger DCXChunkedUploadDefaultChunkSize    = 4 * 1024 * 1024;
+static const NSUInteger DCXChunkedUploadDefaultMinChunkSize = 256 * 1024;
+static const NSUInteger DCXChunkedUploadDefaultMaxChunkSize = 32 * 1024 * 1024;
+static const NSTimeInterval DCXChunkedUploadDefaultTargetChunkDuration = 5.0;
+
+@implementation DCXChunkedUpload {
+    NSString *_path;
+    unsigned long long _fileLength;
+    NSNumber *_fileModified;
+
+    NSString *_uploadId;
+    unsigned long long _offset;
+    BOOL _canRestart;
+
+    DCXChunkUploadBlock _chunkBlock;
+    DCXChunkCommitBlock _commitBlock;
+    DCXUploadSessionHandler _sessionHandler;
+    DCXComponentRequestCompletionHandler _handler;
+    NSOperationQueue *_queue;
+    DCXCompositeRequest *_request;
+}
+
+- (instancetype)initWithPath:(NSString *)path
+               uploadSession:(NSDictionary *)uploadSession
+                  chunkBlock:(DCXChunkUploadBlock)chunkBlock
+                 commitBlock:(DCXChunkCommitBlock)commitBlock
+{
+    NSAssert(path != nil, @"Parameter path must not be nil.");
+    NSAssert(chunkBlock != nil, @"Parameter chunkBlock must not be nil.");
+    NSAssert(commitBlock != nil, @"Parameter commitBlock must not be nil.");
+
+    if (self = [super init])
+    {
+        _path = path;
+        _chunkBlock = chunkBlock;
+        _commitBlock = commitBlock;
+        _chunkSize = DCXChunkedUploadDefaultChunkSize;
+        _minChunkSize = DCXChunkedUploadDefaultMinChunkSize;
+        _maxChunkSize = DCXChunkedUploadDefaultMaxChunkSize;
+        _targetChunkDuration = DCXChunkedUploadDefaultTargetChunkDuration;
+
+        NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil];
+        _fileLength = attributes.fileSize;
+        // Whole milliseconds survive a round trip through JSON
+        _fileModified = @(floor(attributes.fileModificationDate.timeIntervalSince1970 * 1000));
+
+        // Only resume a session that has been started for the same file
+        NSString *uploadId = uploadSession[DCXUploadSessionIdKey];
+        NSNumber *offset = uploadSession[DCXUploadSessionOffsetKey];
+        if (attributes != nil && [uploadId isKindOfClass:[NSString class]] && [offset isKindOfClass:[NSNumber class]]
+            && [uploadSession[DCXUploadSessionFileLengthKey] isEqual:@(_fileLength)]
+            && [uploadSession[DCXUploadSessionFileModifiedKey] isEqual:_fileModified]
+            && offset.unsignedLongLongValue <= _fileLength)
+        {
+            _uploadId = uploadId;
+            _offset = offset.unsignedLongLongValue;
+            _canRestart = YES;
+        }
+        _startOffset = _offset;
+    }
+
+    return self;
+}
+
+- (NSDictionary *)uploadSession
+{
+    return @{ DCXUploadSessionIdKey: _uploadId,
+              DCXUploadSessionOffsetKey: @(_offset),
+              DCXUploadSessionFileLengthKey: @(_fileLength),
+              DCXUploadSessionFileModifiedKey: _fileModified };
+}
+
+- (NSUInteger)nextChunkSizeAfterChunkOfSize:(NSUInteger)chunkSize tookDuration:(NSTimeInterval)duration
+{
+    NSUInteger nextSize = chunkSize;
+
+    if (duration > 0 && chunkSize > 0)
+    {
+        // Move half way towards the size that would have taken targetChunkDuration to smooth out
+        // fluctuations of the throughput
+        double targetSize = chunkSize / duration * _targetChunkDuration;
+        nextSize = (NSUInteger)MIN((chunkSize + targetSize) / 2, (double)NSUIntegerMax);
+    }
+
+    nextSize = MAX(_minChunkSize, MIN(_maxChunkSize, nextSize));
+    if (_minChunkSize > 0)
+    {
+        nextSize -= nextSize % _minChunkSize;
+    }
+
+    return nextSize;
+}
+
+- (DCXHTTPRequest *)startWithPriority:(NSOperationQueuePriority)priority
+                       sessionHandler:(DCXUploadSessionHandler)sessionHandler
+                         handlerQueue:(NSOperationQueue *)queue
+                    completionHandler:(DCXComponentRequestCompletionHandler)handler
+{
+    NSAssert(handler != nil, @"Parameter handler must not be nil.");
+    NSAssert(_request == nil, @"An upload can only be started once.");
+
+    _sessionHandler = sessionHandler;
+    _queue = queue;
+    _handler = handler;
+
+    // Created while the caller's progress is current so that it becomes a child of that progress
+    _request = [[DCXCompositeRequest alloc] initWithPriority:priority];
+    _request.progress.totalUnitCount = _fileLength - _offset;
+    _request.progress.completedUnitCount = 0;
+
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [self uploadNextChunk];
+    });
+
+    return _request;
+}
+
+- (void)addRequest:(DCXHTTPRequest *)request
+{
+    if (request != nil)
+    {
+        @synchronized(self)
+        {
+            [_request addComponentRequest:request];
+        }
+    }
+}
+
+- (NSData *)readChunkWithError:(NSError **)errorPtr
+{
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForReadingAtPath:_path];
+    NSData *chunk = nil;
+
+    if (fileHandle != nil)
+    {
+        @try
+        {
+            [fileHandle seekToFileOffset:_offset];
+            chunk = [fileHandle readDataOfLength:(NSUInteger)MIN(_chunkSize, _fileLength - _offset)];
+        }
+        @catch (NSException *exception)
+        {
+            chunk = nil;
+        }
+        [fileHandle closeFile];
+    }
+
+    if (chunk == nil && errorPtr != NULL)
+    {
+        *errorPtr = [DCXErrorUtils ErrorWithCode:DCXErrorComponentReadFailure domain:DCXErrorDomain
+                                 underlyingError:nil path:_path details:@"Failed to read a chunk of the file."];
+    }
+
+    return chunk;
+}
+
+- (void)uploadNextChunk
+{
+    if (_request.progress.isCancelled)
+    {
+        return [self finishWithComponent:nil error:[DCXErrorUtils ErrorWithCode:DCXErrorCancelled
+                                                                         domain:DCXErrorDomain details:nil]];
+    }
+
+    if (_uploadId != nil && _offset >= _fileLength)
+    {
+        return [self commit];
+    }
+
+    NSError *error = nil;
+    NSData *chunk = [self readChunkWithError:&error];
+    if (chunk == nil)
+    {
+        return [self finishWithComponent:nil error:error];
+    }
+
+    NSDate *chunkStart = [NSDate date];
+    [_request.progress becomeCurrentWithPendingUnitCount:chunk.length];
+    DCXHTTPRequest *request = _chunkBlock(chunk, _uploadId, _offset, ^(NSString *uploadId, unsigned long long offset, NSError *err) {
+        if (err != nil)
+        {
+            NSInteger statusCode = [[err.userInfo objectForKey:DCXHTTPStatusKey] integerValue];
+            if (_canRestart && statusCode == 404)
+            {
+                // The server doesn't know the session we have tried to resume (anymore). Start over.
+                _canRestart = NO;
+                _request.progress.totalUnitCount += _offset;
+                _uploadId = nil;
+                _offset = 0;
+                if (_sessionHandler != nil)
+                {
+                    _sessionHandler(nil);
+                }
+                return [self uploadNextChunk];
+            }
+            return [self finishWithComponent:nil error:err];
+        }
+
+        _canRestart = NO;
+        _chunkSize = [self nextChunkSizeAfterChunkOfSize:chunk.length
+                                            tookDuration:-[chunkStart timeIntervalSinceNow]];
+        _uploadId = uploadId;
+        _offset = MIN(offset, _fileLength);
+        if (_sessionHandler != nil && _uploadId != nil)
+        {
+            _sessionHandler([self uploadSession]);
+        }
+        [self uploadNextChunk];
+    });
+    [_request.progress resignCurrent];
+    [self addRequest:request];
+}
+
+- (void)commit
+{
+    DCXHTTPRequest *request = _commitBlock(_uploadId, ^(DCXComponent *component, NSError *err) {
+        if (err != nil && [[err.userInfo objectForKey:DCXHTTPStatusKey] integerValue] == 404 && _sessionHandler != nil)
+        {
+            // The session has expired so the next attempt needs to start over
+            _sessionHandler(nil);
+        }
+        [self finishWithComponent:component error:err];
+    });
+    [self addRequest:request];
+}
+
+- (void)finishWithComponent:(DCXComponent *)component error:(NSError *)error
+{
+    DCXComponentRequestCompletionHandler handler = _handler;
+    NSOperationQueue *queue = _queue;
+
+    // Break the retain cycles between the blocks and self
+    _handler = nil;
+    _sessionHandler = nil;
+    _chunkBlock = nil;
+    _commitBlock = nil;
+    [_request allComponentsHaveBeenAdded];
+
+    if (queue != nil)
+    {
+        [queue addOperationWithBlock: ^{
+                   handler(component, error);
+               }];
+    }
+    else
+    {
+        handler(component, error);
+    }
+}
+
+@end
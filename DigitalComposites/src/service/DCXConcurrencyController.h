@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+
+/** The default for DCXConcurrencyController::congestionFactor. */
+extern const double DCXConcurrencyDefaultCongestionFactor;
+
+/**
+ * \brief Adjusts the maxConcurrentOperationCount of a request queue in an additive-increase,
+ * multiplicative-decrease fashion.
+ *
+ * Every completed request grows the limit by 1/limit, i.e. by about one per window of requests.
+ * A request that indicates congestion -- a 429 or 5xx response, a network error, or a smoothed cost
+ * of more than congestionFactor times the best recently observed cost -- halves the limit, at most
+ * once per observed request latency.
+ *
+ * The cost of a request is its duration, normalized by the number of bytes transferred for
+ * bulk transfers. Once the available bandwidth is saturated additional concurrent transfers only
+ * slow down the others, which shows up as a growing cost per byte.
+ *
+ * Used internally by DCXHTTPService when adaptsConcurrentRequestCount is set.
+ */
+@interface DCXConcurrencyController : NSObject
+
+/**
+ * \brief Designated initializer.
+ *
+ * \param queue            The queue whose maxConcurrentOperationCount gets adjusted. Its current
+ * maxConcurrentOperationCount is the initial limit.
+ * \param normalizeByBytes Whether the cost of a request gets normalized by the number of bytes it
+ * has transferred. Should be YES for queues of uploads and downloads.
+ */
+- (instancetype)initWithQueue:(NSOperationQueue *)queue normalizeByBytes:(BOOL)normalizeByBytes;
+
+/** The limit gets clamped to 1..maxLimit. Setting it resets the adaptation. */
+@property (nonatomic) NSInteger limit;
+
+/** The upper bound of limit. Defaults to DCXHTTPServiceMaxConcurrentRequests. */
+@property (nonatomic, readonly) NSInteger maxLimit;
+
+/**
+ * The factor by which the smoothed cost of requests must exceed the best recently observed cost
+ * for the controller to consider the service congested. Defaults to 2.
+ *
+ * Once the bandwidth to the service is saturated every additional concurrent request adds to the
+ * cost of all the others, so going from the limit that just saturates the link to twice that limit
+ * doubles the cost. A factor of 2 hence catches a limit that has overshot by about 2x while
+ * tolerating the jitter that the 1/8 smoothing of the cost lets through. Lower values make the
+ * controller back off earlier on noisy connections, higher values let more queuing build up.
+ * Must be greater than 1.
+ */
+@property (nonatomic) double congestionFactor;
+
+/**
+ * \brief Feeds the outcome of a completed request into the controller.
+ *
+ * \param duration     The time in seconds it took to complete the request.
+ * \param bytes        The number of bytes that have been transferred by the request.
+ * \param statusCode   The HTTP status code of the response. 0 if there wasn't a response.
+ * \param error        Optional parameter. The error the request has failed with.
+ * \param growthPaused Whether the limit must not grow, e.g. because the service is still recovering
+ * from earlier errors.
+ */
+- (void)requestDidFinishWithDuration:(NSTimeInterval)duration
+                    transferredBytes:(int64_t)bytes
+                          statusCode:(NSInteger)statusCode
+                               error:(NSError *)error
+                        growthPaused:(BOOL)growthPaused;
+
+@end
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#import "DCXConcurrencyController.h"
+
+extern const NSInteger DCXHTTPServiceMaxConcurrentRequests;
+
+const double DCXConcurrencyDefaultCongestionFactor = 2.0;
+
+static const double DCXConcurrencyDecreaseFactor = 0.5;
+static const double DCXConcurrencySmoothingFactor = 0.125;
+// The best observed cost slowly drifts back up so that a single unusually fast request
+// doesn't keep the limit down forever.
+static const double DCXConcurrencyBaselineDecay = 1.01;
+static const int64_t DCXConcurrencyBytesPerCostUnit = 64 * 1024;
+
+@implementation DCXConcurrencyController {
+    NSOperationQueue *_queue;
+    BOOL _normalizeByBytes;
+    double _limit;
+    double _smoothedCost;
+    double _baselineCost;
+    NSTimeInterval _smoothedDuration;
+    NSDate *_lastDecrease;
+}
+
+- (instancetype)initWithQueue:(NSOperationQueue *)queue normalizeByBytes:(BOOL)normalizeByBytes
+{
+    self = [super init];
+
+    if (self)
+    {
+        _queue = queue;
+        _normalizeByBytes = normalizeByBytes;
+        _maxLimit = DCXHTTPServiceMaxConcurrentRequests;
+        _congestionFactor = DCXConcurrencyDefaultCongestionFactor;
+        _limit = MAX(1, MIN(queue.maxConcurrentOperationCount, _maxLimit));
+    }
+
+    return self;
+}
+
+- (NSInteger)limit
+{
+    @synchronized(self){
+        return (NSInteger)_limit;
+    }
+}
+
+- (void)setLimit:(NSInteger)limit
+{
+    @synchronized(self){
+        _limit = MAX(1, MIN(limit, _maxLimit));
+        _smoothedCost = 0;
+        _baselineCost = 0;
+        _smoothedDuration = 0;
+        _lastDecrease = nil;
+        _queue.maxConcurrentOperationCount = (NSInteger)_limit;
+    }
+}
+
+- (void)setCongestionFactor:(double)congestionFactor
+{
+    NSAssert(congestionFactor > 1.0, @"The congestion factor must be greater than 1.");
+
+    @synchronized(self){
+        _congestionFactor = congestionFactor;
+    }
+}
+
+- (void)requestDidFinishWithDuration:(NSTimeInterval)duration
+                    transferredBytes:(int64_t)bytes
+                          statusCode:(NSInteger)statusCode
+                               error:(NSError *)error
+                        growthPaused:(BOOL)growthPaused
+{
+    double cost = duration;
+
+    if (_normalizeByBytes)
+    {
+        cost = duration / MAX(1.0, (double)bytes / DCXConcurrencyBytesPerCostUnit);
+    }
+
+    @synchronized(self){
+        NSInteger oldLimit = (NSInteger)_limit;
+
+        _smoothedDuration = (_smoothedDuration == 0) ? duration
+            : _smoothedDuration + DCXConcurrencySmoothingFactor * (duration - _smoothedDuration);
+        _smoothedCost = (_smoothedCost == 0) ? cost
+            : _smoothedCost + DCXConcurrencySmoothingFactor * (cost - _smoothedCost);
+        _baselineCost = (_baselineCost == 0) ? _smoothedCost
+            : MIN(_smoothedCost, _baselineCost * DCXConcurrencyBaselineDecay);
+
+        BOOL isOverloaded = statusCode == 429 || (statusCode > 499 && statusCode < 600 && statusCode != 501 && statusCode != 507);
+        BOOL isNetworkError = error != nil && [error.domain isEqualToString:NSURLErrorDomain];
+        BOOL isSlow = _smoothedCost > _congestionFactor * _baselineCost;
+
+        if (isOverloaded || isNetworkError || isSlow)
+        {
+            // Back off at most once per round trip since requests that were in flight together
+            // tend to report the same congestion.
+            if (_lastDecrease == nil || -[_lastDecrease timeIntervalSinceNow] > _smoothedDuration)
+            {
+                _limit = MAX(1.0, floor(_limit * DCXConcurrencyDecreaseFactor));
+                _lastDecrease = [NSDate date];
+                // Start measuring anew at the lower concurrency
+                _baselineCost = _smoothedCost = 0;
+            }
+        }
+        else if (!growthPaused)
+        {
+            _limit = MIN((double)_maxLimit, _limit + 1.0 / _limit);
+        }
+
+        if ((NSInteger)_limit != oldLimit)
+        {
+            _queue.maxConcurrentOperationCount = (NSInteger)_limit;
+        }
+    }
+}
+
+@end
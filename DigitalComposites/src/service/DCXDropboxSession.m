@@ -33,6 +33,7 @@
 #import "DCXConstants_Internal.h"
 
 #import "DCXResourceItem.h"
+#import "DCXChunkedUpload.h"
 
 #import "DCXUtils.h"
 #import "DCXError.h"
@@ -42,6 +43,9 @@
 NSURL *DropboxApiBaseUrl;
 NSURL *DropboxContentBaseUrl;
 
+// Components at least this large get uploaded in chunks
+static const unsigned long long DCXDropboxChunkedUploadThreshold = 8 * 1024 * 1024;
+
 // Hardcoded (for now) lookup table that determines the sync group of
 // the href of a composite.
 static NSDictionary *DCXTypeSyncGroups = nil;
@@ -260,7 +264,11 @@ static NSDictionary *DCXTypeSyncGroups = nil;
     NSURL *url = [self urlFromString:urlString andParams:params relativeToUrl:DropboxContentBaseUrl];
     NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:url];
     
-    return [self getResponseFor:request streamToOrFrom:nil data:nil
+    // Stream the body to a temporary file so that large manifests don't need to be collected in memory
+    NSString *bodyPath = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                          [NSString stringWithFormat:@"manifest-%@", [[NSUUID UUID] UUIDString]]];
+    
+    return [self getResponseFor:request streamDataTo:bodyPath
                 requestPriority:priority
               completionHandler:^(DCXHTTPResponse *response) {
                   
@@ -270,7 +278,7 @@ static NSDictionary *DCXTypeSyncGroups = nil;
                   
                   if (response.error == nil && (statusCode == 200 || statusCode == 304)) {
                       if (statusCode == 200) {
-                          downloadedManifest = [[DCXManifest alloc] initWithData:response.data withError:&error];
+                          downloadedManifest = [[DCXManifest alloc] initWithContentsOfFile:bodyPath withError:&error];
                           if (error == nil) {
                               NSDictionary *headers = response.headers;
                               NSString *metadata = [headers objectForKey:@"x-dropbox-metadata"];
@@ -296,6 +304,7 @@ static NSDictionary *DCXTypeSyncGroups = nil;
                   } else {
                       error = [self errorFromResponse:response andPath:nil details:nil];
                   }
+                  [[NSFileManager defaultManager] removeItemAtPath:bodyPath error:nil];
                   
                   [self callManifestCompletionHandler:handler onQueue:queue
                                          withManifest:(error == nil ? downloadedManifest : nil) andError:error];
@@ -323,53 +332,144 @@ static NSDictionary *DCXTypeSyncGroups = nil;
     
     return [self getResponseFor:request streamToOrFrom:path data:nil requestPriority:priority
               completionHandler:^(DCXHTTPResponse *response) {
-                  
                   NSError *error = nil;
-                  int statusCode = response.statusCode;
-                  
-                  if (response.error == nil && (statusCode == 200 || statusCode == 201 || statusCode == 204)) {
-                      DCXMutableComponent *updatedComponent = nil;
+                  DCXMutableComponent *updatedComponent = [self componentFromUploadResponse:response
+                                                                               forComponent:component
+                                                                                  withError:&error];
+                  [self callComponentCompletionHandler:handler onQueue:queue
+                                         withComponent:updatedComponent andError:error];
+              }];
+}
+
+-(DCXHTTPRequest*) uploadComponent:(DCXComponent *)component ofComposite:(DCXComposite *)composite
+                                   fromPath:(NSString *)path componentIsNew:(BOOL)isNew
+                              uploadSession:(NSDictionary *)uploadSession
+                             sessionHandler:(DCXUploadSessionHandler)sessionHandler
+                            requestPriority:(NSOperationQueuePriority)priority handlerQueue:(NSOperationQueue *)queue
+                          completionHandler:(DCXComponentRequestCompletionHandler)handler
+{
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil];
+    if (attributes == nil || attributes.fileSize < DCXDropboxChunkedUploadThreshold) {
+        return [self uploadComponent:component ofComposite:composite fromPath:path componentIsNew:isNew
+                     requestPriority:priority handlerQueue:queue completionHandler:handler];
+    }
+    
+    NSString *href = [self getHrefForComponent:component ofComposite:composite];
+    
+    DCXChunkUploadBlock chunkBlock = ^DCXHTTPRequest*(NSData *chunk, NSString *uploadId, unsigned long long offset,
+                                                      DCXChunkCompletionHandler chunkHandler) {
+        NSMutableDictionary *params = [NSMutableDictionary dictionaryWithObject:[@(offset) stringValue] forKey:@"offset"];
+        if (uploadId != nil) {
+            params[@"upload_id"] = uploadId;
+        }
+        NSURL *url = [self urlFromString:@"chunked_upload" andParams:params relativeToUrl:DropboxContentBaseUrl];
+        NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:url];
+        request.HTTPMethod = @"PUT";
+        
+        return [self getResponseFor:request streamToOrFrom:nil data:chunk requestPriority:priority
+                  completionHandler:^(DCXHTTPResponse *response) {
+                      NSDictionary *parsedData = nil;
                       if (response.data != nil) {
-                          // Parse returned data
-                          NSDictionary *parsedData = [NSJSONSerialization JSONObjectWithData:response.data options:0 error:&error];
-                          if (parsedData != nil && [parsedData isKindOfClass: [NSDictionary class]]) {
-                              // Dropbox's rev property serves as both version and etag for our components
-                              NSString *rev     = parsedData[@"rev"];
-                              
-                             if (rev == nil) {
-                                 error = [DCXErrorUtils ErrorWithCode:DCXErrorUnexpectedResponse
-                                                               domain:DCXErrorDomain response:response
-                                                              details:@"Response is missing the 'rev' property"];
-                             } else {
-                                 updatedComponent         = [component mutableCopy];
-                                 updatedComponent.etag    = rev;
-                                 updatedComponent.version = rev;
-                                 // TODO
-                                 //updatedComponent.length  = [NSNumber numberWithLongLong:newLength];
-                             }
-                         }
-                     }
-                     
-                     [self callComponentCompletionHandler:handler onQueue:queue
-                                            withComponent:updatedComponent andError:error];
-                  } else {
-                      error = [self errorFromResponse:response andPath:component.path details:nil];
-                      if (error.code == DCXErrorFileReadFailure && [error.domain isEqualToString:DCXErrorDomain]) {
-                          error = [DCXErrorUtils ErrorWithCode:DCXErrorComponentReadFailure
-                                                                 domain:DCXErrorDomain
-                                                               userInfo:error.userInfo];
+                          parsedData = [NSJSONSerialization JSONObjectWithData:response.data options:0 error:nil];
                       }
-                      [self callComponentCompletionHandler:handler onQueue:queue
-                                             withComponent:nil andError:error];
-                  }
-                  
-              }];
+                      NSString *newUploadId = nil;
+                      NSNumber *newOffset = nil;
+                      if ([parsedData isKindOfClass:[NSDictionary class]]) {
+                          newUploadId = parsedData[@"upload_id"];
+                          newOffset = parsedData[@"offset"];
+                      }
+                      
+                      // Dropbox responds with a 400 and the offset it expects if it has received a
+                      // different number of bytes than we think
+                      if (response.error == nil && (response.statusCode == 200 || response.statusCode == 400)
+                          && [newUploadId isKindOfClass:[NSString class]] && [newOffset isKindOfClass:[NSNumber class]]) {
+                          chunkHandler(newUploadId, newOffset.unsignedLongLongValue, nil);
+                      } else {
+                          chunkHandler(nil, 0, [self errorFromResponse:response andPath:path details:nil]);
+                      }
+                  }];
+    };
+    
+    DCXChunkCommitBlock commitBlock = ^DCXHTTPRequest*(NSString *uploadId, DCXComponentRequestCompletionHandler commitHandler) {
+        NSDictionary *params = @{ @"overwrite": @"true", @"upload_id": uploadId };
+        NSString *urlString = [@"commit_chunked_upload/sandbox" stringByAppendingPathComponent:href];
+        NSURL *url = [self urlFromString:urlString andParams:params relativeToUrl:DropboxContentBaseUrl];
+        NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:url];
+        request.HTTPMethod = @"POST";
+        
+        return [self getResponseFor:request streamToOrFrom:nil data:nil requestPriority:priority
+                  completionHandler:^(DCXHTTPResponse *response) {
+                      NSError *error = nil;
+                      DCXMutableComponent *updatedComponent = [self componentFromUploadResponse:response
+                                                                                   forComponent:component
+                                                                                      withError:&error];
+                      commitHandler(updatedComponent, error);
+                  }];
+    };
+    
+    DCXChunkedUpload *upload = [[DCXChunkedUpload alloc] initWithPath:path uploadSession:uploadSession
+                                                           chunkBlock:chunkBlock commitBlock:commitBlock];
+    return [upload startWithPriority:priority sessionHandler:sessionHandler handlerQueue:queue completionHandler:handler];
+}
+
+// Returns the updated component for the response to files_put or commit_chunked_upload.
+-(DCXMutableComponent*) componentFromUploadResponse:(DCXHTTPResponse*)response forComponent:(DCXComponent*)component
+                                          withError:(NSError**)errorPtr
+{
+    NSError *error = nil;
+    DCXMutableComponent *updatedComponent = nil;
+    int statusCode = response.statusCode;
+    
+    if (response.error == nil && (statusCode == 200 || statusCode == 201 || statusCode == 204)) {
+        if (response.data != nil) {
+            // Parse returned data
+            NSDictionary *parsedData = [NSJSONSerialization JSONObjectWithData:response.data options:0 error:&error];
+            if (parsedData != nil && [parsedData isKindOfClass: [NSDictionary class]]) {
+                // Dropbox's rev property serves as both version and etag for our components
+                NSString *rev     = parsedData[@"rev"];
+                
+                if (rev == nil) {
+                    error = [DCXErrorUtils ErrorWithCode:DCXErrorUnexpectedResponse
+                                                  domain:DCXErrorDomain response:response
+                                                 details:@"Response is missing the 'rev' property"];
+                } else {
+                    updatedComponent         = [component mutableCopy];
+                    updatedComponent.etag    = rev;
+                    updatedComponent.version = rev;
+                    // TODO
+                    //updatedComponent.length  = [NSNumber numberWithLongLong:newLength];
+                }
+            }
+        }
+    } else {
+        error = [self errorFromResponse:response andPath:component.path details:nil];
+        if (error.code == DCXErrorFileReadFailure && [error.domain isEqualToString:DCXErrorDomain]) {
+            error = [DCXErrorUtils ErrorWithCode:DCXErrorComponentReadFailure
+                                          domain:DCXErrorDomain
+                                        userInfo:error.userInfo];
+        }
+    }
+    
+    if (error != nil && errorPtr != NULL) {
+        *errorPtr = error;
+    }
+    return updatedComponent;
 }
 
 -(DCXHTTPRequest*) downloadComponent:(DCXComponent *)component ofComposite:(DCXComposite *)composite
                                        toPath:(NSString *)path requestPriority:(NSOperationQueuePriority)priority
                                  handlerQueue:(NSOperationQueue *)queue
                             completionHandler:(DCXComponentRequestCompletionHandler)handler
+{
+    return [self downloadComponent:component ofComposite:composite toPath:path resumeData:nil
+                   requestPriority:priority handlerQueue:queue completionHandler:handler];
+}
+
+-(DCXHTTPRequest*) downloadComponent:(DCXComponent *)component ofComposite:(DCXComposite *)composite
+                                       toPath:(NSString *)path resumeData:(NSData *)resumeData
+                              requestPriority:(NSOperationQueuePriority)priority
+                                 handlerQueue:(NSOperationQueue *)queue
+                            completionHandler:(DCXComponentRequestCompletionHandler)handler
 {
     NSString *href = [self getHrefForComponent:component ofComposite:composite];
     NSString *urlString = [@"files/sandbox" stringByAppendingPathComponent:href];
@@ -378,14 +478,16 @@ static NSDictionary *DCXTypeSyncGroups = nil;
     NSURL *url = [self urlFromString:urlString andParams:nil relativeToUrl:DropboxContentBaseUrl];
     NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:url];
     
-    return [self getResponseFor:request streamToOrFrom:path data:nil
+    return [self getResponseFor:request downloadTo:path resumeData:resumeData
                 requestPriority:priority
               completionHandler:^(DCXHTTPResponse *response) {
                   
                   NSError *error = nil;
                   int statusCode = response.statusCode;
+                  // A resumed download only returns the rest of the file
+                  BOOL resumed = (statusCode == 206 && resumeData != nil);
                   
-                  if (response.error == nil && statusCode == 200) {
+                  if (response.error == nil && (statusCode == 200 || resumed)) {
                       // Various checks to make sure that we got what we expected to get.
                       NSDictionary *headers = response.headers;
                       NSString *metadata = [headers objectForKey:@"x-dropbox-metadata"];
@@ -398,6 +500,14 @@ static NSDictionary *DCXTypeSyncGroups = nil;
                       }
                       
                       NSNumber *newLength = [NSNumber numberWithLongLong:response.bytesReceived];
+                      if (resumed) {
+                          NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil];
+                          newLength = [NSNumber numberWithUnsignedLongLong:attributes.fileSize];
+                          // The rev is part of the URL so the rest of the file belongs to the same rev
+                          if (newEtag == nil) {
+                              newEtag = componentRev;
+                          }
+                      }
                       
                       if (newEtag == nil) {
                           error = [DCXErrorUtils ErrorWithCode:DCXErrorUnexpectedResponse
@@ -24,6 +24,7 @@
 
 @class DCXHTTPResponse;
 @class DCXHTTPRequest;
+@protocol DCXTransferMetricsSink;
 
 /** The number of units of work we add to each http request progress to account for misc
  * work after completion and to avoid premature completion of a progress object if the request fails
@@ -86,8 +87,8 @@ extern int64_t const DCXHTTPProgressCompletionFudge;
  * ### Threading
  *
  * Methods on this class may be invoked on any thread. Instances of this manage one thread for
- * each allowed concurrent request. (See setConcurrentRequest: count for information on this
- * property.)
+ * each allowed concurrent request. (See concurrentRequestCount and concurrentTransferRequestCount
+ * for information on these properties.)
  */
 @interface DCXHTTPService : NSObject <NSURLSessionDataDelegate, NSURLSessionDownloadDelegate, NSURLSessionTaskDelegate>
 
@@ -106,8 +107,14 @@ extern int64_t const DCXHTTPProgressCompletionFudge;
 @property (nonatomic, readwrite, strong) NSURL *baseURL;
 
 /**
- * The number of requests that may be issued to this service in parallel.
- * Must be in the range 1-5.
+ * The number of data requests that may be issued to this service in parallel.
+ * Must be in the range 1-16. Default is 5. Setting this property also sets
+ * concurrentTransferRequestCount to the same value.
+ *
+ * Note that this limit applies to the queue of data requests only. Uploads and downloads are
+ * limited separately by concurrentTransferRequestCount, so the total number of requests that
+ * may be in flight is the sum of the two counts: 10 by default, and 2 after setting this
+ * property to 1.
  *
  * This value can be modified for a service that is in use. Raising the number
  * will cause any additional pending requests to be started immediately.
@@ -117,6 +124,23 @@ extern int64_t const DCXHTTPProgressCompletionFudge;
  */
 @property NSInteger concurrentRequestCount;
 
+/**
+ * The number of uploads and downloads that may be issued to this service in parallel.
+ * Must be in the range 1-16. Default is 5. Uploads and downloads are queued separately
+ * from data requests so that small metadata requests don't have to wait for bulk transfers.
+ * These requests come in addition to the concurrentRequestCount data requests.
+ */
+@property NSInteger concurrentTransferRequestCount;
+
+/**
+ * Whether the service adjusts concurrentRequestCount and concurrentTransferRequestCount on its own
+ * based on the latency and throughput of completed requests. The counts grow additively while
+ * requests complete without signs of congestion and get halved when requests fail with a 429 or 5xx
+ * response, fail with a network error or slow down significantly. Explicitly setting one of the
+ * counts restarts the adaptation from that value. Default is NO.
+ */
+@property BOOL adaptsConcurrentRequestCount;
+
 /**
  * Whether or not issuing requests to this service is suspended. When the service
  * is suspended, new requests can be made but they will only be added to the queue.
@@ -146,6 +170,13 @@ extern int64_t const DCXHTTPProgressCompletionFudge;
  * and with what length of a delay (in seconds) a request that has failed with a 5xx response code
  * will be retried before it fails. Default is @[@0.1, @1, @2] which makes the servive retry these
  * requests three times with a delay of 0.1, 1, and 2 seconds on each successive attempt.
+ *
+ * A request waiting to be retried does not occupy a slot of the request queue. Each delay gets
+ * randomized between 50% and 150% of its value so that requests that failed together don't get
+ * retried together. 429 (Too Many Requests) responses get retried as well and a Retry-After header
+ * of the response is honored if it asks for a longer delay. Requests whose Retry-After exceeds a
+ * minute fail right away as do the retries of a host that has exhausted its retry budget: each
+ * retry costs one of ten tokens per host and each successful request refunds a tenth of a token.
  */
 @property NSArray *retryOn5xxDelays;
 
@@ -155,6 +186,12 @@ extern int64_t const DCXHTTPProgressCompletionFudge;
  */
 @property (weak) id<DCXHTTPServiceDelegate> delegate;
 
+/**
+ * Optional sink that gets the metrics of every request attempt made by the service as well as the
+ * phase timings of pushes and pulls that use the service. Notice that this is a strong reference.
+ */
+@property (strong) id<DCXTransferMetricsSink> metricsSink;
+
 /**
  * Reconnects a disconnected service.
  */
@@ -204,6 +241,47 @@ extern int64_t const DCXHTTPProgressCompletionFudge;
                                            requestPriority:(NSOperationQueuePriority)priority
                                          completionHandler:(void (^)(DCXHTTPResponse *))handler;
 
+/**
+ * Issues a data request whose response body is too large to collect in memory, e.g. a manifest, and
+ * writes the body to a file. Unlike getResponseForDownloadRequest:toPath:requestPriority:completionHandler:
+ * the request goes through the queue of data requests so that it doesn't have to wait for bulk transfers.
+ *
+ * @param request   The request to make.
+ * @param path      A path including file name that determines where the body of a successful response
+ *                  will be saved. An existing file at the same location will be overriden. The body of
+ *                  an error response is available as the data of the response instead.
+ * @param priority  The initial priority of the request.
+ * @param handler   Upon completion, the specified handler is invoked; no guarantees are made as to which
+ *                  thread it is invoked on.
+ *
+ * @return          A DCXHTTPRequest object that can be used to track progress, adjust the priority of
+ *                  the request and to cancel it.
+ */
+- (DCXHTTPRequest *)getResponseForDataRequest:(NSURLRequest *)request streamToPath:(NSString *)path
+                              requestPriority:(NSOperationQueuePriority)priority
+                            completionHandler:(void (^)(DCXHTTPResponse *))handler;
+
+/**
+ * Resumes a download that has failed or has been cancelled.
+ *
+ * @param request    The request of the original download.
+ * @param path       A path including file name that determines where the file will be saved. An existing
+ *                   file at the same location will be overriden.
+ * @param resumeData The resumeData of the response of the original download. If nil the download
+ *                   starts from the beginning.
+ * @param priority   The initial priority of the request.
+ * @param handler    Upon completion, the specified handler is invoked; no guarantees are made as to which
+ *                   thread it is invoked on. The response has a status code of 206 if the download
+ *                   has been resumed and bytesReceived only counts the bytes received after resuming.
+ *
+ * @return           A DCXHTTPRequest object that can be used to track progress, adjust the priority of
+ *                   the request and to cancel it.
+ */
+- (DCXHTTPRequest *)getResponseForDownloadRequest:(NSURLRequest *)request toPath:(NSString *)path
+                                       resumeData:(NSData *)resumeData
+                                  requestPriority:(NSOperationQueuePriority)priority
+                                completionHandler:(void (^)(DCXHTTPResponse *))handler;
+
 /**
  * Uploads the file at the given path asynchronously.
  *
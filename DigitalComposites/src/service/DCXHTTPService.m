@@ -22,6 +22,7 @@
 
 #import "DCXHTTPService.h"
 
+#import "DCXConcurrencyController.h"
 #import "DCXError.h"
 #import "DCXHTTPRequest_Internal.h"
 #import "DCXHTTPResponse.h"
@@ -29,12 +30,16 @@
 #import "DCXFileUtils.h"
 #import "DCXNetworkUtils.h"
 #import "DCXRequestOperation.h"
+#import "DCXTransferMetrics.h"
 
 #import <libkern/OSAtomic.h>
 
 // The allowed limit on request concurrency. Clients may configure
 // this lower, but not higher.
-const NSInteger DCXHTTPServiceMaxConcurrentRequests = 5;
+const NSInteger DCXHTTPServiceMaxConcurrentRequests = 16;
+
+// The request concurrency a service starts out with.
+const NSInteger DCXHTTPServiceDefaultConcurrentRequests = 5;
 
 /** The number of units of work we add to each http request progress to account for misc
  * work after completion and to avoid premature completion of a progress object if the request fails
@@ -43,6 +48,14 @@ int64_t const DCXHTTPProgressCompletionFudge = 10;
 
 const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
 
+// Every retry of a failed request costs one token of the budget of its host while every successful
+// request refunds a fraction of a token. This keeps a failing host from multiplying the load on it.
+const double DCXHTTPServiceRetryBudgetPerHost = 10;
+const double DCXHTTPServiceRetryBudgetRefund = 0.1;
+
+// We don't retry requests if the server asks us to wait longer than this (in seconds).
+const NSTimeInterval DCXHTTPServiceMaxRetryAfterDelay = 60;
+
 ///////////
 //
 // There have been bugs where iOS caches responses to non-GET requests (PUT, HEAD) and returns
@@ -111,9 +124,16 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
 
 @implementation DCXHTTPService
 {
-    // The queue that dispatches requests to this service.
+    // The queue that dispatches data (metadata) requests to this service.
     NSOperationQueue *_requestQueue;
 
+    // The queue that dispatches upload and download requests to this service.
+    NSOperationQueue *_transferQueue;
+
+    // Adjust the concurrency of the two queues if adaptsConcurrentRequestCount is set.
+    DCXConcurrencyController *_requestConcurrency;
+    DCXConcurrencyController *_transferConcurrency;
+
     // A list of the last MAX_NUM_CONCURRENT_REQUESTS tokens for which the delegate
     // (if any) has received an HTTPServiceAuthenticationDidFail: message. It is
     // used to avoid sending the delegate a second message for any single token.
@@ -137,6 +157,9 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
 
     // Dictionary to keep track of and look up active request operations by their url session task.
     NSMutableDictionary *_activeRequestOperations;
+
+    // The remaining retry budget (NSNumber) by host name.
+    NSMutableDictionary *_retryBudgets;
 }
 
 - (instancetype)initWithUrl:(NSURL *)url
@@ -147,7 +170,11 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
     if (self)
     {
         _requestQueue = [[NSOperationQueue alloc] init];
-        _requestQueue.maxConcurrentOperationCount = DCXHTTPServiceMaxConcurrentRequests;
+        _requestQueue.maxConcurrentOperationCount = DCXHTTPServiceDefaultConcurrentRequests;
+        _transferQueue = [[NSOperationQueue alloc] init];
+        _transferQueue.maxConcurrentOperationCount = DCXHTTPServiceDefaultConcurrentRequests;
+        _requestConcurrency = [[DCXConcurrencyController alloc] initWithQueue:_requestQueue normalizeByBytes:NO];
+        _transferConcurrency = [[DCXConcurrencyController alloc] initWithQueue:_transferQueue normalizeByBytes:YES];
 
         _baseURL = url;
         _recentAuthTokens = [NSMutableArray arrayWithCapacity:DCXHTTPServiceMaxConcurrentRequests];
@@ -160,9 +187,11 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
         _retryOn5xxDelays =  @[@.1, @1, @2]; // Retry 3 times after .1, 1, and 2 seconds
 
         _activeRequestOperations = [NSMutableDictionary dictionaryWithCapacity:DCXHTTPServiceMaxConcurrentRequests];
+        _retryBudgets = [NSMutableDictionary dictionary];
 
         NSURLSessionConfiguration *sessionConfiguration = [NSURLSessionConfiguration defaultSessionConfiguration];
-        sessionConfiguration.HTTPMaximumConnectionsPerHost = DCXHTTPServiceMaxConcurrentRequests;
+        // Data requests and transfers are dispatched by separate queues
+        sessionConfiguration.HTTPMaximumConnectionsPerHost = 2 * DCXHTTPServiceMaxConcurrentRequests;
         NSMutableDictionary *headers = [NSMutableDictionary dictionaryWithDictionary:additionalHTTPHeaders];
         sessionConfiguration.HTTPAdditionalHeaders = headers;
         
@@ -206,15 +235,38 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
 
 #pragma mark - Queue Operation
 
-- (void)setConcurrentRequestCount:(NSInteger)concurrentRequestCount
+- (BOOL)operationUsesDataQueue:(DCXRequestOperation *)operation
+{
+    return operation.type == DCXDataRequestType || operation.usesDataQueue;
+}
+
+- (NSOperationQueue *)queueForOperation:(DCXRequestOperation *)operation
+{
+    return [self operationUsesDataQueue:operation] ? _requestQueue : _transferQueue;
+}
+
+- (DCXConcurrencyController *)concurrencyControllerForOperation:(DCXRequestOperation *)operation
+{
+    return [self operationUsesDataQueue:operation] ? _requestConcurrency : _transferConcurrency;
+}
+
+- (void)validateConcurrentRequestCount:(NSInteger)concurrentRequestCount
 {
     if (concurrentRequestCount < 1 || concurrentRequestCount > DCXHTTPServiceMaxConcurrentRequests)
     {
-        NSException *ex = [NSException exceptionWithName:NSRangeException reason:@"Allowable concurrent request count range is 1..5" userInfo:nil];
+        NSString *reason = [NSString stringWithFormat:@"Allowable concurrent request count range is 1..%ld",
+                            (long)DCXHTTPServiceMaxConcurrentRequests];
+        NSException *ex = [NSException exceptionWithName:NSRangeException reason:reason userInfo:nil];
         @throw ex;
     }
+}
 
-    _requestQueue.maxConcurrentOperationCount = concurrentRequestCount;
+- (void)setConcurrentRequestCount:(NSInteger)concurrentRequestCount
+{
+    [self validateConcurrentRequestCount:concurrentRequestCount];
+
+    _requestConcurrency.limit = concurrentRequestCount;
+    _transferConcurrency.limit = concurrentRequestCount;
 }
 
 - (NSInteger)concurrentRequestCount
@@ -222,6 +274,18 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
     return _requestQueue.maxConcurrentOperationCount;
 }
 
+- (void)setConcurrentTransferRequestCount:(NSInteger)concurrentTransferRequestCount
+{
+    [self validateConcurrentRequestCount:concurrentTransferRequestCount];
+
+    _transferConcurrency.limit = concurrentTransferRequestCount;
+}
+
+- (NSInteger)concurrentTransferRequestCount
+{
+    return _transferQueue.maxConcurrentOperationCount;
+}
+
 - (void)setAuthToken:(NSString *)authToken
 {
     @synchronized(_authTokenHistory){
@@ -246,6 +310,7 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
 - (void)setSuspended:(BOOL)suspended
 {
     _requestQueue.suspended = suspended;
+    _transferQueue.suspended = suspended;
 }
 
 - (BOOL)isSuspended
@@ -288,6 +353,7 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
 - (void)clearQueuedRequests
 {
     [_requestQueue cancelAllOperations];
+    [_transferQueue cancelAllOperations];
 }
 
 - (BOOL)isConnected
@@ -309,6 +375,11 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
     return [session downloadTaskWithRequest:preparedRequest];
 }
 
+- (NSURLSessionTask *)createAsynchronousDownloadRequestWithResumeData:(NSData *)resumeData withSession:(NSURLSession *)session
+{
+    return [session downloadTaskWithResumeData:resumeData];
+}
+
 - (NSURLSessionTask *)createAsynchronousUploadRequest:(NSURLRequest *)preparedRequest fromFile:(NSURL *)fileURL
                                           withSession:(NSURLSession *)session
 {
@@ -329,7 +400,14 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
             break;
 
         case DCXDownloadRequestType:
-            task = [self createAsynchronousDownloadRequest:preparedRequest withSession:_session];
+            if (operation.resumeData != nil)
+            {
+                task = [self createAsynchronousDownloadRequestWithResumeData:operation.resumeData withSession:_session];
+            }
+            else
+            {
+                task = [self createAsynchronousDownloadRequest:preparedRequest withSession:_session];
+            }
             break;
 
         case DCXUploadRequestType:
@@ -359,6 +437,152 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
     }
 }
 
+/* Returns the delay in seconds requested by the Retry-After header of the response or -1. */
+- (NSTimeInterval)retryAfterDelayOfResponse:(DCXHTTPResponse *)response
+{
+    NSString *retryAfter = response.headers[@"retry-after"];
+
+    if (retryAfter == nil)
+    {
+        return -1;
+    }
+
+    NSScanner *scanner = [NSScanner scannerWithString:retryAfter];
+    NSInteger seconds = 0;
+
+    if ([scanner scanInteger:&seconds] && scanner.isAtEnd)
+    {
+        return MAX(0, seconds);
+    }
+
+    // Otherwise it must be an HTTP date
+    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+    formatter.locale = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
+    formatter.timeZone = [NSTimeZone timeZoneWithAbbreviation:@"GMT"];
+    formatter.dateFormat = @"EEE',' dd MMM yyyy HH':'mm':'ss 'GMT'";
+    NSDate *date = [formatter dateFromString:retryAfter];
+
+    return date == nil ? -1 : MAX(0, [date timeIntervalSinceNow]);
+}
+
+/* Decides whether a request that failed with a retriable status should get retried and if so
+ * after what delay. Consumes a token of the retry budget of the host. */
+- (BOOL)shouldRetryOperation:(DCXRequestOperation *)requestOperation
+               afterResponse:(DCXHTTPResponse *)response
+                     forHost:(NSString *)host
+                   withDelay:(NSTimeInterval *)delayPtr
+{
+    NSTimeInterval backoff = 0;
+
+    @synchronized(_retryOn5xxDelays)
+    {
+        if (requestOperation.retryCount >= _retryOn5xxDelays.count)
+        {
+            return NO;
+        }
+
+        backoff = [[_retryOn5xxDelays objectAtIndex:requestOperation.retryCount] doubleValue];
+    }
+
+    // Spread out retries of requests that failed at the same time
+    NSTimeInterval delay = backoff * (0.5 + arc4random_uniform(1001) / 1000.0);
+
+    NSTimeInterval retryAfter = [self retryAfterDelayOfResponse:response];
+
+    if (retryAfter > DCXHTTPServiceMaxRetryAfterDelay)
+    {
+        return NO;
+    }
+
+    delay = MAX(delay, retryAfter);
+
+    if (host != nil)
+    {
+        @synchronized(_retryBudgets)
+        {
+            NSNumber *budget = _retryBudgets[host];
+            double tokens = budget == nil ? DCXHTTPServiceRetryBudgetPerHost : budget.doubleValue;
+
+            if (tokens < 1)
+            {
+                return NO;
+            }
+
+            _retryBudgets[host] = @(tokens - 1);
+        }
+    }
+
+    *delayPtr = delay;
+    return YES;
+}
+
+- (void)replenishRetryBudgetForHost:(NSString *)host
+{
+    if (host == nil)
+    {
+        return;
+    }
+
+    @synchronized(_retryBudgets)
+    {
+        NSNumber *budget = _retryBudgets[host];
+
+        if (budget != nil)
+        {
+            // Rounding keeps ten refunds of a tenth from adding up to slightly less than a whole token
+            double tokens = round((budget.doubleValue + DCXHTTPServiceRetryBudgetRefund) * 1000) / 1000;
+            _retryBudgets[host] = tokens < DCXHTTPServiceRetryBudgetPerHost ? @(tokens) : nil;
+        }
+    }
+}
+
+- (void)enqueueOperation:(DCXRequestOperation *)requestOperation
+{
+    requestOperation.enqueueDate = [NSDate date];
+    [[self queueForOperation:requestOperation] addOperation:requestOperation];
+}
+
+/* Reports the metrics of a request attempt to the metrics sink. */
+- (void)reportMetricsOfOperation:(DCXRequestOperation *)requestOperation
+                     withRequest:(NSURLRequest *)request
+                        response:(DCXHTTPResponse *)response
+                       startDate:(NSDate *)startDate
+                       willRetry:(BOOL)willRetry
+{
+    id<DCXTransferMetricsSink> sink = self.metricsSink;
+
+    if (sink == nil)
+    {
+        return;
+    }
+
+    DCXRequestMetrics *metrics = [[DCXRequestMetrics alloc] init];
+    metrics.URL = request.URL;
+    metrics.HTTPMethod = request.HTTPMethod;
+    metrics.kind = (requestOperation.type == DCXUploadRequestType ? DCXRequestMetricsKindUpload :
+                    requestOperation.type == DCXDownloadRequestType ? DCXRequestMetricsKindDownload :
+                    DCXRequestMetricsKindData);
+    metrics.statusCode = response.statusCode;
+    metrics.error = response.error;
+    metrics.retryCount = requestOperation.retryCount;
+    metrics.willRetry = willRetry;
+    metrics.bytesSent = response.bytesSent;
+    metrics.bytesReceived = response.bytesReceived;
+    metrics.requestDuration = -[startDate timeIntervalSinceNow];
+
+    if (requestOperation.enqueueDate != nil)
+    {
+        metrics.queueWaitDuration = [startDate timeIntervalSinceDate:requestOperation.enqueueDate];
+    }
+
+    // Requests without a response body don't get a first byte callback so we use the completion
+    metrics.timeToFirstByte = (requestOperation.firstByteDate != nil ?
+                               [requestOperation.firstByteDate timeIntervalSinceDate:startDate] :
+                               metrics.requestDuration);
+
+    [sink didFinishRequestWithMetrics:metrics];
+}
+
 - (void)processQueuedOperation:(DCXRequestOperation *)requestOperation
 {
     // For errors that indicate temporary conditions, such as an authentication failure,
@@ -366,9 +590,10 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
     BOOL shouldRescheduleThisRequest = NO;
 
     // In the case of intermittent server errors (5xx responses) we want to retry for a number
-    // of times before giving up. These variables control that behavior.
-    BOOL keepTrying = YES;
-    NSUInteger retryCount = 0;
+    // of times before giving up. The retry gets scheduled after retryDelay so that this
+    // operation doesn't hold on to a slot of the queue while waiting.
+    BOOL shouldRetryThisRequest = NO;
+    NSTimeInterval retryDelay = 0;
 
     __block DCXHTTPResponse *result = nil;
 
@@ -393,28 +618,15 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
 
     if (!uploadAbortedDueToMissingFile)
     {
-        while (keepTrying && !requestOperation.isCancelled)
+        if (!self.isConnected)
+        {
+            // Short circuit the case where the service got disconnected and we didn't get a chance
+            // to flush the queue yet.
+            result = [[DCXHTTPResponse alloc] init];
+            result.error = [DCXErrorUtils ErrorWithCode:DCXErrorServiceDisconnected domain:DCXErrorDomain details:nil];
+        }
+        else if (!requestOperation.isCancelled)
         {
-            if (retryCount > 0)
-            {
-                // We need to wait a while before trying again
-                NSTimeInterval delay = 0;
-                @synchronized(_retryOn5xxDelays)
-                {
-                    delay = [[_retryOn5xxDelays objectAtIndex:retryCount - 1] doubleValue];
-                }
-                [NSThread sleepForTimeInterval:delay];
-            }
-
-            if (!self.isConnected)
-            {
-                // Short circuit the case where the service got disconnected and we didn't get a chance
-                // to flush the queue yet.
-                result = [[DCXHTTPResponse alloc] init];
-                result.error = [DCXErrorUtils ErrorWithCode:DCXErrorServiceDisconnected domain:DCXErrorDomain details:nil];
-                break;
-            }
-
             // Prepare the request.
             NSString *tokenForThisRequest = nil;
             @synchronized(_authToken)
@@ -424,6 +636,7 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
 
             NSMutableURLRequest *preparedRequest = [self prepareRequest:requestOperation.request withAuthToken:tokenForThisRequest andId:requestOperation.id];
             NSCondition *condition = [[NSCondition alloc] init];
+            NSDate *requestStart = [NSDate date];
 
             // Make the request.
             result = nil;
@@ -448,6 +661,17 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
 
             NSInteger statusCode = result.statusCode;
 
+            if (self.adaptsConcurrentRequestCount && !requestOperation.isCancelled)
+            {
+                // Don't grow the concurrency while the service is still recovering from errors.
+                [[self concurrencyControllerForOperation:requestOperation]
+                    requestDidFinishWithDuration:-[requestStart timeIntervalSinceNow]
+                                transferredBytes:result.bytesSent + result.bytesReceived
+                                      statusCode:statusCode
+                                           error:result.error
+                                    growthPaused:_recentErrorCount > 0];
+            }
+
             if (statusCode == 401 || (statusCode == 400 && _authToken == nil)) // authentication failure
             {
                 result.error = [DCXErrorUtils ErrorWithCode:DCXErrorAuthenticationFailed
@@ -477,7 +701,7 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
 
                     if (!alreadyAddressed && strongDelegate != nil)
                     {
-                        _requestQueue.suspended = YES;
+                        self.suspended = YES;
                         _shouldRescheduleOnFailure = [strongDelegate HTTPServiceAuthenticationDidFail:self];
                     }
 
@@ -492,7 +716,6 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
                     }
 
                     shouldRescheduleThisRequest = _shouldRescheduleOnFailure;
-                    keepTrying = NO;
                 }
             }
             else if (statusCode == 403) // HTTP Forbidden error
@@ -500,42 +723,29 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
                 result.error = [DCXErrorUtils ErrorWithCode:DCXErrorRequestForbidden
                                                               domain:DCXErrorDomain
                                                              details:nil];
-                keepTrying = NO;
             }
-            else if ((statusCode > 499) &&
-                     (statusCode < 600) &&
-                     (statusCode != 501) &&     // 501 = not implemented
-                     (statusCode != 507))       // 507 = quota exceeded
+            else if (statusCode == 429 ||       // 429 = too many requests
+                     ((statusCode > 499) &&
+                      (statusCode < 600) &&
+                      (statusCode != 501) &&    // 501 = not implemented
+                      (statusCode != 507)))     // 507 = quota exceeded
             {
                 //
-                // A 5xx response code.
+                // A 5xx response code or a request to slow down.
                 // This can be an intermittent failure. We want to retry.
-                @synchronized(_retryOn5xxDelays)
-                {
-                    keepTrying = (retryCount < _retryOn5xxDelays.count);
-                }
-
-                if (keepTrying)
-                {
-                    retryCount++;
-                    DCXHTTPRequest *strongRequest = requestOperation.weakClientRequestObject;
-
-                    if (strongRequest != nil)
-                    {
-                        // Need to reset the progress for this operation
-                        strongRequest.progress.completedUnitCount = 0;
-                    }
-
-                    // Need to reset these for the next iteration of the loop.
-                    result = nil;
-                    requestOperation.receivedData = nil;
-                }
+                shouldRetryThisRequest = [self shouldRetryOperation:requestOperation
+                                                      afterResponse:result
+                                                            forHost:preparedRequest.URL.host
+                                                          withDelay:&retryDelay];
             }
             else
             {
                 // Success
-                keepTrying = NO;
+                [self replenishRetryBudgetForHost:preparedRequest.URL.host];
             }
+
+            [self reportMetricsOfOperation:requestOperation withRequest:preparedRequest response:result
+                                 startDate:requestStart willRetry:shouldRetryThisRequest];
         }
     }
 
@@ -547,7 +757,7 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
                                     ([localErr.domain isEqualToString:NSURLErrorDomain] &&
                                      (localErr.code == NSURLErrorCancelled)));
 
-    if (!isCancelled && !uploadAbortedDueToMissingFile && !shouldRescheduleThisRequest)
+    if (!isCancelled && !uploadAbortedDueToMissingFile && !shouldRescheduleThisRequest && !shouldRetryThisRequest)
     {
         // Update our error statistics. For now we simply keep a running count of recent errors from
         // which we subtract all successful requests.
@@ -590,7 +800,29 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
 
     if (shouldRescheduleThisRequest && !self.shouldStopEnqueueingRequests)
     {
-        [_requestQueue addOperation:[requestOperation copy]];
+        [self enqueueOperation:[requestOperation copy]];
+    }
+    else if (shouldRetryThisRequest && !self.shouldStopEnqueueingRequests)
+    {
+        // The copy takes over the client request object so that the request can still be
+        // cancelled or reprioritized while we wait.
+        DCXRequestOperation *retryOperation = [requestOperation copy];
+        retryOperation.retryCount = requestOperation.retryCount + 1;
+        __weak DCXHTTPService *weakSelf = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(retryDelay * NSEC_PER_SEC)),
+                       dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            DCXHTTPService *strongSelf = weakSelf;
+
+            if (strongSelf == nil || strongSelf.shouldStopEnqueueingRequests)
+            {
+                // The service has been invalidated in the meantime. Cancelling notifies the requester.
+                [retryOperation cancel];
+            }
+            else if (!retryOperation.isCancelled)
+            {
+                [strongSelf enqueueOperation:retryOperation];
+            }
+        });
     }
     else
     {
@@ -603,6 +835,18 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
                                     withPath:(NSString *)path
                              requestPriority:(NSOperationQueuePriority)priority
                            completionHandler:(void (^)(DCXHTTPResponse *))handler
+{
+    return [self scheduleRequest:request ofType:type withPath:path resumeData:nil usesDataQueue:NO
+                 requestPriority:priority completionHandler:handler];
+}
+
+- (DCXHTTPRequest *)scheduleRequest:(NSURLRequest *)request
+                             ofType:(DCXRequestType)type
+                           withPath:(NSString *)path
+                         resumeData:(NSData *)resumeData
+                      usesDataQueue:(BOOL)usesDataQueue
+                    requestPriority:(NSOperationQueuePriority)priority
+                  completionHandler:(void (^)(DCXHTTPResponse *))handler
 {
     NSError *error = nil;
     
@@ -637,6 +881,8 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
     op.request = request;
     op.type = type;
     op.path = path;
+    op.resumeData = resumeData;
+    op.usesDataQueue = usesDataQueue;
     op.invocationBlock = ^(DCXRequestOperation *request){
         [self processQueuedOperation:request];
     };
@@ -649,7 +895,7 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
 
     op.weakClientRequestObject = httpRequest;
     httpRequest.priority = priority;
-    [_requestQueue addOperation:op];
+    [self enqueueOperation:op];
 
     // Return the client-facing request object
     return httpRequest;
@@ -858,6 +1104,11 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
 
     if (operation != nil)
     {
+        if (operation.firstByteDate == nil)
+        {
+            operation.firstByteDate = [NSDate date];
+        }
+
         if (operation.receivedData == nil)
         {
             operation.receivedData = [data mutableCopy];
@@ -886,7 +1137,9 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
     }
     NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse *)downloadTask.response;
 
-    if (operation != nil && httpResponse != nil && httpResponse.statusCode == 200)
+    // A resumed download completes with 206 Partial Content
+    if (operation != nil && httpResponse != nil
+        && (httpResponse.statusCode == 200 || (httpResponse.statusCode == 206 && operation.resumeData != nil)))
     {
         // Atomically move the downloaded file into place
         NSError *error = nil;
@@ -897,6 +1150,11 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
             operation.error = error;
         }
     }
+    else if (operation != nil && httpResponse != nil)
+    {
+        // Keep the body of an error response for the error details. It gets deleted once we return.
+        operation.receivedData = [NSMutableData dataWithContentsOfURL:location];
+    }
 }
 
 /* The task did receive some data. We just update the appropriate progress object. */
@@ -910,6 +1168,17 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
 - (void)URLSession:(NSURLSession *)session downloadTask:(NSURLSessionDownloadTask *)downloadTask
       didWriteData:(int64_t)bytesWritten totalBytesWritten:(int64_t)totalBytesWritten totalBytesExpectedToWrite:(int64_t)totalBytesExpectedToWrite
 {
+    DCXRequestOperation *operation = nil;
+
+    @synchronized(_activeRequestOperations){
+        operation = _activeRequestOperations[downloadTask];
+    }
+
+    if (operation != nil && operation.firstByteDate == nil)
+    {
+        operation.firstByteDate = [NSDate date];
+    }
+
     [self updateProgressFromTask:downloadTask];
 }
 
@@ -938,6 +1207,35 @@ const NSInteger DCXHTTPServiceMaxAuthTokenHistory = 3;
                completionHandler:handler];
 }
 
+- (DCXHTTPRequest *)getResponseForDownloadRequest:(NSURLRequest *)request
+                                           toPath:(NSString *)path
+                                       resumeData:(NSData *)resumeData
+                                  requestPriority:(NSOperationQueuePriority)priority
+                                completionHandler:(void (^)(DCXHTTPResponse *))handler
+{
+    return [self scheduleRequest:request
+                          ofType:DCXDownloadRequestType
+                        withPath:path
+                      resumeData:resumeData
+                   usesDataQueue:NO
+                 requestPriority:priority
+               completionHandler:handler];
+}
+
+- (DCXHTTPRequest *)getResponseForDataRequest:(NSURLRequest *)request
+                                 streamToPath:(NSString *)path
+                              requestPriority:(NSOperationQueuePriority)priority
+                            completionHandler:(void (^)(DCXHTTPResponse *))handler
+{
+    return [self scheduleRequest:request
+                          ofType:DCXDownloadRequestType
+                        withPath:path
+                      resumeData:nil
+                   usesDataQueue:YES
+                 requestPriority:priority
+               completionHandler:handler];
+}
+
 - (DCXHTTPRequest *)getResponseForUploadRequest:(NSURLRequest *)request
                                                 fromPath:(NSString *)path
                                          requestPriority:(NSOperationQueuePriority)priority
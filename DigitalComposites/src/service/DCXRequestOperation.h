@@ -63,6 +63,14 @@ typedef NS_ENUM (NSInteger, DCXRequestType){
 /** The path of the request (for a download or upload). */
 @property NSString *path;
 
+/** Whether the operation goes through the queue of data requests regardless of its type, e.g. for
+ * metadata that gets downloaded to a file. */
+@property BOOL usesDataQueue;
+
+/** The resume data of an earlier download of the same file. Only used once, so it doesn't get copied
+ * when the operation is retried. */
+@property NSData *resumeData;
+
 /** The block invoked when this request is to be issued. */
 @property (strong)void(^ invocationBlock)(DCXRequestOperation *);
 
@@ -75,6 +83,15 @@ typedef NS_ENUM (NSInteger, DCXRequestType){
 /** Request id to track if this request has been issued previously */
 @property NSString *originalId;
 
+/** The number of times this request has been retried after an intermittent server error. */
+@property NSUInteger retryCount;
+
+/** When this operation has been added to its queue. */
+@property NSDate *enqueueDate;
+
+/** When the first byte of the response to this operation's request has arrived. */
+@property NSDate *firstByteDate;
+
 /** Used to store an error from a request. */
 @property NSError *error;
 
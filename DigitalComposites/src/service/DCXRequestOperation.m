@@ -86,10 +86,21 @@
     // Call super class -- This removes the operation from its queue if it is still queued.
     [super cancel];
 
-    if (_sessionTask != nil && _sessionTask.state != NSURLSessionTaskStateCompleted)
+    NSURLSessionTask *task = _sessionTask;
+
+    if (task != nil && task.state != NSURLSessionTaskStateCompleted)
     {
         // Need to cancel the active task
-        [_sessionTask cancel];
+        if ([task isKindOfClass:[NSURLSessionDownloadTask class]])
+        {
+            // Lets the caller resume the download later. The resume data also ends up in the error that
+            // gets passed to the session delegate, which is where DCXErrorUtils ResumeDataOfError: finds it.
+            [(NSURLSessionDownloadTask *)task cancelByProducingResumeData:^(NSData *resumeData) {}];
+        }
+        else
+        {
+            [task cancel];
+        }
     }
     else
     {
@@ -109,9 +120,14 @@
     result.request             = self.request;
     result.type                = self.type;
     result.path                = self.path;
+    result.usesDataQueue       = self.usesDataQueue;
     result.invocationBlock     = self.invocationBlock;
     result.notificationBlock   = self.notificationBlock;
     result.originalId          = self.originalId;
+    // A retried download continues from where the resumed one has started and retries count against
+    // the limit of the original request
+    result.resumeData          = self.resumeData;
+    result.retryCount          = self.retryCount;
 
     // Need to make sure that the client request object gets copied over and redirected to point
     // to the new operation.
@@ -99,6 +99,26 @@
         return [self.service getResponseForUploadRequest:request fromPath:path requestPriority:priority completionHandler:handler];
     }
 }
+
+- (DCXHTTPRequest *)getResponseFor:(NSMutableURLRequest *)request
+                      streamDataTo:(NSString *)path
+                   requestPriority:(NSOperationQueuePriority)priority
+                 completionHandler:(void (^)(DCXHTTPResponse *response))handler
+{
+    return [self.service getResponseForDataRequest:request streamToPath:path
+                                   requestPriority:priority completionHandler:handler];
+}
+
+- (DCXHTTPRequest *)getResponseFor:(NSMutableURLRequest *)request
+                        downloadTo:(NSString *)path
+                        resumeData:(NSData *)resumeData
+                   requestPriority:(NSOperationQueuePriority)priority
+                 completionHandler:(void (^)(DCXHTTPResponse *response))handler
+{
+    return [self.service getResponseForDownloadRequest:request toPath:path resumeData:resumeData
+                                       requestPriority:priority completionHandler:handler];
+}
+
 // Construct an error from a response.
 - (NSError *)errorFromResponse:(DCXHTTPResponse *)response andPath:(NSString *)path details:(NSString *)details
 {
@@ -84,6 +84,34 @@
                    requestPriority:(NSOperationQueuePriority)priority
                  completionHandler:(void (^)(DCXHTTPResponse *response))handler;
 
+/**
+ * \brief Issues a metadata request and writes the body of a successful response to a file. The request
+ * goes through the queue of data requests. The body of an error response ends up in the data of the response.
+ *
+ * \param request  The GET request.
+ * \param path     The file to write the body to.
+ * \param priority The prioprity of the HTTP request.
+ * \param handler  Called when the request has finished or failed.
+ */
+- (DCXHTTPRequest *)getResponseFor:(NSMutableURLRequest *)request
+                      streamDataTo:(NSString *)path
+                   requestPriority:(NSOperationQueuePriority)priority
+                 completionHandler:(void (^)(DCXHTTPResponse *response))handler;
+
+/**
+ * \brief Downloads to a file, resuming an earlier download if possible.
+ *
+ * \param request    The GET request of the download.
+ * \param path       The file to download to.
+ * \param resumeData The resume data of an earlier failed download of the same request. Can be nil.
+ * \param priority   The prioprity of the HTTP request.
+ * \param handler    Called when the download has finished or failed.
+ */
+- (DCXHTTPRequest *)getResponseFor:(NSMutableURLRequest *)request
+                        downloadTo:(NSString *)path resumeData:(NSData *)resumeData
+                   requestPriority:(NSOperationQueuePriority)priority
+                 completionHandler:(void (^)(DCXHTTPResponse *response))handler;
+
 /**
  * \brief Constructs an error for the response.
  *
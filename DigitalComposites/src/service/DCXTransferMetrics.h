@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+
+/** The kind of request a DCXRequestMetrics object describes. */
+typedef NS_ENUM (NSInteger, DCXRequestMetricsKind){
+    DCXRequestMetricsKindData,
+    DCXRequestMetricsKindDownload,
+    DCXRequestMetricsKindUpload
+};
+
+/** Phases of a push or pull that get reported to DCXTransferMetricsSink::didFinishPhase:ofComposite:withDuration: */
+
+/** The whole push from the call of pushComposite until its completion handler gets called. */
+extern NSString *const DCXTransferPhasePush;
+/** Determining which components of the pushed manifest need to be uploaded. */
+extern NSString *const DCXTransferPhasePushComponentDiff;
+/** Determining which components need to be uploaded and uploading all of them. */
+extern NSString *const DCXTransferPhasePushComponents;
+/** Uploading the manifest after all components have been uploaded. */
+extern NSString *const DCXTransferPhasePushManifestUpload;
+/** DCXComposite::acceptPushWithError: */
+extern NSString *const DCXTransferPhaseAcceptPush;
+/** The whole pull from the call of pullComposite until its completion handler gets called. */
+extern NSString *const DCXTransferPhasePull;
+/** Fetching the manifest of a pull. */
+extern NSString *const DCXTransferPhasePullManifestFetch;
+/** Downloading all the components of a pull. */
+extern NSString *const DCXTransferPhasePullComponents;
+/** DCXComposite::resolvePullWithBranch:withError: */
+extern NSString *const DCXTransferPhaseResolvePull;
+
+/**
+ * \brief Data object that captures where the time of a single HTTP request went.
+ *
+ * Each attempt of a request gets its own metrics object, i.e. a request that gets retried after
+ * a server error gets reported once per attempt.
+ */
+@interface DCXRequestMetrics : NSObject
+
+/** The URL of the request. */
+@property (nonatomic) NSURL *URL;
+
+/** The HTTP method of the request. */
+@property (nonatomic) NSString *HTTPMethod;
+
+/** Whether this was a data request, a download or an upload. */
+@property (nonatomic) DCXRequestMetricsKind kind;
+
+/** The HTTP status code returned by the server or 0 if there was no response. */
+@property (nonatomic) int statusCode;
+
+/** The error the attempt has failed with or nil. */
+@property (nonatomic) NSError *error;
+
+/** The number of previous attempts of this request. */
+@property (nonatomic) NSUInteger retryCount;
+
+/** Whether this attempt has failed in a way that causes the request to get retried. */
+@property (nonatomic) BOOL willRetry;
+
+/** Time in seconds the request has spent waiting in the queue of the service. */
+@property (nonatomic) NSTimeInterval queueWaitDuration;
+
+/** Time in seconds from issuing the request until the first byte of the response has arrived. This
+ * includes establishing the connection and, for uploads, sending the body. */
+@property (nonatomic) NSTimeInterval timeToFirstByte;
+
+/** Time in seconds from issuing the request until it has completed. */
+@property (nonatomic) NSTimeInterval requestDuration;
+
+/** Number of bytes sent. */
+@property (nonatomic) int64_t bytesSent;
+
+/** Number of bytes received. */
+@property (nonatomic) int64_t bytesReceived;
+
+@end
+
+/**
+ * \brief Protocol for objects that collect transfer metrics.
+ *
+ * Sinks get called on arbitrary threads, possibly concurrently, and should return quickly since they
+ * get called on the threads that process the requests.
+ */
+@protocol DCXTransferMetricsSink <NSObject>
+
+/**
+ * \brief Called after each attempt of an HTTP request.
+ *
+ * \param metrics The metrics of the attempt.
+ */
+- (void)didFinishRequestWithMetrics:(DCXRequestMetrics *)metrics;
+
+@optional
+
+/**
+ * \brief Called after a phase of a push or pull has finished, successfully or not.
+ *
+ * \param phase       One of the DCXTransferPhase constants.
+ * \param compositeId The id of the composite that was pushed or pulled.
+ * \param duration    The duration of the phase in seconds.
+ */
+- (void)didFinishPhase:(NSString *)phase ofComposite:(NSString *)compositeId withDuration:(NSTimeInterval)duration;
+
+@end
+
+/**
+ * \brief Records values in logarithmic buckets so that percentiles can be computed in constant memory.
+ *
+ * Values between a microsecond and a billion seconds (or bytes) get recorded with a relative error
+ * of less than 3%. This class is thread-safe.
+ */
+@interface DCXMetricsHistogram : NSObject
+
+/** The number of recorded values. */
+@property (readonly) uint64_t count;
+
+/** The smallest recorded value. */
+@property (readonly) double min;
+
+/** The largest recorded value. */
+@property (readonly) double max;
+
+/** The mean of the recorded values. */
+@property (readonly) double mean;
+
+/**
+ * \brief Records a value. Negative values get recorded as 0.
+ *
+ * \param value The value to record.
+ */
+- (void)recordValue:(double)value;
+
+/**
+ * \brief Returns an estimate of the value below which the given fraction of all values lies.
+ *
+ * \param fraction The fraction in the range 0 to 1, e.g. 0.95 for the 95th percentile.
+ *
+ * \return The value of the percentile or 0 if no values have been recorded.
+ */
+- (double)valueAtPercentile:(double)fraction;
+
+/** Removes all recorded values. */
+- (void)reset;
+
+@end
+
+/**
+ * \brief A DCXTransferMetricsSink that aggregates metrics in memory.
+ *
+ * Request metrics get recorded in histograms keyed by the kind of request and the measure, e.g.
+ * "upload.queueWait", "upload.timeToFirstByte", "upload.duration" and "upload.bytes". Phases get
+ * recorded in histograms keyed by the name of the phase. This class is thread-safe.
+ */
+@interface DCXTransferMetricsAggregator : NSObject <DCXTransferMetricsSink>
+
+/** The number of request attempts recorded. */
+@property (readonly) NSUInteger requestCount;
+
+/** The number of request attempts that have failed with an error or a 5xx status code. */
+@property (readonly) NSUInteger failedRequestCount;
+
+/** The number of requests that have been retried at least once. */
+@property (readonly) NSUInteger retriedRequestCount;
+
+/** The keys of all histograms that have been recorded so far. */
+@property (readonly) NSArray *histogramKeys;
+
+/**
+ * \brief Returns the histogram for the given key.
+ *
+ * \param key The key of the histogram.
+ *
+ * \return The histogram or nil if nothing has been recorded for the key.
+ */
+- (DCXMetricsHistogram *)histogramForKey:(NSString *)key;
+
+/**
+ * \brief Returns a human readable summary with the count, p50, p95, p99 and max of each histogram.
+ */
+- (NSString *)summary;
+
+/** Removes all recorded metrics. */
+- (void)reset;
+
+@end
@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2015 Adobe Systems Incorporated. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#import "DCXTransferMetrics.h"
+
+NSString *const DCXTransferPhasePush                = @"push";
+NSString *const DCXTransferPhasePushComponentDiff   = @"push.componentDiff";
+NSString *const DCXTransferPhasePushComponents      = @"push.components";
+NSString *const DCXTransferPhasePushManifestUpload  = @"push.manifestUpload";
+NSString *const DCXTransferPhaseAcceptPush          = @"push.accept";
+NSString *const DCXTransferPhasePull                = @"pull";
+NSString *const DCXTransferPhasePullManifestFetch   = @"pull.manifestFetch";
+NSString *const DCXTransferPhasePullComponents      = @"pull.components";
+NSString *const DCXTransferPhaseResolvePull         = @"pull.resolve";
+
+// Bucket i > 0 covers the values [min * growth^(i-1), min * growth^i). Bucket 0 holds everything
+// below min. With a growth of 5% the midpoint of a bucket is off by at most 2.5%.
+static const double DCXHistogramMinValue = 1e-6;
+static const double DCXHistogramGrowth = 1.05;
+static const NSUInteger DCXHistogramBucketCount = 710;
+
+#pragma mark - DCXRequestMetrics
+
+@implementation DCXRequestMetrics
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"%@ %@ -> %d (retry %lu) queued %.3fs, first byte %.3fs, total %.3fs, %lld bytes sent, %lld bytes received",
+            self.HTTPMethod, self.URL, self.statusCode, (unsigned long)self.retryCount, self.queueWaitDuration,
+            self.timeToFirstByte, self.requestDuration, self.bytesSent, self.bytesReceived];
+}
+
+@end
+
+#pragma mark - DCXMetricsHistogram
+
+@implementation DCXMetricsHistogram
+{
+    uint64_t _buckets[DCXHistogramBucketCount];
+    uint64_t _count;
+    double _sum;
+    double _min;
+    double _max;
+}
+
+static NSUInteger bucketOfValue(double value)
+{
+    if (value < DCXHistogramMinValue)
+    {
+        return 0;
+    }
+
+    double index = 1 + floor(log(value / DCXHistogramMinValue) / log(DCXHistogramGrowth));
+
+    return (NSUInteger)MIN(index, DCXHistogramBucketCount - 1);
+}
+
+static double valueOfBucket(NSUInteger bucket)
+{
+    if (bucket == 0)
+    {
+        return 0;
+    }
+
+    double lower = DCXHistogramMinValue * pow(DCXHistogramGrowth, bucket - 1);
+
+    return lower * sqrt(DCXHistogramGrowth);
+}
+
+- (uint64_t)count
+{
+    @synchronized(self)
+    {
+        return _count;
+    }
+}
+
+- (double)min
+{
+    @synchronized(self)
+    {
+        return _min;
+    }
+}
+
+- (double)max
+{
+    @synchronized(self)
+    {
+        return _max;
+    }
+}
+
+- (double)mean
+{
+    @synchronized(self)
+    {
+        return _count == 0 ? 0 : _sum / _count;
+    }
+}
+
+- (void)recordValue:(double)value
+{
+    value = MAX(0, value);
+
+    @synchronized(self)
+    {
+        _buckets[bucketOfValue(value)]++;
+        _min = (_count == 0 ? value : MIN(_min, value));
+        _max = (_count == 0 ? value : MAX(_max, value));
+        _sum += value;
+        _count++;
+    }
+}
+
+- (double)valueAtPercentile:(double)fraction
+{
+    @synchronized(self)
+    {
+        if (_count == 0)
+        {
+            return 0;
+        }
+
+        uint64_t rank = MAX(1, (uint64_t)ceil(MIN(MAX(fraction, 0), 1) * _count));
+        uint64_t seen = 0;
+
+        for (NSUInteger bucket = 0; bucket < DCXHistogramBucketCount; bucket++)
+        {
+            seen += _buckets[bucket];
+
+            if (seen >= rank)
+            {
+                // The exact extremes are known so we don't report anything outside of them
+                return MIN(MAX(valueOfBucket(bucket), _min), _max);
+            }
+        }
+
+        return _max;
+    }
+}
+
+- (void)reset
+{
+    @synchronized(self)
+    {
+        memset(_buckets, 0, sizeof(_buckets));
+        _count = 0;
+        _sum = 0;
+        _min = 0;
+        _max = 0;
+    }
+}
+
+@end
+
+#pragma mark - DCXTransferMetricsAggregator
+
+@implementation DCXTransferMetricsAggregator
+{
+    NSMutableDictionary *_histograms;
+    NSUInteger _requestCount;
+    NSUInteger _failedRequestCount;
+    NSUInteger _retriedRequestCount;
+}
+
+- (instancetype)init
+{
+    self = [super init];
+
+    if (self)
+    {
+        _histograms = [NSMutableDictionary dictionary];
+    }
+
+    return self;
+}
+
+- (DCXMetricsHistogram *)histogramCreatedIfNecessaryForKey:(NSString *)key
+{
+    @synchronized(_histograms)
+    {
+        DCXMetricsHistogram *histogram = _histograms[key];
+
+        if (histogram == nil)
+        {
+            histogram = [[DCXMetricsHistogram alloc] init];
+            _histograms[key] = histogram;
+        }
+
+        return histogram;
+    }
+}
+
+- (void)didFinishRequestWithMetrics:(DCXRequestMetrics *)metrics
+{
+    NSString *kind = (metrics.kind == DCXRequestMetricsKindUpload ? @"upload" :
+                      metrics.kind == DCXRequestMetricsKindDownload ? @"download" : @"data");
+
+    [[self histogramCreatedIfNecessaryForKey:[kind stringByAppendingString:@".queueWait"]] recordValue:metrics.queueWaitDuration];
+    [[self histogramCreatedIfNecessaryForKey:[kind stringByAppendingString:@".timeToFirstByte"]] recordValue:metrics.timeToFirstByte];
+    [[self histogramCreatedIfNecessaryForKey:[kind stringByAppendingString:@".duration"]] recordValue:metrics.requestDuration];
+    [[self histogramCreatedIfNecessaryForKey:[kind stringByAppendingString:@".bytes"]] recordValue:metrics.bytesSent + metrics.bytesReceived];
+
+    @synchronized(_histograms)
+    {
+        _requestCount++;
+
+        if (metrics.error != nil || metrics.statusCode >= 500)
+        {
+            _failedRequestCount++;
+        }
+
+        // A request that gets retried repeatedly counts once
+        if (metrics.retryCount == 1)
+        {
+            _retriedRequestCount++;
+        }
+    }
+}
+
+- (void)didFinishPhase:(NSString *)phase ofComposite:(NSString *)compositeId withDuration:(NSTimeInterval)duration
+{
+    [[self histogramCreatedIfNecessaryForKey:phase] recordValue:duration];
+}
+
+- (NSUInteger)requestCount
+{
+    @synchronized(_histograms)
+    {
+        return _requestCount;
+    }
+}
+
+- (NSUInteger)failedRequestCount
+{
+    @synchronized(_histograms)
+    {
+        return _failedRequestCount;
+    }
+}
+
+- (NSUInteger)retriedRequestCount
+{
+    @synchronized(_histograms)
+    {
+        return _retriedRequestCount;
+    }
+}
+
+- (NSArray *)histogramKeys
+{
+    @synchronized(_histograms)
+    {
+        return [_histograms.allKeys sortedArrayUsingSelector:@selector(compare:)];
+    }
+}
+
+- (DCXMetricsHistogram *)histogramForKey:(NSString *)key
+{
+    @synchronized(_histograms)
+    {
+        return _histograms[key];
+    }
+}
+
+- (NSString *)summary
+{
+    NSMutableString *summary = [NSMutableString stringWithFormat:@"%lu requests, %lu failed, %lu retries\n",
+                                (unsigned long)self.requestCount, (unsigned long)self.failedRequestCount,
+                                (unsigned long)self.retriedRequestCount];
+
+    for (NSString *key in self.histogramKeys)
+    {
+        DCXMetricsHistogram *histogram = [self histogramForKey:key];
+        [summary appendFormat:@"%@: count %llu, p50 %.6g, p95 %.6g, p99 %.6g, max %.6g\n", key, histogram.count,
+         [histogram valueAtPercentile:0.5], [histogram valueAtPercentile:0.95],
+         [histogram valueAtPercentile:0.99], histogram.max];
+    }
+
+    return summary;
+}
+
+- (void)reset
+{
+    @synchronized(_histograms)
+    {
+        [_histograms removeAllObjects];
+        _requestCount = 0;
+        _failedRequestCount = 0;
+        _retriedRequestCount = 0;
+    }
+}
+
+@end
@@ -34,6 +34,10 @@ typedef void (^DCXCompositeRequestCompletionHandler)(DCXComposite *, NSError *);
 typedef void (^DCXManifestRequestCompletionHandler)(DCXManifest *, NSError *);
 typedef void (^DCXComponentRequestCompletionHandler)(DCXComponent *, NSError *);
 
+/** Gets called with the state of a resumable upload (see DCXChunkedUpload) or nil once the upload
+ * can't be resumed anymore. The state can be persisted as JSON. */
+typedef void (^DCXUploadSessionHandler)(NSDictionary *uploadSession);
+
 /**
  * Defines the protocol that a session has to implement in order to be used as a session for the
  * push and pull methods of DCXCompositeXfer.
@@ -228,4 +232,66 @@ typedef void (^DCXComponentRequestCompletionHandler)(DCXComponent *, NSError *);
                     requestPriority:(NSOperationQueuePriority)priority
                        handlerQueue:(NSOperationQueue *)queue
                   completionHandler:(DCXComponentRequestCompletionHandler)handler;
+
+@optional
+
+/**
+ * \brief Download a component asset asynchronously, resuming an earlier download if possible.
+ *
+ * \param component  The component to download.
+ * \param composite  The composite the component belongs to.
+ * \param path       File path to download the component to.
+ * \param resumeData Optional parameter. The resume data of an earlier failed download of the
+ * component (see DCXErrorUtils ResumeDataOfError:). If nil the download starts from the beginning.
+ * \param priority   The priority of the HTTP request.
+ * \param queue      Optional parameter. If not nil queue determines the operation queue handler
+ * gets executed on.
+ * \param handler    Gets called when the download has completed or failed.
+ *
+ * \note If the download fails the error passed to handler may carry data that can be used to
+ * resume it (see DCXErrorUtils ResumeDataOfError:).
+ *
+ * \return           A DCXHTTPRequest object that can be used to track progress, adjust the
+ * priority of the request and to cancel it.
+ */
+-(DCXHTTPRequest*) downloadComponent:(DCXComponent *)component
+                         ofComposite:(DCXComposite *)composite
+                              toPath:(NSString *)path
+                          resumeData:(NSData *)resumeData
+                     requestPriority:(NSOperationQueuePriority)priority
+                        handlerQueue:(NSOperationQueue *)queue
+                   completionHandler:(DCXComponentRequestCompletionHandler)handler;
+
+/**
+ * \brief Upload a component asset asynchronously in a way that can be resumed if it fails.
+ *
+ * \param component      The component to upload.
+ * \param composite      The composite the component belongs to.
+ * \param path           File path of the asset to upload.
+ * \param isNew          Whether the component is new (i.e. hasn't been uploaded before).
+ * \param uploadSession  Optional parameter. The state of an earlier failed upload of the same file as
+ * passed to sessionHandler.
+ * \param sessionHandler Optional parameter. Gets called with the state of the upload whenever it
+ * progresses so that the caller can persist it (see DCXPushJournal).
+ * \param priority       The priority of the HTTP request.
+ * \param queue          Optional parameter. If not nil queue determines the operation queue handler
+ * gets executed on.
+ * \param handler        Gets called when the upload has completed or failed.
+ *
+ * \note Implementations may decide to upload small files in one piece, in which case
+ * sessionHandler doesn't get called.
+ *
+ * \return               A DCXHTTPRequest object that can be used to track progress, adjust the
+ * priority of the request and to cancel it.
+ */
+- (DCXHTTPRequest *)uploadComponent:(DCXComponent *)component
+                        ofComposite:(DCXComposite *)composite
+                           fromPath:(NSString *)path
+                     componentIsNew:(BOOL)isNew
+                      uploadSession:(NSDictionary *)uploadSession
+                     sessionHandler:(DCXUploadSessionHandler)sessionHandler
+                    requestPriority:(NSOperationQueuePriority)priority
+                       handlerQueue:(NSOperationQueue *)queue
+                  completionHandler:(DCXComponentRequestCompletionHandler)handler;
+
 @end
@@ -157,4 +157,15 @@
  */
 + (BOOL)IsDCXError:(NSError *)error;
 
+/**
+ * \brief Returns the data that can be used to resume the failed download that the given error
+ * originates from.
+ *
+ * \param error   The error object. Its chain of underlying errors gets searched for the
+ * NSURLSessionDownloadTaskResumeData key.
+ *
+ * \return The resume data or nil if the download cannot be resumed.
+ */
++ (NSData *)ResumeDataOfError:(NSError *)error;
+
 @end
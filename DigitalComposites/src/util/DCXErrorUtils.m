@@ -430,4 +430,21 @@ static NSDictionary *httpErrorMapping = nil;
     return [error.domain isEqualToString:DCXErrorDomain];
 }
 
++ (NSData *)ResumeDataOfError:(NSError *)error
+{
+    while (error != nil)
+    {
+        NSData *resumeData = error.userInfo[NSURLSessionDownloadTaskResumeData];
+
+        if ([resumeData isKindOfClass:[NSData class]])
+        {
+            return resumeData;
+        }
+
+        error = error.userInfo[NSUnderlyingErrorKey];
+    }
+
+    return nil;
+}
+
 @end
@@ -52,4 +52,54 @@
 
 + (BOOL)touch:(NSString *)filePath withError:(NSError **)errorPtr;
 
+/**
+ * \brief Computes the SHA-256 digest of the contents of the file at filePath. The file is read
+ * in chunks so that large files do not have to be held in memory.
+ *
+ * \param filePath    The path to the file to hash.
+ * \param errorPtr    Gets set to an error if something goes wrong.
+ *
+ * \return            The digest as a lowercase hex string or nil if the file could not be read.
+ */
+
++ (NSString *)sha256DigestOfFile:(NSString *)filePath withError:(NSError **)errorPtr;
+
+/**
+ * \brief Encodes record as a line of an append-only log of JSON records. The returned data can be
+ * appended to the log as is.
+ *
+ * \param record      The record to encode. Must be serializable by NSJSONSerialization.
+ *
+ * \return            The encoded record.
+ */
+
++ (NSData *)dataOfLogRecord:(NSDictionary *)record;
+
+/**
+ * \brief Calls block for every record of a log that consists of records encoded by
+ * dataOfLogRecord:. Lines that can't be parsed as a JSON dictionary (e.g. a record that got cut
+ * short by a crash) get skipped.
+ *
+ * \param data        The contents of the log.
+ * \param options     The options to parse the records with.
+ * \param block       Gets called with every record in the order of the log. Setting stop to YES
+ * ends the enumeration.
+ */
+
++ (void)enumerateLogRecordsOfData:(NSData *)data options:(NSJSONReadingOptions)options
+                       usingBlock:(void (^)(NSDictionary *record, BOOL *stop))block;
+
+/**
+ * \brief Appends data to the file at filePath and synchronizes the file to disk. Creates the file
+ * if it doesn't exist.
+ *
+ * \param data        The data to append.
+ * \param filePath    The path of the file to append to.
+ * \param lengthPtr   Optional. Gets set to the length of the file after the append.
+ *
+ * \return            YES if successful.
+ */
+
++ (BOOL)appendData:(NSData *)data toFile:(NSString *)filePath resultingLength:(unsigned long long *)lengthPtr;
+
 @end
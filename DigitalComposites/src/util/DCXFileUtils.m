@@ -23,6 +23,10 @@
 
 #import "DCXFileUtils.h"
 
+#import <CommonCrypto/CommonDigest.h>
+
+static const NSUInteger DCXFileDigestChunkSize = 256 * 1024;
+
 @implementation DCXFileUtils
 
 + (BOOL)moveFileAtomicallyFrom:(NSString *)sourcePath to:(NSString *)destPath withError:(NSError **)errorPtr
@@ -53,4 +57,92 @@
     return [fm setAttributes:@{NSFileModificationDate: [NSDate date]} ofItemAtPath:filePath error:errorPtr];
 }
 
++ (NSString *)sha256DigestOfFile:(NSString *)filePath withError:(NSError **)errorPtr
+{
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForReadingFromURL:[NSURL fileURLWithPath:filePath] error:errorPtr];
+    if (fileHandle == nil) {
+        return nil;
+    }
+
+    CC_SHA256_CTX context;
+    CC_SHA256_Init(&context);
+    while (YES) {
+        @autoreleasepool {
+            NSData *chunk = [fileHandle readDataOfLength:DCXFileDigestChunkSize];
+            if (chunk.length == 0) {
+                break;
+            }
+            CC_SHA256_Update(&context, chunk.bytes, (CC_LONG)chunk.length);
+        }
+    }
+    [fileHandle closeFile];
+
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256_Final(digest, &context);
+
+    NSMutableString *hexDigest = [NSMutableString stringWithCapacity:CC_SHA256_DIGEST_LENGTH * 2];
+    for (int i = 0; i < CC_SHA256_DIGEST_LENGTH; i++) {
+        [hexDigest appendFormat:@"%02x", digest[i]];
+    }
+    return hexDigest;
+}
+
++ (NSData *)dataOfLogRecord:(NSDictionary *)record
+{
+    // Every record starts on a new line so that a record that got cut short by a crash can't
+    // swallow the records appended after it.
+    NSMutableData *data = [NSMutableData dataWithBytes:"\n" length:1];
+    [data appendData:[NSJSONSerialization dataWithJSONObject:record options:0 error:nil]];
+    return data;
+}
+
++ (void)enumerateLogRecordsOfData:(NSData *)data options:(NSJSONReadingOptions)options
+                       usingBlock:(void (^)(NSDictionary *record, BOOL *stop))block
+{
+    const char *bytes = data.bytes;
+    NSUInteger length = data.length;
+    NSUInteger lineStart = 0;
+    BOOL stop = NO;
+    while (lineStart < length && !stop) {
+        const char *newline = memchr(bytes + lineStart, '\n', length - lineStart);
+        NSUInteger lineEnd = newline == NULL ? length : (NSUInteger)(newline - bytes);
+        if (lineEnd > lineStart) {
+            NSData *line = [data subdataWithRange:NSMakeRange(lineStart, lineEnd - lineStart)];
+            NSDictionary *record = [NSJSONSerialization JSONObjectWithData:line options:options error:nil];
+            if ([record isKindOfClass:[NSDictionary class]]) {
+                block(record, &stop);
+            }
+        }
+        lineStart = lineEnd + 1;
+    }
+}
+
++ (BOOL)appendData:(NSData *)data toFile:(NSString *)filePath resultingLength:(unsigned long long *)lengthPtr
+{
+    NSFileManager *fm = [NSFileManager defaultManager];
+    NSFileHandle *fileHandle = nil;
+    if ([fm fileExistsAtPath:filePath] || [fm createFileAtPath:filePath contents:nil attributes:nil]) {
+        fileHandle = [NSFileHandle fileHandleForWritingAtPath:filePath];
+    }
+    if (fileHandle == nil) {
+        return NO;
+    }
+
+    BOOL success = NO;
+    @try {
+        [fileHandle seekToEndOfFile];
+        [fileHandle writeData:data];
+        [fileHandle synchronizeFile];
+        if (lengthPtr != NULL) {
+            *lengthPtr = [fileHandle offsetInFile];
+        }
+        success = YES;
+    }
+    @catch (NSException *exception) {
+        success = NO;
+    }
+    [fileHandle closeFile];
+    return success;
+}
+
 @end